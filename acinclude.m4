@@ -367,6 +367,50 @@ AC_DEFUN([ECM_C_INLINESSE2_PROG], dnl
   }
 ]])])
 
+# A test program to check whether the compiler can compile AVX2 intrinsics
+# in a function with a target attribute, and check for AVX2 at run time
+AC_DEFUN([ECM_C_AVX2_PROG], dnl
+[AC_LANG_PROGRAM([[#include <immintrin.h>
+__attribute__ ((target ("avx2"))) static void
+f2 (long long *v)
+{
+  __m256i x = _mm256_set_epi64x (8, 7, 6, 5);
+
+  x = _mm256_mul_epu32 (x, x);
+  _mm256_storeu_si256 ((__m256i *) v, x);
+}]], dnl
+[[long long v[4] = {25, 36, 49, 64};
+  if (__builtin_cpu_supports ("avx2"))
+    f2 (v);
+  return (int) v[0] - 25;
+]])])
+
+# A test program to check whether the compiler can compile functions for
+# AVX2 and AVX-512 with target attributes, and check for them at run time
+AC_DEFUN([ECM_C_NTT_SIMD_PROG], dnl
+[AC_LANG_PROGRAM([[#include <immintrin.h>
+__attribute__ ((target ("avx2"))) static void
+f2 (unsigned long long *v)
+{
+  __m256i x = _mm256_loadu_si256 ((__m256i *) v);
+  _mm256_storeu_si256 ((__m256i *) v, _mm256_mul_epu32 (x, x));
+}
+__attribute__ ((target ("avx512f,avx512dq"))) static void
+f5 (unsigned long long *v)
+{
+  __m512i x = _mm512_loadu_si512 ((void *) v);
+  x = _mm512_min_epu64 (_mm512_mullo_epi64 (x, x), x);
+  _mm512_storeu_si512 ((void *) v, x);
+}]], dnl
+[[unsigned long long v[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512dq"))
+    f5 (v);
+  else if (__builtin_cpu_supports ("avx2"))
+    f2 (v);
+  return (int) v[0] - 1;
+]])])
+
 dnl  CU_CHECK_CUDA
 dnl  Check if a GPU version is asked, for which GPU and where CUDA is install.
 dnl  Includes are put in CUDA_INC_FLAGS
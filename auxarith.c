@@ -87,6 +87,24 @@ ceil_log2 (unsigned long n)
   return k;
 }
 
+/* returns the largest NTT length <= n, i.e., the largest 2^k or 3*2^k with
+   k >= 1 (spv_ntt_gfp_dif_len), or 0 if n == 0 */
+unsigned long
+ntt_floor_len (unsigned long n)
+{
+  unsigned long l;
+
+  if (n == 0UL)
+    return 0UL;
+
+  for (l = 1UL; l <= n / 2UL; l *= 2UL);
+  /* now l is the largest power of 2 <= n */
+  if (l >= 4UL && l + l / 2UL <= n)
+    return l + l / 2UL;
+
+  return l;
+}
+
 /* Returns the smallest prime factor of N. If N == 1, return 1. */
 unsigned long
 find_factor (const unsigned long N)
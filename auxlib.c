@@ -55,7 +55,7 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #endif
 
 #define VERBOSE __ECM(verbose)
-static int VERBOSE = OUTPUT_NORMAL;
+static ECM_TLS int VERBOSE = OUTPUT_NORMAL;
 
 void 
 mpz_add_si (mpz_t r, mpz_t s, long i)
@@ -194,6 +194,14 @@ set_verbose (int v)
   VERBOSE = v;
 }
 
+/* The verbose setting of the calling thread, for the threads it starts */
+
+int
+get_verbose (void)
+{
+  return VERBOSE;
+}
+
 int
 outputf (int loglevel, const char *format, ...)
 {
@@ -215,18 +223,17 @@ outputf (int loglevel, const char *format, ...)
   return n;
 }
 
-/* for P-1 and P+1 we have A = y = z = NULL */
-void
-writechkfile (char *chkfilename, int method, double p, mpmod_t modulus, 
-              mpres_t A, mpres_t x, mpres_t y, mpres_t z)
+/* Start the checkpoint line of method, with B1 = p and the residue x.
+   Return the file, to which the caller adds its fields before calling
+   close_chkfile, or NULL if method is invalid. */
+static FILE *
+open_chkfile (char *chkfilename, int method, double p, mpmod_t modulus, 
+              const mpres_t x)
 {
   FILE *chkfile;
   char *methodname;
   mpz_t t;
 
-  outputf (OUTPUT_VERBOSE, "Writing checkpoint to %s at p = %.0f\n",
-           chkfilename, p);
-
   switch (method)
     {
     case ECM_ECM : methodname = "ECM"; break;
@@ -234,7 +241,7 @@ writechkfile (char *chkfilename, int method, double p, mpmod_t modulus,
     case ECM_PP1 : methodname = "P+1"; break;
     default: 
       outputf (OUTPUT_ERROR, "writechkfile: Invalid method\n");
-      return;
+      return NULL;
     }
 
   chkfile = fopen (chkfilename, "w");
@@ -246,6 +253,35 @@ writechkfile (char *chkfilename, int method, double p, mpmod_t modulus,
 	       methodname, p, modulus->orig_modulus);
   mpres_get_z (t, x, modulus);
   gmp_fprintf (chkfile, " X=0x%Zx;", t);
+  mpz_clear (t);
+
+  return chkfile;
+}
+
+static void
+close_chkfile (FILE *chkfile)
+{
+  fprintf (chkfile, "\n");
+  fflush (chkfile);
+  fclose (chkfile);
+}
+
+/* for P-1 and P+1 we have A = y = z = NULL */
+void
+writechkfile (char *chkfilename, int method, double p, mpmod_t modulus, 
+              mpres_t A, mpres_t x, mpres_t y, mpres_t z)
+{
+  FILE *chkfile;
+  mpz_t t;
+
+  outputf (OUTPUT_VERBOSE, "Writing checkpoint to %s at p = %.0f\n",
+           chkfilename, p);
+
+  chkfile = open_chkfile (chkfilename, method, p, modulus, x);
+  if (chkfile == NULL)
+    return;
+
+  mpz_init (t);
   if (method == ECM_ECM)
     {
 	if (y != NULL) /* this should mean Weierstrass form */
@@ -263,13 +299,63 @@ writechkfile (char *chkfilename, int method, double p, mpmod_t modulus,
       mpres_get_z (t, A, modulus);
       gmp_fprintf (chkfile, " A=0x%Zx;", t);
     }
-  fprintf (chkfile, "\n");
   mpz_clear (t);
-  fflush (chkfile);
-  fclose (chkfile);
+  close_chkfile (chkfile);
+}
+
+/* Checkpoint of the fast stage 2 of P-1 or P+1 after the multi-point
+   evaluations 0 to done-1: resuming it does the next ones only. x is the
+   residue at the end of stage 1, with bound params->B1done. */
+void
+writechkfile_fs2 (const faststage2_param_t *params, int method,
+                  unsigned long done, mpmod_t modulus, const mpres_t x)
+{
+  FILE *chkfile;
+
+  outputf (OUTPUT_VERBOSE, "Writing checkpoint to %s after multi-point "
+           "evaluation %lu of %lu\n", params->chkfilename, done, params->s_2);
+
+  chkfile = open_chkfile (params->chkfilename, method, params->B1done,
+                          modulus, x);
+  if (chkfile == NULL)
+    return;
+  gmp_fprintf (chkfile, " FS2=%lu/%lu,%lu,%lu,%lu,%Zd;", done, params->s_2,
+               params->P, params->s_1, params->l, params->m_1);
+  close_chkfile (chkfile);
+}
+
+/* Checkpoint of the batch stage 1 of ECM with parametrization param, whose
+   ladder on the bits of s for B1 has bits bits left to do, with the points
+   (x1:z1) and (x2:z2). The stage 1 bound of the line stays B1done. */
+void
+writechkfile_batch (char *chkfilename, double B1done, mpmod_t modulus,
+                    mpres_t A, int param, double B1, unsigned long bits,
+                    mpres_t x1, mpres_t z1, mpres_t x2, mpres_t z2)
+{
+  FILE *chkfile;
+  mpz_t t, u;
+
+  outputf (OUTPUT_VERBOSE, "Writing checkpoint to %s with %lu bits of s "
+           "left\n", chkfilename, bits);
+
+  chkfile = open_chkfile (chkfilename, ECM_ECM, B1done, modulus, x1);
+  if (chkfile == NULL)
+    return;
+
+  mpz_init (t);
+  mpz_init (u);
+  mpres_get_z (t, z1, modulus);
+  gmp_fprintf (chkfile, " Z=0x%Zx;", t);
+  mpres_get_z (t, A, modulus);
+  gmp_fprintf (chkfile, " A=0x%Zx; PARAM=%d;", t, param);
+  mpres_get_z (t, x2, modulus);
+  mpres_get_z (u, z2, modulus);
+  gmp_fprintf (chkfile, " LADDER=%.0f,%lu,0x%Zx,0x%Zx;", B1, bits, t, u);
+  mpz_clear (t);
+  mpz_clear (u);
+  close_chkfile (chkfile);
 }
 
-#if 0 /* currently unused (only used in listz_handle.c, currently inactive) */
 int 
 aux_fseek64(FILE *f, const int64_t offset, const int whence)
 {
@@ -282,7 +368,6 @@ aux_fseek64(FILE *f, const int64_t offset, const int whence)
   ASSERT_ALWAYS (offset <= LONG_MAX);
   return fseek (f, (long) offset, whence);
 }
-#endif
 
 int
 ecm_tstbit (mpz_srcptr u, ecm_uint bit_index)
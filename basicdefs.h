@@ -62,6 +62,18 @@ typedef unsigned __int64 uint64_t;
 #define ATTRIBUTE_CONST
 #endif
 
+/* Storage class for the output streams and verbosity used by outputf():
+   they are set on entry of ecm(), pm1() and pp1() from their arguments, and
+   each thread gets its own copy, so that several threads can call
+   ecm_factor() at the same time */
+#if defined(_MSC_VER)
+#define ECM_TLS __declspec(thread)
+#elif defined(HAVE_TLS)
+#define ECM_TLS __thread
+#else
+#define ECM_TLS
+#endif
+
 #ifndef LIKELY
 #if defined(__GNUC__)
 #define LIKELY(x) __builtin_expect ((x) != 0, 1)
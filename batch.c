@@ -30,11 +30,17 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 */
 
 #include <stdlib.h>
+#include <string.h> /* for memcmp, memcpy */
+#include "ecm-gmp.h"
 #include "ecm-impl.h"
 #include "getprime_r.h"
 
 #define MAX_HEIGHT 32
 
+/* number of bits of s between two checks for a checkpoint or stop_asap in
+   the ladder of ecm_stage1_batch */
+#define BATCH_CHKPNT_BITS 1024
+
 #if ECM_UINT_MAX == 4294967295
 /* On a 32-bit machine, with no access to a 64-bit type,
     the maximum value that can be returned by mpz_sizeinbase(s,2)
@@ -51,30 +57,35 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #define MAX_B1_BATCH 50685770166ULL
 #endif
 
-/* If forbiddenres != NULL, forbiddenres = "m r_1 ... r_k -1" indicating that
+/* minimal number of integers up to B1 handled by each thread of compute_s */
+#define COMPUTE_S_MIN_RANGE 1000000
+
+/* Put in s the product of the largest powers <= B1 of the primes p with
+   lo < p <= hi, where hi <= B1.
+   If forbiddenres != NULL, forbiddenres = "m r_1 ... r_k -1" indicating that
    if p = r_i mod m, then p^2 should be considered instead of p. This has
    only a sense for CM curves. We assume r_1 < r_2 < ... < r_k.
    Typical example: "4 3 -1" for curves Y^2 = X^3 + a * X.
 */
-void
-compute_s (mpz_t s, ecm_uint B1, int *forbiddenres ATTRIBUTE_UNUSED)
+static void
+compute_s_range (mpz_t s, ecm_uint lo, ecm_uint hi, ecm_uint B1,
+                 int *forbiddenres ATTRIBUTE_UNUSED)
 {
   mpz_t acc[MAX_HEIGHT]; /* To accumulate products of prime powers */
   mpz_t ppz;
   unsigned int i, j;
-  ecm_uint pi = 2, pp, maxpp, qi;
+  ecm_uint pi, pp, maxpp, qi;
   prime_info_t prime_info;
 
   prime_info_init (prime_info);
 
-  ASSERT_ALWAYS (B1 <= MAX_B1_BATCH);
-
   for (j = 0; j < MAX_HEIGHT; j++)
     mpz_init (acc[j]); /* sets acc[j] to 0 */
   mpz_init (ppz);
 
   i = 0;
-  while (pi <= B1)
+  pi = prime_info_seek (prime_info, lo + 1);
+  while (pi <= hi)
     {
       pp = qi = pi;
       maxpp = B1 / qi;
@@ -138,8 +149,17 @@ compute_s (mpz_t s, ecm_uint B1, int *forbiddenres ATTRIBUTE_UNUSED)
       pi = getprime_mt (prime_info);
     }
 
-  for (mpz_set (s, acc[0]), j = 1; mpz_cmp_ui (acc[j], 0) != 0; j++)
-    mpz_mul (s, s, acc[j]);
+  /* the levels are freed as soon as they are used, in order not to keep
+     them all in memory along with s */
+  mpz_swap (s, acc[0]);
+  if (i == 0)
+    mpz_set_ui (s, 1);
+  for (j = 1; mpz_cmp_ui (acc[j], 0) != 0; j++)
+    {
+      mpz_mul (s, s, acc[j]);
+      mpz_clear (acc[j]);
+      mpz_init (acc[j]);
+    }
 
   prime_info_clear (prime_info); /* free the prime tables */
   
@@ -148,6 +168,310 @@ compute_s (mpz_t s, ecm_uint B1, int *forbiddenres ATTRIBUTE_UNUSED)
   mpz_clear (ppz);
 }
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+/* A thread of compute_s: it puts in s the product of the prime powers for
+   the primes in (lo, hi], or if t != NULL, multiplies s by t. */
+typedef struct
+{
+  pthread_t tid;
+  mpz_t s;
+  mpz_ptr t;
+  ecm_uint lo, hi, B1;
+  int *forbiddenres;
+} compute_s_thread_t;
+
+static void *
+compute_s_thread (void *arg)
+{
+  compute_s_thread_t *w = (compute_s_thread_t *) arg;
+
+  if (w->t == NULL)
+    compute_s_range (w->s, w->lo, w->hi, w->B1, w->forbiddenres);
+  else
+    mpz_mul (w->s, w->s, w->t);
+  return NULL;
+}
+
+/* Run the threads W[i], i = first, first + step, ... < n, the first one in
+   the calling thread */
+static void
+compute_s_run (compute_s_thread_t *W, unsigned int first, unsigned int step,
+               unsigned int n)
+{
+  unsigned int i;
+  int *started;
+
+  started = (int *) malloc (n * sizeof (int));
+  ASSERT_ALWAYS (started != NULL);
+  for (i = first + step; i < n; i += step)
+    started[i] = pthread_create (&W[i].tid, NULL, compute_s_thread,
+                                 (void *) (W + i)) == 0;
+  compute_s_thread ((void *) (W + first));
+  /* if a thread could not be created, do its work here */
+  for (i = first + step; i < n; i += step)
+    if (started[i])
+      pthread_join (W[i].tid, NULL);
+    else
+      compute_s_thread ((void *) (W + i));
+  free (started);
+}
+
+/* compute_s with nthreads > 1 threads: each thread computes the product
+   for one part of the primes up to B1 (sieved from its start with
+   prime_info_seek), then the products are multiplied in a balanced tree,
+   the products of each level being done in parallel. */
+static void
+compute_s_threaded (mpz_t s, ecm_uint B1, int *forbiddenres,
+                    unsigned int nthreads)
+{
+  compute_s_thread_t *W;
+  unsigned int i, step;
+
+  W = (compute_s_thread_t *) malloc (nthreads * sizeof (compute_s_thread_t));
+  ASSERT_ALWAYS (W != NULL);
+  for (i = 0; i < nthreads; i++)
+    {
+      mpz_init (W[i].s);
+      W[i].t = NULL;
+      W[i].lo = i * (B1 / nthreads);
+      W[i].hi = (i + 1 < nthreads) ? (i + 1) * (B1 / nthreads) : B1;
+      W[i].B1 = B1;
+      W[i].forbiddenres = forbiddenres;
+    }
+  compute_s_run (W, 0, 1, nthreads);
+
+  /* W[i] *= W[i + step] for i multiple of 2*step, freeing W[i + step] */
+  for (step = 1; step < nthreads; step *= 2)
+    {
+      unsigned int last = 0;
+
+      for (i = 0; i + step < nthreads; i += 2 * step)
+        {
+          W[i].t = W[i + step].s;
+          last = i + 1;
+        }
+      compute_s_run (W, 0, 2 * step, last);
+      for (i = 0; i + step < nthreads; i += 2 * step)
+        {
+          W[i].t = NULL;
+          mpz_clear (W[i + step].s);
+          mpz_init (W[i + step].s);
+        }
+    }
+
+  mpz_swap (s, W[0].s);
+  for (i = 0; i < nthreads; i++)
+    mpz_clear (W[i].s);
+  free (W);
+}
+#endif
+
+/* Put in s the product of the largest powers <= B1 of all primes <= B1,
+   using up to nthreads threads. For forbiddenres, see compute_s_range. */
+void
+compute_s (mpz_t s, ecm_uint B1, int *forbiddenres,
+           unsigned int nthreads ATTRIBUTE_UNUSED)
+{
+  ASSERT_ALWAYS (B1 <= MAX_B1_BATCH);
+
+#ifdef HAVE_PTHREAD
+  if (nthreads > B1 / COMPUTE_S_MIN_RANGE)
+    nthreads = B1 / COMPUTE_S_MIN_RANGE;
+  if (nthreads > 1)
+    {
+      compute_s_threaded (s, B1, forbiddenres, nthreads);
+      return;
+    }
+#endif
+
+  compute_s_range (s, 0, B1, B1, forbiddenres);
+}
+
+/* Process-wide cache of batch exponents.
+
+   For large B1, s has tens of megabytes and takes seconds to compute, so
+   rather than giving each ecm_params its own copy, the exponents are kept in
+   a list shared by all threads, keyed by B1 and the forbidden residues.
+   A caller holds a reference to an entry through a mpz_srcptr (the
+   batch_s_shared field of ecm_params), and an entry is freed when its last
+   reference is released. Entries are read-only once inserted.
+
+   A single lock protects the list; it is also held while s is computed, so
+   that threads asking for the same B1 at the same time compute it only
+   once. */
+
+typedef struct batch_s_entry_s
+{
+  double B1;
+  int *forbiddenres;   /* copy of the forbidden residues, or NULL */
+  mpz_t s;
+  unsigned int refs;   /* number of references to this entry */
+  struct batch_s_entry_s *next;
+} batch_s_entry_t;
+
+static batch_s_entry_t *batch_s_cache = NULL;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t batch_s_lock = PTHREAD_MUTEX_INITIALIZER;
+#define BATCH_S_LOCK() pthread_mutex_lock (&batch_s_lock)
+#define BATCH_S_UNLOCK() pthread_mutex_unlock (&batch_s_lock)
+#else
+#define BATCH_S_LOCK()
+#define BATCH_S_UNLOCK()
+#endif
+
+/* Return the length of forbiddenres, including the modulus and the
+   terminating -1, or 0 if forbiddenres is NULL */
+static size_t
+forbiddenres_len (const int *forbiddenres)
+{
+  size_t j;
+
+  if (forbiddenres == NULL)
+    return 0;
+  for (j = 1; forbiddenres[j] >= 0; j++);
+  return j + 1;
+}
+
+/* Return the entry for (B1, forbiddenres), or NULL. Needs the lock. */
+static batch_s_entry_t *
+batch_s_lookup (double B1, const int *forbiddenres)
+{
+  batch_s_entry_t *e;
+  size_t len = forbiddenres_len (forbiddenres);
+
+  for (e = batch_s_cache; e != NULL; e = e->next)
+    if (e->B1 == B1 && forbiddenres_len (e->forbiddenres) == len &&
+        (len == 0 ||
+         memcmp (e->forbiddenres, forbiddenres, len * sizeof (int)) == 0))
+      return e;
+  return NULL;
+}
+
+/* Create an entry for (B1, forbiddenres) with s = 1 and no reference.
+   Needs the lock. */
+static batch_s_entry_t *
+batch_s_new (double B1, const int *forbiddenres)
+{
+  batch_s_entry_t *e;
+  size_t len = forbiddenres_len (forbiddenres);
+
+  e = (batch_s_entry_t *) malloc (sizeof (batch_s_entry_t));
+  ASSERT_ALWAYS (e != NULL);
+  e->B1 = B1;
+  e->forbiddenres = NULL;
+  if (len > 0)
+    {
+      e->forbiddenres = (int *) malloc (len * sizeof (int));
+      ASSERT_ALWAYS (e->forbiddenres != NULL);
+      memcpy (e->forbiddenres, forbiddenres, len * sizeof (int));
+    }
+  mpz_init_set_ui (e->s, 1);
+  e->refs = 0;
+  e->next = batch_s_cache;
+  batch_s_cache = e;
+  return e;
+}
+
+/* Drop one reference to the entry whose exponent is s, and free the entry
+   if it was the last one. Needs the lock. */
+static void
+batch_s_unref (mpz_srcptr s)
+{
+  batch_s_entry_t *e, **pe;
+
+  for (pe = &batch_s_cache; *pe != NULL; pe = &((*pe)->next))
+    if ((*pe)->s == s)
+      break;
+  ASSERT_ALWAYS (*pe != NULL);
+  e = *pe;
+  ASSERT_ALWAYS (e->refs > 0);
+  if (--e->refs == 0)
+    {
+      *pe = e->next;
+      mpz_clear (e->s);
+      free (e->forbiddenres);
+      free (e);
+    }
+}
+
+/* Make *ref a reference to the batch exponent for (B1, forbiddenres),
+   computing it with up to nthreads threads if no other caller holds it,
+   and return *ref.
+   If *ref was a reference to another exponent, it is released. */
+mpz_srcptr
+batch_s_acquire (mpz_srcptr *ref, double B1, int *forbiddenres,
+                 unsigned int nthreads)
+{
+  batch_s_entry_t *e;
+  long st;
+
+  BATCH_S_LOCK();
+  e = batch_s_lookup (B1, forbiddenres);
+  if (e != NULL && *ref == e->s)
+    {
+      BATCH_S_UNLOCK();
+      return *ref;
+    }
+  if (*ref != NULL)
+    batch_s_unref (*ref);
+  if (e == NULL)
+    {
+      e = batch_s_new (B1, forbiddenres);
+      st = cputime ();
+      compute_s (e->s, (ecm_uint) B1, forbiddenres, nthreads);
+      outputf (OUTPUT_VERBOSE, "Computing batch product (of %" PRIu64
+                               " bits) of primes up to B1=%1.0f took %ldms\n",
+                               mpz_sizeinbase (e->s, 2), B1, cputime () - st);
+    }
+  e->refs ++;
+  *ref = e->s;
+  BATCH_S_UNLOCK();
+
+  return *ref;
+}
+
+/* Make *ref a reference to s, which is the batch exponent for B1 (for
+   example read from a file), without computing it. The value of s is moved
+   into the cache, and s is set to 1. If the cache already holds the
+   exponent for B1, it is kept and s is discarded. */
+void
+batch_s_insert (mpz_srcptr *ref, double B1, mpz_t s)
+{
+  batch_s_entry_t *e;
+
+  BATCH_S_LOCK();
+  e = batch_s_lookup (B1, NULL);
+  if (e == NULL || *ref != e->s)
+    {
+      if (*ref != NULL)
+        batch_s_unref (*ref);
+      if (e == NULL)
+        {
+          e = batch_s_new (B1, NULL);
+          mpz_swap (e->s, s);
+        }
+      e->refs ++;
+      *ref = e->s;
+    }
+  mpz_set_ui (s, 1);
+  BATCH_S_UNLOCK();
+}
+
+/* Release the reference *ref, if any, and set *ref to NULL */
+void
+batch_s_release (mpz_srcptr *ref)
+{
+  if (*ref == NULL)
+    return;
+  BATCH_S_LOCK();
+  batch_s_unref (*ref);
+  BATCH_S_UNLOCK();
+  *ref = NULL;
+}
+
 #if 0
 /* this function is useful in debug mode to print non-normalized residues */
 static void
@@ -264,34 +588,78 @@ dup_add_batch2 (mpres_t x1, mpres_t z1, mpres_t x2, mpres_t z2,
 }
 
 
+/* Called in the ladder of ecm_stage1_batch with bits bits of s left: write
+   a checkpoint if chkfilename is not NULL and CHKPNT_PERIOD has elapsed
+   since *last_chkpnt, or if we have to stop. The points are padded, as in
+   the ladder. Return non-zero if the ladder must stop now. */
+static int
+batch_checkpoint (char *chkfilename, int (*stop_asap)(void), long *last_chkpnt,
+                  double B1done, mpmod_t n, mpres_t A, int batch, double B1,
+                  unsigned long bits, mpres_t x1, mpres_t z1, mpres_t x2,
+                  mpres_t z2)
+{
+  const int stop = stop_asap != NULL && (*stop_asap) ();
+  mpres_t t[4];
+  mpz_ptr p[4];
+  int j;
+
+  if (chkfilename != NULL &&
+      (stop || elltime (*last_chkpnt, cputime ()) > CHKPNT_PERIOD))
+    {
+      p[0] = x1;
+      p[1] = z1;
+      p[2] = x2;
+      p[3] = z2;
+      for (j = 0; j < 4; j++)
+        {
+          mpres_init (t[j], n);
+          mpres_set (t[j], p[j], n);
+          mpresn_unpad (t[j]);
+        }
+      writechkfile_batch (chkfilename, B1done, n, A, batch, B1, bits,
+                          t[0], t[1], t[2], t[3]);
+      for (j = 0; j < 4; j++)
+        mpres_clear (t[j], n);
+      *last_chkpnt = cputime ();
+    }
+
+  return stop;
+}
+
 /* Input: x is initial point
           A is curve parameter in Montgomery's form:
           g*y^2*z = x^3 + a*x^2*z + x*z^2
           n is the number to factor
           B1 is the stage 1 bound
+          stop_asap and chkfilename are as for ecm_stage1
+          bits is 0 to start the ladder on the bits of s, or the number of
+            bits of s left to do when resuming it from a checkpoint, with x
+            the x-coordinate of the first point and x2 of the second one
    Output: If a factor is found, it is returned in x.
            Otherwise, x contains the x-coordinate of the point computed
            in stage 1 (with z coordinate normalized to 1).
-           B1done is set to B1 if stage 1 completed normally,
-           or to the largest prime processed if interrupted, but never
-           to a smaller value than B1done was upon function entry.
+           B1done is set to B1 if stage 1 completed normally. If it was
+           interrupted, x and B1done are unchanged, and the ladder is
+           written to chkfilename.
    Return value: ECM_FACTOR_FOUND_STEP1 if a factor, otherwise 
            ECM_NO_FACTOR_FOUND
 */
 /*
-For now we don't take into account go stop_asap and chkfilename
+For now we don't take into account go
 */
 int
 ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
-                  double *B1done, int batch, mpz_t s)
+                  double *B1done, int batch, mpz_t s, int (*stop_asap)(void),
+                  char *chkfilename, unsigned long bits, mpz_t x2_0)
 {
-  mp_limb_t d_1;
+  mp_limb_t d_1 = 0; /* GCC complains about uninitialized value */
   mpz_t d_2;
 
   mpres_t x1, z1, x2, z2;
   ecm_uint i;
   mpres_t t, u;
-  int ret = ECM_NO_FACTOR_FOUND;
+  int ret = ECM_NO_FACTOR_FOUND, stopped = 0;
+  long last_chkpnt = cputime ();
 
   mpres_init (x1, n);
   mpres_init (z1, n);
@@ -332,22 +700,34 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
       mpres_div_2exp (d_2, d_2, 2, n); 
     }
 
-  /* Compute 2P : no need to duplicate P, the coordinates are simple. */
-  mpres_set_ui (x2, 9, n);
-  /* here d = d_1 / GMP_NUMB_BITS */
-  if (batch == ECM_PARAM_BATCH_SQUARE || batch == ECM_PARAM_BATCH_32BITS_D)
+  if (bits == 0)
     {
-      /* warning: mpres_set_ui takes an unsigned long which has only 32 bits
-         on Windows, while d_1 might have 64 bits */
-      ASSERT_ALWAYS (mpz_size (u) == 1 && mpz_getlimbn (u, 0) == d_1);
-      mpres_set_z (z2, u, n);
-      mpres_div_2exp (z2, z2, GMP_NUMB_BITS, n);
+      /* Compute 2P : no need to duplicate P, the coordinates are simple. */
+      mpres_set_ui (x2, 9, n);
+      /* here d = d_1 / GMP_NUMB_BITS */
+      if (batch == ECM_PARAM_BATCH_SQUARE ||
+          batch == ECM_PARAM_BATCH_32BITS_D)
+        {
+          /* warning: mpres_set_ui takes an unsigned long which has only 32
+             bits on Windows, while d_1 might have 64 bits */
+          ASSERT_ALWAYS (mpz_size (u) == 1 && mpz_getlimbn (u, 0) == d_1);
+          mpres_set_z (z2, u, n);
+          mpres_div_2exp (z2, z2, GMP_NUMB_BITS, n);
+        }
+      else
+          mpres_set (z2, d_2, n);
+     
+      mpres_mul_2exp (z2, z2, 6, n);
+      mpres_add_ui (z2, z2, 8, n); /* P2 <- 2P = (9 : : 64d+8) */
+
+      bits = mpz_sizeinbase (s, 2) - 1;
+    }
+  else /* the ladder of a checkpoint */
+    {
+      ASSERT_ALWAYS (bits < mpz_sizeinbase (s, 2));
+      mpres_set_z (x2, x2_0, n);
+      mpres_set_ui (z2, 1, n);
     }
-  else
-      mpres_set (z2, d_2, n);
- 
-  mpres_mul_2exp (z2, z2, 6, n);
-  mpres_add_ui (z2, z2, 8, n); /* P2 <- 2P = (9 : : 64d+8) */
 
   /* invariant: if j represents the upper bits of s,
      then P1 = j*P and P2=(j+1)*P */
@@ -360,7 +740,7 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
   /* now perform the double-and-add ladder */
   if (batch == ECM_PARAM_BATCH_SQUARE || batch == ECM_PARAM_BATCH_32BITS_D)
     {
-      for (i = mpz_sizeinbase (s, 2) - 1; i-- > 0;)
+      for (i = bits; i-- > 0;)
         {
           if (ecm_tstbit (s, i) == 0) /* (j,j+1) -> (2j,2j+1) */
             /* P2 <- P1+P2    P1 <- 2*P1 */
@@ -368,12 +748,19 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
           else /* (j,j+1) -> (2j+1,2j+2) */
               /* P1 <- P1+P2     P2 <- 2*P2 */
             dup_add_batch1 (x2, z2, x1, z1, t, u, d_1, n);
+          if (i % BATCH_CHKPNT_BITS == 0 && i > 0 &&
+              batch_checkpoint (chkfilename, stop_asap, &last_chkpnt,
+                                *B1done, n, A, batch, B1, i, x1, z1, x2, z2))
+            {
+              stopped = 1;
+              break;
+            }
         }
     }
   else /* batch = ECM_PARAM_BATCH_2 */
     {
       mpresn_pad (d_2, n);
-      for (i = mpz_sizeinbase (s, 2) - 1; i-- > 0;)
+      for (i = bits; i-- > 0;)
         {
           if (ecm_tstbit (s, i) == 0) /* (j,j+1) -> (2j,2j+1) */
             /* P2 <- P1+P2    P1 <- 2*P1 */
@@ -381,14 +768,31 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
           else /* (j,j+1) -> (2j+1,2j+2) */
               /* P1 <- P1+P2     P2 <- 2*P2 */
             dup_add_batch2 (x2, z2, x1, z1, t, u, d_2, n);
+          if (i % BATCH_CHKPNT_BITS == 0 && i > 0 &&
+              batch_checkpoint (chkfilename, stop_asap, &last_chkpnt,
+                                *B1done, n, A, batch, B1, i, x1, z1, x2, z2))
+            {
+              stopped = 1;
+              break;
+            }
         }
     }
 
+  if (stopped)
+    {
+      outputf (OUTPUT_NORMAL, "Interrupted with %lu bits of s left\n",
+               (unsigned long) i);
+      goto clear_and_exit;
+    }
+
   *B1done=B1;
 
   mpresn_unpad (x1);
   mpresn_unpad (z1);
 
+  if (chkfilename != NULL)
+    writechkfile (chkfilename, ECM_ECM, *B1done, n, A, x1, NULL, z1);
+
   if (!mpres_invert (u, z1, n)) /* Factor found? */
     {
       mpres_gcd (f, z1, n);
@@ -396,6 +800,7 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
     }
   mpres_mul (x, x1, u, n);
 
+clear_and_exit:
   mpz_clear (x1);
   mpz_clear (z1);
   mpz_clear (x2);
@@ -407,3 +812,167 @@ ecm_stage1_batch (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
 
   return ret;
 }
+
+/* Stage 1 in batch mode on several curves at once, with consecutive
+   sigma values and ECM_PARAM_BATCH_32BITS_D, as the GPU code does.
+
+   The curves are processed by blocks of ECM_BATCH_LANES curves. All curves
+   of a block go through the same ladder on the bits of s, thus the
+   residues of a block are stored with their limbs interleaved: limb i of
+   the residue of curve c is at index i * ECM_BATCH_LANES + c (see
+   lanes.c for the arithmetic on such residues). */
+
+/* Same as dup_add_batch1 for each curve of a block: 
+   (x1:z1) <- 2(x1:z1), (x2:z2) <- (x1:z1) + (x2:z2), assuming
+   (x2:z2) - (x1:z1) = (2:1). Here d[c] = B*d for curve c, and the
+   temporary t has room for (n + 2) * ECM_BATCH_LANES limbs. */
+static void
+dup_add_lanes (mp_limb_t *x1, mp_limb_t *z1, mp_limb_t *x2, mp_limb_t *z2,
+               mp_limb_t *u, mp_limb_t *w, const mp_limb_t *d,
+               mp_srcptr np, mp_size_t n, mp_limb_t invm, mp_limb_t *t)
+{
+  addmod_lanes (w, x1, z1, np, n, t);   /* w = x1+z1 */
+  submod_lanes (z1, x1, z1, np, n);     /* z1 = x1-z1 */
+  addmod_lanes (x1, x2, z2, np, n, t);  /* x1 = x2+z2 */
+  submod_lanes (x2, x2, z2, np, n);     /* x2 = x2-z2 */
+
+  mulredc_lanes (z2, w, x2, np, n, invm, t);  /* z2 = (x1+z1)(x2-z2) */
+  mulredc_lanes (x2, z1, x1, np, n, invm, t); /* x2 = (x1-z1)(x2+z2) */
+  sqrredc_lanes (u, z1, np, n, invm, t);      /* u = (x1-z1)^2 */
+  sqrredc_lanes (z1, w, np, n, invm, t);      /* z1 = (x1+z1)^2 */
+
+  mulredc_lanes (x1, z1, u, np, n, invm, t);  /* xdup = (x1+z1)^2 (x1-z1)^2 */
+  submod_lanes (w, z1, u, np, n);   /* w = (x1+z1)^2 - (x1-z1)^2 */
+  mulredc_1_lanes (z1, w, d, np, n, invm, t); /* z1 = d * w */
+  addmod_lanes (u, u, z1, np, n, t);          /* u = (x1-z1)^2 + d * w */
+  mulredc_lanes (z1, w, u, np, n, invm, t);   /* zdup = w * u */
+
+  addmod_lanes (w, x2, z2, np, n, t);
+  submod_lanes (z2, x2, z2, np, n);
+  sqrredc_lanes (x2, w, np, n, invm, t);
+  sqrredc_lanes (w, z2, np, n, invm, t);
+  addmod_lanes (z2, w, w, np, n, t);
+}
+
+/* Stage 1 with the batch exponent s on the curves with
+   ECM_PARAM_BATCH_32BITS_D and sigma = firstsigma, ...,
+   firstsigma + number_of_curves - 1, starting from (x:z) = (2:1).
+   Mirrors gpu_ecm_stage1: on output, for each curve i, either
+   array_stage_found[i] is ECM_FACTOR_FOUND_STEP1 and factors[i] is the
+   factor found, or array_stage_found[i] is ECM_NO_FACTOR_FOUND and
+   factors[i] is the x-coordinate of the point at the end of stage 1 (with
+   z = 1). Returns ECM_FACTOR_FOUND_STEP1 if a factor was found with any
+   curve, ECM_NO_FACTOR_FOUND otherwise. */
+int
+cpu_ecm_stage1 (mpz_t *factors, int *array_stage_found, mpz_t N, mpz_t s,
+                unsigned int number_of_curves, unsigned int firstsigma)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_size_t n = mpz_size (N);
+  mp_limb_t invm, d[ECM_BATCH_LANES];
+  mp_limb_t *x1, *z1, *x2, *z2, *u, *w, *t;
+  mpz_t R, v, invd;
+  unsigned int c, i, k, sigma;
+  ecm_uint b;
+  int youpi = ECM_NO_FACTOR_FOUND;
+
+  ASSERT_ALWAYS (mpz_odd_p (N));
+
+  x1 = (mp_limb_t *) malloc ((7 * n + 2) * L * sizeof (mp_limb_t));
+  ASSERT_ALWAYS (x1 != NULL);
+  z1 = x1 + n * L;
+  x2 = z1 + n * L;
+  z2 = x2 + n * L;
+  u = z2 + n * L;
+  w = u + n * L;
+  t = w + n * L;
+
+  mpz_init (R);
+  mpz_init (v);
+  mpz_init (invd);
+
+  /* invm = -1/N mod B */
+  mpz_set_ui (R, 1);
+  mpz_mul_2exp (R, R, GMP_NUMB_BITS);
+  mpz_invert (v, N, R);
+  mpz_sub (v, R, v);
+  invm = mpz_getlimbn (v, 0);
+
+  /* R = B^n mod N, the Montgomery representation of 1 */
+  mpz_set_ui (R, 1);
+  mpz_mul_2exp (R, R, n * GMP_NUMB_BITS);
+  mpz_mod (R, R, N);
+
+  /* invd = 2^-32 mod N, since d = sigma/2^32 */
+  mpz_set_ui (invd, 1);
+  mpz_mul_2exp (invd, invd, 32);
+  mpz_invert (invd, invd, N);
+
+  for (k = 0; k < number_of_curves; k += L)
+    {
+      /* set up the curves of this block, the lanes past the last curve
+         repeat it and their result is ignored */
+      for (c = 0; c < L; c++)
+        {
+          sigma = firstsigma + ((k + c < number_of_curves)
+                                ? k + c : number_of_curves - 1);
+          /* the multiplier by d in dup_add_batch1 is B*d */
+#if GMP_NUMB_BITS == 32
+          d[c] = sigma;
+#else
+          d[c] = (mp_limb_t) sigma << (GMP_NUMB_BITS - 32);
+#endif
+          mpz_mul_ui (v, R, 2);
+          mpz_mod (v, v, N);
+          mpz_to_lane (x1, c, v, n);        /* x1 = 2 */
+          mpz_to_lane (z1, c, R, n);        /* z1 = 1 */
+          mpz_mul_ui (v, R, 9);
+          mpz_mod (v, v, N);
+          mpz_to_lane (x2, c, v, n);        /* x2 = 9 */
+          mpz_mul_ui (v, invd, sigma);
+          mpz_mul_2exp (v, v, 6);
+          mpz_add_ui (v, v, 8);
+          mpz_mul (v, v, R);
+          mpz_mod (v, v, N);
+          mpz_to_lane (z2, c, v, n);        /* z2 = 64d+8 */
+        }
+
+      for (b = mpz_sizeinbase (s, 2) - 1; b-- > 0;)
+        {
+          if (ecm_tstbit (s, b) == 0)
+            dup_add_lanes (x1, z1, x2, z2, u, w, d, PTR(N), n, invm, t);
+          else
+            dup_add_lanes (x2, z2, x1, z1, u, w, d, PTR(N), n, invm, t);
+        }
+
+      /* x1/z1 does not depend on the Montgomery representation */
+      for (c = 0; c < L && k + c < number_of_curves; c++)
+        {
+          i = k + c;
+          lane_to_mpz (v, z1, c, n);
+          if (!mpz_invert (v, v, N))
+            {
+              mpz_gcd (factors[i], v, N);
+              array_stage_found[i] = ECM_FACTOR_FOUND_STEP1;
+              youpi = ECM_FACTOR_FOUND_STEP1;
+              outputf (OUTPUT_NORMAL, "CPU: factor %Zd found in Step 1 with"
+                       " curve %u (-sigma 3:%u)\n", factors[i], i,
+                       firstsigma + i);
+            }
+          else
+            {
+              lane_to_mpz (factors[i], x1, c, n);
+              mpz_mul (factors[i], factors[i], v);
+              mpz_mod (factors[i], factors[i], N);
+              array_stage_found[i] = ECM_NO_FACTOR_FOUND;
+            }
+        }
+    }
+
+  free (x1);
+  mpz_clear (R);
+  mpz_clear (v);
+  mpz_clear (invd);
+
+  return youpi;
+}
@@ -0,0 +1,180 @@
+/* bench_crt.c - time the conversions between mpz_t and the CRT
+   representation modulo small primes used by the NTT code, as a function of
+   the number sp_num of primes.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Usage: bench_crt [-len l] [digits ...]
+   For a random modulus of each given number of digits, print the number of
+   primes, the time of mpzspm_init(), and the time per coefficient of
+   mpzspv_from_mpzv() and mpzspv_to_mpzv() on l coefficients. When there
+   is a product tree (sp_num > 2^I0_THRESHOLD), the last column is the time
+   of mpzspv_to_mpzv() with the quadratic algorithm, for comparison: the
+   product tree is used from MPZSPV_TO_MPZV_TREE_THRESHOLD primes on.
+   Build with "make bench_crt". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ecm-impl.h"
+#include "sp.h"
+
+/* the time in microseconds of one conversion of each of len coefficients,
+   for about one second in total */
+static double
+time_to_mpzv (mpzspv_t x, mpzv_t r, spv_size_t len, mpzspm_t mpzspm)
+{
+  unsigned int i, n = 0;
+  long st = cputime ();
+
+  do
+    {
+      for (i = 0; i < 10; i++)
+        mpzspv_to_mpzv (x, 0, r, len, mpzspm);
+      n += 10;
+    }
+  while (cputime () - st < 1000);
+  return 1000.0 * (double) elltime (st, cputime ()) / ((double) n * len);
+}
+
+static double
+time_from_mpzv (mpzspv_t x, mpzv_t a, spv_size_t len, mpzspm_t mpzspm)
+{
+  unsigned int i, n = 0;
+  long st = cputime ();
+
+  do
+    {
+      for (i = 0; i < 10; i++)
+        mpzspv_from_mpzv (x, 0, a, len, mpzspm);
+      n += 10;
+    }
+  while (cputime () - st < 1000);
+  return 1000.0 * (double) elltime (st, cputime ()) / ((double) n * len);
+}
+
+static void
+bench (unsigned long digits, spv_size_t len, gmp_randstate_t rng)
+{
+  mpz_t N;
+  mpzspm_t mpzspm;
+  mpzspv_t x;
+  mpzv_t a, r;
+  mpzv_t *T;
+  spv_size_t i;
+  long st;
+  double t_from, t_to, t_direct = 0.;
+
+  mpz_init (N);
+  mpz_ui_pow_ui (N, 10, digits - 1);
+  mpz_urandomm (N, rng, N);
+  mpz_mul_2exp (N, N, 1);
+  mpz_add_ui (N, N, 1);
+
+  st = cputime ();
+  mpzspm = mpzspm_init (len, N);
+  st = elltime (st, cputime ());
+  if (mpzspm == NULL)
+    {
+      fprintf (stderr, "mpzspm_init failed for %lu digits\n", digits);
+      exit (EXIT_FAILURE);
+    }
+
+  x = mpzspv_init (len, mpzspm);
+  a = (mpzv_t) malloc (len * sizeof (mpz_t));
+  r = (mpzv_t) malloc (len * sizeof (mpz_t));
+  if (x == NULL || a == NULL || r == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory in bench\n");
+      exit (EXIT_FAILURE);
+    }
+  for (i = 0; i < len; i++)
+    {
+      mpz_init (a[i]);
+      mpz_init (r[i]);
+      mpz_urandomm (a[i], rng, N);
+    }
+
+  t_from = time_from_mpzv (x, a, len, mpzspm);
+  t_to = time_to_mpzv (x, r, len, mpzspm);
+  /* the direct method does not reduce its output modulo N */
+  for (i = 0; i < len; i++)
+    if (!mpz_congruent_p (r[i], a[i], N))
+      {
+        fprintf (stderr, "Error, wrong conversion for %lu digits\n", digits);
+        exit (EXIT_FAILURE);
+      }
+
+  /* without the product tree, mpzspv_to_mpzv() uses the direct method */
+  T = mpzspm->T;
+  if (T != NULL)
+    {
+      mpzspm->T = NULL;
+      t_direct = time_to_mpzv (x, r, len, mpzspm);
+      mpzspm->T = T;
+    }
+
+  printf ("%8lu %7u %10ld %12.2f %12.2f", digits, mpzspm->sp_num, st,
+          t_from, t_to);
+  if (T != NULL)
+    printf (" %12.2f", t_direct);
+  printf ("\n");
+  fflush (stdout);
+
+  for (i = 0; i < len; i++)
+    {
+      mpz_clear (a[i]);
+      mpz_clear (r[i]);
+    }
+  free (a);
+  free (r);
+  mpzspv_clear (x, mpzspm);
+  mpzspm_clear (mpzspm);
+  mpz_clear (N);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const unsigned long default_digits[] =
+    {100, 300, 1000, 2000, 5000, 10000, 20000, 50000, 0};
+  spv_size_t len = 64;
+  gmp_randstate_t rng;
+  int i;
+
+  if (argc >= 3 && strcmp (argv[1], "-len") == 0)
+    {
+      len = strtoul (argv[2], NULL, 10);
+      argv += 2;
+      argc -= 2;
+    }
+
+  gmp_randinit_default (rng);
+  printf ("  digits  sp_num init (ms) from (us/c) to (us/c)   to direct\n");
+  if (argc > 1)
+    for (i = 1; i < argc; i++)
+      bench (strtoul (argv[i], NULL, 10), len, rng);
+  else
+    for (i = 0; default_digits[i] != 0; i++)
+      bench (default_digits[i], len, rng);
+  gmp_randclear (rng);
+
+  return 0;
+}
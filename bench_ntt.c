@@ -0,0 +1,149 @@
+/* bench_ntt.c - time the forward and inverse transforms of ntt_gfp.c with
+   and without the column pass, against the memory bandwidth.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Usage: bench_ntt [-breakover b] [min_log2_len [max_log2_len]]
+   For each length 2^l of the given range (default 10 to 24), print the
+   time in ns per butterfly of spv_ntt_gfp_dif() followed by
+   spv_ntt_gfp_dit() with the radix-2 code only, then with the column pass
+   above NTT_GFP_BLOCK_BREAKOVER (or b), the bandwidth of a copy of the
+   vector in GB/s (counting the read and the write), and the number of such
+   copies each transform takes as long as, with and without the column
+   pass. Once the vector no longer fits in the cache, the transforms are
+   bound by the memory if this last number is close to the number of passes
+   over the vector: l for the radix-2 code. Build with "make bench_ntt". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ecm-impl.h"
+#include "sp.h"
+
+/* never any column pass */
+#define NO_BLOCK 64
+
+/* the time in ns of one dif and one dit of length 2^log2_len, for about
+   one second in total */
+static double
+time_ntt (spv_t x, spv_size_t log2_len, spm_t spm, size_t breakover)
+{
+  unsigned int i, n = 0;
+  long st;
+
+  NTT_GFP_BLOCK_BREAKOVER = breakover;
+  st = cputime ();
+  do
+    {
+      for (i = 0; i < 2; i++)
+        {
+          spv_ntt_gfp_dif (x, log2_len, spm);
+          spv_ntt_gfp_dit (x, log2_len, spm);
+        }
+      n += 2;
+    }
+  while (cputime () - st < 1000);
+  return 1e6 * (double) elltime (st, cputime ()) / (double) n;
+}
+
+/* the time in ns of a copy of len entries */
+static double
+time_copy (spv_t r, spv_t x, spv_size_t len)
+{
+  unsigned int n = 0;
+  long st = cputime ();
+
+  do
+    {
+      memcpy (r, x, len * sizeof (sp_t));
+      memcpy (x, r, len * sizeof (sp_t));
+      n += 2;
+    }
+  while (cputime () - st < 1000);
+  return 1e6 * (double) elltime (st, cputime ()) / (double) n;
+}
+
+int
+main (int argc, char *argv[])
+{
+  spv_size_t min_log2_len = 10, max_log2_len = 24, l, len;
+  size_t breakover = NTT_GFP_BLOCK_BREAKOVER;
+  mpzspm_t mpzspm;
+  spm_t spm;
+  spv_t x, r;
+  mpz_t n;
+
+  if (argc >= 3 && strcmp (argv[1], "-breakover") == 0)
+    {
+      breakover = strtoul (argv[2], NULL, 10);
+      argv += 2;
+      argc -= 2;
+    }
+  if (argc > 1)
+    min_log2_len = strtoul (argv[1], NULL, 10);
+  if (argc > 2)
+    max_log2_len = strtoul (argv[2], NULL, 10);
+  if (min_log2_len < 1 || max_log2_len < min_log2_len)
+    {
+      fprintf (stderr, "Usage: bench_ntt [-breakover b] "
+               "[min_log2_len [max_log2_len]]\n");
+      exit (EXIT_FAILURE);
+    }
+
+  /* a 200-digit modulus: only the first prime is used */
+  mpz_init (n);
+  mpz_ui_pow_ui (n, 10, 200);
+  mpz_add_ui (n, n, 1);
+  mpzspm = mpzspm_init ((spv_size_t) 1 << max_log2_len, n);
+  x = (spv_t) sp_aligned_malloc (sizeof (sp_t) << max_log2_len);
+  r = (spv_t) sp_aligned_malloc (sizeof (sp_t) << max_log2_len);
+  if (mpzspm == NULL || x == NULL || r == NULL)
+    {
+      fprintf (stderr, "Cannot allocate memory in main\n");
+      exit (EXIT_FAILURE);
+    }
+  spm = mpzspm->spm[0];
+  spv_random (x, (spv_size_t) 1 << max_log2_len, spm->sp);
+
+  printf ("NTT_GFP_BLOCK_BREAKOVER = %lu\n", (unsigned long) breakover);
+  printf ("log2_len  radix-2 (ns/b)  blocked (ns/b)  copy (GB/s)"
+          "  radix-2 (copies)  blocked (copies)\n");
+  for (l = min_log2_len; l <= max_log2_len; l++)
+    {
+      double t_radix2, t_block, t_copy, bfly;
+
+      len = (spv_size_t) 1 << l;
+      bfly = 2.0 * (double) l * (double) (len / 2);
+      t_radix2 = time_ntt (x, l, spm, NO_BLOCK);
+      t_block = time_ntt (x, l, spm, breakover);
+      t_copy = time_copy (r, x, len);
+      printf ("%8lu %15.3f %15.3f %12.2f %17.1f %17.1f\n", (unsigned long) l,
+              t_radix2 / bfly, t_block / bfly,
+              2.0 * (double) (len * sizeof (sp_t)) / t_copy,
+              t_radix2 / (2.0 * t_copy), t_block / (2.0 * t_copy));
+      fflush (stdout);
+    }
+
+  sp_aligned_free (x);
+  sp_aligned_free (r);
+  mpzspm_clear (mpzspm);
+  mpz_clear (n);
+  return 0;
+}
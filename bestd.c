@@ -84,15 +84,152 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
    The number of roots of G we compute is k * dF. For d2 == 1, this means 
    i1 = i0 + k * dF - 1  (-1 because both i0 and i1 are included).
 
-   For d2 > 1, values j not coprime to d2 are skipped (see condition 1).
-   The number of values in [1, i0] that are not coprime to d2 (with d2 prime) 
-   is floor (i0 / d2); in [1, i1] it is floor (i1 / d2). 
-   So we require that
-   k * dF >= i1 - i0 + 1 - (floor (i1 / d2) - floor (i0 / d2))
-   
-   
+   For d2 > 1, values i not coprime to d2 are skipped (see condition 1).
+   With c(x) the number of values in [1, x] that are coprime to d2 (see
+   count_coprime), we require that
+   k * dF >= c(i1) - c(i0 - 1)
+
+   d2 is squarefree, and a product of several primes skips a larger
+   fraction 1 - eulerphi(d2)/d2 of the i values: this is the S_1 + S_2
+   idea of Montgomery and Kruppa for P+-1, with S_1 the multiples of d2
+   and S_2 the multiples of d1. The price is the larger margins of about
+   d2 values of i at each end of the range, and the eulerphi(d2)
+   progressions ecm_rootsG_init() needs at least, whose tables share most
+   of their entries (see init_progression_points). The number of blocks k
+   is the one needed with d2 the first prime that does not divide d1, as
+   in earlier versions, and we use the choice of d2 that covers the
+   largest B2 with these k blocks. Taking the fewest blocks instead would
+   shrink the effective B2 (and with it the Brent-Suyama degree, see
+   choose_S) at the default B2 values.
 */
 
+/* Number of primes p that may divide d2 */
+#define D2_PRIMES 3
+
+/* r <- c(x), the number of integers in [1, x] coprime to d2 if x >= 0,
+   minus the number of those in [x + 1, 0] if x < 0, for a squarefree d2
+   whose prime factors are p[0..n-1] */
+static void
+count_coprime (mpz_t r, mpz_t x, const unsigned long *p, const unsigned int n)
+{
+  unsigned long s, b, delta;
+  int mu;
+  mpz_t t;
+
+  mpz_init (t);
+  mpz_set_ui (r, 0);
+  /* inclusion-exclusion over the divisors of d2 */
+  for (s = 0; s < (1UL << n); s++)
+    {
+      for (b = 0, delta = 1, mu = 1; b < n; b++)
+        if (s & (1UL << b))
+          {
+            delta *= p[b];
+            mu = -mu;
+          }
+      mpz_fdiv_q_ui (t, x, delta);
+      if (mu > 0)
+        mpz_add (r, r, t);
+      else
+        mpz_sub (r, r, t);
+    }
+  mpz_clear (t);
+}
+
+/* Put in p[0..n-1] the primes 5 <= p < 25 that may divide d2 for d1 and
+   dF, in increasing order, and return n */
+static unsigned int
+d2_primes (unsigned long *p, const unsigned long d1, const unsigned long dF)
+{
+  unsigned long q, d;
+  unsigned int n;
+
+  for (q = 5, n = 0, d = 1; q < 25 && n < D2_PRIMES; q += 2)
+    {
+      if (q % 3 == 0 || d1 % q == 0)
+        continue;
+      if (eulerphi (d * q) > dF)
+        break;
+      p[n++] = q;
+      d *= q;
+    }
+  return n;
+}
+
+/* Computes i0 and i1 for d1, d2 (see above), and puts in j the number of
+   roots of G needed */
+static void
+roots_needed (mpz_t j, mpz_t i0, mpz_t i1, mpz_t B2min, mpz_t B2,
+              const unsigned long d1, const unsigned long d2,
+              const unsigned long *p, const unsigned int n)
+{
+  mpz_t t;
+
+  mpz_init (t);
+  mpz_set_ui (i0, d1 - 1);
+  mpz_mul_ui (i0, i0, d2);
+  mpz_add (i1, B2, i0); /* i1 = B2 + (d1 - 1) * d2 */
+  mpz_sub (i0, B2min, i0); /* i0 = B2min - (d1 - 1) * d2 */
+  mpz_cdiv_q_ui (i0, i0, d1); /* i0 = ceil ((B2min - (d1 - 1) * d2) / d1) */
+  mpz_fdiv_q_ui (i1, i1, d1); /* i1 = floor ((B2 + (d1 - 1) * d2) / d1) */
+
+  /* Values not coprime to d2 are skipped: j = c(i1) - c(i0 - 1) */
+  count_coprime (j, i1, p, n);
+  mpz_sub_ui (t, i0, 1);
+  count_coprime (t, t, p, n);
+  mpz_sub (j, j, t);
+  mpz_clear (t);
+}
+
+/* Puts in B2 the largest end of stage 2 covered by k blocks of dF roots of
+   G starting at i0, for d1, d2 */
+static void
+stage2_end (mpz_t B2, mpz_t i0, const unsigned long k, const unsigned long dF,
+            const unsigned long d1, const unsigned long d2,
+            const unsigned long *p, const unsigned int n)
+{
+  unsigned long q, r2;
+  mpz_t i1, j;
+
+  mpz_init (i1);
+  mpz_init (j);
+
+  /* There will be k * dF roots of G computed, starting at i0, skipping all
+     that are not coprime to d2. There are eulerphi(d2) of those in each
+     interval of length d2, hence we want the largest i1 with
+       c(i1) - c(i0 - 1) == k * dF
+     i.e., i1 is one less than the (c(i0 - 1) + k * dF + 1)-th integer
+     coprime to d2.
+  */
+  mpz_sub_ui (i1, i0, 1);
+  count_coprime (j, i1, p, n);
+  mpz_set_ui (i1, k);
+  mpz_addmul_ui (j, i1, dF); /* j = c(i0 - 1) + k * dF */
+  r2 = mpz_fdiv_q_ui (i1, j, eulerphi (d2));
+  mpz_mul_ui (i1, i1, d2);
+  /* the (r2 + 1)-th integer in [1, d2] coprime to d2, minus 1 */
+  for (q = 1; r2 > 0 || gcd (q, d2) != 1; q++)
+    if (gcd (q, d2) == 1)
+      r2--;
+  mpz_add_ui (i1, i1, q - 1);
+
+  /* We want B2' the largest integer that satisfies 
+     i1 = floor ((B2' + (d1 - 1) * d2) / d1)
+        = floor ((B2'-d2)/d1) + d2
+     i1 - d2 = floor ((B2'-d2)/d1)
+     (B2'-d2)/d1 < i1-d2+1
+     B2'-d2 < (i1-d2+1) * d1
+     B2' < (i1-d2+1) * d1 + d2
+     B2' = (i1-d2+1) * d1 + d2 - 1
+  */
+  mpz_sub_ui (i1, i1, d2 - 1);
+  mpz_mul_ui (B2, i1, d1);
+  mpz_add_ui (B2, B2, d2 - 1);
+
+  mpz_clear (j);
+  mpz_clear (i1);
+}
+
 int
 bestD (root_params_t *root_params, unsigned long *finalk, 
        unsigned long *finaldF, mpz_t B2min, mpz_t B2, int po2, int use_ntt, 
@@ -117,8 +254,10 @@ od:
                                  324870, 690690, 1345890, 2852850, 5705700, 
                                  11741730, 23130030, 48498450, 96996900};
 
-  unsigned long i, d1 = 0, d2 = 0, dF = 0, phid, k, maxN;
-  mpz_t j, t, i0, i1;
+  unsigned long i, d1 = 0, d2, dF = 0, phid, k, maxN, d;
+  unsigned long p[D2_PRIMES];
+  unsigned int n = 0, m;
+  mpz_t j, t, i0, i1, ti0, ti1, tB2;
   int r = 0;
 
   if (mpz_cmp (B2, B2min) < 0)
@@ -133,6 +272,9 @@ od:
   mpz_init (i1);
   mpz_init (j);
   mpz_init (t);
+  mpz_init (ti0);
+  mpz_init (ti1);
+  mpz_init (tB2);
   k = *finalk; /* User specified k value passed in via finalk */
 
   /* Look for largest dF we can use while satisfying the maxmem parameter */
@@ -168,48 +310,12 @@ od:
       d1 = (po2) ? lpo2[i] : l[i];
       phid = eulerphi (d1) / 2;
       dF = (po2) ? 1U << ceil_log2 (phid) : phid;
-      /* Look for smallest prime < 25 that does not divide d1 */
-      /* The caller can force d2 = 1 by setting root_params->d2 != 0 */
-      d2 = 1;
-      if (root_params->d2 == 0)
-        for (d2 = 5; d2 < 25; d2 += 2)
-          {
-            if (d2 % 3 == 0)
-              continue;
-            if (d1 % d2 > 0)
-              break;
-          }
-
-      if (d2 >= 25 || d2 - 1 > dF)
-        d2 = 1;
-
-#if 0
-      /* The code to init roots of G can handle negative i0 now. */
-      if (d2 > 1 && mpz_cmp_ui (B2min, (d1 - 1) * d2 - d1) <= 0) 
-        d2 = 1; /* Would make i0 < 0 */
-#endif
-      
-      mpz_set_ui (i0, d1 - 1);
-      mpz_mul_ui (i0, i0, d2);
-      mpz_set (j, B2);
-      mpz_add (i1, j, i0); /* i1 = B2 + (d1 - 1) * d2 */
-      mpz_set (j, B2min);
-      mpz_sub (i0, j, i0); /* i0 = B2min - (d1 - 1) * d2 */
-      mpz_cdiv_q_ui (i0, i0, d1); /* i0 = ceil ((B2min - (d1 - 1) * d2) / d1) */
-      mpz_fdiv_q_ui (i1, i1, d1); /* i1 = floor ((B2 + (d1 - 1) * d2) / d1) */
-      
-      /* How many roots of G will we need ? */
-      mpz_sub (j, i1, i0);
-      mpz_add_ui (j, j, 1);
-
-      /* Integer multiples of d2 are skipped (if d2 > 1) */
-      if (d2 > 1)
-        {
-          mpz_fdiv_q_ui (t, i1, d2);
-          mpz_sub (j, j, t);
-          mpz_fdiv_q_ui (t, i0, d2);
-          mpz_add (j, j, t); /* j -= floor (i1 / d2) - floor (i0 / d2) */
-        }
+      /* The number of blocks is the one needed with d2 = p[0], or d2 = 1
+         if there is no such prime. The caller can force d2 = 1 by setting
+         root_params->d2 != 0 */
+      n = (root_params->d2 == 0) ? d2_primes (p, d1, dF) : 0;
+      roots_needed (j, i0, i1, B2min, B2, d1, (n > 0) ? p[0] : 1, p,
+                    (n > 0) ? 1 : 0);
       
       /* How many blocks will we need ? Divide lines by dF, rounding up */
       mpz_cdiv_q_ui (j, j, dF);
@@ -257,29 +363,23 @@ od:
   if (k == ECM_DEFAULT_K)
     k = mpz_get_ui (j);
 
-  /* Now that we have the number of blocks, compute real i1. There will be
-     k * dF roots of G computed, starting at i0, skipping all that are not
-     coprime to d2. While d2 is prime, that means: are not multiples of d2.
-     Hence we want i1 so that 
-       i1 - floor(i1 / d2) - i0 + ceil((i0 / d2) == k * dF
-       i1 - floor(i1 / d2) == k * dF + i0 - ceil((i0 / d2)
-  */
-  
-  mpz_set_ui (j, k);
-  mpz_mul_ui (j, j, dF);
-  if (d2 == 1)
+  /* Now that we have the number of blocks, d2 is the product of the first
+     m primes of p[], with m chosen to reach the largest B2 with k blocks.
+     Ties go to the smaller d2, so the choice of earlier versions is kept
+     unless a product of more primes does better. */
+  d2 = (n > 0) ? p[0] : 1;
+  stage2_end (B2, i0, k, dF, d1, d2, p, (n > 0) ? 1 : 0);
+  for (m = 2, d = d2; m <= n; m++)
     {
-      mpz_add (i1, i0, j);
-      mpz_sub_ui (i1, i1, 1);
-    }
-  else
-    {
-      mpz_add (j, j, i0);
-      mpz_cdiv_q_ui (t, i0, d2);
-      mpz_sub (j, j, t); /* j = k * dF + i0 - ceil((i0 / d2) */
-      mpz_fdiv_qr_ui (j, t, j, d2 - 1);
-      mpz_mul_ui (j, j, d2);
-      mpz_add (i1, j, t);
+      d *= p[m - 1];
+      roots_needed (t, ti0, ti1, B2min, B2, d1, d, p, m); /* for ti0 */
+      stage2_end (tB2, ti0, k, dF, d1, d, p, m);
+      if (mpz_cmp (tB2, B2) > 0)
+        {
+          d2 = d;
+          mpz_swap (i0, ti0);
+          mpz_swap (B2, tB2);
+        }
     }
 
   root_params->d1 = d1;
@@ -288,21 +388,10 @@ od:
   *finaldF = dF;
   *finalk = k;
 
-  /* We want B2' the largest integer that satisfies 
-     i1 = floor ((B2' + (d1 - 1) * d2) / d1)
-        = floor ((B2'-d2)/d1) + d2
-     i1 - d2 = floor ((B2'-d2)/d1)
-     (B2'-d2)/d1 < i1-d2+1
-     B2'-d2 < (i1-d2+1) * d1
-     B2' < (i1-d2+1) * d1 + d2
-     B2' = (i1-d2+1) * d1 + d2 - 1
-  */
-  
-  mpz_sub_ui (i1, i1, d2 - 1);
-  mpz_mul_ui (B2, i1, d1);
-  mpz_add_ui (B2, B2, d2 - 1);
-
 clear_and_exit:
+  mpz_clear (tB2);
+  mpz_clear (ti1);
+  mpz_clear (ti0);
   mpz_clear (t);
   mpz_clear (j);
   mpz_clear (i1);
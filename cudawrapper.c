@@ -1,9 +1,9 @@
 #include "ecm-gpu.h"
 
-#ifdef WITH_GPU
-
 #define TWO32 4294967296 /* 2^32 */ 
 
+#ifdef WITH_GPU
+
 extern int select_and_init_GPU (int, unsigned int*, int);
 extern float cuda_Main (biguint_t, biguint_t, biguint_t, digit_t, biguint_t*, 
                         biguint_t*, biguint_t*, biguint_t*, mpz_t, unsigned int, 
@@ -212,6 +212,7 @@ int gpu_ecm_stage1 (mpz_t *factors, int *array_stage_found, mpz_t N, mpz_t s,
 
   return youpi;
 }
+#endif
 
 static void
 A_from_sigma (mpz_t A, unsigned int sigma, mpz_t n)
@@ -219,8 +220,8 @@ A_from_sigma (mpz_t A, unsigned int sigma, mpz_t n)
   mpz_t tmp;
   int i;
   mpz_init_set_ui (tmp, sigma);
-  /* Compute d = sigma/2^ECM_GPU_SIZE_DIGIT */
-  for (i = 0; i < ECM_GPU_SIZE_DIGIT; i++)
+  /* Compute d = sigma/2^32 */
+  for (i = 0; i < 32; i++)
     {
       if (mpz_tstbit (tmp, 0) == 1)
       mpz_add (tmp, tmp, n);
@@ -234,15 +235,23 @@ A_from_sigma (mpz_t A, unsigned int sigma, mpz_t n)
   mpz_clear (tmp);
 }
 
-int
-gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
-         double *B1done, double B1, mpz_t B2min_parm, mpz_t B2_parm, 
+/* Stage 1 on *nb_curves curves at once, with consecutive values of sigma
+   starting at firstsigma, on the GPU if use_gpu is non-zero (in which case
+   *nb_curves may be set by the device initialization), otherwise on the
+   CPU with cpu_ecm_stage1. Then stage 2 is computed on the CPU for each
+   curve. See gpu_ecm and cpu_ecm for the output. */
+static int
+multi_curves_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n,
+         mpz_t go, double *B1done, double B1, mpz_t B2min_parm, mpz_t B2_parm,
          unsigned long k, const int S, int verbose, int repr,
          int nobase2step2, int use_ntt, int sigma_is_A, FILE *os, FILE* es, 
-         char *chkfilename ATTRIBUTE_UNUSED, char *TreeFilename, double maxmem,
+         char *TreeFilename, double maxmem,
          int (*stop_asap)(void), mpz_t batch_s, double *batch_last_B1_used, 
-         int device, int *device_init, unsigned int *nb_curves)
+         mpz_srcptr *batch_s_shared, int stage2_engine, int use_gpu,
+         int device ATTRIBUTE_UNUSED, int *device_init ATTRIBUTE_UNUSED,
+         unsigned int *nb_curves)
 {
+  const char *dev = use_gpu ? "GPU" : "CPU";
   unsigned int i;
   int youpi = ECM_NO_FACTOR_FOUND;
   int factor_found = ECM_NO_FACTOR_FOUND;
@@ -273,31 +282,33 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
   ECM_STDERR = (es == NULL) ? stdout : es;
 
 
+#ifdef WITH_GPU
   /* Check that N is not too big */
-  if (mpz_sizeinbase (n, 2) > ECM_GPU_MAX_BITS-6)
+  if (use_gpu && mpz_sizeinbase (n, 2) > ECM_GPU_MAX_BITS-6)
     {
       outputf (OUTPUT_ERROR, "GPU: Error, input number should be stricly lower"
                              " than 2^%d\n", ECM_GPU_MAX_BITS-6);
       return ECM_ERROR;
     }
+#endif
 
-  /* Only param = ECM_PARAM_BATCH_32BITS_D is accepted on GPU */
+  /* Only param = ECM_PARAM_BATCH_32BITS_D is accepted */
   if (param == ECM_PARAM_DEFAULT)
       param = ECM_PARAM_BATCH_32BITS_D;
     
   if (param != ECM_PARAM_BATCH_32BITS_D)
     {
-      outputf (OUTPUT_ERROR, "GPU: Error, only param = ECM_PARAM_BATCH_32BITS_D "
-                             "is accepted on GPU.\n");
+      outputf (OUTPUT_ERROR, "%s: Error, only param = ECM_PARAM_BATCH_32BITS_D "
+                             "is accepted on %s.\n", dev, dev);
       return ECM_ERROR;
     }
 
   /* check that repr == ECM_MOD_DEFAULT or ECM_MOD_BASE2 (only for stage 2) */
   if (repr != ECM_MOD_DEFAULT && repr != ECM_MOD_BASE2)
-      outputf (OUTPUT_ERROR, "GPU: Warning, the value of repr will be ignored "
-      "for step 1 on GPU.\n");
+      outputf (OUTPUT_ERROR, "%s: Warning, the value of repr will be ignored "
+      "for step 1 on %s.\n", dev, dev);
 
-  /* It is only for stage 2, it is not taken into account for GPU code */
+  /* It is only for stage 2, it is not taken into account for stage 1 */
   if (mpmod_init (modulus, n, repr) != 0)
     return ECM_ERROR;
 
@@ -318,25 +329,16 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
   else
       Fermat = 0;
  
-  /* Cannot do resume on GPU */
+  /* Cannot do resume */
   if (!ECM_IS_DEFAULT_B1_DONE(*B1done) && *B1done < B1)
     {
-      outputf (OUTPUT_ERROR, "GPU: Error, cannot resume on GPU.\n");
+      outputf (OUTPUT_ERROR, "%s: Error, cannot resume on %s.\n", dev, dev);
       return ECM_ERROR;
     }
 
-  /* Compute s */
+  /* Get s from the process-wide cache, unless the caller gave it */
   if (B1 != *batch_last_B1_used || mpz_cmp_ui (batch_s, 1) <= 0)
-    {
-      *batch_last_B1_used = B1;
-
-      st = cputime ();
-      /* construct the batch exponent */
-      compute_s (batch_s, B1, NULL);
-      outputf (OUTPUT_VERBOSE, "Computing batch product (of %" PRIu64
-                               " bits) of primes up to B1=%1.0f took %ldms\n",
-                               mpz_sizeinbase (batch_s, 2), B1, cputime () - st);
-    }
+    batch_s = (mpz_ptr) batch_s_acquire (batch_s_shared, B1, NULL, 1);
 
   /* Set parameters for stage 2 */
   mpres_init (P.x, modulus);
@@ -347,14 +349,15 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
   mpz_init (B2min);
 
   youpi = set_stage_2_params (B2, B2_parm, B2min, B2min_parm, &root_params,
-                              B1, &k, S, use_ntt, &po2, &dF,
+                              B1, &k, S, use_ntt, &stage2_engine, &po2, &dF,
                               TreeFilename, maxmem, Fermat, modulus);
   if (youpi == ECM_ERROR)
       goto end_gpu_ecm;
   
 
+#ifdef WITH_GPU
   /* Initialize the GPU if necessary */
-  if (!*device_init)
+  if (use_gpu && !*device_init)
     {
       st = cputime ();
       youpi = select_and_init_GPU (device, nb_curves,
@@ -372,6 +375,14 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
       /* try running 'nvidia-smi -q -l' on the background .                 */
       *device_init = 1;
     }
+#endif
+
+  if (*nb_curves == 0)
+    {
+      outputf (OUTPUT_ERROR, "%s: Error, no curve to compute\n", dev);
+      youpi = ECM_ERROR;
+      goto end_gpu_ecm2;
+    }
   
   /* Init arrays */
   factors = (mpz_t *) malloc (*nb_curves * sizeof (mpz_t));
@@ -390,7 +401,7 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
   /* Current code works only for sigma_is_A = 0 */
   if (sigma_is_A != 0)
     {
-      outputf (OUTPUT_ERROR, "GPU: Not yet implemented.\n");
+      outputf (OUTPUT_ERROR, "%s: Not yet implemented.\n", dev);
       youpi= ECM_ERROR;
       goto end_gpu_ecm;
     }
@@ -407,8 +418,8 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
       if (mpz_cmp_ui (firstsigma, 2) < 0 || 
           mpz_cmp_ui (firstsigma, TWO32 - *nb_curves) >= 0)
         {
-          outputf (OUTPUT_ERROR, "GPU: Error, sigma should be in [2,%lu]\n",
-                                 TWO32 - *nb_curves - 1);
+          outputf (OUTPUT_ERROR, "%s: Error, sigma should be in [2,%lu]\n",
+                                 dev, TWO32 - *nb_curves - 1);
           youpi= ECM_ERROR;
           goto end_gpu_ecm;
         }
@@ -418,12 +429,13 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
   print_B1_B2_poly (OUTPUT_NORMAL, ECM_ECM, B1, *B1done,  B2min_parm, B2min,
                     B2, S, firstsigma, sigma_is_A, ECM_EC_TYPE_MONTGOMERY,
                     go, param, *nb_curves);
-  outputf (OUTPUT_VERBOSE, "dF=%lu, k=%lu, d=%lu, d2=%lu, i0=%Zd\n", 
-           dF, k, root_params.d1, root_params.d2, root_params.i0);
+  if (stage2_engine != ECM_STAGE2_SC)
+    outputf (OUTPUT_VERBOSE, "dF=%lu, k=%lu, d=%lu, d2=%lu, i0=%Zd\n", 
+             dF, k, root_params.d1, root_params.d2, root_params.i0);
 
   if (go != NULL && mpz_cmp_ui (go, 1) > 0)
     {
-      outputf (OUTPUT_ERROR, "GPU: Error, option -go is not allowed\n");
+      outputf (OUTPUT_ERROR, "%s: Error, option -go is not allowed\n", dev);
       youpi= ECM_ERROR;
       goto end_gpu_ecm;
     }
@@ -443,12 +455,24 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
     }
   
   st = cputime ();
-  youpi = gpu_ecm_stage1 (factors, array_stage_found, n, batch_s, *nb_curves, 
-                          firstsigma_ui, &gputime, verbose);
-
-  outputf (OUTPUT_NORMAL, "Computing %u Step 1 took %ldms of CPU time / "
-                          "%.0fms of GPU time\n", *nb_curves, 
+#ifdef WITH_GPU
+  if (use_gpu)
+    {
+      youpi = gpu_ecm_stage1 (factors, array_stage_found, n, batch_s,
+                              *nb_curves, firstsigma_ui, &gputime, verbose);
+      outputf (OUTPUT_NORMAL, "Computing %u Step 1 took %ldms of CPU time / "
+                              "%.0fms of GPU time\n", *nb_curves, 
                                            elltime (st, cputime ()), gputime);
+    }
+  else
+#endif
+    {
+      youpi = cpu_ecm_stage1 (factors, array_stage_found, n, batch_s,
+                              *nb_curves, firstsigma_ui);
+      gputime = (float) elltime (st, cputime ());
+      outputf (OUTPUT_NORMAL, "Computing %u Step 1 took %.0fms of CPU time\n",
+                              *nb_curves, gputime);
+    }
   outputf (OUTPUT_VERBOSE, "Throughput: %.3f curves per second ", 
                                                  1000 * (*nb_curves)/gputime);
   outputf (OUTPUT_VERBOSE, "(on average %.2fms per Step 1)\n", 
@@ -529,16 +553,20 @@ gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
         (without it, stage2() prints a least a line by curves) */
       if (!test_verbose (OUTPUT_VERBOSE)) 
         set_verbose (0);
-      youpi = stage2 (factors[i], &P, modulus, dF, k, &root_params, use_ntt, 
-                      TreeFilename, stop_asap);
+      if (stage2_engine == ECM_STAGE2_SC)
+        youpi = ecm_stage2_sc (factors[i], &P, B2min, B2, modulus, stop_asap);
+      else
+        youpi = stage2 (factors[i], &P, modulus, dF, k, &root_params,
+                        use_ntt, TreeFilename, 1, stop_asap);
       set_verbose (verbose);
 
     next_curve:
       if (youpi != ECM_NO_FACTOR_FOUND)
         {
           array_stage_found[i] = youpi;
-          outputf (OUTPUT_NORMAL, "GPU: factor %Zd found in Step 2 with"
-                " curve %u (-sigma 3:%u)\n", factors[i], i, i+firstsigma_ui);
+          outputf (OUTPUT_NORMAL, "%s: factor %Zd found in Step 2 with"
+                " curve %u (-sigma 3:%u)\n", dev, factors[i], i,
+                i+firstsigma_ui);
           /* factor_found corresponds to the first factor found */
           if (factor_found == ECM_NO_FACTOR_FOUND)
             factor_found = youpi;
@@ -569,7 +597,6 @@ end_gpu_ecm_rhotable:
               (stop_asap == NULL || !(*stop_asap)()))
               print_exptime (B1, B2, dF, k, root_params.S, 
                              (long) (tottime / *nb_curves), param);
-          rhoinit (1, 0); /* Free memory of rhotable */
         }
     }
 
@@ -608,7 +635,49 @@ end_gpu_ecm2:
 
   return youpi;
 }
+
+#ifdef WITH_GPU
+int
+gpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
+         double *B1done, double B1, mpz_t B2min_parm, mpz_t B2_parm, 
+         unsigned long k, const int S, int verbose, int repr,
+         int nobase2step2, int use_ntt, int sigma_is_A, FILE *os, FILE* es, 
+         char *chkfilename ATTRIBUTE_UNUSED, char *TreeFilename, double maxmem,
+         int (*stop_asap)(void), mpz_t batch_s, double *batch_last_B1_used, 
+         mpz_srcptr *batch_s_shared, int stage2_engine,
+         int device, int *device_init, unsigned int *nb_curves)
+{
+  return multi_curves_ecm (f, x, param, firstsigma, n, go, B1done, B1,
+                           B2min_parm, B2_parm, k, S, verbose, repr,
+                           nobase2step2, use_ntt, sigma_is_A, os, es,
+                           TreeFilename, maxmem, stop_asap, batch_s,
+                           batch_last_B1_used, batch_s_shared, stage2_engine,
+                           1, device, device_init, nb_curves);
+}
 #endif
 
+/* Same as gpu_ecm, with stage 1 computed on the CPU for nb_curves curves
+   at once by cpu_ecm_stage1. As with gpu_ecm, if a factor is found with
+   the curves of sigma s_0 < ... < s_k, f = f_0 + f_1*n + ... + f_k*n^k,
+   where f_i is the factor found with s_i, and x = x_0*n^(c-1) + ... +
+   x_(c-1) holds the end-of-stage-1 residues of the c = nb_curves curves. */
+int
+cpu_ecm (mpz_t f, mpz_t x, int param, mpz_t firstsigma, mpz_t n, mpz_t go,
+         double *B1done, double B1, mpz_t B2min_parm, mpz_t B2_parm, 
+         unsigned long k, const int S, int verbose, int repr,
+         int nobase2step2, int use_ntt, int sigma_is_A, FILE *os, FILE* es, 
+         char *TreeFilename, double maxmem, int (*stop_asap)(void),
+         mpz_t batch_s, double *batch_last_B1_used,
+         mpz_srcptr *batch_s_shared, int stage2_engine,
+         unsigned int *nb_curves)
+{
+  return multi_curves_ecm (f, x, param, firstsigma, n, go, B1done, B1,
+                           B2min_parm, B2_parm, k, S, verbose, repr,
+                           nobase2step2, use_ntt, sigma_is_A, os, es,
+                           TreeFilename, maxmem, stop_asap, batch_s,
+                           batch_last_B1_used, batch_s_shared, stage2_engine,
+                           0, -1, NULL, nb_curves);
+}
+
 
 
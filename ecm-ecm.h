@@ -66,6 +66,32 @@ typedef struct
                            that expression will have to be built for each candidate */
 } mpgocandi_t;
 
+/* A part of the stage 2 range of a residue, written to save files by the
+   -split option. Part j of K covers [B2min, B2], and factor is the
+   factor its run found, or 0 if none. For P-1 and P+1, a
+   checkpoint written during stage 2 gives instead the multi-point
+   evaluations done, see the fs2_* fields of ecm_params. */
+typedef struct
+{
+  unsigned int j;       /* 1 <= j <= K, or 0 if the residue is not split */
+  unsigned int K;
+  mpz_t B2min, B2;
+  mpz_t factor;
+  unsigned long fs2_done; /* 0 if the line has no stage 2 checkpoint */
+  unsigned long fs2_param[4];
+  mpz_t fs2_m_1;
+} stage2_unit_t;
+
+/* The ladder of the batch stage 1 of ECM, read from a checkpoint written
+   during it: bits bits of s for B1 were left, and x2 is the x-coordinate of
+   its second point. bits is 0 if the line has no ladder. */
+typedef struct
+{
+  unsigned long bits;
+  double B1;
+  mpz_t x2;
+} stage1_ladder_t;
+
 /* auxi.c */
 unsigned int nb_digits  (const mpz_t);
 int read_number (mpcandi_t*, FILE*, int);
@@ -120,10 +146,12 @@ double calc_B1_AutoIncrement(double cur_B1, double incB1val);
 int  read_resumefile_line (int *, mpz_t, mpz_t, mpcandi_t *, 
 			   mpz_t, mpz_t,
 			   mpz_t, mpz_t, int *, int *,
-                           double *, char *, char *, char *, char *, FILE *);
+                           double *, char *, char *, char *, char *,
+                           stage2_unit_t *, stage1_ladder_t *, FILE *);
 int write_resumefile (char *, int, mpz_t, ecm_params params,
 		      mpcandi_t *, mpz_t, mpz_t, 
-		      const char *);
+		      const char *, const stage2_unit_t *);
+int check_stage2_units (FILE *);
 int write_s_in_file (char *, mpz_t);
 int read_s_from_file (mpz_t, char *, double); 
 
@@ -44,10 +44,15 @@ typedef carry_t VOL bigint_t[ECM_GPU_NB_DIGITS];
 int gpu_ecm (mpz_t, mpz_t, int, mpz_t, mpz_t, mpz_t, double *, double, mpz_t,
              mpz_t, unsigned long, const int, int, int, int, int, int,
              FILE*, FILE*, char*, char *, double, int (*)(void), mpz_t,
-             double *, int, int*, unsigned int*);
+             double *, mpz_srcptr *, int, int, int*, unsigned int*);
 #else
 int gpu_ecm ();
 #endif
+#define cpu_ecm __ECM(cpu_ecm)
+int cpu_ecm (mpz_t, mpz_t, int, mpz_t, mpz_t, mpz_t, double *, double, mpz_t,
+             mpz_t, unsigned long, const int, int, int, int, int, int,
+             FILE*, FILE*, char *, double, int (*)(void), mpz_t, double *,
+             mpz_srcptr *, int, unsigned int*);
 #define gpu_ecm_stage1 __ECM(gpu_ecm_stage1)
 int gpu_ecm_stage1 (mpz_t *, int *, mpz_t, mpz_t, unsigned int, unsigned int,
                     float *, int);
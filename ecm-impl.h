@@ -45,16 +45,15 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 #include "ecm_int.h"
 
-#ifndef TUNE
-#include "ecm-params.h"
-#else
+#include "ecm-tune.h"
+#ifdef TUNE
 extern size_t MPZMOD_THRESHOLD;
 extern size_t REDC_THRESHOLD;
-#define TUNE_MULREDC_TABLE {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-#define TUNE_SQRREDC_TABLE {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-#define LIST_MUL_TABLE {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-#endif
+extern int tune_mulredc_table[];
+extern int tune_sqrredc_table[];
+extern int list_mul_table[];
 extern size_t mpn_mul_lo_threshold[];
+#endif
 
 #define TUNE_LIST_MUL_N_MAX_SIZE 32
 
@@ -83,7 +82,7 @@ extern size_t mpn_mul_lo_threshold[];
 
 #define ECM_STDOUT __ecm_stdout
 #define ECM_STDERR __ecm_stderr
-extern FILE *ECM_STDOUT, *ECM_STDERR;
+extern ECM_TLS FILE *ECM_STDOUT, *ECM_STDERR;
 
 /* #define TIMING_CRT */
 
@@ -97,6 +96,12 @@ extern FILE *ECM_STDOUT, *ECM_STDERR;
 #define PM1FS2_COST 1.0 / 4.0
 #define PP1FS2_COST 1.0 / 4.0
 
+/* ECM stage 2 uses the standard continuation when it needs fewer modular
+   multiplications than this (see ecm_stage2_sc_cost), the polynomial
+   continuation otherwise. The crossover was measured at B2 - B2min from
+   2e5 to 4e5 for inputs of 26 to 200 digits. */
+#define ECM_STAGE2_SC_MULS 3e4
+
 /* define top-level multiplication */
 #define KARA 2
 #define TOOM3 3
@@ -164,6 +169,11 @@ extern FILE *ECM_STDOUT, *ECM_STDERR;
 
 typedef mpz_t mpres_t;
 
+/* A residue of exactly n = mpz_size(N) limbs in [0, N), in the same
+   representation as mpres_t. Its limbs are allocated once for
+   all by mpresf_init, so that the arithmetic never reallocates. */
+typedef mp_limb_t *mpresf_t;
+
 typedef mpz_t* listz_t;
 
 typedef struct
@@ -198,6 +208,12 @@ typedef struct
   unsigned long P, s_1, s_2, l;
   mpz_t m_1;
   const char *file_stem;
+  unsigned long done;  /* multi-point evaluations done before, from a
+                          checkpoint: the stage 2 starts with number done */
+  char *chkfilename;   /* file for checkpoints, or NULL */
+  double B1done;       /* stage 1 bound of X, written to the checkpoints */
+  int (*stop_asap)(void);
+  unsigned int threads; /* for the NTT, see mpzspm_set_threads() */
 } __faststage2_param_t;
 typedef __faststage2_param_t faststage2_param_t;
 
@@ -244,6 +260,23 @@ typedef struct
 } __polyz_struct;
 typedef __polyz_struct polyz_t[1];
 
+/* The product tree of F stored in a file, for -treefile (see treefile.c) */
+typedef struct
+{
+  char *filename;
+  int fd;             /* when the file is mapped into memory */
+  FILE *file;         /* otherwise */
+  mp_limb_t *data;    /* the mapping of the file, or a buffer for one level */
+  size_t width;       /* number of limbs of each coefficient */
+  unsigned long len;  /* number of coefficients of each level */
+  unsigned int levels;
+  mpz_t modulus;
+  mpz_t t;
+  listz_t view;       /* the coefficients of the level in use */
+  listz_t *tree;      /* tree[i] = view when level i is in use, else NULL */
+} __treefile_struct;
+typedef __treefile_struct treefile_t[1];
+
 typedef struct 
 {
   int repr;           /* ECM_MOD_MPZ: plain modulus, possibly normalized
@@ -269,6 +302,8 @@ typedef struct
   mpz_t R2, R3;       /* For MODMULN and REDC, R^2 and R^3 (mod orig_modulus), 
                          where R = 2^bits. */
   mpz_t temp1, temp2; /* Temp values used during multiplication etc. */
+  mpz_t temp3;        /* Result of the mpres_* calls made by the mpresf_*
+                         functions for the MPZ and BASE2 representations */
 } __mpmod_struct;
 typedef __mpmod_struct mpmod_t[1];
 
@@ -298,6 +333,9 @@ unsigned long pp1fs2_maxlen (const size_t, const mpz_t, const int, const int);
 long    choose_P (const mpz_t, const mpz_t, const unsigned long,
                   const unsigned long, faststage2_param_t *, mpz_t, mpz_t,
                   const int, const int);
+#define fs2_resume __ECM(fs2_resume)
+void    fs2_resume (faststage2_param_t *, const unsigned long,
+                    const unsigned long *, mpz_t);
 #define pm1fs2 __ECM(pm1fs2)
 int	pm1fs2 (mpz_t, const mpres_t, mpmod_t, const faststage2_param_t *);
 #define pm1fs2_ntt __ECM(pm1fs2_ntt)
@@ -317,11 +355,11 @@ int     bestD (root_params_t *, unsigned long *, unsigned long *, mpz_t,
 #define choose_S __ECM(choose_S)
 int  choose_S (mpz_t);
 #define add3 __ECM(add3)
-void add3 (mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, 
-           mpres_t, mpmod_t, mpres_t, mpres_t, mpres_t);
+void add3 (mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpresf_t,
+           mpresf_t, mpresf_t, mpmod_t, mpresf_t, mpresf_t, mpresf_t);
 #define duplicate __ECM(duplicate)
-void duplicate (mpres_t, mpres_t, mpres_t, mpres_t, mpmod_t, mpres_t, mpres_t,
-                mpres_t, mpres_t);
+void duplicate (mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpmod_t, mpresf_t,
+                mpresf_t, mpresf_t, mpresf_t);
 
 #define ecm_mul __ECM(ecm_mul)
 void ecm_mul (mpres_t, mpres_t, mpz_t, mpmod_t, mpres_t);
@@ -331,7 +369,7 @@ void print_B1_B2_poly (int, int, double, double, mpz_t, mpz_t, mpz_t, int S,
 #define set_stage_2_params __ECM(set_stage_2_params)
 int set_stage_2_params (mpz_t, mpz_t, mpz_t, mpz_t, root_params_t *,
                         double, unsigned long *, const int, int, int *,
-                        unsigned long *, char *, double, int, mpmod_t);
+                        int *, unsigned long *, char *, double, int, mpmod_t);
 #define print_expcurves __ECM(print_expcurves)
 void print_expcurves (double, const mpz_t, unsigned long, unsigned long, int, 
                       int);
@@ -353,20 +391,29 @@ int     ecm_rootsG       (mpz_t, listz_t, unsigned long, ecm_roots_state_t *,
                           mpmod_t);
 #define ecm_rootsG_clear __ECM(ecm_rootsG_clear)
 void    ecm_rootsG_clear (ecm_roots_state_t *, mpmod_t);
+#define ecm_stage2_sc_cost __ECM(ecm_stage2_sc_cost)
+double  ecm_stage2_sc_cost (mpz_t, mpz_t, mpmod_t);
+#define ecm_stage2_sc __ECM(ecm_stage2_sc)
+int     ecm_stage2_sc    (mpz_t, curve *, mpz_t, mpz_t, mpmod_t,
+                          int (*)(void));
 
 /* lucas.c */
 #define pp1_mul_prac __ECM(pp1_mul_prac)
-void  pp1_mul_prac     (mpres_t, ecm_uint, mpmod_t, mpres_t, mpres_t,
-                        mpres_t, mpres_t, mpres_t);
+void  pp1_mul_prac     (mpresf_t, ecm_uint, mpmod_t, mpresf_t, mpresf_t,
+                        mpresf_t, mpresf_t, mpresf_t, mpresf_t);
 
 /* stage2.c */
 #define stage2 __ECM(stage2)
 int          stage2     (mpz_t, void *, mpmod_t, unsigned long, unsigned long,
-                         root_params_t *, int, char *, int (*)(void));
+                         root_params_t *, int, char *, unsigned int,
+                         int (*)(void));
 #define init_progression_coeffs __ECM(init_progression_coeffs)
 listz_t init_progression_coeffs (mpz_t, const unsigned long, const unsigned long, 
 				 const unsigned int, const unsigned int, 
 				 const unsigned int, const int);
+#define init_progression_coeffs2 __ECM(init_progression_coeffs2)
+listz_t init_progression_coeffs2 (mpz_t, mpz_t, mpz_t, const unsigned int,
+                                  const int, const unsigned int);
 #define init_roots_params __ECM(init_roots_params)
 void init_roots_params  (progression_params_t *, const int, 
 			 const unsigned long, const unsigned long, 
@@ -411,26 +458,28 @@ void          list_mulup (listz_t, unsigned int, mpz_t, mpz_t);
 void         list_zero  (listz_t, unsigned int);
 #define list_mul __ECM(list_mul)
 void         list_mul (listz_t, listz_t, unsigned int, listz_t,
-    unsigned int, int, listz_t);
+    unsigned int, int, listz_t, unsigned int);
 #define list_mul_high __ECM(list_mul_high)
 void      list_mul_high (listz_t, listz_t, listz_t, unsigned int);
 #define list_mulmod __ECM(list_mulmod)
 void        list_mulmod (listz_t, listz_t, listz_t, listz_t, unsigned int,
-                         listz_t, mpz_t);
+                         listz_t, mpz_t, unsigned int);
 #define PolyFromRoots __ECM(PolyFromRoots)
-void      PolyFromRoots (listz_t, listz_t, unsigned int, listz_t, mpz_t);
+void      PolyFromRoots (listz_t, listz_t, unsigned int, listz_t, mpz_t,
+                         unsigned int);
 #define PolyFromRoots_Tree __ECM(PolyFromRoots_Tree)
 int       PolyFromRoots_Tree (listz_t, listz_t, unsigned int, listz_t, int, 
-                         mpz_t, listz_t*, FILE*, unsigned int);
+                         mpz_t, listz_t*, treefile_t, unsigned int,
+                         unsigned int, unsigned int);
 
 #define ntt_PolyFromRoots __ECM(ntt_PolyFromRoots)
 void	  ntt_PolyFromRoots (mpzv_t, mpzv_t, spv_size_t, mpzv_t, mpzspm_t);
 #define ntt_PolyFromRoots_Tree __ECM(ntt_PolyFromRoots_Tree)
 int       ntt_PolyFromRoots_Tree (mpzv_t, mpzv_t, spv_size_t, mpzv_t,
-                         int, mpzspm_t, mpzv_t *, FILE *);
+                         int, mpzspm_t, mpzv_t *, treefile_t);
 #define ntt_polyevalT __ECM(ntt_polyevalT)
 int  ntt_polyevalT (mpzv_t, spv_size_t, mpzv_t *, mpzv_t, mpzspv_t,
-		mpzspm_t, char *);
+		mpzspm_t, treefile_t);
 #define ntt_mul __ECM(ntt_mul)
 void  ntt_mul (mpzv_t, mpzv_t, mpzv_t, spv_size_t, mpzv_t, int, mpzspm_t);
 #define ntt_PrerevertDivision __ECM(ntt_PrerevertDivision)
@@ -438,12 +487,19 @@ void  ntt_PrerevertDivision (mpzv_t, mpzv_t, mpzv_t, mpzspv_t, mpzspv_t,
 		spv_size_t, mpzv_t, mpzspm_t);
 #define ntt_PolyInvert __ECM(ntt_PolyInvert)
 void	     ntt_PolyInvert (mpzv_t, mpzv_t, spv_size_t, mpzv_t, mpzspm_t);
+#define ntt_MontgomeryMulMod __ECM(ntt_MontgomeryMulMod)
+void  ntt_MontgomeryMulMod (mpzv_t, mpzv_t, mpzv_t, mpzspv_t, mpzspv_t,
+                            spv_size_t, mpzspm_t);
 
 #define PrerevertDivision __ECM(PrerevertDivision)
 int   PrerevertDivision (listz_t, listz_t, listz_t, unsigned int, listz_t,
-			 mpz_t);
+			 mpz_t, unsigned int);
 #define PolyInvert __ECM(PolyInvert)
-void         PolyInvert (listz_t, listz_t, unsigned int, listz_t, mpz_t);
+void         PolyInvert (listz_t, listz_t, unsigned int, listz_t, mpz_t,
+                         unsigned int);
+#define PolyInvertNegacyclic __ECM(PolyInvertNegacyclic)
+int          PolyInvertNegacyclic (listz_t, listz_t, unsigned int, mpz_t,
+                                   mpz_t);
 
 #define RecursiveDivision __ECM(RecursiveDivision)
 void  RecursiveDivision (listz_t, listz_t, listz_t, unsigned int,
@@ -454,10 +510,23 @@ void  RecursiveDivision (listz_t, listz_t, listz_t, unsigned int,
 void polyeval (listz_t, unsigned int, listz_t*, listz_t, mpz_t, unsigned int);
 #define polyeval_tellegen __ECM(polyeval_tellegen)
 int polyeval_tellegen (listz_t, unsigned int, listz_t*, listz_t,
-		       unsigned int, listz_t, mpz_t, char *);
+		       unsigned int, listz_t, mpz_t, treefile_t,
+		       unsigned int);
 #define TUpTree __ECM(TUpTree)
 void TUpTree (listz_t, listz_t *, unsigned int, listz_t, int, unsigned int,
-		mpz_t, FILE *);
+		mpz_t, unsigned int);
+
+/* treefile.c */
+#define treefile_init __ECM(treefile_init)
+int treefile_init (treefile_t, const char *, unsigned long, unsigned int,
+                   mpz_t);
+#define treefile_write __ECM(treefile_write)
+int treefile_write (treefile_t, unsigned int, unsigned long, listz_t,
+                    unsigned long);
+#define treefile_level __ECM(treefile_level)
+listz_t *treefile_level (treefile_t, unsigned int);
+#define treefile_clear __ECM(treefile_clear)
+void treefile_clear (treefile_t);
 
 /* ks-multiply.c */
 #define list_mul_n_basecase __ECM(list_mul_n_basecase)
@@ -478,6 +547,9 @@ unsigned int ks_wrapmul_m (unsigned int, unsigned int, mpz_t);
 #define ks_wrapmul __ECM(ks_wrapmul)
 unsigned int ks_wrapmul (listz_t, unsigned int, listz_t, unsigned int,
                          listz_t, unsigned int, mpz_t);
+#define ks_negacyclicmul __ECM(ks_negacyclicmul)
+void ks_negacyclicmul (listz_t, listz_t, listz_t, unsigned int, mpz_t,
+                       listz_t);
 
 /* mpmod.c */
 /* Define MPRESN_NO_ADJUSTMENT if mpresn_add, mpresn_sub and mpresn_addsub
@@ -579,6 +651,41 @@ void mpresn_add (mpres_t, const mpres_t, const mpres_t, mpmod_t);
 void mpresn_sub (mpres_t, const mpres_t, const mpres_t, mpmod_t);
 #define mpresn_mul_1 __ECM(mpresn_mul_ui)
 void mpresn_mul_1 (mpres_t, const mpres_t, const mp_limb_t, mpmod_t);
+#define mpresf_init __ECM(mpresf_init)
+void mpresf_init (mpresf_t *, unsigned int, const mpmod_t);
+#define mpresf_clear __ECM(mpresf_clear)
+void mpresf_clear (mpresf_t *, const mpmod_t);
+#define mpresf_set_mpres __ECM(mpresf_set_mpres)
+void mpresf_set_mpres (mpresf_t, const mpres_t, mpmod_t);
+#define mpres_set_mpresf __ECM(mpres_set_mpresf)
+void mpres_set_mpresf (mpres_t, const mpresf_t, const mpmod_t);
+#define mpresf_mul __ECM(mpresf_mul)
+void mpresf_mul (mpresf_t, const mpresf_t, const mpresf_t, mpmod_t);
+#define mpresf_sqr __ECM(mpresf_sqr)
+void mpresf_sqr (mpresf_t, const mpresf_t, mpmod_t);
+#define mpresf_add __ECM(mpresf_add)
+void mpresf_add (mpresf_t, const mpresf_t, const mpresf_t, const mpmod_t);
+#define mpresf_sub __ECM(mpresf_sub)
+void mpresf_sub (mpresf_t, const mpresf_t, const mpresf_t, const mpmod_t);
+#define mpresf_addsub __ECM(mpresf_addsub)
+void mpresf_addsub (mpresf_t, mpresf_t, const mpresf_t, const mpresf_t,
+                    mpmod_t);
+#define mpresf_mul_ui __ECM(mpresf_mul_ui)
+void mpresf_mul_ui (mpresf_t, const mpresf_t, const unsigned long,
+                    const mpmod_t);
+#define mpresf_div_2exp __ECM(mpresf_div_2exp)
+void mpresf_div_2exp (mpresf_t, const mpresf_t, const unsigned int,
+                      const mpmod_t);
+#define mpresf_invert __ECM(mpresf_invert)
+int  mpresf_invert (mpresf_t, const mpresf_t, mpmod_t);
+#define mpresf_gcd __ECM(mpresf_gcd)
+void mpresf_gcd (mpz_t, const mpresf_t, const mpmod_t);
+#define mpresf_is_zero __ECM(mpresf_is_zero)
+int  mpresf_is_zero (const mpresf_t, const mpmod_t);
+#define mpresf_set(a,b,n) mpn_copyi (a, b, mpz_size ((n)->orig_modulus))
+/* exchanges the pointers a and b, not the limbs they point to */
+#define mpresf_swap(a,b,n) \
+  do { mpresf_t __t = (a); (a) = (b); (b) = __t; } while (0)
 
 /* mul_lo.c */
 #define ecm_mul_lo_n __ECM(ecm_mul_lo_n)
@@ -586,13 +693,28 @@ void ecm_mul_lo_n (mp_ptr, mp_srcptr, mp_srcptr, mp_size_t);
 #define ecm_mul_lo_basecase __ECM(ecm_mul_lo_basecase)
 void ecm_mul_lo_basecase (mp_ptr, mp_srcptr, mp_srcptr, mp_size_t);
 	
+/* tune_profile.c */
+#define tune_cpu_model __ECM(tune_cpu_model)
+void tune_cpu_model (char *, size_t);
+#define tune_profile_read __ECM(tune_profile_read)
+int tune_profile_read (ecm_tune_params_t *, const char *, FILE *);
+#define tune_profile_write __ECM(tune_profile_write)
+int tune_profile_write (const ecm_tune_params_t *, const char *, FILE *);
+#define tune_profile_load __ECM(tune_profile_load)
+int tune_profile_load (const char *, FILE *);
+
+/* fat.c */
+#define fat_tune_params __ECM(fat_tune_params)
+const ecm_tune_params_t *fat_tune_params (void);
+
 /* median.c */
 #define TMulGen __ECM(TMulGen)
 int
 TMulGen (listz_t, unsigned int, listz_t, unsigned int, listz_t, 
-         unsigned int, listz_t, mpz_t);
+         unsigned int, listz_t, mpz_t, unsigned int);
 #define TMulGen_space __ECM(TMulGen_space)
-unsigned int TMulGen_space (unsigned int, unsigned int, unsigned int);
+unsigned int TMulGen_space (unsigned int, unsigned int, unsigned int,
+                            unsigned int);
 
 /* schoen_strass.c */
 #define DEFAULT 0
@@ -604,8 +726,6 @@ unsigned int F_mul (mpz_t *, mpz_t *, mpz_t *, unsigned int, int,
 #define F_mul_trans __ECM(F_mul_trans)
 unsigned int F_mul_trans (mpz_t *, mpz_t *, mpz_t *, unsigned int,
                           unsigned int, unsigned int, mpz_t *);
-#define F_clear __ECM(F_clear)
-void F_clear ();
 
 /* rho.c */
 #define rhoinit __ECM(rhoinit)
@@ -633,10 +753,18 @@ long         elltime    (long, long);
 int          test_verbose (int);
 #define set_verbose __ECM(set_verbose)
 void         set_verbose (int);
+#define get_verbose __ECM(get_verbose)
+int          get_verbose (void);
 #define outputf __ECM(outputf)
 int          outputf (int, const char *, ...);
 #define writechkfile __ECM(writechkfile)
 void writechkfile (char *, int, double, mpmod_t, mpres_t, mpres_t, mpres_t, mpres_t);
+#define writechkfile_fs2 __ECM(writechkfile_fs2)
+void writechkfile_fs2 (const faststage2_param_t *, int, unsigned long,
+                       mpmod_t, const mpres_t);
+#define writechkfile_batch __ECM(writechkfile_batch)
+void writechkfile_batch (char *, double, mpmod_t, mpres_t, int, double,
+                         unsigned long, mpres_t, mpres_t, mpres_t, mpres_t);
 #define aux_fseek64 __ECM(aux_fseek64)
 int aux_fseek64(FILE *, const int64_t, const int);
 #define ecm_tstbit __ECM(ecm_tstbit)
@@ -657,6 +785,8 @@ unsigned long gcd (unsigned long, unsigned long);
 unsigned long eulerphi (unsigned long);
 #define ceil_log2 __ECM(ceil_log2)
 unsigned int  ceil_log2  (unsigned long);
+#define ntt_floor_len __ECM(ntt_floor_len)
+unsigned long ntt_floor_len (unsigned long);
 #define find_factor __ECM(find_factor)
 unsigned long find_factor (const unsigned long);
 
@@ -678,10 +808,42 @@ int  gw_ecm_stage1 (mpz_t, curve *, mpmod_t, double, double *, mpz_t,
 
 /* batch.c */
 #define compute_s  __ECM(compute_s )
-void compute_s (mpz_t, ecm_uint, int *);
+void compute_s (mpz_t, ecm_uint, int *, unsigned int);
+#define batch_s_acquire  __ECM(batch_s_acquire)
+mpz_srcptr batch_s_acquire (mpz_srcptr *, double, int *, unsigned int);
+#define batch_s_insert  __ECM(batch_s_insert)
+void batch_s_insert (mpz_srcptr *, double, mpz_t);
+#define batch_s_release  __ECM(batch_s_release)
+void batch_s_release (mpz_srcptr *);
 #define ecm_stage1_batch  __ECM(ecm_stage1_batch)
 int ecm_stage1_batch (mpz_t, mpres_t, mpres_t, mpmod_t, double, double *, 
-                                                                int,  mpz_t);
+                      int, mpz_t, int (*)(void), char *, unsigned long,
+                      mpz_t);
+#define cpu_ecm_stage1  __ECM(cpu_ecm_stage1)
+int cpu_ecm_stage1 (mpz_t *, int *, mpz_t, mpz_t, unsigned int, unsigned int);
+
+/* lanes.c */
+/* number of curves whose residues are interleaved in a block */
+#define ECM_BATCH_LANES 8
+#define mulredc_lanes  __ECM(mulredc_lanes)
+void mulredc_lanes (mp_limb_t *, const mp_limb_t *, const mp_limb_t *,
+                    mp_srcptr, mp_size_t, mp_limb_t, mp_limb_t *);
+#define sqrredc_lanes  __ECM(sqrredc_lanes)
+void sqrredc_lanes (mp_limb_t *, const mp_limb_t *, mp_srcptr, mp_size_t,
+                    mp_limb_t, mp_limb_t *);
+#define mulredc_1_lanes  __ECM(mulredc_1_lanes)
+void mulredc_1_lanes (mp_limb_t *, const mp_limb_t *, const mp_limb_t *,
+                      mp_srcptr, mp_size_t, mp_limb_t, mp_limb_t *);
+#define addmod_lanes  __ECM(addmod_lanes)
+void addmod_lanes (mp_limb_t *, const mp_limb_t *, const mp_limb_t *,
+                   mp_srcptr, mp_size_t, mp_limb_t *);
+#define submod_lanes  __ECM(submod_lanes)
+void submod_lanes (mp_limb_t *, const mp_limb_t *, const mp_limb_t *,
+                   mp_srcptr, mp_size_t);
+#define mpz_to_lane  __ECM(mpz_to_lane)
+void mpz_to_lane (mp_limb_t *, unsigned int, mpz_t, mp_size_t);
+#define lane_to_mpz  __ECM(lane_to_mpz)
+void lane_to_mpz (mpz_t, const mp_limb_t *, unsigned int, mp_size_t);
 
 /* parametrizations.c */
 #define get_curve_from_random_parameter __ECM(get_curve_from_random_parameter)
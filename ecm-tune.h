@@ -0,0 +1,86 @@
+/* ecm-tune.h - tuning parameters of libecm, read at run time.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Every parameter set by a params.h file is a field of __ecm_tune_params.
+   tune_profile.c initializes it from ecm-params.h (or from the set fat.c
+   chooses for the cpu in a fat build) and from the tuning profile named by
+   the ECM_TUNE_PROFILE environment variable, if any. Outside of the tune
+   program, the macros below keep the names used by the rest of the code. */
+
+#ifndef _ECM_TUNE_H
+#define _ECM_TUNE_H
+
+#include <stddef.h> /* for size_t */
+
+typedef struct
+{
+  const char *name;          /* where the values come from */
+  int mulredc_table[21];     /* TUNE_MULREDC_TABLE */
+  int sqrredc_table[21];     /* TUNE_SQRREDC_TABLE */
+  int list_mul_table[32];    /* LIST_MUL_TABLE */
+  size_t mul_lo_table[32];   /* MPN_MUL_LO_THRESHOLD_TABLE */
+  size_t mpzmod_threshold;
+  size_t redc_threshold;
+  size_t ntt_gfp_twiddle_dif_breakover;
+  size_t ntt_gfp_twiddle_dit_breakover;
+  size_t ntt_gfp_block_breakover;
+  size_t mul_ntt_threshold;
+  size_t prerevertdivision_ntt_threshold;
+  size_t montgomery_reduce_ntt_threshold;
+  size_t polyinvert_ntt_threshold;
+  size_t polyevalt_ntt_threshold;
+  size_t mpzspv_normalise_stride;
+} ecm_tune_params_t;
+
+/* initializer from the macros of a params.h file */
+#define ECM_TUNE_PARAMS(name)                                           \
+  { name, TUNE_MULREDC_TABLE, TUNE_SQRREDC_TABLE, LIST_MUL_TABLE,       \
+    MPN_MUL_LO_THRESHOLD_TABLE, MPZMOD_THRESHOLD, REDC_THRESHOLD,       \
+    NTT_GFP_TWIDDLE_DIF_BREAKOVER, NTT_GFP_TWIDDLE_DIT_BREAKOVER,       \
+    NTT_GFP_BLOCK_BREAKOVER, MUL_NTT_THRESHOLD,                         \
+    PREREVERTDIVISION_NTT_THRESHOLD, MONTGOMERY_REDUCE_NTT_THRESHOLD,   \
+    POLYINVERT_NTT_THRESHOLD, POLYEVALT_NTT_THRESHOLD,                  \
+    MPZSPV_NORMALISE_STRIDE }
+
+extern ecm_tune_params_t __ecm_tune_params;
+
+#endif /* _ECM_TUNE_H */
+
+/* tune has its own variables, tune_profile.c and fat.c include params.h
+   files themselves */
+#if !defined (TUNE) && !defined (ECM_TUNE_NO_ALIASES)
+#define ECM_TUNE_CASE (__ecm_tune_params.name)
+#define MPZMOD_THRESHOLD (__ecm_tune_params.mpzmod_threshold)
+#define REDC_THRESHOLD (__ecm_tune_params.redc_threshold)
+#define NTT_GFP_TWIDDLE_DIF_BREAKOVER \
+  (__ecm_tune_params.ntt_gfp_twiddle_dif_breakover)
+#define NTT_GFP_TWIDDLE_DIT_BREAKOVER \
+  (__ecm_tune_params.ntt_gfp_twiddle_dit_breakover)
+#define NTT_GFP_BLOCK_BREAKOVER (__ecm_tune_params.ntt_gfp_block_breakover)
+#define MUL_NTT_THRESHOLD (__ecm_tune_params.mul_ntt_threshold)
+#define PREREVERTDIVISION_NTT_THRESHOLD \
+  (__ecm_tune_params.prerevertdivision_ntt_threshold)
+#define MONTGOMERY_REDUCE_NTT_THRESHOLD \
+  (__ecm_tune_params.montgomery_reduce_ntt_threshold)
+#define POLYINVERT_NTT_THRESHOLD (__ecm_tune_params.polyinvert_ntt_threshold)
+#define POLYEVALT_NTT_THRESHOLD (__ecm_tune_params.polyevalt_ntt_threshold)
+#define MPZSPV_NORMALISE_STRIDE (__ecm_tune_params.mpzspv_normalise_stride)
+#endif
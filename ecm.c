@@ -59,10 +59,11 @@ extern int mpzspv_from_mpzv_slow_time, mpzspv_to_mpzv_time,
 *                                                                             *
 ******************************************************************************/
 
-void duplicate (mpres_t, mpres_t, mpres_t, mpres_t, mpmod_t, mpres_t, 
-                mpres_t, mpres_t, mpres_t) ATTRIBUTE_HOT;
-void add3 (mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, mpres_t, 
-           mpres_t, mpmod_t, mpres_t, mpres_t, mpres_t) ATTRIBUTE_HOT;
+void duplicate (mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpmod_t, mpresf_t, 
+                mpresf_t, mpresf_t, mpresf_t) ATTRIBUTE_HOT;
+void add3 (mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpresf_t, mpresf_t,
+           mpresf_t, mpresf_t, mpmod_t, mpresf_t, mpresf_t,
+           mpresf_t) ATTRIBUTE_HOT;
 
 #define mpz_mulmod5(r,s1,s2,m,t) { mpz_mul(t,s1,s2); mpz_mod(r, t, m); }
 
@@ -125,37 +126,39 @@ montgomery_to_weierstrass (mpz_t f, mpres_t x, mpres_t y, mpres_t A, mpmod_t n)
    (x3,z3) may be identical to (x2,z2) and to (x,z)
 */
 void
-add3 (mpres_t x3, mpres_t z3, mpres_t x2, mpres_t z2, mpres_t x1, mpres_t z1, 
-      mpres_t x, mpres_t z, mpmod_t n, mpres_t u, mpres_t v, mpres_t w)
+add3 (mpresf_t x3, mpresf_t z3, mpresf_t x2, mpresf_t z2, mpresf_t x1,
+      mpresf_t z1, mpresf_t x, mpresf_t z, mpmod_t n, mpresf_t u, mpresf_t v,
+      mpresf_t w)
 {
-  mpres_sub (u, x2, z2, n);
-  mpres_add (v, x1, z1, n);      /* u = x2-z2, v = x1+z1 */
+  mpresf_sub (u, x2, z2, n);
+  mpresf_add (v, x1, z1, n);     /* u = x2-z2, v = x1+z1 */
 
-  mpres_mul (u, u, v, n);        /* u = (x2-z2)*(x1+z1) */
+  mpresf_mul (u, u, v, n);       /* u = (x2-z2)*(x1+z1) */
 
-  mpres_add (w, x2, z2, n);
-  mpres_sub (v, x1, z1, n);      /* w = x2+z2, v = x1-z1 */
+  mpresf_add (w, x2, z2, n);
+  mpresf_sub (v, x1, z1, n);     /* w = x2+z2, v = x1-z1 */
 
-  mpres_mul (v, w, v, n);        /* v = (x2+z2)*(x1-z1) */
+  mpresf_mul (v, w, v, n);       /* v = (x2+z2)*(x1-z1) */
 
-  mpres_add (w, u, v, n);        /* w = 2*(x1*x2-z1*z2) */
-  mpres_sub (v, u, v, n);        /* v = 2*(x2*z1-x1*z2) */
+  mpresf_addsub (w, v, u, v, n); /* w = 2*(x1*x2-z1*z2),
+                                    v = 2*(x2*z1-x1*z2) */
 
-  mpres_sqr (w, w, n);           /* w = 4*(x1*x2-z1*z2)^2 */
-  mpres_sqr (v, v, n);           /* v = 4*(x2*z1-x1*z2)^2 */
+  mpresf_sqr (w, w, n);          /* w = 4*(x1*x2-z1*z2)^2 */
+  mpresf_sqr (v, v, n);          /* v = 4*(x2*z1-x1*z2)^2 */
 
   if (x == x3) /* same variable: in-place variant */
     {
-      /* x3 <- w * z mod n
-	 z3 <- x * v mod n */
-      mpres_mul (z3, w, z, n);
-      mpres_mul (x3, x, v, n);
-      mpres_swap (x3, z3, n);
+      /* u <- w * z mod n
+	 z3 <- x * v mod n
+         x3 <- u */
+      mpresf_mul (u, w, z, n);
+      mpresf_mul (z3, x, v, n);
+      mpresf_set (x3, u, n);
     }
   else
     {
-      mpres_mul (x3, w, z, n);   /* x3 = 4*z*(x1*x2-z1*z2)^2 mod n */
-      mpres_mul (z3, x, v, n);   /* z3 = 4*x*(x2*z1-x1*z2)^2 mod n */
+      mpresf_mul (x3, w, z, n);  /* x3 = 4*z*(x1*x2-z1*z2)^2 mod n */
+      mpresf_mul (z3, x, v, n);  /* z3 = 4*x*(x2*z1-x1*z2)^2 mod n */
     }
   /* mul += 6; */
 }
@@ -167,18 +170,17 @@ add3 (mpres_t x3, mpres_t z3, mpres_t x2, mpres_t z2, mpres_t x1, mpres_t z1,
      - t, u, v, w : auxiliary variables
 */
 void
-duplicate (mpres_t x2, mpres_t z2, mpres_t x1, mpres_t z1, mpmod_t n, 
-           mpres_t b, mpres_t u, mpres_t v, mpres_t w)
+duplicate (mpresf_t x2, mpresf_t z2, mpresf_t x1, mpresf_t z1, mpmod_t n, 
+           mpresf_t b, mpresf_t u, mpresf_t v, mpresf_t w)
 {
-  mpres_add (u, x1, z1, n);
-  mpres_sqr (u, u, n);      /* u = (x1+z1)^2 mod n */
-  mpres_sub (v, x1, z1, n);
-  mpres_sqr (v, v, n);      /* v = (x1-z1)^2 mod n */
-  mpres_mul (x2, u, v, n);  /* x2 = u*v = (x1^2 - z1^2)^2 mod n */
-  mpres_sub (w, u, v, n);   /* w = u-v = 4*x1*z1 */
-  mpres_mul (u, w, b, n);   /* u = w*b = ((A+2)/4*(4*x1*z1)) mod n */
-  mpres_add (u, u, v, n);   /* u = (x1-z1)^2+(A+2)/4*(4*x1*z1) */
-  mpres_mul (z2, w, u, n);  /* z2 = ((4*x1*z1)*((x1-z1)^2+(A+2)/4*(4*x1*z1))) mod n */
+  mpresf_addsub (u, v, x1, z1, n);
+  mpresf_sqr (u, u, n);      /* u = (x1+z1)^2 mod n */
+  mpresf_sqr (v, v, n);      /* v = (x1-z1)^2 mod n */
+  mpresf_mul (x2, u, v, n);  /* x2 = u*v = (x1^2 - z1^2)^2 mod n */
+  mpresf_sub (w, u, v, n);   /* w = u-v = 4*x1*z1 */
+  mpresf_mul (u, w, b, n);   /* u = w*b = ((A+2)/4*(4*x1*z1)) mod n */
+  mpresf_add (u, u, v, n);   /* u = (x1-z1)^2+(A+2)/4*(4*x1*z1) */
+  mpresf_mul (z2, w, u, n);  /* z2 = ((4*x1*z1)*((x1-z1)^2+(A+2)/4*(4*x1*z1))) mod n */
 }
 
 /* multiply P=(x:z) by e and puts the result in (x:z). */
@@ -187,7 +189,7 @@ ecm_mul (mpres_t x, mpres_t z, mpz_t e, mpmod_t n, mpres_t b)
 {
   size_t l;
   int negated = 0;
-  mpres_t x0, z0, x1, z1, u, v, w;
+  mpresf_t t[10], xf, zf, bf, x0, z0, x1, z1, u, v, w;
 
   /* In Montgomery coordinates, the point at infinity is (0::0) */
   if (mpz_sgn (e) == 0)
@@ -208,19 +210,26 @@ ecm_mul (mpres_t x, mpres_t z, mpz_t e, mpmod_t n, mpres_t b)
   if (mpz_cmp_ui (e, 1) == 0)
     goto ecm_mul_end;
 
-  mpres_init (x0, n);
-  mpres_init (z0, n);
-  mpres_init (x1, n);
-  mpres_init (z1, n);
-  mpres_init (u, n);
-  mpres_init (v, n);
-  mpres_init (w, n);
+  mpresf_init (t, 10, n);
+  xf = t[0];
+  zf = t[1];
+  bf = t[2];
+  x0 = t[3];
+  z0 = t[4];
+  x1 = t[5];
+  z1 = t[6];
+  u = t[7];
+  v = t[8];
+  w = t[9];
 
   l = mpz_sizeinbase (e, 2) - 1; /* l >= 1 */
 
-  mpres_set (x0, x, n);
-  mpres_set (z0, z, n);
-  duplicate (x1, z1, x0, z0, n, b, u, v, w);
+  mpresf_set_mpres (xf, x, n);
+  mpresf_set_mpres (zf, z, n);
+  mpresf_set_mpres (bf, b, n);
+  mpresf_set (x0, xf, n);
+  mpresf_set (z0, zf, n);
+  duplicate (x1, z1, x0, z0, n, bf, u, v, w);
 
   /* invariant: (P1,P0) = ((k+1)P, kP) where k = floor(e/2^l) */
 
@@ -228,26 +237,20 @@ ecm_mul (mpres_t x, mpres_t z, mpz_t e, mpmod_t n, mpres_t b)
     {
       if (ecm_tstbit (e, l)) /* k, k+1 -> 2k+1, 2k+2 */
         {
-          add3 (x0, z0, x0, z0, x1, z1, x, z, n, u, v, w); /* 2k+1 */
-          duplicate (x1, z1, x1, z1, n, b, u, v, w); /* 2k+2 */
+          add3 (x0, z0, x0, z0, x1, z1, xf, zf, n, u, v, w); /* 2k+1 */
+          duplicate (x1, z1, x1, z1, n, bf, u, v, w); /* 2k+2 */
         }
       else /* k, k+1 -> 2k, 2k+1 */
         {
-          add3 (x1, z1, x1, z1, x0, z0, x, z, n, u, v, w); /* 2k+1 */
-          duplicate (x0, z0, x0, z0, n, b, u, v, w); /* 2k */
+          add3 (x1, z1, x1, z1, x0, z0, xf, zf, n, u, v, w); /* 2k+1 */
+          duplicate (x0, z0, x0, z0, n, bf, u, v, w); /* 2k */
         }
     }
 
-  mpres_set (x, x0, n);
-  mpres_set (z, z0, n);
+  mpres_set_mpresf (x, x0, n);
+  mpres_set_mpresf (z, z0, n);
 
-  mpres_clear (x0, n);
-  mpres_clear (z0, n);
-  mpres_clear (x1, n);
-  mpres_clear (z1, n);
-  mpres_clear (u, n);
-  mpres_clear (v, n);
-  mpres_clear (w, n);
+  mpresf_clear (t, n);
 
 ecm_mul_end:
 
@@ -351,13 +354,14 @@ lucas_cost (ecm_uint n, double v)
 */
 
 static void
-prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
-      mpres_t u, mpres_t v, mpres_t w, mpres_t xB, mpres_t zB, mpres_t xC, 
-      mpres_t zC, mpres_t xT, mpres_t zT, mpres_t xT2, mpres_t zT2)
+prac (mpresf_t xA, mpresf_t zA, ecm_uint k, mpmod_t n, mpresf_t b,
+      mpresf_t u, mpresf_t v, mpresf_t w, mpresf_t xB, mpresf_t zB,
+      mpresf_t xC, mpresf_t zC, mpresf_t xT, mpresf_t zT, mpresf_t xT2,
+      mpresf_t zT2)
 {
   ecm_uint d, e, r, i = 0, nv;
   double c, cmin;
-  __mpz_struct *tmp;
+  mpresf_t tmp, xA0 = xA, zA0 = zA;
 #define NV 10  
   /* 1/val[0] = the golden ratio (1+sqrt(5))/2, and 1/val[i] for i>0
      is the real number whose continued fraction expansion is all 1s
@@ -393,10 +397,10 @@ prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
   /* first iteration always begins by Condition 3, then a swap */
   d = k - r;
   e = 2 * r - k;
-  mpres_set (xB, xA, n);
-  mpres_set (zB, zA, n); /* B=A */
-  mpres_set (xC, xA, n);
-  mpres_set (zC, zA, n); /* C=A */
+  mpresf_set (xB, xA, n);
+  mpresf_set (zB, zA, n); /* B=A */
+  mpresf_set (xC, xA, n);
+  mpresf_set (zC, zA, n); /* C=A */
   duplicate (xA, zA, xA, zA, n, b, u, v, w); /* A = 2*A */
   while (d != e)
     {
@@ -405,8 +409,8 @@ prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
           r = d;
           d = e;
           e = r;
-          mpres_swap (xA, xB, n);
-          mpres_swap (zA, zB, n);
+          mpresf_swap (xA, xB, n);
+          mpresf_swap (zA, zB, n);
         }
       /* do the first line of Table 4 whose condition qualifies */
       if (d - e <= e / 4 && ((d + e) % 3) == 0)
@@ -416,8 +420,8 @@ prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
           add3 (xT, zT, xA, zA, xB, zB, xC, zC, n, u, v, w); /* T = f(A,B,C) */
           add3 (xT2, zT2, xT, zT, xA, zA, xB, zB, n, u, v, w); /* T2 = f(T,A,B) */
           add3 (xB, zB, xB, zB, xT, zT, xA, zA, n, u, v, w); /* B = f(B,T,A) */
-          mpres_swap (xA, xT2, n);
-          mpres_swap (zA, zT2, n); /* swap A and T2 */
+          mpresf_swap (xA, xT2, n);
+          mpresf_swap (zA, zT2, n); /* swap A and T2 */
         }
       else if (d - e <= e / 4 && (d - e) % 6 == 0)
         { /* condition 2 */
@@ -483,8 +487,8 @@ prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
           d = (d - e) / 3;
           add3 (xT, zT, xA, zA, xB, zB, xC, zC, n, u, v, w); /* T = f(A,B,C) */
           add3 (xC, zC, xC, zC, xA, zA, xB, zB, n, u, v, w); /* C = f(A,C,B) */
-          mpres_swap (xB, xT, n);
-          mpres_swap (zB, zT, n); /* swap B and T */
+          mpresf_swap (xB, xT, n);
+          mpresf_swap (zB, zT, n); /* swap B and T */
           duplicate (xT, zT, xA, zA, n, b, u, v, w);
           add3 (xA, zA, xA, zA, xT, zT, xA, zA, n, u, v, w); /* A = 3*A */
         }
@@ -498,6 +502,14 @@ prac (mpres_t xA, mpres_t zA, ecm_uint k, mpmod_t n, mpres_t b,
   
   add3 (xA, zA, xA, zA, xB, zB, xC, zC, n, u, v, w);
 
+  /* the swaps above exchange pointers, thus the result may be in another
+     variable than the one given by the caller */
+  if (xA != xA0)
+    {
+      mpresf_set (xA0, xA, n);
+      mpresf_set (zA0, zA, n);
+    }
+
   ASSERT(d == 1);
 }
 
@@ -520,7 +532,8 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
             double *B1done, mpz_t go, int (*stop_asap)(void), 
             char *chkfilename)
 {
-  mpres_t b, z, u, v, w, xB, zB, xC, zC, xT, zT, xT2, zT2;
+  mpres_t b, z;
+  mpresf_t t[14], xf, zf, bf, u, v, w, xB, zB, xC, zC, xT, zT, xT2, zT2;
   uint64_t p, r, last_chkpnt_p;
   int ret = ECM_NO_FACTOR_FOUND;
   long last_chkpnt_time;
@@ -530,17 +543,21 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
 
   mpres_init (b, n);
   mpres_init (z, n);
-  mpres_init (u, n);
-  mpres_init (v, n);
-  mpres_init (w, n);
-  mpres_init (xB, n);
-  mpres_init (zB, n);
-  mpres_init (xC, n);
-  mpres_init (zC, n);
-  mpres_init (xT, n);
-  mpres_init (zT, n);
-  mpres_init (xT2, n);
-  mpres_init (zT2, n);
+  mpresf_init (t, 14, n);
+  xf = t[0];
+  zf = t[1];
+  bf = t[2];
+  u = t[3];
+  v = t[4];
+  w = t[5];
+  xB = t[6];
+  zB = t[7];
+  xC = t[8];
+  zC = t[9];
+  xT = t[10];
+  zT = t[11];
+  xT2 = t[12];
+  zT2 = t[13];
   
   last_chkpnt_time = cputime ();
 
@@ -553,17 +570,23 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
   if (go != NULL)
     ecm_mul (x, z, go, n, b);
 
+  /* the point and b as fixed-size residues, which avoid the mpz_t overhead
+     in the loop below */
+  mpresf_set_mpres (xf, x, n);
+  mpresf_set_mpres (zf, z, n);
+  mpresf_set_mpres (bf, b, n);
+
   /* prac() wants multiplicands > 2 */
   for (r = 2; r <= B1; r *= 2)
     if (r > *B1done)
-      duplicate (x, z, x, z, n, b, u, v, w);
+      duplicate (xf, zf, xf, zf, n, bf, u, v, w);
   
   /* We'll do 3 manually, too (that's what ecm4 did..) */
   for (r = 3; r <= B1; r *= 3)
     if (r > *B1done)
       {
-        duplicate (xB, zB, x, z, n, b, u, v, w);
-        add3 (x, z, x, z, xB, zB, x, z, n, u, v, w);
+        duplicate (xB, zB, xf, zf, n, bf, u, v, w);
+        add3 (xf, zf, xf, zf, xB, zB, xf, zf, n, u, v, w);
       }
   
   last_chkpnt_p = 3;
@@ -572,10 +595,10 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
     {
       for (r = p; r <= B1; r *= p)
 	if (r > *B1done)
-	  prac (x, z, (ecm_uint) p, n, b, u, v, w, xB, zB, xC, zC, xT,
+	  prac (xf, zf, (ecm_uint) p, n, bf, u, v, w, xB, zB, xC, zC, xT,
 		zT, xT2, zT2);
 
-      if (mpres_is_zero (z, n))
+      if (mpresf_is_zero (zf, n))
         {
           outputf (OUTPUT_VERBOSE, "Reached point at infinity, %.0f divides "
                    "group orders\n", p);
@@ -591,6 +614,8 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
       if (chkfilename != NULL && p > last_chkpnt_p + 10000 && 
           elltime (last_chkpnt_time, cputime ()) > CHKPNT_PERIOD)
         {
+          mpres_set_mpresf (x, xf, n);
+          mpres_set_mpresf (z, zf, n);
 	  writechkfile (chkfilename, ECM_ECM, MAX(p, *B1done), n, A, x, NULL, z);
           last_chkpnt_p = p;
           last_chkpnt_time = cputime ();
@@ -606,28 +631,23 @@ ecm_stage1 (mpz_t f, mpres_t x, mpres_t A, mpmod_t n, double B1,
       *B1done = p;
 
   if (chkfilename != NULL)
-    writechkfile (chkfilename, ECM_ECM, *B1done, n, A, x, NULL, z);
+    {
+      mpres_set_mpresf (x, xf, n);
+      mpres_set_mpresf (z, zf, n);
+      writechkfile (chkfilename, ECM_ECM, *B1done, n, A, x, NULL, z);
+    }
 
   prime_info_clear (prime_info);
 
-  if (!mpres_invert (u, z, n)) /* Factor found? */
+  if (!mpresf_invert (u, zf, n)) /* Factor found? */
     {
-      mpres_gcd (f, z, n);
+      mpresf_gcd (f, zf, n);
       ret = ECM_FACTOR_FOUND_STEP1;
     }
-  mpres_mul (x, x, u, n);
-
-  mpres_clear (zT2, n);
-  mpres_clear (xT2, n);
-  mpres_clear (zT, n);
-  mpres_clear (xT, n);
-  mpres_clear (zC, n);
-  mpres_clear (xC, n);
-  mpres_clear (zB, n);
-  mpres_clear (xB, n);
-  mpres_clear (w, n);
-  mpres_clear (v, n);
-  mpres_clear (u, n);
+  mpresf_mul (xf, xf, u, n);
+  mpres_set_mpresf (x, xf, n);
+
+  mpresf_clear (t, n);
   mpres_clear (z, n);
   mpres_clear (b, n);
 
@@ -1020,14 +1040,34 @@ print_B1_B2_poly (int verbosity, int method, double B1, double B1done,
   }
 }
 
-/* Compute parameters for stage 2 */
+/* The polynomial continuation has a large fixed cost (product tree,
+   inverse of F, transforms), the standard continuation a cost about
+   proportional to the number of primes in ]B2min, B2]. */
+static int
+choose_stage2_engine (mpz_t B2min, mpz_t B2, mpmod_t modulus)
+{
+  double cost = ecm_stage2_sc_cost (B2min, B2, modulus);
+
+  return (cost >= 0. && cost < ECM_STAGE2_SC_MULS) ? ECM_STAGE2_SC
+                                                    : ECM_STAGE2_POLY;
+}
+
+/* Compute parameters for stage 2. If *engine is ECM_STAGE2_DEFAULT, it is
+   set to the stage 2 algorithm to use: the polynomial continuation if S,
+   *k or TreeFilename was given, since only it uses them. With
+   ECM_STAGE2_SC, only B2 (the effective B2' of the polynomial
+   continuation) and B2min are set, and root_params->S is 0 since the
+   standard continuation has no Brent-Suyama extension. */
 int
 set_stage_2_params (mpz_t B2, mpz_t B2_parm, mpz_t B2min, mpz_t B2min_parm, 
                     root_params_t *root_params, double B1,
-                    unsigned long *k, const int S, int use_ntt, int *po2,
+                    unsigned long *k, const int S, int use_ntt, int *engine,
+                    int *po2,
                     unsigned long *dF, char *TreeFilename, double maxmem, 
                     int Fermat, mpmod_t modulus)
 {
+  const unsigned long k_parm = *k;
+
   mpz_set (B2min, B2min_parm);
   mpz_set (B2, B2_parm);
   
@@ -1065,6 +1105,26 @@ set_stage_2_params (mpz_t B2, mpz_t B2_parm, mpz_t B2min, mpz_t B2min_parm,
              (TreeFilename != NULL), modulus) == ECM_ERROR)
     return ECM_ERROR;
 
+  /* The standard continuation covers the same range [B2min, B2'] */
+  if (*engine == ECM_STAGE2_DEFAULT)
+    *engine = (S != ECM_DEFAULT_S || k_parm != ECM_DEFAULT_K
+               || TreeFilename != NULL) ? ECM_STAGE2_POLY
+      : choose_stage2_engine (B2min, B2, modulus);
+  if (*engine == ECM_STAGE2_SC)
+    {
+      if (ecm_stage2_sc_cost (B2min, B2, modulus) < 0.)
+        {
+          outputf (OUTPUT_ERROR, "Error, B2 is too large for the standard "
+                   "continuation\n");
+          return ECM_ERROR;
+        }
+      root_params->d1 = root_params->d2 = 0;
+      mpz_set_ui (root_params->i0, 0);
+      root_params->S = 0;
+      *dF = *k = 0;
+      return ECM_NO_FACTOR_FOUND;
+    }
+
   /* Set default degree for Brent-Suyama extension */
   /* We try to keep the time used by the Brent-Suyama extension
      at about 10% of the stage 2 time */
@@ -1108,6 +1168,11 @@ set_stage_2_params (mpz_t B2, mpz_t B2_parm, mpz_t B2min, mpz_t B2min_parm,
 	  Etype
 	  zE is a curve that is used when a special torsion group was used; in
 	    that case, (x, y) must be a point on E.
+	  ladder_bits, ladder_x2 and ladder_B1 are the ladder of the batch
+	    stage 1 read from a checkpoint (see ecm_stage1_batch), with x the
+	    x-coordinate of its first point; ladder_bits is 0 if none.
+	  batch_s_threads is the number of threads used to compute the batch
+	    exponent s, if it is not in the cache.
    Output: f is the factor found.
    Return value: ECM_FACTOR_FOUND_STEPn if a factor was found,
                  ECM_NO_FACTOR_FOUND if no factor was found,
@@ -1122,8 +1187,10 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
      FILE *os, FILE* es, char *chkfilename, char
      *TreeFilename, double maxmem, double stage1time, gmp_randstate_t rng, int
      (*stop_asap)(void), mpz_t batch_s, double *batch_last_B1_used,
-     ATTRIBUTE_UNUSED double gw_k, ATTRIBUTE_UNUSED unsigned long gw_b,
-     ATTRIBUTE_UNUSED unsigned long gw_n, ATTRIBUTE_UNUSED signed long gw_c)
+     mpz_srcptr *batch_s_shared, unsigned long ladder_bits, mpz_t ladder_x2,
+     double ladder_B1, unsigned int stage2_threads,
+     unsigned int batch_s_threads, int stage2_engine, ATTRIBUTE_UNUSED double gw_k,
+     ATTRIBUTE_UNUSED unsigned long gw_b, ATTRIBUTE_UNUSED unsigned long gw_n, ATTRIBUTE_UNUSED signed long gw_c)
 {
   int youpi = ECM_NO_FACTOR_FOUND;
   int base2 = 0;  /* If n is of form 2^n[+-]1, set base to [+-]n */
@@ -1137,6 +1204,7 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
   ell_point_t PE;
 #endif
   mpz_t B2min, B2; /* Local B2, B2min to avoid changing caller's values */
+  mpz_t B2eff; /* Effective B2' of stage 2, B2 may be the user's B2 */
   unsigned long dF;
   root_params_t root_params;
 
@@ -1179,7 +1247,14 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
   /* In batch mode, 
         we force repr=MODMULN, 
         B1done should be either the default value or greater than B1 
-        x should be either 0 (undetermined) or 2 */
+        x should be either 0 (undetermined) or 2,
+     except for the ladder of a checkpoint */
+  if (ladder_bits > 0 && !IS_BATCH_MODE(param))
+    {
+      outputf (OUTPUT_ERROR, "Error, the stage 1 of the checkpoint needs "
+               "a batch parametrization\n");
+      return ECM_ERROR;
+    }
   if (IS_BATCH_MODE(param))
     {
       if (repr != ECM_MOD_MODMULN)
@@ -1196,7 +1271,16 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
           return ECM_ERROR;
         }
 
-      if (sigma_is_A >= 0 && mpz_sgn (x) != 0 && mpz_cmp_ui (x, 2) != 0)
+      if (ladder_bits > 0 && (!ECM_IS_DEFAULT_B1_DONE(*B1done) ||
+                              ladder_B1 != B1))
+        {
+          outputf (OUTPUT_ERROR, "Error, the stage 1 of the checkpoint can "
+                   "only be resumed with B1=%1.0f\n", ladder_B1);
+          return ECM_ERROR;
+        }
+
+      if (sigma_is_A >= 0 && mpz_sgn (x) != 0 && mpz_cmp_ui (x, 2) != 0 &&
+          ladder_bits == 0)
         {
           if (ECM_IS_DEFAULT_B1_DONE(*B1done))
             {
@@ -1230,19 +1314,12 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
       exit (EXIT_FAILURE);
     }
 
-  /* Compute s for the batch mode */
+  /* Get s for the batch mode from the process-wide cache, unless the caller
+     gave it in batch_s */
   if (IS_BATCH_MODE(param) && ECM_IS_DEFAULT_B1_DONE(*B1done) &&
       (B1 != *batch_last_B1_used || mpz_cmp_ui (batch_s, 1) <= 0))
-    {
-      *batch_last_B1_used = B1;
-
-      st = cputime ();
-      /* construct the batch exponent */
-      compute_s (batch_s, B1, NULL);
-      outputf (OUTPUT_VERBOSE, "Computing batch product (of %" PRIu64
-                               " bits) of primes up to B1=%1.0f took %ldms\n",
-                               mpz_sizeinbase (batch_s, 2), B1, cputime () - st);
-    }
+    batch_s = (mpz_ptr) batch_s_acquire (batch_s_shared, B1, NULL,
+                                          batch_s_threads);
 
   st = cputime ();
 
@@ -1275,9 +1352,11 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
 
   mpz_init (B2);
   mpz_init (B2min);
+  mpz_init (B2eff);
   youpi = set_stage_2_params (B2, B2_parm, B2min, B2min_parm,
-			      &root_params, B1, &k, S, use_ntt,
+			      &root_params, B1, &k, S, use_ntt, &stage2_engine,
 			      &po2, &dF, TreeFilename, maxmem, Fermat,modulus);
+  mpz_set (B2eff, B2);
 
   /* if the user gave B2, print that B2 on the Using B1=..., B2=... line */
   if(!ECM_IS_DEFAULT_B2(B2_parm))
@@ -1359,8 +1438,9 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
   outputf (OUTPUT_VERBOSE, "b2=%1.0f, dF=%lu, k=%lu, d=%lu, d2=%lu, i0=%Zd\n", 
            b2, dF, k, root_params.d1, root_params.d2, root_params.i0);
 #else
-  outputf (OUTPUT_VERBOSE, "dF=%lu, k=%lu, d=%lu, d2=%lu, i0=%Zd\n", 
-           dF, k, root_params.d1, root_params.d2, root_params.i0);
+  if (stage2_engine != ECM_STAGE2_SC)
+    outputf (OUTPUT_VERBOSE, "dF=%lu, k=%lu, d=%lu, d2=%lu, i0=%Zd\n", 
+             dF, k, root_params.d1, root_params.d2, root_params.i0);
 #endif
 
   if (sigma_is_A == -1) /* Weierstrass or Hessian form. 
@@ -1448,9 +1528,10 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
   if (B1 > *B1done || mpz_cmp_ui (go, 1) > 0)
     {
         if (IS_BATCH_MODE(param))
-        /* FIXME: go, stop_asap and chkfilename are ignored in batch mode */
+        /* FIXME: go is ignored in batch mode */
 	    youpi = ecm_stage1_batch (f, P.x, P.A, modulus, B1, B1done, 
-				      param, batch_s);
+				      param, batch_s, stop_asap, chkfilename,
+                                      ladder_bits, ladder_x2);
         else{
 #ifdef HAVE_ADDLAWS
 	    if(E->type == ECM_EC_TYPE_MONTGOMERY)
@@ -1607,8 +1688,13 @@ ecm (mpz_t f, mpz_t x, mpz_t y, int param, mpz_t sigma, mpz_t n, mpz_t go,
   P.disc = 0; /* FIXME: should disappear one day */
   
   if (youpi == ECM_NO_FACTOR_FOUND && mpz_cmp (B2, B2min) >= 0)
-    youpi = stage2 (f, &P, modulus, dF, k, &root_params, use_ntt, 
-                    TreeFilename, stop_asap);
+    {
+      if (stage2_engine == ECM_STAGE2_SC)
+        youpi = ecm_stage2_sc (f, &P, B2min, B2eff, modulus, stop_asap);
+      else
+        youpi = stage2 (f, &P, modulus, dF, k, &root_params, use_ntt,
+                        TreeFilename, stage2_threads, stop_asap);
+    }
 #ifdef TIMING_CRT
   printf ("mpzspv_from_mpzv_slow: %dms\n", mpzspv_from_mpzv_slow_time);
   printf ("mpzspv_to_mpzv: %dms\n", mpzspv_to_mpzv_time);
@@ -1625,7 +1711,6 @@ end_of_ecm_rhotable:
             print_exptime (B1, B2, dF, k, root_params.S, 
                            (long) (stage1time * 1000.) + 
                            elltime (st, cputime ()), param);
-          rhoinit (1, 0); /* Free memory of rhotable */
         }
     }
 
@@ -1639,6 +1724,7 @@ end_of_ecm:
   mpz_clear (root_params.i0);
   mpz_clear (B2);
   mpz_clear (B2min);
+  mpz_clear (B2eff);
   mpmod_clear (modulus);
   return youpi;
 }
@@ -22,7 +22,9 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "ecm-impl.h"
+#include "getprime_r.h"
 
 /* R_i <- q_i * S, 0 <= i < n, where q_i are large integers, S is a point on
    an elliptic curve. Uses max(bits in q_i) modular inversions (one less if 
@@ -418,6 +420,186 @@ addWnm (mpz_t p, point *X, curve *S, mpmod_t modulus, unsigned int m,
   return ECM_NO_FACTOR_FOUND;
 }
 
+/* Estimate the cost of a modular inversion (in unit of time per 
+   modular multiplication) */
+static unsigned int
+inversion_cost (mpmod_t modulus)
+{
+  return (modulus->repr == ECM_MOD_BASE2) ? 18 : 6;
+}
+
+/* Puts in fd[0..size_fd-1] the points coeffs[i] * X, where coeffs[] are
+   the tables of differences init_progression_coeffs (i0, d, e, k, m, E,
+   dickson_a) gives, size_fd = k * eulerphi(d) / eulerphi(m) * (E + 1).
+   i0 may be a NULL pointer, in this case i0 = 0 is assumed.
+
+   Multiplying a coefficient by X costs O(E log(x)) point operations for
+   coefficients of the size of x^E. The entry E-j of the table of the
+   progression e * (i0 + i) + n * d * k * e is a polynomial of degree j
+   in i, thus the last L entries of all tables are the successive values
+   of a table of differences in two variables (see init_progression_coeffs2)
+   which needs only L * (L + 1) / 2 such multiplications, then O(L^2) point
+   additions per value of i. L is chosen to minimize the cost, for L = 1
+   this means computing the last entry, which is the same for all
+   progressions, only once.
+   T must have size_fd + 4 entries.
+   Returns ECM_NO_FACTOR_FOUND, ECM_FACTOR_FOUND_STEP2 (the factor is then
+   in f) or ECM_ERROR. */
+static int
+init_progression_points (mpz_t f, point *fd, curve *X, mpz_t i0,
+                         const unsigned long d, const unsigned long e,
+                         const unsigned int k, const unsigned int m,
+                         const unsigned int E, const int dickson_a,
+                         const unsigned int size_fd, mpres_t *T,
+                         mpmod_t modulus, unsigned long *muls,
+                         unsigned long *gcds)
+{
+  unsigned int i, j, h, E1 = E + 1, R, L, T_inv = inversion_cost (modulus);
+  unsigned long nbits;
+  double cost_mul, gain, best_gain;
+  int youpi = ECM_NO_FACTOR_FOUND;
+  listz_t coeffs;
+  point *W;
+  mpres_t *TW;
+  mpz_t t, dke, em;
+
+  ASSERT (d % m == 0);
+
+  /* t = e * (i0 + i) for the first i, dke = d * k * e, em = e * m */
+  i = (m > 1) ? 1 : 0;
+  mpz_init (t);
+  if (i0 != NULL)
+    mpz_set (t, i0);
+  mpz_add_ui (t, t, (unsigned long) i);
+  mpz_mul_ui (t, t, e);
+  mpz_init_set_ui (dke, d);
+  mpz_mul_ui (dke, dke, k);
+  mpz_mul_ui (dke, dke, e);
+  mpz_init_set_ui (em, e);
+  mpz_mul_ui (em, em, (unsigned long) m);
+  /* number of values of i */
+  R = (k * d - i + m - 1) / m;
+
+  /* The coefficients have about E times as many bits as the largest
+     argument of Dickson_{E,a}, and multiplyW2n adds 2^b * X to about half
+     of its results for each bit b, a point addition costing about 6
+     modular multiplications. Taking the entry E-j from the table in two
+     variables instead of multiplying it for each of the size_fd / E1
+     progressions saves size_fd / E1 - j - 1 multiplications by X, but
+     costs j point additions per value of i, and addWnm needs one inversion
+     per value of i if L > 1. */
+  mpz_mul_ui (dke, dke, E);
+  mpz_addmul_ui (dke, em, R);
+  mpz_add (dke, dke, t);
+  nbits = E * MAX (mpz_sizeinbase (t, 2), mpz_sizeinbase (dke, 2));
+  mpz_set_ui (dke, d);
+  mpz_mul_ui (dke, dke, k);
+  mpz_mul_ui (dke, dke, e);
+  cost_mul = 3. * (double) nbits;
+  L = 0;
+  best_gain = 0.;
+  for (j = 0, gain = 0.; j < E1; j++)
+    {
+      gain += ((double) (size_fd / E1) - j - 1.) * cost_mul
+              - 6. * (double) R * j;
+      if (j == 1)
+        gain -= (double) R * T_inv;
+      if (gain > best_gain)
+        {
+          best_gain = gain;
+          L = j + 1;
+        }
+    }
+
+  coeffs = init_progression_coeffs (i0, d, e, k, m, E, dickson_a);
+  if (coeffs == NULL)
+    {
+      youpi = ECM_ERROR;
+      goto clear;
+    }
+
+  /* The entries taken from the table in two variables are set to zero,
+     multiplyW2n() gives the neutral element for them without any work */
+  for (i = 0; i < size_fd; i += E1)
+    for (h = E1 - L; h <= E; h++)
+      mpz_set_ui (coeffs[i + h], 0);
+
+  if (test_verbose (OUTPUT_TRACE))
+    for (i = 0; i < size_fd; i++)
+      outputf (OUTPUT_TRACE, "init_progression_points: coeffs[%d] == "
+               "%Zd\n", i, coeffs[i]);
+
+  if (L < E1)
+    youpi = multiplyW2n (f, fd, X, coeffs, size_fd, modulus, T[0], T[1],
+                         T + 2, muls, gcds);
+  clear_list (coeffs, size_fd);
+  if (youpi != ECM_NO_FACTOR_FOUND || L == 0)
+    goto clear;
+
+  outputf (OUTPUT_DEVVERBOSE, "init_progression_points: the last %u "
+           "entries come from a table of differences in two variables\n", L);
+
+  coeffs = init_progression_coeffs2 (t, dke, em, E, dickson_a, L);
+  W = (point *) malloc (L * L * sizeof (point));
+  TW = (mpres_t *) malloc ((L * L + 4) * sizeof (mpres_t));
+  if (coeffs == NULL || W == NULL || TW == NULL)
+    {
+      if (coeffs != NULL)
+        clear_list (coeffs, L * L);
+      free (W);
+      free (TW);
+      youpi = ECM_ERROR;
+      goto clear;
+    }
+  for (i = 0; i < L * L; i++)
+    {
+      mpres_init (W[i].x, modulus);
+      mpres_init (W[i].y, modulus);
+    }
+  for (i = 0; i < L * L + 4; i++)
+    mpres_init (TW[i], modulus);
+
+  /* W[j * L + l] = Delta^l Delta^(E-j) Dickson_{E,a} (t) * X, where l is
+     the variable of the progression of the i values. The zero coefficients
+     give the neutral element, which addWnm() handles. */
+  youpi = multiplyW2n (f, W, X, coeffs, L * L, modulus, TW[0], TW[1],
+                       TW + 2, muls, gcds);
+  clear_list (coeffs, L * L);
+
+  for (i = 0; youpi == ECM_NO_FACTOR_FOUND && i < size_fd; )
+    {
+      if (mpz_gcd_ui (NULL, t, d) == 1)
+        {
+          for (j = 0; j < L; j++)
+            {
+              mpres_set (fd[i + E - j].x, W[j * L].x, modulus);
+              mpres_set (fd[i + E - j].y, W[j * L].y, modulus);
+            }
+          i += E1;
+        }
+      mpz_add (t, t, em);
+      /* next value of i */
+      if (i < size_fd && L > 1)
+        youpi = addWnm (f, W, X, modulus, L, L - 1, TW, muls, gcds);
+    }
+
+  for (i = 0; i < L * L + 4; i++)
+    mpres_clear (TW[i], modulus);
+  free (TW);
+  for (i = 0; i < L * L; i++)
+    {
+      mpres_clear (W[i].x, modulus);
+      mpres_clear (W[i].y, modulus);
+    }
+  free (W);
+
+ clear:
+  mpz_clear (em);
+  mpz_clear (dke);
+  mpz_clear (t);
+  return youpi;
+}
+
 /* puts in F[0..dF-1] the successive values of 
 
    Dickson_{S, a} (j * d2) * s  where s is a point on the elliptic curve
@@ -435,10 +617,8 @@ ecm_rootsF (mpz_t f, listz_t F, root_params_t *root_params,
   unsigned long muls = 0, gcds = 0;
   long st;
   int youpi = ECM_NO_FACTOR_FOUND;
-  listz_t coeffs;
   ecm_roots_state_t state;
   progression_params_t *params = &state.params; /* for less typing */
-  mpz_t t;
   
   if (dF == 0)
     return ECM_NO_FACTOR_FOUND;
@@ -454,26 +634,6 @@ ecm_rootsF (mpz_t f, listz_t F, root_params_t *root_params,
 	   params->nr, params->dsieve, params->size_fd, params->S, 
 	   params->dickson_a);
 
-  /* Init finite differences tables */
-  mpz_init (t); /* t = 0 */
-  coeffs = init_progression_coeffs (t, params->dsieve, root_params->d2, 
-				    1, 6, params->S, params->dickson_a);
-  mpz_clear (t);
-
-  if (coeffs == NULL) /* error */
-    {
-      youpi = ECM_ERROR;
-      goto clear;
-    }
-
-  /* The highest coefficient is the same for all progressions, so set them
-     to one for all but the first progression, later we copy the point.
-     FIXME: can we avoid the multiplication of those points in multiplyW2n()
-     below?
-  */
-  for (i = params->S + 1; i < params->size_fd; i += params->S + 1)
-    mpz_set_ui (coeffs[i + params->S], 1);
-
   /* Allocate memory for fd[] and T[] */
 
   state.fd = (point *) malloc (params->size_fd * sizeof (point));
@@ -484,7 +644,6 @@ ecm_rootsF (mpz_t f, listz_t F, root_params_t *root_params,
     }
   for (i = 0; i < params->size_fd; i++)
     {
-      outputf (OUTPUT_TRACE, "ecm_rootsF: coeffs[%d] = %Zd\n", i, coeffs[i]);
       mpres_init (state.fd[i].x, modulus);
       mpres_init (state.fd[i].y, modulus);
     }
@@ -498,27 +657,18 @@ ecm_rootsF (mpz_t f, listz_t F, root_params_t *root_params,
   for (i = 0 ; i < params->size_fd + 4; i++)
     mpres_init (state.T[i], modulus);
 
-  /* Multiply fd[] = s * coeffs[] */
+  /* Init finite differences tables: fd[] = s * coeffs[] */
 
-  youpi = multiplyW2n (f, state.fd, s, coeffs, params->size_fd, modulus,
-                       state.T[0], state.T[1], state.T + 2, &muls, &gcds);
+  youpi = init_progression_points (f, state.fd, s, NULL, params->dsieve,
+                                   root_params->d2, 1, 6, params->S,
+                                   params->dickson_a, params->size_fd,
+                                   state.T, modulus, &muls, &gcds);
   if (youpi == ECM_FACTOR_FOUND_STEP2)
     outputf (OUTPUT_VERBOSE, "Found factor while computing coeff[] * X\n");  
 
   if (youpi == ECM_ERROR)
     goto clear;
 
-  /* Copy the point corresponding to the highest coefficient of the first 
-     progression to the other progressions */
-  for (i = params->S + 1; i < params->size_fd; i += params->S + 1)
-    {
-      mpres_set (state.fd[i + params->S].x, state.fd[params->S].x, modulus);
-      mpres_set (state.fd[i + params->S].y, state.fd[params->S].y, modulus);
-    }
-
-  clear_list (coeffs, params->size_fd);
-  coeffs = NULL;
-
   if (test_verbose (OUTPUT_VERBOSE))
     {
       unsigned int st1 = cputime ();
@@ -606,7 +756,6 @@ ecm_rootsG_init (mpz_t f, curve *X, root_params_t *root_params,
 {
   unsigned int k, phid2;
   unsigned long muls = 0, gcds = 0;
-  listz_t coeffs;
   ecm_roots_state_t *state;
   progression_params_t *params; /* for less typing */
   int youpi = 0;
@@ -633,10 +782,7 @@ ecm_rootsG_init (mpz_t f, curve *X, root_params_t *root_params,
 
   /* Estimate the cost of a modular inversion (in unit of time per 
      modular multiplication) */
-  if (modulus->repr == ECM_MOD_BASE2)
-    T_inv = 18;
-  else
-    T_inv = 6;
+  T_inv = inversion_cost (modulus);
   
   /* Guesstimate a value for the number of disjoint progressions to use */
   bestnr = -(4. + T_inv) + sqrt(12. * (double) dF * (double) blocks * 
@@ -670,21 +816,9 @@ ecm_rootsG_init (mpz_t f, curve *X, root_params_t *root_params,
 			       so nothing to be skipped */
   params->rsieve = 0;
 
-  coeffs = init_progression_coeffs (root_params->i0, root_params->d2, 
-				    root_params->d1, params->nr / phid2, 
-				    1, params->S, params->dickson_a);
-
-  if (coeffs == NULL) /* error */
-    {
-      free (state);
-      mpz_set_si (f, -1);
-      return NULL;
-    }
-
   state->fd = (point *) malloc (params->size_fd * sizeof (point));
   if (state->fd == NULL)
     {
-      clear_list (coeffs, params->size_fd);
       free (state);
       mpz_set_si (f, -1);
       return NULL;
@@ -704,7 +838,7 @@ ecm_rootsG_init (mpz_t f, curve *X, root_params_t *root_params,
           mpres_clear (state->fd[k].x, modulus);
           mpres_clear (state->fd[k].y, modulus);
         }
-      clear_list (coeffs, params->size_fd);
+      free (state->fd);
       free (state);
       mpz_set_si (f, -1);
       return NULL;
@@ -712,28 +846,14 @@ ecm_rootsG_init (mpz_t f, curve *X, root_params_t *root_params,
   for (k = 0; k < state->size_T; k++)
     mpres_init (state->T[k], modulus);
 
-  for (k = params->S + 1; k < params->size_fd; k += params->S + 1)
-     mpz_set_ui (coeffs[k + params->S], 1);
-
-  if (test_verbose (OUTPUT_TRACE))
-    for (k = 0; k < params->size_fd; k++)
-      outputf (OUTPUT_TRACE, "ecm_rootsG_init: coeffs[%d] == %Zd\n", 
-               k, coeffs[k]);
-
-  youpi = multiplyW2n (f, state->fd, X, coeffs, params->size_fd, modulus, 
-                     state->T[0], state->T[1], state->T + 2, &muls, &gcds);
+  youpi = init_progression_points (f, state->fd, X, root_params->i0,
+                                   root_params->d2, root_params->d1,
+                                   params->nr / phid2, 1, params->S,
+                                   params->dickson_a, params->size_fd,
+                                   state->T, modulus, &muls, &gcds);
   if (youpi == ECM_ERROR)
     mpz_set_si (f, -1); /* fall through */
 
-  for (k = params->S + 1; k < params->size_fd; k += params->S + 1)
-    {
-      mpres_set (state->fd[k + params->S].x, state->fd[params->S].x, modulus);
-      mpres_set (state->fd[k + params->S].y, state->fd[params->S].y, modulus);
-    }
-  
-  clear_list (coeffs, params->size_fd);
-  coeffs = NULL;
-  
   if (youpi != ECM_NO_FACTOR_FOUND) /* factor found or error */
     {
       if (youpi == ECM_FACTOR_FOUND_STEP2)
@@ -852,3 +972,356 @@ ecm_rootsG (mpz_t f, listz_t G, unsigned long dF, ecm_roots_state_t *state,
   
   return youpi;
 }
+
+/* Number of interleaved progressions of giant steps in the standard
+   continuation: they are advanced together by addWnm(), with one inversion
+   for SC_GIANT points. */
+#define SC_GIANT 64
+
+/* Choose the giant step D of the standard continuation for the primes in
+   ]b2min, b2], among the primorials whose prime factors are all <= b2min,
+   and return an estimate of the number of modular multiplications of the
+   point arithmetic, as in init_progression_points: multiplyW2n costs about
+   3 * bits multiplications per point, and each giant step 6 multiplications
+   plus a share of the inversion. The multiplications of the pairs do not
+   depend on D. */
+static unsigned long
+sc_choose_D (unsigned long b2min, unsigned long b2, unsigned int T_inv,
+             double *cost)
+{
+  static const unsigned long primorial[] = {6, 30, 210, 2310, 30030};
+  static const unsigned long largest[] = {3, 5, 7, 11, 13};
+  unsigned long D, best_D = primorial[0], nm;
+  unsigned int i, G;
+  double c, best = 0.;
+
+  for (i = 0; i < sizeof (primorial) / sizeof (primorial[0]); i++)
+    {
+      D = primorial[i];
+      if (i > 0 && largest[i] > b2min)
+        break;
+      nm = b2 / D - b2min / D + 1;
+      G = MIN (nm, SC_GIANT);
+      c = 3. * eulerphi (D) * log2 ((double) D)
+        + 3. * (G + 1) * log2 ((double) D * (b2 / D + G + 1))
+        + (double) nm * (6. + (double) T_inv / G);
+      if (i == 0 || c < best)
+        {
+          best = c;
+          best_D = D;
+        }
+    }
+  *cost = best;
+  return best_D;
+}
+
+/* Set w[i] for 0 <= i < len to 1 if lo + i is in ]b2min, b2] and has no
+   divisor in sp[0..nsp-1] other than itself, to 0 otherwise. The sp[] are
+   the primes up to sqrt(b2) which do not divide D, thus w[i] is 1 for a
+   number coprime to D iff it is a prime. */
+static void
+sc_sieve (unsigned char *w, unsigned long lo, unsigned long len,
+          unsigned long b2min, unsigned long b2, const unsigned long *sp,
+          unsigned long nsp)
+{
+  unsigned long i, a, b, p;
+
+  a = (b2min >= lo) ? MIN (b2min - lo + 1, len) : 0;
+  b = (b2 >= lo) ? MIN (b2 - lo + 1, len) : 0;
+  memset (w, 0, a);
+  if (b > a)
+    memset (w + a, 1, b - a);
+  memset (w + MAX (a, b), 0, len - MAX (a, b));
+  for (i = 0; i < nsp; i++)
+    {
+      p = sp[i];
+      /* the smaller multiples of p have a smaller prime factor */
+      a = (lo + p - 1) / p * p;
+      if (a < p * p)
+        a = p * p;
+      for (a -= lo; a < b; a += p)
+        w[a] = 0;
+    }
+}
+
+/* Estimate the number of modular multiplications of ecm_stage2_sc for
+   primes in [B2min, B2]: there are about (B2 - B2min) / (log(B2) - 1)
+   primes, and the pairing leaves about 0.72 multiplications per prime
+   (measured for B2 from 1e5 to 1e8). Returns a negative value if B2 is
+   too large for the standard continuation. */
+double
+ecm_stage2_sc_cost (mpz_t B2min, mpz_t B2, mpmod_t modulus)
+{
+  unsigned long b2min, b2;
+  double cost;
+
+  if (!mpz_fits_ulong_p (B2))
+    return -1.;
+  if (mpz_cmp (B2min, B2) > 0)
+    return 0.;
+  b2 = mpz_get_ui (B2);
+  b2min = (mpz_sgn (B2min) > 0) ? mpz_get_ui (B2min) - 1 : 0;
+  sc_choose_D (b2min, b2, inversion_cost (modulus), &cost);
+  return cost + 0.72 * (double) (b2 - b2min) / (log ((double) b2 + 3.) - 1.);
+}
+
+/* Standard continuation of ECM stage 2 with prime pairing (Montgomery,
+   "Speeding the Pollard and Elliptic Curve Methods of Factorization",
+   1987), cheaper than the polynomial stage 2 when B2 is small.
+
+   Every prime q in [B2min, B2] not dividing D is q = m*D - j for m the
+   first multiple of D above q, and q = (m-1)*D + (D-j), with 0 < j < D and
+   gcd(j, D) = 1. If q*X = 0 mod p, then x(m*D*X) = x(j*X) mod p, thus each
+   factor x(m*D*X) - x(j*X) of the product covers both m*D - j and m*D + j.
+   The baby steps j*X are precomputed, the giant steps m*D*X come from
+   SC_GIANT progressions advanced together by addWnm().
+
+   A prime can be reached from two values of m. The choice is made greedily
+   while m increases: the primes below m*D must be taken at m, with a prime
+   above m*D when possible, and a prime above m*D which got no partner is
+   left for m+1. The primes are taken from a window of (SC_GIANT+1)*D bytes,
+   the last D of which carry over to the next batch of giant steps.
+
+   Primes dividing D are not covered, D is chosen so that they are < B2min.
+   Returns ECM_FACTOR_FOUND_STEP2 (the factor is then in f),
+   ECM_NO_FACTOR_FOUND or ECM_ERROR. */
+int
+ecm_stage2_sc (mpz_t f, curve *X, mpz_t B2min, mpz_t B2, mpmod_t modulus,
+               int (*stop_asap)(void))
+{
+  unsigned long b2min, b2, D, m, m0, m1, lo, nj, i, t, G, W;
+  unsigned long muls = 0, gcds = 0, nsingles = 0, npairs = 0;
+  unsigned int *js = NULL;
+  unsigned char *win = NULL;
+  int youpi = ECM_NO_FACTOR_FOUND;
+  long st, st0;
+  double cost;
+  unsigned long *sp, nsp;
+  ecm_uint p;
+  prime_info_t pi;
+  mpz_t *q = NULL;
+  mpres_t *bx = NULL, *T = NULL, acc, u;
+  point *R = NULL, *gp = NULL;
+
+  st0 = st = cputime ();
+
+  if (!mpz_fits_ulong_p (B2))
+    {
+      outputf (OUTPUT_ERROR, "Error, B2 is too large for the standard "
+               "continuation\n");
+      return ECM_ERROR;
+    }
+  b2 = mpz_get_ui (B2);
+  /* like the polynomial continuation, include B2min */
+  b2min = (mpz_sgn (B2min) > 0) ? mpz_get_ui (B2min) - 1 : 0;
+  D = sc_choose_D (b2min, b2, inversion_cost (modulus), &cost);
+  m0 = b2min / D + 1;
+  m1 = b2 / D + 1;
+  G = MIN (m1 - m0 + 1, SC_GIANT);
+  W = (G + 1) * D;
+
+  outputf (OUTPUT_VERBOSE, "Standard continuation with D=%lu, m=%lu..%lu\n",
+           D, m0, m1);
+
+  /* the baby steps j*X for 0 < j < D, gcd(j, D) = 1, and the first giant
+     steps m*D*X for m0 <= m < m0 + G, then G*D*X, are computed with
+     multiplyW2n, which needs n+2 cells in T */
+  nj = eulerphi (D);
+  js = (unsigned int *) malloc (nj * sizeof (unsigned int));
+  win = (unsigned char *) malloc (W);
+  q = (mpz_t *) malloc (MAX (nj, G + 1) * sizeof (mpz_t));
+  T = (mpres_t *) malloc ((MAX (nj, G + 1) + 2) * sizeof (mpres_t));
+  R = (point *) malloc (MAX (nj, G + 1) * sizeof (point));
+  bx = (mpres_t *) malloc (nj * sizeof (mpres_t));
+  gp = (point *) malloc (2 * G * sizeof (point));
+  if (js == NULL || win == NULL || q == NULL || T == NULL || R == NULL ||
+      bx == NULL || gp == NULL)
+    {
+      outputf (OUTPUT_ERROR, "Error, not enough memory\n");
+      free (js);
+      free (win);
+      free (q);
+      free (T);
+      free (R);
+      free (bx);
+      free (gp);
+      return ECM_ERROR;
+    }
+
+  for (i = 0; i < MAX (nj, G + 1); i++)
+    {
+      mpz_init (q[i]);
+      mpres_init (T[i], modulus);
+      mpres_init (R[i].x, modulus);
+      mpres_init (R[i].y, modulus);
+    }
+  mpres_init (T[i], modulus);
+  mpres_init (T[i + 1], modulus);
+  for (i = 0; i < nj; i++)
+    mpres_init (bx[i], modulus);
+  for (i = 0; i < 2 * G; i++)
+    {
+      mpres_init (gp[i].x, modulus);
+      mpres_init (gp[i].y, modulus);
+    }
+  mpres_init (acc, modulus);
+  mpres_init (u, modulus);
+
+  for (i = 1, t = 0; i < D; i++)
+    if (gcd (i, D) == 1)
+      {
+        js[t] = i;
+        mpz_set_ui (q[t++], i);
+      }
+  youpi = multiplyW2n (f, R, X, q, nj, modulus, acc, u, T, &muls, &gcds);
+  if (youpi != ECM_NO_FACTOR_FOUND)
+    goto clear;
+  for (t = 0; t < nj; t++)
+    mpres_set (bx[t], R[t].x, modulus);
+
+  for (t = 0; t < G; t++)
+    {
+      mpz_set_ui (q[t], m0 + t);
+      mpz_mul_ui (q[t], q[t], D);
+    }
+  mpz_set_ui (q[G], G);
+  mpz_mul_ui (q[G], q[G], D);
+  youpi = multiplyW2n (f, R, X, q, G + 1, modulus, acc, u, T, &muls, &gcds);
+  if (youpi != ECM_NO_FACTOR_FOUND)
+    goto clear;
+  /* the layout of addWnm with n = 1: gp[2t] += gp[2t+1] */
+  for (t = 0; t < G; t++)
+    {
+      mpres_set (gp[2 * t].x, R[t].x, modulus);
+      mpres_set (gp[2 * t].y, R[t].y, modulus);
+      mpres_set (gp[2 * t + 1].x, R[G].x, modulus);
+      mpres_set (gp[2 * t + 1].y, R[G].y, modulus);
+    }
+
+  outputf (OUTPUT_VERBOSE, "Computing the baby and giant steps took %ldms",
+           elltime (st, cputime ()));
+  outputf (OUTPUT_DEVVERBOSE, ", %lu muls and %lu extgcds", muls, gcds);
+  outputf (OUTPUT_VERBOSE, "\n");
+  st = cputime ();
+
+  /* the primes p <= sqrt(b2) not dividing D, to sieve the window */
+  prime_info_init (pi);
+  for (p = 2, nsp = 0; p * p <= b2; p = getprime_mt (pi))
+    if (D % p != 0)
+      nsp++;
+  prime_info_clear (pi);
+  sp = (unsigned long *) malloc ((nsp + 1) * sizeof (unsigned long));
+  if (sp == NULL)
+    {
+      outputf (OUTPUT_ERROR, "Error, not enough memory\n");
+      youpi = ECM_ERROR;
+      goto clear;
+    }
+  prime_info_init (pi);
+  for (p = 2, nsp = 0; p * p <= b2; p = getprime_mt (pi))
+    if (D % p != 0)
+      sp[nsp++] = p;
+  prime_info_clear (pi);
+
+  /* win[i] is set iff lo + i is a prime in ]b2min, b2] not covered yet,
+     the entries not coprime to D are never read */
+  lo = (m0 - 1) * D;
+  memset (win, 0, W);
+  i = 0; /* number of bytes carried over from the previous batch */
+  mpres_set_ui (acc, 1, modulus);
+  for (m = m0; m <= m1; m += G)
+    {
+      if (stop_asap != NULL && (*stop_asap)())
+        break;
+
+      sc_sieve (win + i, lo + i, W - i, b2min, b2, sp, nsp);
+
+      for (t = 0; t < G && m + t <= m1; t++)
+        {
+          unsigned char *c = win + (t + 1) * D; /* m*D is at c[0] */
+          unsigned long k;
+
+          for (k = 0; k < nj; k++)
+            if (c[-(long) js[k]] && c[js[k]])
+              {
+                c[-(long) js[k]] = c[js[k]] = 0;
+                mpres_sub (u, gp[2 * t].x, bx[k], modulus);
+                mpres_mul (acc, acc, u, modulus);
+                npairs++;
+              }
+          for (k = 0; k < nj; k++)
+            if (c[-(long) js[k]])
+              {
+                c[-(long) js[k]] = 0;
+                mpres_sub (u, gp[2 * t].x, bx[k], modulus);
+                mpres_mul (acc, acc, u, modulus);
+                nsingles++;
+              }
+        }
+
+      /* next batch: the last D bytes are the primes above (m+G-1)*D */
+      memmove (win, win + G * D, D);
+      i = D;
+      lo += G * D;
+      if (m + G <= m1)
+        {
+          youpi = addWnm (f, gp, X, modulus, G, 1, T, &muls, &gcds);
+          if (youpi != ECM_NO_FACTOR_FOUND)
+            break;
+        }
+    }
+  free (sp);
+
+  if (youpi == ECM_NO_FACTOR_FOUND)
+    {
+      mpres_gcd (f, acc, modulus);
+      if (mpz_cmp_ui (f, 1) > 0)
+        youpi = ECM_FACTOR_FOUND_STEP2;
+      else if (test_verbose (OUTPUT_RESVERBOSE))
+        {
+          mpz_t a;
+          mpz_init (a);
+          mpres_get_z (a, acc, modulus);
+          outputf (OUTPUT_RESVERBOSE, "Product of x(m*D*P)-x(j*P) = %Zd\n",
+                   a);
+          mpz_clear (a);
+        }
+    }
+  outputf (OUTPUT_VERBOSE, "Covering the primes took %ldms", 
+           elltime (st, cputime ()));
+  outputf (OUTPUT_DEVVERBOSE, ", %lu primes with %lu multiplications",
+           nsingles + 2 * npairs, nsingles + npairs);
+  outputf (OUTPUT_VERBOSE, "\n");
+
+ clear:
+  mpres_clear (u, modulus);
+  mpres_clear (acc, modulus);
+  for (i = 0; i < 2 * G; i++)
+    {
+      mpres_clear (gp[i].x, modulus);
+      mpres_clear (gp[i].y, modulus);
+    }
+  for (i = 0; i < nj; i++)
+    mpres_clear (bx[i], modulus);
+  for (i = 0; i < MAX (nj, G + 1); i++)
+    {
+      mpz_clear (q[i]);
+      mpres_clear (T[i], modulus);
+      mpres_clear (R[i].x, modulus);
+      mpres_clear (R[i].y, modulus);
+    }
+  mpres_clear (T[i], modulus);
+  mpres_clear (T[i + 1], modulus);
+  free (gp);
+  free (bx);
+  free (R);
+  free (T);
+  free (q);
+  free (win);
+  free (js);
+
+  if (stop_asap == NULL || !(*stop_asap)())
+    outputf (OUTPUT_NORMAL, "Step 2 took %ldms\n", elltime (st0, cputime ()));
+
+  return youpi;
+}
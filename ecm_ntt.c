@@ -22,14 +22,9 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 #include "sp.h"
 #include "ecm-impl.h"
 
-#ifdef HAVE_UNISTD_H
-#include <unistd.h> /* for unlink */
-#endif
-
 #define UNUSED 0
 
 /* memory: 4 * len mpspv coeffs */
@@ -41,7 +36,7 @@ ntt_mul (mpzv_t r, mpzv_t x, mpzv_t y, spv_size_t len, mpzv_t t,
 	
   if (len < MUL_NTT_THRESHOLD)
     {
-      list_mul (r, x, len, y, len, monic, t);
+      list_mul (r, x, len, y, len, monic, t, 0);
       return;
     }
 
@@ -72,7 +67,7 @@ ntt_PolyFromRoots (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
 
   if (len <= MUL_NTT_THRESHOLD)
   {
-    PolyFromRoots (r, a, len, t, mpzspm->modulus);
+    PolyFromRoots (r, a, len, t, mpzspm->modulus, 0);
     return;
   }
   
@@ -80,7 +75,7 @@ ntt_PolyFromRoots (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
   
   for (i = 0; i < len; i += MUL_NTT_THRESHOLD)
     {
-      PolyFromRoots (r, a + i, MUL_NTT_THRESHOLD, t, mpzspm->modulus);
+      PolyFromRoots (r, a + i, MUL_NTT_THRESHOLD, t, mpzspm->modulus, 0);
       mpzspv_from_mpzv (x, 2 * i, r, MUL_NTT_THRESHOLD, mpzspm);
     }
   
@@ -105,7 +100,7 @@ ntt_PolyFromRoots (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
 /* memory: 2 * len mpzspv coeffs */
 int
 ntt_PolyFromRoots_Tree (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
-    int dolvl, mpzspm_t mpzspm, mpzv_t *Tree, FILE *TreeFile)
+    int dolvl, mpzspm_t mpzspm, mpzv_t *Tree, treefile_t TreeFile)
 {
   mpzspv_t x;
   spv_size_t i, m, m_max;
@@ -141,14 +136,12 @@ ntt_PolyFromRoots_Tree (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
       if (m == len / 2)
 	dst = &r;
       
-      if (TreeFile && list_out_raw (TreeFile, src, len) == ECM_ERROR)
-        {
-          outputf (OUTPUT_ERROR, "Error writing product tree of F\n");
-          return ECM_ERROR;
-        }
+      if (TreeFile && treefile_write (TreeFile, dolvl, 0, src, len)
+                      == ECM_ERROR)
+        return ECM_ERROR;
 
       for (i = 0; i < len; i += 2 * m)
-	list_mul (t + i, src + i, m, src + i + m, m, 1, t + len);
+	list_mul (t + i, src + i, m, src + i + m, m, 1, t + len, 0);
 
       list_mod (*dst, t, len, mpzspm->modulus);
       
@@ -166,8 +159,8 @@ ntt_PolyFromRoots_Tree (mpzv_t r, mpzv_t a, spv_size_t len, mpzv_t t,
       
       for (i = 0; i < 2 * len; i += 4 * m)
         {
- 	  if (TreeFile &&
-	      list_out_raw (TreeFile, src + i / 2, 2 * m) == ECM_ERROR)
+ 	  if (TreeFile && treefile_write (TreeFile, dolvl, i / 2, src + i / 2,
+	                                  2 * m) == ECM_ERROR)
 	    return ECM_ERROR;
 	  
 	  mpzspv_from_mpzv (x, i, src + i / 2, m, mpzspm);
@@ -202,7 +195,7 @@ ntt_PrerevertDivision (mpzv_t a, mpzv_t b, mpzv_t invb, mpzspv_t sp_b,
   
   if (len < PREREVERTDIVISION_NTT_THRESHOLD)
     {
-      PrerevertDivision (a, b, invb, len, t, mpzspm->modulus);
+      PrerevertDivision (a, b, invb, len, t, mpzspm->modulus, 0);
       return;
     }
   
@@ -227,6 +220,79 @@ ntt_PrerevertDivision (mpzv_t a, mpzv_t b, mpzv_t invb, mpzspv_t sp_b,
   list_mod (a, a, len, mpzspm->modulus);
 }
 
+/* Montgomery multiplication: puts in r[0..len-1] the polynomial R of degree
+   < len such that R * (x^len+1) = A * C mod B, where A = a[0..len-1],
+   C = c[0..len-1] and B = b[0]+...+b[len-1]*x^(len-1)+x^len, for len a
+   power of two. With D = -A*C/B mod (x^len+1), A*C + D*B is divisible by
+   x^len+1 and the quotient has degree < len, thus modulo x^len-1 where
+   x^len+1 = 2 it is (A*C + D*B mod (x^len-1)) / 2. See "Fast convolution
+   meets Montgomery" by Preda Mihailescu, Mathematics of Computation, 2008.
+   sp_b is the transform of B modulo x^len-1 (with the monic term), sp_ninvb
+   the twisted negacyclic transform of -1/B mod (x^len+1), both of length
+   len.
+   All transforms have length len, where ntt_mul and ntt_PrerevertDivision
+   need length 2len for the same result.
+   r may be a or c.
+   memory: 4 * len mpzspv coeffs */
+void
+ntt_MontgomeryMulMod (mpzv_t r, mpzv_t a, mpzv_t c, mpzspv_t sp_b,
+                      mpzspv_t sp_ninvb, spv_size_t len, mpzspm_t mpzspm)
+{
+  mpzspv_t x, y, u, v;
+  spv_size_t i;
+
+  x = mpzspv_init (len, mpzspm);
+  y = mpzspv_init (len, mpzspm);
+  u = mpzspv_init (len, mpzspm);
+  v = mpzspv_init (len, mpzspm);
+
+  mpzspv_from_mpzv (x, 0, a, len, mpzspm);
+  mpzspv_from_mpzv (y, 0, c, len, mpzspm);
+  mpzspv_set (u, 0, x, 0, len, mpzspm);
+  mpzspv_set (v, 0, y, 0, len, mpzspm);
+
+  /* u = transform of A*C mod (x^len-1) */
+  mpzspv_mul_ntt (u, 0, u, 0, len, v, 0, len, len, 0, 0, mpzspm,
+    NTT_MUL_STEP_FFT1 + NTT_MUL_STEP_FFT2 + NTT_MUL_STEP_MUL);
+  mpzspv_clear (v, mpzspm);
+
+  /* x = A*C mod (x^len+1) */
+  mpzspv_negacyclic_twist (x, 0, len, mpzspm);
+  mpzspv_negacyclic_twist (y, 0, len, mpzspm);
+  mpzspv_mul_ntt (x, 0, x, 0, len, y, 0, len, len, 0, 0, mpzspm,
+    NTT_MUL_STEP_FFT1 + NTT_MUL_STEP_FFT2 + NTT_MUL_STEP_MUL +
+    NTT_MUL_STEP_IFFT);
+  mpzspv_clear (y, mpzspm);
+  mpzspv_negacyclic_untwist (x, 0, len, mpzspm);
+  mpzspv_normalise (x, 0, len, mpzspm);
+
+  /* x = D = -A*C/B mod (x^len+1) */
+  mpzspv_negacyclic_twist (x, 0, len, mpzspm);
+  mpzspv_mul_ntt (x, 0, x, 0, len, sp_ninvb, 0, UNUSED, len, 0, 0, mpzspm,
+    NTT_MUL_STEP_FFT1 + NTT_MUL_STEP_MUL + NTT_MUL_STEP_IFFT);
+  mpzspv_negacyclic_untwist (x, 0, len, mpzspm);
+  mpzspv_normalise (x, 0, len, mpzspm);
+
+  /* u = A*C + D*B mod (x^len-1), which is 2R */
+  mpzspv_mul_ntt (x, 0, x, 0, len, sp_b, 0, UNUSED, len, 0, 0, mpzspm,
+    NTT_MUL_STEP_FFT1 + NTT_MUL_STEP_MUL);
+  mpzspv_add (u, 0, u, 0, x, 0, len, mpzspm);
+  mpzspv_mul_ntt (u, 0, u, 0, len, u, 0, len, len, 0, 0, mpzspm,
+    NTT_MUL_STEP_IFFT);
+  mpzspv_to_mpzv (u, 0, r, len, mpzspm);
+
+  mpzspv_clear (x, mpzspm);
+  mpzspv_clear (u, mpzspm);
+
+  for (i = 0; i < len; i++)
+    {
+      mpz_mod (r[i], r[i], mpzspm->modulus);
+      if (mpz_odd_p (r[i]))
+        mpz_add (r[i], r[i], mpzspm->modulus);
+      mpz_tdiv_q_2exp (r[i], r[i], 1);
+    }
+}
+
 /* memory: 7/2 * len mpzspv coeffs */
 void ntt_PolyInvert (mpzv_t q, mpzv_t b, spv_size_t len, mpzv_t t,
     mpzspm_t mpzspm)
@@ -236,11 +302,11 @@ void ntt_PolyInvert (mpzv_t q, mpzv_t b, spv_size_t len, mpzv_t t,
   
   if (len < POLYINVERT_NTT_THRESHOLD)
     {
-      PolyInvert (q, b, len, t, mpzspm->modulus);
+      PolyInvert (q, b, len, t, mpzspm->modulus, 0);
       return;
     }
 
-  PolyInvert (q + len - k, b + len - k, k, t, mpzspm->modulus);
+  PolyInvert (q + len - k, b + len - k, k, t, mpzspm->modulus, 0);
   
   w = mpzspv_init (len / 2, mpzspm);
   x = mpzspv_init (len, mpzspm);
@@ -291,27 +357,14 @@ void ntt_PolyInvert (mpzv_t q, mpzv_t b, spv_size_t len, mpzv_t t,
 /* memory: 4 * len mpzspv coeffs */
 int
 ntt_polyevalT (mpzv_t b, spv_size_t len, mpzv_t *Tree, mpzv_t T,
-                   mpzspv_t sp_invF, mpzspm_t mpzspm, char *TreeFilenameStem)
+                   mpzspv_t sp_invF, mpzspm_t mpzspm, treefile_t TreeFile)
 {
   spv_size_t m, i;
-  FILE *TreeFile = NULL;
-  /* assume this "small" malloc will not fail in normal usage */
-  char *TreeFilename = NULL;
   mpzv_t *Tree_orig = Tree;
   int level = 0; /* = ceil_log2 (len / m) - 1 */
   mpzspv_t x = mpzspv_init (2 * len, mpzspm);
   mpzspv_t y = mpzspv_init (2 * len, mpzspm);
 
-  if (TreeFilenameStem)
-    {
-      TreeFilename = (char *) malloc (strlen (TreeFilenameStem) + 1 + 2 + 1);
-      if (TreeFilename == NULL)
-        {
-          fprintf (stderr, "Cannot allocate memory in ntt_polyevalT\n");
-          exit (1);
-        }
-    }
-  
   mpzspv_from_mpzv (x, 0, b, len, mpzspm);
   mpzspv_mul_ntt(x, 0, x, 0, len, sp_invF, 0, UNUSED, 2 * len, 0, 0, mpzspm,
     NTT_MUL_STEP_FFT1 + NTT_MUL_STEP_MUL + NTT_MUL_STEP_IFFT);
@@ -321,27 +374,16 @@ ntt_polyevalT (mpzv_t b, spv_size_t len, mpzv_t *Tree, mpzv_t T,
     
   for (m = len / 2; m >= POLYEVALT_NTT_THRESHOLD; m /= 2)
     {
-      if (TreeFilenameStem)
+      if (TreeFile != NULL)
         {
-          Tree = &T;
-	  
-          sprintf (TreeFilename, "%s.%d", TreeFilenameStem, level);
-          
-	  TreeFile = fopen (TreeFilename, "rb");
-          if (TreeFile == NULL)
+          Tree = treefile_level (TreeFile, level);
+          if (Tree == NULL)
             {
-              outputf (OUTPUT_ERROR,
-		  "Error opening file %s for product tree of F\n",
-                        TreeFilename);
               mpzspv_clear (x, mpzspm);
 	      mpzspv_clear (y, mpzspm);
 	      return ECM_ERROR;
             }
-
-	  list_inp_raw (*Tree, TreeFile, len);
-
-	  fclose (TreeFile);
-	  unlink (TreeFilename);
+          Tree += level;
 	}
 
       for (i = 0; i < len; i += 2 * m)
@@ -380,32 +422,17 @@ ntt_polyevalT (mpzv_t b, spv_size_t len, mpzv_t *Tree, mpzv_t T,
 
   for (; m >= 1; m /= 2)
     {
-      if (TreeFilenameStem)
+      if (TreeFile != NULL)
         {
-          sprintf (TreeFilename, "%s.%d", TreeFilenameStem, level);
-
-          TreeFile = fopen (TreeFilename, "rb");
-          if (TreeFile == NULL)
-            {
-              outputf (OUTPUT_ERROR,
-		  "Error opening file %s for product tree of F\n",
-                        TreeFilename);
-	      return ECM_ERROR;
-            }
+          Tree_orig = treefile_level (TreeFile, level);
+          if (Tree_orig == NULL)
+	    return ECM_ERROR;
 	}
       
       TUpTree (T, Tree_orig, len, T + len, level++, 0,
-	  mpzspm->modulus, TreeFile);
-
-      if (TreeFilenameStem)
-        {
-	  fclose (TreeFile);
-	  unlink (TreeFilename);
-	}
+	  mpzspm->modulus, 0);
     }
   
-  if (TreeFilenameStem)
-    free (TreeFilename);
   list_swap (b, T, len);
   return 0;
 }
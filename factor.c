@@ -75,10 +75,21 @@ ecm_init (ecm_params q)
   q->stop_asap = NULL;
   q->batch_last_B1_used = 1.0;
   mpz_init_set_ui (q->batch_s, 1);
+  q->batch_s_shared = NULL;
+  q->batch_ladder_bits = 0;
+  mpz_init (q->batch_ladder_x2);
+  q->batch_ladder_B1 = 0.0;
   q->gpu = 0; /* no gpu by default in library mode */
   q->gpu_device = -1; 
   q->gpu_device_init = 0; 
   q->gpu_number_of_curves = 0; 
+  q->cpubatch = 0; /* stage 1 on one curve at a time */
+  q->tune_profile = NULL; /* ECM_TUNE_PROFILE or compiled-in parameters */
+  q->stage2_threads = 1;
+  q->batch_s_threads = 1;
+  q->stage2_engine = ECM_STAGE2_DEFAULT;
+  q->fs2_done = 0;
+  mpz_init (q->fs2_m_1);
   q->gw_k = 0.0;
   q->gw_b = 0;
   q->gw_n = 0;
@@ -94,8 +105,11 @@ ecm_clear (ecm_params q)
   mpz_clear (q->go);
   mpz_clear (q->B2min);
   mpz_clear (q->B2);
+  mpz_clear (q->fs2_m_1);
   gmp_randclear (q->rng);
   mpz_clear (q->batch_s);
+  batch_s_release (&(q->batch_s_shared));
+  mpz_clear (q->batch_ladder_x2);
   mpz_clear (q->E->a1);
   mpz_clear (q->E->a3);
   mpz_clear (q->E->a2);
@@ -138,24 +152,12 @@ ecm_factor (mpz_t f, mpz_t n, double B1, ecm_params p0)
   else
     p = p0;
 
-  if (p->method == ECM_ECM)
+  if (p->tune_profile != NULL && tune_profile_load (p->tune_profile, p->es) < 0)
+    res = ECM_ERROR;
+  else if (p->method == ECM_ECM)
     {
 #ifdef WITH_GPU
-      if (p->gpu == 0)
-        {
-#endif
-            res = ecm (f, p->x, p->y, p->param, p->sigma, n, p->go,
-		       &(p->B1done),
-                       B1, p->B2min, p->B2, p->k, p->S, p->verbose,
-                       p->repr, p->nobase2step2, p->use_ntt, 
-		       p->sigma_is_A, p->E,
-                       p->os, p->es, p->chkfilename, p->TreeFilename, p->maxmem,
-                       p->stage1time, p->rng, p->stop_asap, p->batch_s,
-                       &(p->batch_last_B1_used), p->gw_k, p->gw_b, p->gw_n,
-                       p->gw_c);
-#ifdef WITH_GPU
-        }
-      else
+      if (p->gpu != 0)
         {
           res = gpu_ecm (f, p->x, p->param, p->sigma, n, p->go,
                          &(p->B1done), B1, p->B2min, p->B2, p->k,
@@ -163,21 +165,51 @@ ecm_factor (mpz_t f, mpz_t n, double B1, ecm_params p0)
                          p->use_ntt, p->sigma_is_A, p->os, p->es,
                          p->chkfilename, p->TreeFilename, p->maxmem,
                          p->stop_asap, p->batch_s, &(p->batch_last_B1_used),
+                         &(p->batch_s_shared), p->stage2_engine,
                          p->gpu_device, &(p->gpu_device_init),
                          &(p->gpu_number_of_curves));
         }
+      else
 #endif
+      if (p->cpubatch != 0)
+        {
+          res = cpu_ecm (f, p->x, p->param, p->sigma, n, p->go,
+                         &(p->B1done), B1, p->B2min, p->B2, p->k,
+                         p->S, p->verbose, p->repr, p->nobase2step2,
+                         p->use_ntt, p->sigma_is_A, p->os, p->es,
+                         p->TreeFilename, p->maxmem, p->stop_asap,
+                         p->batch_s, &(p->batch_last_B1_used),
+                         &(p->batch_s_shared), p->stage2_engine,
+                         &(p->cpubatch));
+        }
+      else
+        {
+            res = ecm (f, p->x, p->y, p->param, p->sigma, n, p->go,
+		       &(p->B1done),
+                       B1, p->B2min, p->B2, p->k, p->S, p->verbose,
+                       p->repr, p->nobase2step2, p->use_ntt, 
+		       p->sigma_is_A, p->E,
+                       p->os, p->es, p->chkfilename, p->TreeFilename, p->maxmem,
+                       p->stage1time, p->rng, p->stop_asap, p->batch_s,
+                       &(p->batch_last_B1_used), &(p->batch_s_shared),
+                       p->batch_ladder_bits, p->batch_ladder_x2,
+                       p->batch_ladder_B1, p->stage2_threads,
+                       p->batch_s_threads, p->stage2_engine,
+                       p->gw_k, p->gw_b, p->gw_n, p->gw_c);
+        }
     }
   else if (p->method == ECM_PM1)
     res = pm1 (f, p->x, n, p->go, &(p->B1done), B1, p->B2min, p->B2,
                p->k, p->verbose, p->repr, p->use_ntt, p->os, p->es,
                p->chkfilename, p->TreeFilename, p->maxmem, p->rng,
-               p->stop_asap);
+               p->stop_asap, p->fs2_done, p->fs2_param, p->fs2_m_1,
+               p->stage2_threads);
   else if (p->method == ECM_PP1)
     res = pp1 (f, p->x, n, p->go, &(p->B1done), B1, p->B2min, p->B2,
                p->k, p->verbose, p->repr, p->use_ntt, p->os, p->es,
                p->chkfilename, p->TreeFilename, p->maxmem, p->rng,
-               p->stop_asap);
+               p->stop_asap, p->fs2_done, p->fs2_param, p->fs2_m_1,
+               p->stage2_threads);
   else
     {
       fprintf (p->es, "Error, unknown method: %d\n", p->method);
@@ -189,3 +221,112 @@ ecm_factor (mpz_t f, mpz_t n, double B1, ecm_params p0)
 
   return res;
 }
+
+/* Give s, the batch exponent for B1 (as read from a file written by
+   ecm_batch_s_get), to the process-wide cache, so that it is not recomputed
+   by the calls of ecm_factor() with this B1 in batch mode, from any thread.
+   The value of s is moved into the cache and s is set to 1. */
+void
+ecm_batch_s_set (ecm_params p, double B1, mpz_t s)
+{
+  batch_s_insert (&(p->batch_s_shared), B1, s);
+}
+
+/* Return the batch exponent for B1 from the process-wide cache, computing
+   it if needed. It remains valid until p is cleared or used with another
+   B1 in batch mode. */
+mpz_srcptr
+ecm_batch_s_get (ecm_params p, double B1)
+{
+  set_verbose (p->verbose);
+  ECM_STDOUT = (p->os == NULL) ? stdout : p->os;
+  ECM_STDERR = (p->es == NULL) ? stdout : p->es;
+  return batch_s_acquire (&(p->batch_s_shared), B1, NULL,
+                          p->batch_s_threads);
+}
+
+/* Split the ECM stage 2 range of p for n and the stage 1 bound B1 into K
+   contiguous parts that can be run separately with p->B2min and p->B2 set
+   to bounds[j-1] and bounds[j], 1 <= j <= K. The range is the one
+   ecm_factor() would use, with the same default B2min and B2. The inner
+   bounds are multiples of the d1 chosen for the whole range, such that
+   the parts get about the same number of roots i*d1, i0 <= i <= B2'/d1,
+   and bounds[K] is the effective B2' of the whole range. If the range is
+   small enough for the standard continuation (see p->stage2_engine), the
+   parts have the same length instead. bounds must have K+1 initialized
+   entries.
+   Return ECM_ERROR in case of error, ECM_NO_FACTOR_FOUND otherwise. */
+int
+ecm_stage2_split (mpz_t *bounds, unsigned int K, mpz_t n, double B1,
+                  ecm_params p)
+{
+  mpmod_t modulus;
+  root_params_t root_params;
+  unsigned long k = p->k, dF;
+  int repr = p->repr, base2 = 0, Fermat, po2 = 0, youpi;
+  int engine = p->stage2_engine;
+  unsigned int j;
+  mpz_t B2min, B2, t;
+
+  set_verbose (p->verbose);
+  ECM_STDOUT = (p->os == NULL) ? stdout : p->os;
+  ECM_STDERR = (p->es == NULL) ? stdout : p->es;
+
+  /* the same choice of arithmetic and test for Fermat numbers as ecm() */
+  if (repr == ECM_MOD_DEFAULT && IS_BATCH_MODE(p->param))
+    repr = ECM_MOD_MODMULN;
+  if (mpmod_init (modulus, n, repr) != 0)
+    return ECM_ERROR;
+  if (modulus->repr == ECM_MOD_BASE2)
+    base2 = modulus->bits;
+  for (Fermat = base2; Fermat > 0 && (Fermat & 1) == 0; Fermat >>= 1);
+  if (Fermat == 1)
+    {
+      Fermat = base2;
+      po2 = 1;
+    }
+  else
+    Fermat = 0;
+
+  mpz_init (B2min);
+  mpz_init (B2);
+  youpi = set_stage_2_params (B2, p->B2, B2min, p->B2min, &root_params, B1,
+                              &k, p->S, p->use_ntt, &engine, &po2, &dF,
+                              p->TreeFilename, p->maxmem, Fermat, modulus);
+  if (youpi != ECM_ERROR)
+    {
+      mpz_init (t);
+      mpz_set (bounds[0], B2min);
+      for (j = 1; j < K; j++)
+        if (engine == ECM_STAGE2_SC)
+          {
+            /* B2min + floor (j * (B2 - B2min) / K) */
+            mpz_sub (t, B2, B2min);
+            mpz_mul_ui (t, t, j);
+            mpz_fdiv_q_ui (t, t, K);
+            mpz_add (bounds[j], B2min, t);
+          }
+        else
+          {
+            /* i = i0 + ceil (j * (floor (B2' / d1) - i0) / K) */
+            mpz_fdiv_q_ui (t, B2, root_params.d1);
+            mpz_sub (t, t, root_params.i0);
+            mpz_mul_ui (t, t, j);
+            mpz_cdiv_q_ui (t, t, K);
+            mpz_add (t, t, root_params.i0);
+            mpz_mul_ui (bounds[j], t, root_params.d1);
+            /* i0 * d1 may be smaller than B2min */
+            if (mpz_cmp (bounds[j], bounds[j - 1]) < 0)
+              mpz_set (bounds[j], bounds[j - 1]);
+          }
+      mpz_set (bounds[K], B2);
+      mpz_clear (t);
+      youpi = ECM_NO_FACTOR_FOUND;
+    }
+
+  mpz_clear (root_params.i0);
+  mpz_clear (B2);
+  mpz_clear (B2min);
+  mpmod_clear (modulus);
+  return youpi;
+}
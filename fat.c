@@ -0,0 +1,105 @@
+/* fat.c - choose the tuning parameters according to the running cpu.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Only compiled with --enable-fat. The parameter sets of x86_64/k8,
+   x86_64/core2 and x86_64/corei7 are all compiled in, each completed by the
+   defaults of generic/params.h like ecm-params.h does, and tune_profile.c
+   copies the one matching the cpu into __ecm_tune_params when the library
+   is loaded.
+   The mulredc assembly code is the same for the three, only the tables and
+   thresholds differ. */
+
+#define ECM_TUNE_NO_ALIASES
+#include "ecm-impl.h"
+
+#include "x86_64/k8/params.h"
+#include "generic/params.h"
+static const ecm_tune_params_t k8_params =
+  ECM_TUNE_PARAMS ("x86_64/k8/params.h");
+
+#undef TUNE_MULREDC_TABLE
+#undef TUNE_SQRREDC_TABLE
+#undef LIST_MUL_TABLE
+#undef MPN_MUL_LO_THRESHOLD_TABLE
+#undef MPZMOD_THRESHOLD
+#undef REDC_THRESHOLD
+#undef NTT_GFP_TWIDDLE_DIF_BREAKOVER
+#undef NTT_GFP_TWIDDLE_DIT_BREAKOVER
+#undef NTT_GFP_BLOCK_BREAKOVER
+#undef MUL_NTT_THRESHOLD
+#undef PREREVERTDIVISION_NTT_THRESHOLD
+#undef MONTGOMERY_REDUCE_NTT_THRESHOLD
+#undef POLYINVERT_NTT_THRESHOLD
+#undef POLYEVALT_NTT_THRESHOLD
+#undef MPZSPV_NORMALISE_STRIDE
+
+#include "x86_64/core2/params.h"
+#include "generic/params.h"
+static const ecm_tune_params_t core2_params =
+  ECM_TUNE_PARAMS ("x86_64/core2/params.h");
+
+#undef TUNE_MULREDC_TABLE
+#undef TUNE_SQRREDC_TABLE
+#undef LIST_MUL_TABLE
+#undef MPN_MUL_LO_THRESHOLD_TABLE
+#undef MPZMOD_THRESHOLD
+#undef REDC_THRESHOLD
+#undef NTT_GFP_TWIDDLE_DIF_BREAKOVER
+#undef NTT_GFP_TWIDDLE_DIT_BREAKOVER
+#undef NTT_GFP_BLOCK_BREAKOVER
+#undef MUL_NTT_THRESHOLD
+#undef PREREVERTDIVISION_NTT_THRESHOLD
+#undef MONTGOMERY_REDUCE_NTT_THRESHOLD
+#undef POLYINVERT_NTT_THRESHOLD
+#undef POLYEVALT_NTT_THRESHOLD
+#undef MPZSPV_NORMALISE_STRIDE
+
+#include "x86_64/corei7/params.h"
+#include "generic/params.h"
+static const ecm_tune_params_t corei7_params =
+  ECM_TUNE_PARAMS ("x86_64/corei7/params.h");
+
+/* The same choice as ecm-params.h makes at compile time with -mtune:
+   corei7 covers Nehalem and all later Intel Core processors, core2 the
+   Core 2 and its Xeons, and the AMD processors use the k8 parameters, as
+   does any other cpu. Virtual machines often report a model number the
+   compiler does not know, thus an unknown Intel cpu is classified by its
+   instruction set: SSE4.2 appeared with Nehalem, SSSE3 with Core 2. */
+const ecm_tune_params_t *
+fat_tune_params (void)
+{
+  const ecm_tune_params_t *p = &k8_params;
+
+  /* needed since we run from a constructor, maybe before the one of libgcc */
+  __builtin_cpu_init ();
+  if (__builtin_cpu_is ("corei7"))
+    p = &corei7_params;
+  else if (__builtin_cpu_is ("core2"))
+    p = &core2_params;
+  else if (__builtin_cpu_is ("intel"))
+    {
+      if (__builtin_cpu_supports ("sse4.2"))
+        p = &corei7_params;
+      else if (__builtin_cpu_supports ("ssse3"))
+        p = &core2_params;
+    }
+  return p;
+}
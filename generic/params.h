@@ -18,6 +18,10 @@
 #define NTT_GFP_TWIDDLE_DIT_BREAKOVER 11
 #endif
 
+#ifndef NTT_GFP_BLOCK_BREAKOVER
+#define NTT_GFP_BLOCK_BREAKOVER 15
+#endif
+
 #ifndef MUL_NTT_THRESHOLD
 #define MUL_NTT_THRESHOLD 1024
 #endif
@@ -26,6 +30,10 @@
 #define PREREVERTDIVISION_NTT_THRESHOLD 64
 #endif
 
+#ifndef MONTGOMERY_REDUCE_NTT_THRESHOLD
+#define MONTGOMERY_REDUCE_NTT_THRESHOLD 512
+#endif
+
 #ifndef POLYINVERT_NTT_THRESHOLD
 #define POLYINVERT_NTT_THRESHOLD 512
 #endif
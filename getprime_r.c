@@ -186,6 +186,94 @@ getprime_mt (prime_info_t i)
   return i->offset + 2 * i->current;
 }
 
+/* Return the smallest prime >= p, after which getprime_mt (i) returns the
+   next primes. This allows to sieve the primes of an interval without
+   sieving the primes before it, for example to split the primes up to B1
+   among threads:
+
+      prime_info_t pi;
+      prime_info_init (pi);
+      for (p = prime_info_seek (pi, lo); p <= hi; p = getprime_mt (pi))
+         {
+            ...
+         }
+
+      prime_info_clear (pi);
+
+   The previous state of i is discarded, and i must have been initialized
+   with prime_info_init. */
+ecm_uint
+prime_info_seek (prime_info_t i, ecm_uint p)
+{
+  prime_info_t t;
+  ecm_uint o, q, k;
+
+  prime_info_clear (i);
+  prime_info_init (i);
+
+  if (p <= 2)
+    return 2;
+
+  /* small p: the sieve of getprime_mt starts from 5 anyway */
+  if (p < 1024)
+    {
+      do
+        q = getprime_mt (i);
+      while (q < p);
+      return q;
+    }
+
+  /* the sieving table of length len starts at o, the smallest odd number
+     >= p, with len^2 >= o as getprime_mt would have it there */
+  o = p | 1;
+  for (i->len = 1; (ecm_uint) i->len * i->len < o; i->len *= 2);
+
+  /* the small primes are 3, 5, ..., up to the first one whose square
+     exceeds the end of the sieving table */
+  prime_info_init (t);
+  k = 16;
+  i->primes = (ecm_uint*) malloc (k * sizeof (ecm_uint));
+  ASSERT(i->primes != NULL);
+  i->nprimes = 0;
+  do
+    {
+      q = getprime_mt (t);
+      if (i->nprimes == k)
+        {
+          k *= 2;
+          i->primes = (ecm_uint*) realloc (i->primes, k * sizeof (ecm_uint));
+          ASSERT(i->primes != NULL);
+        }
+      i->primes[i->nprimes++] = q;
+    }
+  while (q * q <= o + 2 * i->len);
+  prime_info_clear (t);
+
+  /* moduli[k] is the smallest m such that o + 2*m = k*p */
+  i->moduli = (ecm_uint*) malloc (i->nprimes * sizeof (ecm_uint));
+  ASSERT(i->moduli != NULL);
+  for (k = 0; k < i->nprimes; k++)
+    {
+      q = i->primes[k];
+      p = o % q;
+      p = (p == 0) ? p : q - p;
+      if ((p % 2) != 0)
+        p += q;
+      i->moduli[k] = p / 2;
+    }
+
+  /* an empty sieving table just before o: the next call of getprime_mt
+     sieves the one at o */
+  i->sieve = (unsigned char *) malloc ((i->len + 1) * sizeof (unsigned char));
+  ASSERT(i->sieve != NULL);
+  memset (i->sieve, 0, i->len);
+  i->sieve[i->len] = 1; /* End mark */
+  i->offset = o - 2 * i->len;
+  i->current = -1;
+
+  return getprime_mt (i);
+}
+
 #ifdef MAIN
 int
 main (int argc, char *argv[])
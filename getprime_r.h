@@ -22,6 +22,7 @@ extern "C" {
 void prime_info_init (prime_info_t);
 void prime_info_clear (prime_info_t);
 ecm_uint getprime_mt (prime_info_t);
+ecm_uint prime_info_seek (prime_info_t, ecm_uint);
 
 #ifdef __cplusplus
 }
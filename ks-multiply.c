@@ -359,13 +359,22 @@ list_mul_n_KS2 (listz_t R, listz_t A, listz_t B, unsigned int n)
   free (tmp);
 }
 
+#ifdef TUNE
+int list_mul_table[TUNE_LIST_MUL_N_MAX_SIZE]; /* set by tune.c */
+#endif
+
 /* Puts in R[0..2n-2] the product of A[0..n-1] and B[0..n-1], seen as
    polynomials.
 */
 void
 list_mult_n (listz_t R, listz_t A, listz_t B, unsigned int n)
 {
-  int T[TUNE_LIST_MUL_N_MAX_SIZE] = LIST_MUL_TABLE, best;
+#ifdef TUNE
+  const int *T = list_mul_table;
+#else
+  const int *T = __ecm_tune_params.list_mul_table;
+#endif
+  int best;
 
   /* See tune_list_mul_n() in tune.c:
      0 : list_mul_n_basecase
@@ -673,3 +682,99 @@ ks_wrapmul (listz_t R, unsigned int m0,
   return m;
 #endif /* FFT_WRAP */
 }
+
+#if defined(HAVE___GMPN_MUL_FFT) && defined(HAVE___GMPN_FFT_BEST_K) && \
+  !defined(__MPIR_RELEASE)
+#define FFT_NEGACYCLIC /* products modulo B^n + 1 with mpn_mul_fft */
+#endif
+
+/* Return the number of limbs of a coefficient in the Kronecker substitution
+   for products of K coefficients in [0, n), with extra more bits:
+   reduce the coefficients of A[0..K-1] outside [0, n) first. */
+static mp_size_t
+ks_mod_limbs (listz_t A, unsigned int K, mpz_t n, unsigned int extra)
+{
+  unsigned long i, t = mpz_sizeinbase (n, 2);
+  mp_size_t s;
+
+  for (i = 0; i < K; i++)
+    if (mpz_sgn (A[i]) < 0 || mpz_sizeinbase (A[i], 2) > t)
+      mpz_mod (A[i], A[i], n);
+
+  s = 2 * t + extra;
+  for (i = K - 1; i; s++, i >>= 1);
+
+  return 1 + (s - 1) / GMP_NUMB_BITS;
+}
+
+/* R[0..K-1] <- A[0..K-1] * B[0..K-1] mod (x^K + 1), where the coefficients
+   of the result are non-negative and congruent modulo n to the ones of the
+   negacyclic product, but not reduced. A or B may be modified (reduced
+   modulo n), R must not overlap A or B. Requires 2K-1 cells in t. */
+void
+ks_negacyclicmul (listz_t R, listz_t A, listz_t B, unsigned int K, mpz_t n,
+                  listz_t t)
+{
+  unsigned int i;
+#ifdef FFT_NEGACYCLIC
+  mp_size_t s, pl, j;
+  mp_limb_t cy;
+  mp_ptr ap, bp, rp;
+  mpz_t M;
+  int k;
+
+  /* one more bit for the offset below */
+  s = ks_mod_limbs (A, K, n, 1);
+  if (B != A)
+    s = ks_mod_limbs (B, K, n, 1);
+  pl = K * s;
+  k = mpn_fft_best_k (pl, A == B);
+  while (pl % (1 << k) != 0)
+    k--;
+
+  if (k >= 4)
+    {
+      ap = (mp_ptr) malloc ((3 * pl + 1) * sizeof (mp_limb_t));
+      if (ap == NULL)
+        {
+          outputf (OUTPUT_ERROR, "Out of memory in ks_negacyclicmul()\n");
+          exit (1);
+        }
+      bp = ap + pl;
+      rp = bp + pl;
+
+      pack (ap, A, K, 1, s);
+      if (B != A)
+        pack (bp, B, K, 1, s);
+      cy = mpn_mul_fft (rp, pl, ap, pl, (B != A) ? bp : ap, pl, k);
+
+      /* The coefficients c[i] of the negacyclic product are in
+         ]-K*n^2, K*n^2[. Adding M = K*n^2, a multiple of n, to each of them
+         makes them non-negative and less than 2^(s*GMP_NUMB_BITS), thus
+         the sum of the (c[i] + M) * B^(s*i) is the representative in
+         [0, B^pl[ of the product plus M * (1 + B^s + ... ) mod B^pl + 1 */
+      mpz_init (M);
+      mpz_mul (M, n, n);
+      mpz_mul_ui (M, M, K);
+      ASSERT((mp_size_t) mpz_size (M) <= s);
+      MPN_ZERO (ap, pl);
+      for (j = 0; j < pl; j += s)
+        MPN_COPY (ap + j, PTR(M), mpz_size (M));
+      mpz_clear (M);
+      cy += mpn_add_n (rp, rp, ap, pl);
+      /* B^pl = -1 mod B^pl + 1 */
+      if (mpn_sub_1 (rp, rp, pl, cy))
+        mpn_add_1 (rp, rp, pl, 1);
+
+      unpack (R, 1, rp, K, s);
+      free (ap);
+      return;
+    }
+#endif
+
+  list_mult_n (t, A, B, K);
+  for (i = 0; i + 1 < K; i++)
+    mpz_sub (R[i], t[i], t[K + i]);
+  mpz_set (R[K - 1], t[K - 1]);
+  list_mod (R, R, K - 1, n);
+}
@@ -0,0 +1,561 @@
+/* lanes.c - arithmetic modulo N on a block of residues with interleaved limbs
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* A block holds the residues of ECM_BATCH_LANES curves modulo the same N
+   of n limbs, with limb i of the residue of curve c at index
+   i * ECM_BATCH_LANES + c. The functions below run the same instruction
+   stream for every curve of a block: the inner loops run over the curves,
+   which gives independent carry chains the processor can overlap, and
+   whole cache lines of useful data. There are no branches depending on the
+   data.
+
+   The residues are in Montgomery form with R = B^n, and are fully reduced
+   in [0, N), thus every implementation gives the same results. */
+
+#include "ecm-gmp.h"
+#include "ecm-impl.h"
+
+#if defined(HAVE_AVX2) && GMP_NUMB_BITS == 64
+#define USE_LANES_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef USE_LANES_AVX2
+/* AVX2 code: each limb of 4 consecutive curves is split into two 32-bit
+   digits, held in the low halves of the 64-bit elements of a __m256i, so
+   that vpmuludq computes 4 products of digits at once. With digits < 2^32,
+   t + x * y + c < 2^64 for t, x, y, c < 2^32, thus a carry fits in the high
+   half of an element. Since R = 2^(64n) is the same as for the code with
+   limbs, both give the same results.
+
+   The functions are compiled for AVX2 with a target attribute, and
+   mulredc_lanes and sqrredc_lanes call them only if the cpu has AVX2. */
+
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#define LANES_AVX2_MAXN 20 /* largest n for the AVX2 code */
+#define LANES_AVX2_G (ECM_BATCH_LANES / 4) /* number of __m256i per digit */
+
+/* Digits of N, each one broadcast to the 4 elements. */
+static TARGET_AVX2 void
+lanes_avx2_ndigits (__m256i *nd, mp_srcptr np, mp_size_t n)
+{
+  mp_size_t j;
+
+  for (j = 0; j < n; j++)
+    {
+      nd[2 * j] = _mm256_set1_epi64x (np[j] & 0xffffffff);
+      nd[2 * j + 1] = _mm256_set1_epi64x (np[j] >> 32);
+    }
+}
+
+/* {r, n} <- {t, 2n+1} - N if that is non-negative, {t, 2n} otherwise, for
+   the 4 curves g*4, ..., g*4+3, with t < 2N given by digits. */
+static TARGET_AVX2 void
+lanes_avx2_final (mp_limb_t *r, const __m256i *t, const __m256i *nd,
+                  mp_size_t n, unsigned int g)
+{
+  const __m256i mask32 = _mm256_set1_epi64x (0xffffffff);
+  __m256i d[2 * LANES_AVX2_MAXN], bw, keep, lo, hi;
+  mp_size_t j;
+
+  bw = _mm256_setzero_si256 ();
+  for (j = 0; j < 2 * n; j++)
+    {
+      d[j] = _mm256_sub_epi64 (_mm256_sub_epi64 (t[j], nd[j]), bw);
+      bw = _mm256_srli_epi64 (d[j], 63);
+      d[j] = _mm256_and_si256 (d[j], mask32);
+    }
+  /* keep t if t - N < 0 */
+  keep = _mm256_cmpgt_epi64 (_mm256_setzero_si256 (),
+                             _mm256_sub_epi64 (t[2 * n], bw));
+  for (j = 0; j < n; j++)
+    {
+      lo = _mm256_blendv_epi8 (d[2 * j], t[2 * j], keep);
+      hi = _mm256_blendv_epi8 (d[2 * j + 1], t[2 * j + 1], keep);
+      _mm256_storeu_si256 ((__m256i *) (r + j * ECM_BATCH_LANES + 4 * g),
+                           _mm256_or_si256 (lo, _mm256_slli_epi64 (hi, 32)));
+    }
+}
+
+/* Same as mulredc_lanes, for n <= LANES_AVX2_MAXN, with 32-bit digits:
+   for each digit a_i of a, t <- (t + a_i * b + m * N) / 2^32 where
+   m = -t/N mod 2^32 (coarsely integrated operand scanning). */
+static TARGET_AVX2 void
+mulredc_lanes_avx2 (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+                    mp_srcptr np, mp_size_t n, mp_limb_t invm)
+{
+  const __m256i mask32 = _mm256_set1_epi64x (0xffffffff);
+  const __m256i inv = _mm256_set1_epi64x (invm & 0xffffffff);
+  __m256i bd[LANES_AVX2_G][2 * LANES_AVX2_MAXN];
+  __m256i t[LANES_AVX2_G][2 * LANES_AVX2_MAXN + 2];
+  __m256i nd[2 * LANES_AVX2_MAXN], ai[LANES_AVX2_G], m[LANES_AVX2_G];
+  __m256i cy[LANES_AVX2_G], s, x;
+  const mp_size_t k = 2 * n;
+  mp_size_t i, j;
+  unsigned int g;
+
+  lanes_avx2_ndigits (nd, np, n);
+  /* vpmuludq only reads the low half of each element, thus the low digits
+     of b need no masking */
+  for (g = 0; g < LANES_AVX2_G; g++)
+    {
+      for (j = 0; j < n; j++)
+        {
+          x = _mm256_loadu_si256 ((const __m256i *)
+                                  (b + j * ECM_BATCH_LANES + 4 * g));
+          bd[g][2 * j] = x;
+          bd[g][2 * j + 1] = _mm256_srli_epi64 (x, 32);
+        }
+      for (j = 0; j < k + 2; j++)
+        t[g][j] = _mm256_setzero_si256 ();
+    }
+
+  for (i = 0; i < k; i++)
+    {
+      /* t <- t + a_i * b */
+      for (g = 0; g < LANES_AVX2_G; g++)
+        {
+          x = _mm256_loadu_si256 ((const __m256i *)
+                                  (a + (i / 2) * ECM_BATCH_LANES + 4 * g));
+          ai[g] = (i & 1) ? _mm256_srli_epi64 (x, 32) : x;
+          cy[g] = _mm256_setzero_si256 ();
+        }
+      for (j = 0; j < k; j++)
+        for (g = 0; g < LANES_AVX2_G; g++)
+          {
+            s = _mm256_add_epi64 (t[g][j], _mm256_mul_epu32 (ai[g], bd[g][j]));
+            s = _mm256_add_epi64 (s, cy[g]);
+            t[g][j] = _mm256_and_si256 (s, mask32);
+            cy[g] = _mm256_srli_epi64 (s, 32);
+          }
+      for (g = 0; g < LANES_AVX2_G; g++)
+        {
+          s = _mm256_add_epi64 (t[g][k], cy[g]);
+          t[g][k] = _mm256_and_si256 (s, mask32);
+          t[g][k + 1] = _mm256_srli_epi64 (s, 32);
+          /* only the low 32 bits of m matter */
+          m[g] = _mm256_mul_epu32 (t[g][0], inv);
+          s = _mm256_add_epi64 (t[g][0], _mm256_mul_epu32 (m[g], nd[0]));
+          cy[g] = _mm256_srli_epi64 (s, 32);
+        }
+      /* t <- (t + m * N) / 2^32 */
+      for (j = 1; j < k; j++)
+        for (g = 0; g < LANES_AVX2_G; g++)
+          {
+            s = _mm256_add_epi64 (t[g][j], _mm256_mul_epu32 (m[g], nd[j]));
+            s = _mm256_add_epi64 (s, cy[g]);
+            t[g][j - 1] = _mm256_and_si256 (s, mask32);
+            cy[g] = _mm256_srli_epi64 (s, 32);
+          }
+      for (g = 0; g < LANES_AVX2_G; g++)
+        {
+          s = _mm256_add_epi64 (t[g][k], cy[g]);
+          t[g][k - 1] = _mm256_and_si256 (s, mask32);
+          t[g][k] = _mm256_add_epi64 (t[g][k + 1], _mm256_srli_epi64 (s, 32));
+        }
+    }
+
+  for (g = 0; g < LANES_AVX2_G; g++)
+    lanes_avx2_final (r, t[g], nd, n, g);
+}
+
+/* Same as sqrredc_lanes, for n <= LANES_AVX2_MAXN: the square is computed
+   first, with each cross product a_i * a_j computed once, then reduced
+   (separated operand scanning). */
+static TARGET_AVX2 void
+sqrredc_lanes_avx2 (mp_limb_t *r, const mp_limb_t *a, mp_srcptr np,
+                    mp_size_t n, mp_limb_t invm)
+{
+  const __m256i mask32 = _mm256_set1_epi64x (0xffffffff);
+  const __m256i inv = _mm256_set1_epi64x (invm & 0xffffffff);
+  __m256i ad[LANES_AVX2_G][2 * LANES_AVX2_MAXN];
+  __m256i t[LANES_AVX2_G][4 * LANES_AVX2_MAXN + 1];
+  __m256i nd[2 * LANES_AVX2_MAXN], m[LANES_AVX2_G];
+  __m256i cy[LANES_AVX2_G], c2[LANES_AVX2_G], s, x, p;
+  const mp_size_t k = 2 * n;
+  mp_size_t i, j;
+  unsigned int g;
+
+  lanes_avx2_ndigits (nd, np, n);
+  for (g = 0; g < LANES_AVX2_G; g++)
+    {
+      for (j = 0; j < n; j++)
+        {
+          x = _mm256_loadu_si256 ((const __m256i *)
+                                  (a + j * ECM_BATCH_LANES + 4 * g));
+          ad[g][2 * j] = x;
+          ad[g][2 * j + 1] = _mm256_srli_epi64 (x, 32);
+        }
+      for (j = 0; j < 2 * k; j++)
+        t[g][j] = _mm256_setzero_si256 ();
+    }
+
+  /* t <- sum of a_i * a_j * 2^(32(i+j)) for i < j */
+  for (i = 0; i + 1 < k; i++)
+    {
+      for (g = 0; g < LANES_AVX2_G; g++)
+        cy[g] = _mm256_setzero_si256 ();
+      for (j = i + 1; j < k; j++)
+        for (g = 0; g < LANES_AVX2_G; g++)
+          {
+            s = _mm256_add_epi64 (t[g][i + j],
+                                  _mm256_mul_epu32 (ad[g][i], ad[g][j]));
+            s = _mm256_add_epi64 (s, cy[g]);
+            t[g][i + j] = _mm256_and_si256 (s, mask32);
+            cy[g] = _mm256_srli_epi64 (s, 32);
+          }
+      for (g = 0; g < LANES_AVX2_G; g++)
+        t[g][i + k] = cy[g];
+    }
+
+  /* t <- 2t + sum of a_i^2 * 2^(64i), which is a^2 < 2^(64n) */
+  for (g = 0; g < LANES_AVX2_G; g++)
+    cy[g] = _mm256_setzero_si256 ();
+  for (j = 0; j < k; j++)
+    for (g = 0; g < LANES_AVX2_G; g++)
+      {
+        p = _mm256_mul_epu32 (ad[g][j], ad[g][j]);
+        s = _mm256_add_epi64 (_mm256_slli_epi64 (t[g][2 * j], 1),
+                              _mm256_and_si256 (p, mask32));
+        s = _mm256_add_epi64 (s, cy[g]);
+        t[g][2 * j] = _mm256_and_si256 (s, mask32);
+        cy[g] = _mm256_srli_epi64 (s, 32);
+        s = _mm256_add_epi64 (_mm256_slli_epi64 (t[g][2 * j + 1], 1),
+                              _mm256_srli_epi64 (p, 32));
+        s = _mm256_add_epi64 (s, cy[g]);
+        t[g][2 * j + 1] = _mm256_and_si256 (s, mask32);
+        cy[g] = _mm256_srli_epi64 (s, 32);
+      }
+
+  /* for each i, t <- t + m * N * 2^(32i) with m = -t_i/N mod 2^32; the
+     carry out of digit i+k is kept in c2 and added with the next row */
+  for (g = 0; g < LANES_AVX2_G; g++)
+    c2[g] = _mm256_setzero_si256 ();
+  for (i = 0; i < k; i++)
+    {
+      for (g = 0; g < LANES_AVX2_G; g++)
+        {
+          m[g] = _mm256_mul_epu32 (t[g][i], inv);
+          cy[g] = _mm256_setzero_si256 ();
+        }
+      for (j = 0; j < k; j++)
+        for (g = 0; g < LANES_AVX2_G; g++)
+          {
+            s = _mm256_add_epi64 (t[g][i + j],
+                                  _mm256_mul_epu32 (m[g], nd[j]));
+            s = _mm256_add_epi64 (s, cy[g]);
+            t[g][i + j] = _mm256_and_si256 (s, mask32);
+            cy[g] = _mm256_srli_epi64 (s, 32);
+          }
+      for (g = 0; g < LANES_AVX2_G; g++)
+        {
+          s = _mm256_add_epi64 (_mm256_add_epi64 (t[g][i + k], cy[g]), c2[g]);
+          t[g][i + k] = _mm256_and_si256 (s, mask32);
+          c2[g] = _mm256_srli_epi64 (s, 32);
+        }
+    }
+
+  for (g = 0; g < LANES_AVX2_G; g++)
+    {
+      t[g][2 * k] = c2[g];
+      lanes_avx2_final (r, t[g] + k, nd, n, g);
+    }
+}
+#endif /* USE_LANES_AVX2 */
+
+/* Portable code for mulredc_lanes, with one limb by one limb products */
+static void
+mulredc_lanes_basecase (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+                        mp_srcptr np, mp_size_t n, mp_limb_t invm,
+                        mp_limb_t *t)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_limb_t cy[ECM_BATCH_LANES], q[ECM_BATCH_LANES], hi, lo, bw, mask;
+  mp_size_t i, j;
+  unsigned int c;
+
+  for (j = 0; j < (n + 2) * L; j++)
+    t[j] = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      /* t <- t + a[i] * b */
+      for (c = 0; c < L; c++)
+        cy[c] = 0;
+      for (j = 0; j < n; j++)
+        for (c = 0; c < L; c++)
+          {
+            umul_ppmm (hi, lo, a[i * L + c], b[j * L + c]);
+            add_ssaaaa (hi, lo, hi, lo, 0, t[j * L + c]);
+            add_ssaaaa (hi, lo, hi, lo, 0, cy[c]);
+            t[j * L + c] = lo;
+            cy[c] = hi;
+          }
+      for (c = 0; c < L; c++)
+        add_ssaaaa (t[(n + 1) * L + c], t[n * L + c], 0, t[n * L + c],
+                    0, cy[c]);
+
+      /* t <- (t + q * N) / B, with q such that the division is exact */
+      for (c = 0; c < L; c++)
+        {
+          q[c] = t[c] * invm;
+          umul_ppmm (hi, lo, q[c], np[0]);
+          add_ssaaaa (hi, lo, hi, lo, 0, t[c]); /* lo = 0 */
+          cy[c] = hi;
+        }
+      for (j = 1; j < n; j++)
+        for (c = 0; c < L; c++)
+          {
+            umul_ppmm (hi, lo, q[c], np[j]);
+            add_ssaaaa (hi, lo, hi, lo, 0, t[j * L + c]);
+            add_ssaaaa (hi, lo, hi, lo, 0, cy[c]);
+            t[(j - 1) * L + c] = lo;
+            cy[c] = hi;
+          }
+      for (c = 0; c < L; c++)
+        {
+          add_ssaaaa (hi, lo, 0, t[n * L + c], 0, cy[c]);
+          t[(n - 1) * L + c] = lo;
+          t[n * L + c] = t[(n + 1) * L + c] + hi;
+          t[(n + 1) * L + c] = 0;
+        }
+    }
+
+  /* now t < 2N, subtract N if t >= N */
+  for (c = 0; c < L; c++)
+    cy[c] = 0;
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        lo = t[j * L + c] - np[j];
+        bw = t[j * L + c] < np[j];
+        bw += lo < cy[c];
+        r[j * L + c] = lo - cy[c];
+        cy[c] = bw;
+      }
+  for (c = 0; c < L; c++)
+    {
+      /* keep t if t < N, i.e., if the subtraction borrowed and t[n] = 0 */
+      mask = -(mp_limb_t) ((cy[c] != 0) & (t[n * L + c] == 0));
+      for (j = 0; j < n; j++)
+        r[j * L + c] = (r[j * L + c] & ~mask) | (t[j * L + c] & mask);
+    }
+}
+
+/* {r, n} <- {a, n} * {b, n} / B^n mod {np, n} for each curve of a block,
+   invm = -1/N mod B, t has room for (n + 2) * ECM_BATCH_LANES limbs.
+   The output may overlap the inputs. */
+void
+mulredc_lanes (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+               mp_srcptr np, mp_size_t n, mp_limb_t invm, mp_limb_t *t)
+{
+#ifdef USE_LANES_AVX2
+  if (n <= LANES_AVX2_MAXN && __builtin_cpu_supports ("avx2"))
+    {
+      mulredc_lanes_avx2 (r, a, b, np, n, invm);
+      return;
+    }
+#endif
+  mulredc_lanes_basecase (r, a, b, np, n, invm, t);
+}
+
+/* {r, n} <- {a, n}^2 / B^n mod {np, n} for each curve of a block, with the
+   same conventions as mulredc_lanes. */
+void
+sqrredc_lanes (mp_limb_t *r, const mp_limb_t *a, mp_srcptr np, mp_size_t n,
+               mp_limb_t invm, mp_limb_t *t)
+{
+#ifdef USE_LANES_AVX2
+  if (n <= LANES_AVX2_MAXN && __builtin_cpu_supports ("avx2"))
+    {
+      sqrredc_lanes_avx2 (r, a, np, n, invm);
+      return;
+    }
+#endif
+  mulredc_lanes_basecase (r, a, a, np, n, invm, t);
+}
+
+/* {r, n} <- {a, n} * m[c] / B mod {np, n} for each curve c of a block,
+   with m[c] a single limb. Same conventions as mulredc_lanes. */
+void
+mulredc_1_lanes (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *m,
+                 mp_srcptr np, mp_size_t n, mp_limb_t invm, mp_limb_t *t)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_limb_t cy[ECM_BATCH_LANES], q[ECM_BATCH_LANES], hi, lo, bw, mask;
+  mp_size_t j;
+  unsigned int c;
+
+  /* t <- a * m */
+  for (c = 0; c < L; c++)
+    cy[c] = 0;
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        umul_ppmm (hi, lo, a[j * L + c], m[c]);
+        add_ssaaaa (hi, lo, hi, lo, 0, cy[c]);
+        t[j * L + c] = lo;
+        cy[c] = hi;
+      }
+  for (c = 0; c < L; c++)
+    t[n * L + c] = cy[c];
+
+  /* t <- (t + q * N) / B */
+  for (c = 0; c < L; c++)
+    {
+      q[c] = t[c] * invm;
+      umul_ppmm (hi, lo, q[c], np[0]);
+      add_ssaaaa (hi, lo, hi, lo, 0, t[c]);
+      cy[c] = hi;
+    }
+  for (j = 1; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        umul_ppmm (hi, lo, q[c], np[j]);
+        add_ssaaaa (hi, lo, hi, lo, 0, t[j * L + c]);
+        add_ssaaaa (hi, lo, hi, lo, 0, cy[c]);
+        t[(j - 1) * L + c] = lo;
+        cy[c] = hi;
+      }
+  for (c = 0; c < L; c++)
+    {
+      add_ssaaaa (hi, lo, 0, t[n * L + c], 0, cy[c]);
+      t[(n - 1) * L + c] = lo;
+      t[n * L + c] = hi;
+    }
+
+  /* t < 2N, subtract N if t >= N */
+  for (c = 0; c < L; c++)
+    cy[c] = 0;
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        lo = t[j * L + c] - np[j];
+        bw = t[j * L + c] < np[j];
+        bw += lo < cy[c];
+        r[j * L + c] = lo - cy[c];
+        cy[c] = bw;
+      }
+  for (c = 0; c < L; c++)
+    {
+      mask = -(mp_limb_t) ((cy[c] != 0) & (t[n * L + c] == 0));
+      for (j = 0; j < n; j++)
+        r[j * L + c] = (r[j * L + c] & ~mask) | (t[j * L + c] & mask);
+    }
+}
+
+/* r <- a + b mod N for each curve of a block, r may overlap a or b */
+void
+addmod_lanes (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+              mp_srcptr np, mp_size_t n, mp_limb_t *t)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_limb_t cy[ECM_BATCH_LANES], bw[ECM_BATCH_LANES], s, d, mask;
+  mp_size_t j;
+  unsigned int c;
+
+  /* t <- a + b, r <- a + b - N */
+  for (c = 0; c < L; c++)
+    cy[c] = bw[c] = 0;
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        s = a[j * L + c] + cy[c];
+        cy[c] = s < cy[c];
+        s += b[j * L + c];
+        cy[c] += s < b[j * L + c];
+        t[j * L + c] = s;
+        d = s - np[j];
+        mask = s < np[j];
+        mask += d < bw[c];
+        r[j * L + c] = d - bw[c];
+        bw[c] = mask;
+      }
+  /* keep a + b if it is < N, i.e., no carry and a borrow */
+  for (c = 0; c < L; c++)
+    {
+      mask = -(mp_limb_t) ((cy[c] == 0) & (bw[c] != 0));
+      for (j = 0; j < n; j++)
+        r[j * L + c] = (r[j * L + c] & ~mask) | (t[j * L + c] & mask);
+    }
+}
+
+/* r <- a - b mod N for each curve of a block, r may overlap a or b */
+void
+submod_lanes (mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+              mp_srcptr np, mp_size_t n)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_limb_t bw[ECM_BATCH_LANES], cy[ECM_BATCH_LANES], d, s, mask;
+  mp_size_t j;
+  unsigned int c;
+
+  /* r <- a - b, then add N back if the subtraction borrowed */
+  for (c = 0; c < L; c++)
+    bw[c] = 0;
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        d = a[j * L + c] - b[j * L + c];
+        mask = a[j * L + c] < b[j * L + c];
+        mask += d < bw[c];
+        r[j * L + c] = d - bw[c];
+        bw[c] = mask;
+      }
+  for (c = 0; c < L; c++)
+    {
+      bw[c] = -bw[c];
+      cy[c] = 0;
+    }
+  for (j = 0; j < n; j++)
+    for (c = 0; c < L; c++)
+      {
+        s = r[j * L + c] + cy[c];
+        cy[c] = s < cy[c];
+        d = np[j] & bw[c];
+        s += d;
+        cy[c] += s < d;
+        r[j * L + c] = s;
+      }
+}
+
+/* Store x mod N in lane c of the interleaved residue r */
+void
+mpz_to_lane (mp_limb_t *r, unsigned int c, mpz_t x, mp_size_t n)
+{
+  mp_size_t j;
+
+  for (j = 0; j < n; j++)
+    r[j * ECM_BATCH_LANES + c] = mpz_getlimbn (x, j);
+}
+
+/* Set x to the value in lane c of the interleaved residue r */
+void
+lane_to_mpz (mpz_t x, const mp_limb_t *r, unsigned int c, mp_size_t n)
+{
+  mp_size_t j;
+
+  MPZ_REALLOC (x, n);
+  for (j = 0; j < n; j++)
+    PTR(x)[j] = r[j * ECM_BATCH_LANES + c];
+  MPN_NORMALIZE (PTR(x), n);
+  SIZ(x) = n;
+}
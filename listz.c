@@ -29,7 +29,6 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #define ASSERTD(x)
 #endif
 
-extern unsigned int Fermat;
 
 /* returns a bound on the auxiliary memory needed by list_mult_n */
 int
@@ -261,10 +260,13 @@ list_mul_high (listz_t a, listz_t b, listz_t c, unsigned int K)
    Assumes k = l or k = l+1.
    The auxiliary array t contains at least list_mul_mem(l) entries.
    a and t should not overlap.
+   If Fermat is non-zero, the coefficients are reduced modulo 2^Fermat+1
+   and F_mul() is used for power-of-two lengths; this applies to all the
+   functions below taking a Fermat argument.
 */
 void
 list_mul (listz_t a, listz_t b, unsigned int k,
-          listz_t c, unsigned int l, int monic, listz_t t)
+          listz_t c, unsigned int l, int monic, listz_t t, unsigned int Fermat)
 {
   unsigned int i, po2;
 
@@ -325,7 +327,7 @@ list_mul (listz_t a, listz_t b, unsigned int k,
  */
 void
 list_mulmod (listz_t a2, listz_t a, listz_t b, listz_t c, unsigned int k,
-              listz_t t, mpz_t n)
+              listz_t t, mpz_t n, unsigned int Fermat)
 {
   int i;
 
@@ -349,7 +351,8 @@ list_mulmod (listz_t a2, listz_t a, listz_t b, listz_t c, unsigned int k,
    G == a is allowed. T must not overlap with anything else.
 */
 void
-PolyFromRoots (listz_t G, listz_t a, unsigned int k, listz_t T, mpz_t n)
+PolyFromRoots (listz_t G, listz_t a, unsigned int k, listz_t T, mpz_t n,
+               unsigned int Fermat)
 {
   unsigned int l, m;
 
@@ -366,9 +369,9 @@ PolyFromRoots (listz_t G, listz_t a, unsigned int k, listz_t T, mpz_t n)
   m = k / 2; /* m >= 1 */
   l = k - m; /* l >= 1 */
   
-  PolyFromRoots (G, a, l, T, n);
-  PolyFromRoots (G + l, a + l, m, T, n);
-  list_mul (T, G, l, G + l, m, 1, T + k);
+  PolyFromRoots (G, a, l, T, n, Fermat);
+  PolyFromRoots (G + l, a + l, m, T, n, Fermat);
+  list_mul (T, G, l, G + l, m, 1, T + k, Fermat);
   list_mod (G, T, k, n);
 }
 
@@ -386,12 +389,13 @@ PolyFromRoots (listz_t G, listz_t a, unsigned int k, listz_t T, mpz_t n)
    the tree should be computed (dolvl < 0 means all levels).
 
    Either Tree <> NULL and TreeFile == NULL, and we write the tree to memory,
-   or Tree == NULL and TreeFile <> NULL, and we write the tree to disk.
+   or Tree == NULL and TreeFile <> NULL, and we write level lvl of the tree
+   to disk, with dolvl = lvl at the top of the recursion.
 */
 int
 PolyFromRoots_Tree (listz_t G, listz_t a, unsigned int k, listz_t T, 
-               int dolvl, mpz_t n, listz_t *Tree, FILE *TreeFile, 
-               unsigned int sh)
+               int dolvl, mpz_t n, listz_t *Tree, treefile_t TreeFile, 
+               unsigned int lvl, unsigned int sh, unsigned int Fermat)
 {
   unsigned int l, m;
   listz_t H1, *NextTree;
@@ -422,23 +426,21 @@ PolyFromRoots_Tree (listz_t G, listz_t a, unsigned int k, listz_t T,
   if (dolvl != 0) /* either dolvl < 0 and we need to compute all levels,
                      or dolvl > 0 and we need first to compute lower levels */
     {
-      PolyFromRoots_Tree (H1, a, l, T, dolvl - 1, n, NextTree, TreeFile, sh);
-      PolyFromRoots_Tree (H1 + l, a + l, m, T, dolvl - 1, n, NextTree, 
-                          TreeFile, sh + l);
+      if (PolyFromRoots_Tree (H1, a, l, T, dolvl - 1, n, NextTree, TreeFile,
+                              lvl, sh, Fermat) == ECM_ERROR ||
+          PolyFromRoots_Tree (H1 + l, a + l, m, T, dolvl - 1, n, NextTree, 
+                              TreeFile, lvl, sh + l, Fermat) == ECM_ERROR)
+        return ECM_ERROR;
     }
   if (dolvl <= 0)
     {
       /* Write this level to disk, if requested */
       if (TreeFile != NULL)
         {
-          if (list_out_raw (TreeFile, H1, l) == ECM_ERROR ||
-              list_out_raw (TreeFile, H1 + l, m) == ECM_ERROR)
-            {
-              outputf (OUTPUT_ERROR, "Error writing product tree of F\n");
-              return ECM_ERROR;
-            }
+          if (treefile_write (TreeFile, lvl, sh, H1, k) == ECM_ERROR)
+            return ECM_ERROR;
         }
-      list_mul (T, H1, l, H1 + l, m, 1, T + k);
+      list_mul (T, H1, l, H1 + l, m, 1, T + k, Fermat);
       list_mod (G, T, k, n);
     }
   
@@ -449,7 +451,8 @@ PolyFromRoots_Tree (listz_t G, listz_t a, unsigned int k, listz_t T,
    where B = b[0]+b[1]*x+...+b[K-1]*x^(K-1) with b[K-1]=1.
 */
 void
-PolyInvert (listz_t q, listz_t b, unsigned int K, listz_t t, mpz_t n)
+PolyInvert (listz_t q, listz_t b, unsigned int K, listz_t t, mpz_t n,
+            unsigned int Fermat)
 {
   if (K == 1)
     {
@@ -469,7 +472,7 @@ PolyInvert (listz_t q, listz_t b, unsigned int K, listz_t t, mpz_t n)
       po2 = (po2 == 1 && Fermat != 0);
 
       /* first determine l most-significant coeffs of Q */
-      PolyInvert (q + k, b + k, l, t, n); /* Q1 = {q+k, l} */
+      PolyInvert (q + k, b + k, l, t, n, Fermat); /* Q1 = {q+k, l} */
 
       /* now Q1 * B = x^(2K-2) + O(x^(2K-2-l)) = x^(2K-2) + O(x^(K+k-2)).
          We need the coefficients of degree K-1 to K+k-2 of Q1*B */
@@ -496,7 +499,7 @@ PolyInvert (listz_t q, listz_t b, unsigned int K, listz_t t, mpz_t n)
           if (k > 1)
             {
               list_mul (t + k, q + k, l - 1, b + l, k - 1, 1,
-			t + k + K - 2); /* Q1 * B1 */
+			t + k + K - 2, Fermat); /* Q1 * B1 */
               list_sub (t + 1, t + 1, t + k, k - 1);
             }
         }
@@ -527,7 +530,7 @@ PolyInvert (listz_t q, listz_t b, unsigned int K, listz_t t, mpz_t n)
 */
 int
 PrerevertDivision (listz_t a, listz_t b, listz_t invb,
-                   unsigned int K, listz_t t, mpz_t n)
+                   unsigned int K, listz_t t, mpz_t n, unsigned int Fermat)
 {
   int po2, wrap;
   listz_t t2 = NULL;
@@ -609,3 +612,87 @@ PrerevertDivision (listz_t a, listz_t b, listz_t invb,
 
   return 0;
 }
+
+/* Puts in q[0..K-1] the inverse of A = a[0]+a[1]*x+...+a[K-1]*x^(K-1)
+   modulo x^K+1 and n, for K a power of two. With A = A0(x^2) + x*A1(x^2),
+   A(x)*A(-x) = C(x^2) where C(y) = A0(y)^2 - y*A1(y)^2 mod (y^(K/2)+1),
+   thus 1/A = (A0(x^2) - x*A1(x^2)) * 1/C(x^2), and C is inverted in half
+   the length. The last C is the resultant of A and x^K+1.
+   The coefficients of a must be in [0, n), a is destroyed.
+   Requires 3K cells in t.
+   Return 0, or non-zero with gcd(resultant, n) in f if the resultant
+   is not invertible modulo n. */
+static int
+PolyInvertNegacyclic_rec (listz_t q, listz_t a, unsigned int K, listz_t t,
+                          mpz_t f, mpz_t n)
+{
+  unsigned int h = K / 2, i;
+  listz_t a0 = t, a1 = t + h, c = t + K, d = t + K + h;
+
+  if (K == 1)
+    {
+      if (mpz_invert (q[0], a[0], n))
+        return 0;
+      mpz_gcd (f, a[0], n);
+      return 1;
+    }
+
+  for (i = 0; i < h; i++)
+    {
+      mpz_swap (a0[i], a[2 * i]);
+      mpz_swap (a1[i], a[2 * i + 1]);
+    }
+  ks_negacyclicmul (c, a0, a0, h, n, t + 2 * K);
+  ks_negacyclicmul (d, a1, a1, h, n, t + 2 * K);
+  /* y^h = -1 */
+  mpz_add (a[0], c[0], d[h - 1]);
+  for (i = 1; i < h; i++)
+    mpz_sub (a[i], c[i], d[i - 1]);
+  list_mod (a, a, h, n);
+
+  if (PolyInvertNegacyclic_rec (q, a, h, t + K, f, n))
+    return 1;
+
+  /* now 1/C is in q[0..h-1] */
+  ks_negacyclicmul (c, a0, q, h, n, t + 2 * K);
+  ks_negacyclicmul (d, a1, q, h, n, t + 2 * K);
+  for (i = 0; i < h; i++)
+    {
+      mpz_mod (q[2 * i], c[i], n);
+      mpz_mod (q[2 * i + 1], d[i], n);
+      if (mpz_sgn (q[2 * i + 1]))
+        mpz_sub (q[2 * i + 1], n, q[2 * i + 1]);
+    }
+
+  return 0;
+}
+
+/* Puts in q[0..K-1] the polynomial -1/B mod (x^K+1), where
+   B = b[0]+b[1]*x+...+b[K-1]*x^(K-1)+x^K, for ntt_MontgomeryMulMod.
+   Assumes K is a power of two and the coefficients of b are in [0, n).
+   Return 0, or non-zero if B is not invertible modulo x^K+1 and n: then
+   f is a non-trivial factor of n, or n itself. */
+int
+PolyInvertNegacyclic (listz_t q, listz_t b, unsigned int K, mpz_t f,
+                      mpz_t n)
+{
+  listz_t a;
+  int ret;
+
+  a = init_list2 (4 * K, mpz_sizeinbase (n, 2));
+  ASSERT_ALWAYS(a != NULL);
+
+  /* B mod (x^K+1) = b - 1 */
+  list_mod (a, b, K, n);
+  mpz_sub_ui (a[0], a[0], 1);
+  mpz_mod (a[0], a[0], n);
+
+  ret = PolyInvertNegacyclic_rec (q, a, K, a + K, f, n);
+  if (ret == 0)
+    list_neg (q, q, K, n);
+
+  clear_list (a, 4 * K);
+
+  return ret;
+}
+
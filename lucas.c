@@ -30,12 +30,12 @@ Lucas chains, Peter L. Montgomery, December 1983, revised January 1992. */
 
 #include "ecm-impl.h"
 
-/* P <- V_2(Q) */
+/* P <- V_2(Q), where two is 2 as a residue */
 static void
-pp1_duplicate (mpres_t P, mpres_t Q, mpmod_t n)
+pp1_duplicate (mpresf_t P, mpresf_t Q, mpresf_t two, mpmod_t n)
 {
-  mpres_sqr (P, Q, n);
-  mpres_sub_ui (P, P, 2, n);
+  mpresf_sqr (P, Q, n);
+  mpresf_sub (P, P, two, n);
 }
 
 /* P <- V_{m+n} where Q = V_m, R = V_n, S = V_{m-n}.
@@ -43,19 +43,21 @@ pp1_duplicate (mpres_t P, mpres_t Q, mpmod_t n)
    Warning: P may equal Q, R or S.
 */
 static void
-pp1_add3 (mpres_t P, mpres_t Q, mpres_t R, mpres_t S, mpmod_t n, mpres_t t)
+pp1_add3 (mpresf_t P, mpresf_t Q, mpresf_t R, mpresf_t S, mpmod_t n,
+          mpresf_t t)
 {
-  mpres_mul (t, Q, R, n);
-  mpres_sub (P, t, S, n);
+  mpresf_mul (t, Q, R, n);
+  mpresf_sub (P, t, S, n);
 }
 
 /* computes V_k(P) from P=A and puts the result in P=A. Assumes k>2.
-   Uses auxiliary variables t, B, C, T, T2.
+   Uses auxiliary variables t, B, C, T, T2. two is 2 as a residue.
 */
 void
-pp1_mul_prac (mpres_t A, ecm_uint k, mpmod_t n, mpres_t t, mpres_t B,
-              mpres_t C, mpres_t T, mpres_t T2)
+pp1_mul_prac (mpresf_t A, ecm_uint k, mpmod_t n, mpresf_t t, mpresf_t B,
+              mpresf_t C, mpresf_t T, mpresf_t T2, mpresf_t two)
 {
+  mpresf_t A0 = A;
   ecm_uint d, e, r;
   static double val = 0.61803398874989485; /* 1/(golden ratio) */
 
@@ -71,9 +73,9 @@ pp1_mul_prac (mpres_t A, ecm_uint k, mpmod_t n, mpres_t t, mpres_t B,
   /* first iteration always begins by Condition 3, then a swap */
   d = k - r;
   e = 2 * r - k;
-  mpres_set (B, A, n); /* B=A */
-  mpres_set (C, A, n); /* C=A */
-  pp1_duplicate (A, A, n); /* A = 2*A */
+  mpresf_set (B, A, n); /* B=A */
+  mpresf_set (C, A, n); /* C=A */
+  pp1_duplicate (A, A, two, n); /* A = 2*A */
   while (d != e)
     {
       if (d < e)
@@ -81,7 +83,7 @@ pp1_mul_prac (mpres_t A, ecm_uint k, mpmod_t n, mpres_t t, mpres_t B,
           r = d;
           d = e;
           e = r;
-          mpres_swap (A, B, n);
+          mpresf_swap (A, B, n);
         }
       /* do the first line of Table 4 whose condition qualifies */
       if (d - e <= e / 4 && ((d + e) % 3) == 0)
@@ -91,49 +93,49 @@ pp1_mul_prac (mpres_t A, ecm_uint k, mpmod_t n, mpres_t t, mpres_t B,
           pp1_add3 (T,  A, B, C, n, t); /* T = f(A,B,C) */
           pp1_add3 (T2, T, A, B, n, t); /* T2 = f(T,A,B) */
           pp1_add3 (B,  B, T, A, n, t); /* B = f(B,T,A) */
-          mpres_swap (A, T2, n);    /* swap A and T2 */
+          mpresf_swap (A, T2, n);   /* swap A and T2 */
         }
       else if (d - e <= e / 4 && (d - e) % 6 == 0)
         { /* condition 2 */
           d = (d - e) / 2;
           pp1_add3 (B, A, B, C, n, t); /* B = f(A,B,C) */
-          pp1_duplicate (A, A, n);     /* A = 2*A */
+          pp1_duplicate (A, A, two, n); /* A = 2*A */
         }
       else if ((d + 3) / 4 <= e) /* <==>  (d <= 4 * e) */
         { /* condition 3 */
           d -= e;
           pp1_add3 (C, B, A, C, n, t); /* C = f(B,A,C) */
-          mpres_swap (B, C, n);
+          mpresf_swap (B, C, n);
         }
       else if ((d + e) % 2 == 0)
         { /* condition 4 */
           d = (d - e) / 2;
           pp1_add3 (B, B, A, C, n, t); /* B = f(B,A,C) */
-          pp1_duplicate (A, A, n);     /* A = 2*A */
+          pp1_duplicate (A, A, two, n); /* A = 2*A */
         }
       /* d+e is now odd */
       else if (d % 2 == 0)
         { /* condition 5 */
           d /= 2;
           pp1_add3 (C, C, A, B, n, t); /* C = f(C,A,B) */
-          pp1_duplicate (A, A, n);     /* A = 2*A */
+          pp1_duplicate (A, A, two, n); /* A = 2*A */
         }
       /* d is odd, e even */
       else if (d % 3 == 0)
         { /* condition 6 */
           d = d / 3 - e;
-          pp1_duplicate (T, A, n);       /* T = 2*A */
+          pp1_duplicate (T, A, two, n); /* T = 2*A */
           pp1_add3 (T2, A, B, C, n, t);  /* T2 = f(A,B,C) */
           pp1_add3 (A,  T, A, A, n, t);  /* A = f(T,A,A) */
           pp1_add3 (C,  T, T2, C, n, t); /* C = f(T,T2,C) */
-          mpres_swap (B, C, n);
+          mpresf_swap (B, C, n);
         }
       else if ((d + e) % 3 == 0) /* d+e <= val[i]*k < k < 2^32 */
         { /* condition 7 */
           d = (d - 2 * e) / 3;
           pp1_add3 (T, A, B, C, n, t); /* T1 = f(A,B,C) */
           pp1_add3 (B, T, A, B, n, t); /* B = f(T1,A,B) */
-          pp1_duplicate (T, A, n);
+          pp1_duplicate (T, A, two, n);
           pp1_add3 (A, A, T, A, n, t); /* A = 3*A */
         }
       else if ((d - e) % 3 == 0)
@@ -141,19 +143,23 @@ pp1_mul_prac (mpres_t A, ecm_uint k, mpmod_t n, mpres_t t, mpres_t B,
           d = (d - e) / 3;
           pp1_add3 (T, A, B, C, n, t); /* T1 = f(A,B,C) */
           pp1_add3 (C, C, A, B, n, t); /* C = f(A,C,B) */
-          mpres_swap (B, T, n);          /* swap B and T */
-          pp1_duplicate (T, A, n);
+          mpresf_swap (B, T, n);         /* swap B and T */
+          pp1_duplicate (T, A, two, n);
           pp1_add3 (A, A, T, A, n, t); /* A = 3*A */
         }
       else /* necessarily e is even */
         { /* condition 9: never happens? */
           e /= 2;
           pp1_add3 (C, C, B, A, n, t); /* C = f(C,B,A) */
-          pp1_duplicate (B, B, n);     /* B = 2*B */
+          pp1_duplicate (B, B, two, n); /* B = 2*B */
         }
     }
   
   pp1_add3 (A, A, B, C, n, t);
 
+  /* mpresf_swap exchanges pointers, thus the result may be elsewhere */
+  if (A != A0)
+    mpresf_set (A0, A, n);
+
   ASSERT(d == 1);
 }
@@ -43,14 +43,15 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 # include <signal.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
 #ifdef HAVE_GWNUM
 /* For GWNUM_VERSION */
 #include "gwnum.h"
 #endif
 
-/* Used in print_config() */
-#include "ecm-params.h"
-
 #ifdef HAVE_TORSION
 #include "torsions.h" /* to benefit from more torsion groups */
 #endif
@@ -81,6 +82,224 @@ stop_asap_test ()
   return exit_asap_value;
 }
 
+#ifdef HAVE_PTHREAD
+/* Multi-threaded loop mode (-t n): the curves for one input number are
+   run by a pool of worker threads. Each worker has its own ecm_params, hence
+   its own random number generator, sigma values and residues, and the
+   library output of each curve is captured in a temporary file so that it
+   can be printed in one piece once the curve is finished. */
+
+/* Set when a worker found a factor: the other workers then abandon their
+   current curve through the stop_asap hook */
+static volatile int curves_cancelled = 0;
+
+static int
+stop_asap_threads ()
+{
+  return exit_asap_value || curves_cancelled;
+}
+
+typedef struct
+{
+  pthread_mutex_t lock;   /* protects everything below, and stdout */
+  mpz_ptr n;              /* number to factor */
+  double B1;
+  ecm_params_ptr params;  /* parameters of the current run, read-only */
+  unsigned int count;     /* value of -c, to print "Run i out of count" */
+  unsigned int remaining; /* curves not yet started */
+  unsigned int done;      /* curves finished (and not cancelled) */
+  int winner;             /* worker that found a factor, or -1 */
+  int result;             /* return value of ecm_factor() for the winner */
+  int verbose;
+  char *savefilename;     /* save file, or NULL */
+  mpcandi_t *candi;       /* for the save file */
+  mpz_ptr orig_x0, orig_y0;
+  const char *comment;
+} curve_pool_t;
+
+typedef struct
+{
+  curve_pool_t *pool;
+  int id;
+  ecm_params params;      /* private copy of pool->params */
+  FILE *out;              /* receives the library output of one curve */
+  mpz_t f;                /* factor found */
+  pthread_t tid;
+} curve_worker_t;
+
+/* Copy to q the parameters of p that describe the next curve to run */
+static void
+curve_params_set (ecm_params_ptr q, ecm_params_ptr p)
+{
+  q->method = p->method;
+  mpz_set (q->x, p->x);
+  mpz_set (q->y, p->y);
+  q->param = p->param;
+  mpz_set (q->sigma, p->sigma);
+  q->sigma_is_A = p->sigma_is_A;
+  q->E->type = p->E->type;
+  q->E->law = p->E->law;
+  q->E->disc = p->E->disc;
+  mpz_set (q->E->a1, p->E->a1);
+  mpz_set (q->E->a2, p->E->a2);
+  mpz_set (q->E->a3, p->E->a3);
+  mpz_set (q->E->a4, p->E->a4);
+  mpz_set (q->E->a6, p->E->a6);
+  mpz_set (q->E->sq[0], p->E->sq[0]);
+  mpz_set (q->go, p->go);
+  q->B1done = p->B1done;
+  mpz_set (q->B2min, p->B2min);
+  mpz_set (q->B2, p->B2);
+  q->k = p->k;
+  q->S = p->S;
+  q->repr = p->repr;
+  q->nobase2step2 = p->nobase2step2;
+  q->verbose = p->verbose;
+  q->maxmem = p->maxmem;
+  q->stage1time = p->stage1time;
+  q->use_ntt = p->use_ntt;
+  q->stage2_threads = p->stage2_threads;
+  q->batch_s_threads = p->batch_s_threads;
+  q->stage2_engine = p->stage2_engine;
+  q->stop_asap = &stop_asap_threads;
+  q->gw_k = p->gw_k;
+  q->gw_b = p->gw_b;
+  q->gw_n = p->gw_n;
+  q->gw_c = p->gw_c;
+  /* a batch exponent loaded with -bloads is in the cache of the library, so
+     that batch_s only holds the value telling ecm() that -bsaves or -bloads
+     was given */
+  mpz_set (q->batch_s, p->batch_s);
+  q->batch_last_B1_used = p->batch_last_B1_used;
+}
+
+/* Print the first len bytes of the curve output captured in out */
+static void
+curve_output_flush (FILE *out, long len)
+{
+  char buf[4096];
+  size_t r;
+
+  rewind (out);
+  while (len > 0)
+    {
+      r = fread (buf, 1, MIN ((size_t) len, sizeof (buf)), out);
+      if (r == 0)
+        break;
+      fwrite (buf, 1, r, stdout);
+      len -= (long) r;
+    }
+  fflush (stdout);
+}
+
+static void *
+curve_worker (void *arg)
+{
+  curve_worker_t *w = (curve_worker_t *) arg;
+  curve_pool_t *pool = w->pool;
+  unsigned int run;
+  long len;
+  int res;
+
+  while (1)
+    {
+      pthread_mutex_lock (&pool->lock);
+      if (pool->remaining == 0 || pool->winner >= 0 || exit_asap_value)
+        {
+          pthread_mutex_unlock (&pool->lock);
+          break;
+        }
+      run = pool->count - pool->remaining + 1;
+      pool->remaining --;
+      curve_params_set (w->params, pool->params);
+      pthread_mutex_unlock (&pool->lock);
+
+      rewind (w->out);
+      res = ecm_factor (w->f, pool->n, pool->B1, w->params);
+      fflush (w->out);
+      len = ftell (w->out);
+
+      pthread_mutex_lock (&pool->lock);
+      if (pool->winner >= 0)
+        {
+          /* another worker found a factor while we were running: this
+             curve was interrupted, forget it */
+          pthread_mutex_unlock (&pool->lock);
+          break;
+        }
+      /* the curves finish in any order: each one has its header, the
+         first one included */
+      if (pool->verbose >= OUTPUT_NORMAL)
+        printf ("Run %u out of %u:\n", run, pool->count);
+      curve_output_flush (w->out, len);
+      pool->done ++;
+      if (res == ECM_ERROR || ECM_FACTOR_FOUND_P (res))
+        {
+          /* the factor is processed by the main thread, which also writes
+             the save file entry for this curve */
+          pool->winner = w->id;
+          pool->result = res;
+          curves_cancelled = 1;
+        }
+      else if (pool->savefilename != NULL && !pool->candi->isPrp)
+        write_resumefile (pool->savefilename, w->params->method, pool->n,
+                          w->params, pool->candi, pool->orig_x0,
+                          pool->orig_y0, pool->comment, NULL);
+      pthread_mutex_unlock (&pool->lock);
+    }
+
+  return NULL;
+}
+
+/* Run the *cnt remaining curves on n with B1 using nthreads workers.
+   Stop as soon as one of them finds a factor, which is put in f. Then
+   the parameters of that curve are copied to params, so that the caller can
+   write them to a save file. Decrease *cnt by the number of curves
+   performed and return the result of the successful curve, or
+   ECM_NO_FACTOR_FOUND. */
+static int
+run_curves_threaded (mpz_t f, mpz_t n, double B1, ecm_params params,
+                     curve_pool_t *pool, curve_worker_t *W,
+                     unsigned int nthreads, unsigned int *cnt)
+{
+  curve_worker_t *w;
+  unsigned int i;
+
+  pool->n = n;
+  pool->B1 = B1;
+  pool->params = params;
+  /* with -c 0, *cnt wraps around like in the sequential loop */
+  pool->remaining = (*cnt == 0) ? UINT_MAX : *cnt;
+  pool->done = 0;
+  pool->winner = -1;
+  pool->result = ECM_NO_FACTOR_FOUND;
+  curves_cancelled = 0;
+
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create (&W[i].tid, NULL, curve_worker, (void *) (W + i)) != 0)
+      {
+        fprintf (stderr, "Error, could not create thread %u\n", i);
+        exit (EXIT_FAILURE);
+      }
+  for (i = 0; i < nthreads; i++)
+    pthread_join (W[i].tid, NULL);
+
+  *cnt -= pool->done;
+
+  if (pool->winner < 0)
+    return ECM_NO_FACTOR_FOUND;
+
+  w = W + pool->winner;
+  mpz_set (f, w->f);
+  mpz_set (params->x, w->params->x);
+  mpz_set (params->y, w->params->y);
+  mpz_set (params->sigma, w->params->sigma);
+  params->param = w->params->param;
+  params->B1done = w->params->B1done;
+  return pool->result;
+}
+#endif
+
 static void
 usage (void)
 {
@@ -102,6 +321,10 @@ usage (void)
     printf ("  -power n     use x^n for Brent-Suyama's extension\n");
     printf ("  -dickson n   use n-th Dickson's polynomial for Brent-Suyama's extension\n");
     printf ("  -c n         perform n runs for each input\n");
+#ifdef HAVE_PTHREAD
+    printf ("  -t n         perform the runs for each input with n threads\n");
+    printf ("  -t2 n        use n threads in stage 2\n");
+#endif
     printf ("  -pm1         perform P-1 instead of ECM\n");
     printf ("  -pp1         perform P+1 instead of ECM\n");
     printf ("  -q           quiet mode\n");
@@ -115,12 +338,18 @@ usage (void)
     printf ("  -base2 n     force base 2 mode with 2^n+1 (n>0) or 2^|n|-1 (n<0)\n");
     printf ("  -ntt         enable NTT convolution routines in stage 2\n");
     printf ("  -no-ntt      disable NTT convolution routines in stage 2\n");
+    printf ("  -sc          [ECM only] use the standard continuation in stage 2\n");
+    printf ("  -no-sc       [ECM only] use the polynomial continuation in stage 2\n");
     printf ("  -save file   save residues at end of stage 1 to file\n");
     printf ("  -savea file  like -save, appends to existing files\n");
     printf ("  -resume file resume residues from file, reads from stdin if file is \"-\"\n");
-    printf ("  -chkpnt file save periodic checkpoints during stage 1 to file (for -param 0)\n");
+    printf ("  -split n     [ECM only] with -resume and -save, save the stage 2 of each\n"
+            "               residue as n units instead of running it\n");
+    printf ("  -checkunits file check that all stage 2 units in file were done and exit\n");
+    printf ("  -chkpnt file save periodic checkpoints during stage 1 to file (for -param 0-3)\n"
+            "               and during stage 2 of P-1 and P+1\n");
     printf ("  -primetest   perform a primality test on input\n");
-    printf ("  -treefile f  [ECM only] store stage 2 data in files f.0, ... \n");
+    printf ("  -treefile f  [ECM only] store stage 2 data in file f\n");
     printf ("  -maxmem n    use at most n MB of memory in stage 2\n");
     printf ("  -stage1time n add n seconds to ECM stage 1 time (for expected time est.)\n");
 
@@ -133,6 +362,8 @@ usage (void)
 
     printf ("  -bsaves file With -param 1-3, save stage 1 exponent in file.\n");
     printf ("  -bloads file With -param 1-3, load stage 1 exponent from file.\n");
+    printf ("  -cpubatch n  [ECM only] compute stage 1 of n curves at once on the CPU,\n"
+            "               with -param 3, like -gpu does\n");
 #ifdef WITH_GPU
     printf ("  -gpu         Use GPU-ECM for stage 1.\n");
     printf ("  -gpudevice n Use device n to execute GPU code (by default, "
@@ -169,6 +400,13 @@ print_config ()
   printf ("ECM_TUNE_CASE not defined.\n");
 #endif
 
+#ifdef WANT_FAT_BINARY
+  printf ("WANT_FAT_BINARY = %d (parameters chosen for the running cpu)\n",
+          WANT_FAT_BINARY);
+#else
+  printf ("WANT_FAT_BINARY undefined\n");
+#endif
+
 #ifdef GWNUM_VERSION
   printf ("Included GWNUM header files version %s\n", GWNUM_VERSION);
 #else
@@ -181,6 +419,18 @@ print_config ()
   printf ("HAVE_SSE2 undefined\n");
 #endif
 
+#ifdef HAVE_AVX2
+  printf ("HAVE_AVX2 = %d\n", HAVE_AVX2);
+#else
+  printf ("HAVE_AVX2 undefined\n");
+#endif
+
+#ifdef HAVE_NTT_SIMD
+  printf ("HAVE_NTT_SIMD = %d\n", HAVE_NTT_SIMD);
+#else
+  printf ("HAVE_NTT_SIMD undefined\n");
+#endif
+
 #ifdef HAVE___GMPN_ADD_NC
   printf ("HAVE___GMPN_ADD_NC = %d\n", HAVE___GMPN_ADD_NC);
 #else
@@ -222,59 +472,78 @@ print_config ()
   printf ("_OPENMP undefined\n");
 #endif
 
+#ifdef HAVE_PTHREAD
+  printf ("HAVE_PTHREAD = %d\n", HAVE_PTHREAD);
+#else
+  printf ("HAVE_PTHREAD undefined\n");
+#endif
+
 #ifdef MPZMOD_THRESHOLD
-  printf ("MPZMOD_THRESHOLD = %d\n", MPZMOD_THRESHOLD);
+  printf ("MPZMOD_THRESHOLD = %d\n", (int) MPZMOD_THRESHOLD);
 #else
   printf ("MPZMOD_THRESHOLD undefined\n");
 #endif
 
 #ifdef REDC_THRESHOLD
-  printf ("REDC_THRESHOLD = %d\n", REDC_THRESHOLD);
+  printf ("REDC_THRESHOLD = %d\n", (int) REDC_THRESHOLD);
 #else
   printf ("REDC_THRESHOLD undefined\n");
 #endif
 
 #ifdef MUL_NTT_THRESHOLD
-  printf ("MUL_NTT_THRESHOLD = %d\n", MUL_NTT_THRESHOLD);
+  printf ("MUL_NTT_THRESHOLD = %d\n", (int) MUL_NTT_THRESHOLD);
 #else
   printf ("MUL_NTT_THRESHOLD undefined\n");
 #endif
 
 #ifdef NTT_GFP_TWIDDLE_DIF_BREAKOVER
   printf ("NTT_GFP_TWIDDLE_DIF_BREAKOVER = %d\n", 
-	  NTT_GFP_TWIDDLE_DIF_BREAKOVER);
+	  (int) NTT_GFP_TWIDDLE_DIF_BREAKOVER);
 #else
   printf ("NTT_GFP_TWIDDLE_DIF_BREAKOVER undefined\n");
 #endif
 
 #ifdef NTT_GFP_TWIDDLE_DIT_BREAKOVER
   printf ("NTT_GFP_TWIDDLE_DIT_BREAKOVER = %d\n", 
-	  NTT_GFP_TWIDDLE_DIT_BREAKOVER);
+	  (int) NTT_GFP_TWIDDLE_DIT_BREAKOVER);
 #else
   printf ("NTT_GFP_TWIDDLE_DIT_BREAKOVER undefined\n");
 #endif
 
+#ifdef NTT_GFP_BLOCK_BREAKOVER
+  printf ("NTT_GFP_BLOCK_BREAKOVER = %d\n", (int) NTT_GFP_BLOCK_BREAKOVER);
+#else
+  printf ("NTT_GFP_BLOCK_BREAKOVER undefined\n");
+#endif
+
 #ifdef PREREVERTDIVISION_NTT_THRESHOLD
   printf ("PREREVERTDIVISION_NTT_THRESHOLD = %d\n", 
-          PREREVERTDIVISION_NTT_THRESHOLD);
+          (int) PREREVERTDIVISION_NTT_THRESHOLD);
 #else
   printf ("PREREVERTDIVISION_NTT_THRESHOLD undefined\n");
 #endif
 
+#ifdef MONTGOMERY_REDUCE_NTT_THRESHOLD
+  printf ("MONTGOMERY_REDUCE_NTT_THRESHOLD = %d\n",
+          (int) MONTGOMERY_REDUCE_NTT_THRESHOLD);
+#else
+  printf ("MONTGOMERY_REDUCE_NTT_THRESHOLD undefined\n");
+#endif
+
 #ifdef POLYINVERT_NTT_THRESHOLD
-  printf ("POLYINVERT_NTT_THRESHOLD = %d\n", POLYINVERT_NTT_THRESHOLD);
+  printf ("POLYINVERT_NTT_THRESHOLD = %d\n", (int) POLYINVERT_NTT_THRESHOLD);
 #else
   printf ("POLYINVERT_NTT_THRESHOLD undefined\n");
 #endif
 
 #ifdef POLYEVALT_NTT_THRESHOLD
-  printf ("POLYEVALT_NTT_THRESHOLD = %d\n", POLYEVALT_NTT_THRESHOLD);
+  printf ("POLYEVALT_NTT_THRESHOLD = %d\n", (int) POLYEVALT_NTT_THRESHOLD);
 #else
   printf ("POLYEVALT_NTT_THRESHOLD undefined\n");
 #endif
 
 #ifdef MPZSPV_NORMALISE_STRIDE
-  printf ("MPZSPV_NORMALISE_STRIDE = %d\n", MPZSPV_NORMALISE_STRIDE);
+  printf ("MPZSPV_NORMALISE_STRIDE = %d\n", (int) MPZSPV_NORMALISE_STRIDE);
 #else
   printf ("MPZSPV_NORMALISE_STRIDE undefined\n");
 #endif
@@ -385,6 +654,18 @@ main (int argc, char *argv[])
   double autoincrementB1 = 0.0, startingB1;
   unsigned int count = 1; /* number of curves for each number */
   unsigned int cnt = 0;   /* number of remaining curves for current number */
+  unsigned int nthreads = 1; /* number of threads running curves (-t) */
+  unsigned int stage2_threads = 1; /* number of threads in stage 2 (-t2) */
+  int stage2_engine = ECM_STAGE2_DEFAULT; /* -sc, -no-sc */
+  unsigned int split_units = 0; /* number of stage 2 units (-split) */
+  mpz_t *split_bounds = NULL;   /* their bounds, see ecm_stage2_split() */
+  stage2_unit_t unit;           /* stage 2 unit of the residue, if any */
+  stage1_ladder_t ladder;       /* batch stage 1 of the residue, if any */
+#ifdef HAVE_PTHREAD
+  curve_pool_t pool;
+  curve_worker_t *workers = NULL;
+#endif
+  int threaded = 0; /* were the curves of this iteration run by the pool? */
   int deep=1;
   double maxmem = 0.;
   double stage1time = 0.;
@@ -403,6 +684,9 @@ main (int argc, char *argv[])
                       /* chooses)                                             */
   unsigned int gpucurves = 0; /* How many curves do we want for GPU code */ 
                               /* (by default CUDA chooses)               */
+  unsigned int cpubatch = 0; /* number of curves in stage 1 on the CPU at */
+                             /* once (by default one at a time)          */
+  int multi_curves; /* does a call of ecm_factor() run several curves */
 
   /* check ecm is linked with a compatible library */
   if (mp_bits_per_limb != GMP_NUMB_BITS)
@@ -423,6 +707,14 @@ main (int argc, char *argv[])
   mpz_init (B2);
   mpz_init (B2min);
   mpz_init (startingB2min);
+  mpz_init (unit.B2min);
+  mpz_init (unit.B2);
+  mpz_init (unit.factor);
+  mpz_init (unit.fs2_m_1);
+  unit.j = 0;
+  unit.fs2_done = 0;
+  mpz_init (ladder.x2);
+  ladder.bits = 0;
   mpq_init (rat_A);
   mpq_init (rat_x0);
   mpq_init (rat_y0);
@@ -502,6 +794,18 @@ main (int argc, char *argv[])
 	  argv++;
 	  argc--;
 	}
+      else if (strcmp (argv[1], "-sc") == 0)
+	{
+	  stage2_engine = ECM_STAGE2_SC;
+	  argv++;
+	  argc--;
+	}
+      else if (strcmp (argv[1], "-no-sc") == 0)
+	{
+	  stage2_engine = ECM_STAGE2_POLY;
+	  argv++;
+	  argc--;
+	}
       else if (strcmp (argv[1], "-primetest") == 0)
         {
           primetest = 1;
@@ -526,6 +830,18 @@ main (int argc, char *argv[])
           argv += 2;
           argc -= 2;
         }
+      else if ((argc > 2) && (strcmp (argv[1], "-cpubatch") == 0))
+        {
+          if (atoi (argv[2]) < 1)
+            {
+              fprintf (stderr, "Error, the -cpubatch n option requires "
+                               "n > 0\n");
+              exit (EXIT_FAILURE);
+            }
+          cpubatch = atoi (argv[2]);
+          argv += 2;
+          argc -= 2;
+        }
       else if (strcmp (argv[1], "-h") == 0 || strcmp (argv[1], "--help") == 0)
         {
           usage ();
@@ -673,6 +989,44 @@ main (int argc, char *argv[])
 	  argv += 2;
 	  argc -= 2;
 	}
+      else if ((argc > 2) && (strcmp (argv[1], "-t") == 0))
+	{
+	  nthreads = atoi (argv[2]);
+	  if (atoi (argv[2]) < 1)
+	    {
+	      fprintf (stderr, "Error, the -t n option requires n > 0\n");
+	      exit (EXIT_FAILURE);
+	    }
+#ifndef HAVE_PTHREAD
+	  if (nthreads > 1)
+	    {
+	      fprintf (stderr, "Error, -t needs POSIX threads, which were not "
+	                       "available at compile time\n");
+	      exit (EXIT_FAILURE);
+	    }
+#endif
+	  argv += 2;
+	  argc -= 2;
+	}
+      else if ((argc > 2) && (strcmp (argv[1], "-t2") == 0))
+	{
+	  stage2_threads = atoi (argv[2]);
+	  if (atoi (argv[2]) < 1)
+	    {
+	      fprintf (stderr, "Error, the -t2 n option requires n > 0\n");
+	      exit (EXIT_FAILURE);
+	    }
+#ifndef HAVE_PTHREAD
+	  if (stage2_threads > 1)
+	    {
+	      fprintf (stderr, "Error, -t2 needs POSIX threads, which were not "
+	                       "available at compile time\n");
+	      exit (EXIT_FAILURE);
+	    }
+#endif
+	  argv += 2;
+	  argc -= 2;
+	}
       else if ((argc > 2) && (strcmp (argv[1], "-save") == 0))
 	{
 	  savefilename = argv[2];
@@ -693,6 +1047,35 @@ main (int argc, char *argv[])
 	  argv += 2;
 	  argc -= 2;
 	}
+      else if ((argc > 2) && (strcmp (argv[1], "-split") == 0))
+	{
+	  if (atoi (argv[2]) < 1)
+	    {
+	      fprintf (stderr, "Error, the -split n option requires n > 0\n");
+	      exit (EXIT_FAILURE);
+	    }
+	  split_units = atoi (argv[2]);
+	  argv += 2;
+	  argc -= 2;
+	}
+      else if ((argc > 2) && (strcmp (argv[1], "-checkunits") == 0))
+	{
+	  FILE *unitsfile;
+
+	  if (strcmp (argv[2], "-") == 0)
+	    unitsfile = stdin;
+	  else if ((unitsfile = fopen (argv[2], "r")) == NULL)
+	    {
+	      fprintf (stderr, "Could not open file %s for reading\n",
+		       argv[2]);
+	      exit (EXIT_FAILURE);
+	    }
+	  init_expr ();
+	  returncode = check_stage2_units (unitsfile) ? 0 : EXIT_FAILURE;
+	  if (unitsfile != stdin)
+	    fclose (unitsfile);
+	  goto free_all;
+	}
       else if ((argc > 2) && (strcmp (argv[1], "-chkpnt") == 0))
 	{
 	  chkfilename = argv[2];
@@ -1032,14 +1415,28 @@ main (int argc, char *argv[])
                                   /* use_gpu = 0, it has no meaning   */
   params->gpu_number_of_curves = gpucurves; /* If WITH_GPU is not defined or */
                                             /* use_gpu = 0, it has no meaning*/
+  if (cpubatch != 0 && (use_gpu || method != ECM_ECM))
+    {
+      fprintf (stderr, "Error, -cpubatch is only for ECM, without -gpu\n");
+      exit (EXIT_FAILURE);
+    }
+  params->cpubatch = cpubatch;
+  params->stage2_threads = stage2_threads;
+  /* the threads of -t wait for s anyway, and those of -t2 are idle in
+     stage 1 */
+  params->batch_s_threads = (nthreads > stage2_threads) ? nthreads
+                                                        : stage2_threads;
+  params->stage2_engine = stage2_engine;
+  multi_curves = use_gpu || cpubatch != 0;
 
   /* Open resume file for reading, if resuming is requested */
   if (resumefilename != NULL)
     {
-      /* -resume should not be used with -gpu */
-      if (use_gpu)
+      /* -resume should not be used with -gpu or -cpubatch */
+      if (use_gpu || cpubatch != 0)
         {
-          fprintf (stderr, "Error, -resume not allowed with -gpu\n");
+          fprintf (stderr, "Error, -resume not allowed with -gpu or "
+                           "-cpubatch\n");
           exit (EXIT_FAILURE);
         }
       if (strcmp (resumefilename, "-") == 0)
@@ -1058,6 +1455,26 @@ main (int argc, char *argv[])
       mpz_set_ui (resume_lastfac, 1);
     }
 
+  if (split_units > 0)
+    {
+      unsigned int j;
+
+      if (resumefile == NULL || savefilename == NULL || method != ECM_ECM)
+        {
+          fprintf (stderr, "Error, -split needs -resume and -save, and is "
+                   "only for ECM\n");
+          exit (EXIT_FAILURE);
+        }
+      split_bounds = (mpz_t *) malloc ((split_units + 1) * sizeof (mpz_t));
+      if (split_bounds == NULL)
+        {
+          fprintf (stderr, "Error, cannot allocate memory for -split\n");
+          exit (EXIT_FAILURE);
+        }
+      for (j = 0; j <= split_units; j++)
+        mpz_init (split_bounds[j]);
+    }
+
   /* Open save file for writing, if saving is requested */
   if (savefilename != NULL)
     {
@@ -1104,6 +1521,11 @@ main (int argc, char *argv[])
       specific_x0 = 0;
     }
 
+  if (method == ECM_ECM && stage2_engine == ECM_STAGE2_SC &&
+      (S != ECM_DEFAULT_S || k != ECM_DEFAULT_K || TreeFilename != NULL))
+    printf ("Warning: -power, -dickson, -k and -treefile parameters are\n"
+            "ignored by the standard continuation (-sc).\n");
+
   mpcandi_t_init (&n); /* number(s) to factor */
   mpz_init (f); /* factor found */
   mpz_init (x); /* stage 1 residue */
@@ -1113,11 +1535,12 @@ main (int argc, char *argv[])
 
   /* Install signal handlers */
 #ifdef HAVE_SIGNAL
-  /* We catch signals only if there is a savefile. Otherwise there's nothing
-     we could save by exiting cleanly, but the waiting for the code to check
-     for signals may delay program end unacceptably */
+  /* We catch signals only if there is a savefile or a checkpoint file.
+     Otherwise there's nothing we could save by exiting cleanly, but the
+     waiting for the code to check for signals may delay program end
+     unacceptably */
 
-  if (savefilename != NULL)
+  if (savefilename != NULL || chkfilename != NULL)
     {
       signal (SIGINT, &signal_handler);
       signal (SIGTERM, &signal_handler);
@@ -1125,6 +1548,60 @@ main (int argc, char *argv[])
     }
 #endif
 
+#ifdef HAVE_PTHREAD
+  if (nthreads > 1)
+    {
+      unsigned int i;
+
+      if (resumefile != NULL || chkfilename != NULL || TreeFilename != NULL
+          || autoincrementB1 > 0.0 || use_gpu || cpubatch != 0
+#ifdef HAVE_TORSION
+          || torsion != NULL
+#endif
+          )
+        {
+          fprintf (stderr, "Error, option -t is incompatible with -resume, "
+                   "-chkpnt, -treefile, -I, -gpu, -cpubatch and -torsion\n");
+          exit (EXIT_FAILURE);
+        }
+
+      pthread_mutex_init (&pool.lock, NULL);
+      pool.count = count;
+      pool.verbose = verbose;
+      pool.savefilename = savefilename;
+      pool.candi = &n;
+      pool.orig_x0 = orig_x0;
+      pool.orig_y0 = orig_y0;
+      pool.comment = comment;
+
+      /* each worker draws its random numbers from its own generator,
+         seeded from ours */
+      init_randstate (params->rng);
+      workers = (curve_worker_t *) malloc (nthreads * sizeof (curve_worker_t));
+      if (workers == NULL)
+        {
+          fprintf (stderr, "Cannot allocate memory in main\n");
+          exit (EXIT_FAILURE);
+        }
+      for (i = 0; i < nthreads; i++)
+        {
+          workers[i].pool = &pool;
+          workers[i].id = i;
+          ecm_init (workers[i].params);
+          gmp_randseed_ui (workers[i].params->rng,
+                           gmp_urandomb_ui (params->rng, 32) + i);
+          workers[i].params->os = workers[i].out = tmpfile ();
+          if (workers[i].out == NULL)
+            {
+              fprintf (stderr, "Error, could not create temporary file for "
+                       "thread %u\n", i);
+              exit (EXIT_FAILURE);
+            }
+          mpz_init (workers[i].f);
+        }
+    }
+#endif
+
   /* loop for number in standard input or file */
 
   startingB1 = B1;
@@ -1150,7 +1627,8 @@ main (int argc, char *argv[])
           if (!read_resumefile_line (&method, x, y, &n, sigma, A, 
 				     orig_x0, orig_y0, &(params->E->type), 
 				     &(params->param), &(params->B1done), 
-				     program, who, rtime, comment, resumefile))
+				     program, who, rtime, comment, &unit,
+				     &ladder, resumefile))
             break;
 
 	  if (params->E->type == ECM_EC_TYPE_WEIERSTRASS
@@ -1203,6 +1681,8 @@ main (int argc, char *argv[])
                 printf ("with %s ", program);
               if (rtime[0])
                 printf ("on %s ", rtime);
+              if (unit.j > 0)
+                printf ("for stage 2 unit %u of %u ", unit.j, unit.K);
               if (comment[0])
                 printf ("(%s)", comment);
               printf ("\n");
@@ -1212,7 +1692,8 @@ main (int argc, char *argv[])
         {
           if (cnt) /* nothing to read: reuse old number */   
             {
-              if (verbose >= OUTPUT_NORMAL)
+              /* with -t, the workers print the header of each curve */
+              if (verbose >= OUTPUT_NORMAL && nthreads <= 1)
                 printf ("Run %u out of %u:\n", count - cnt + 1, count);
             }
           else /* new number */
@@ -1347,17 +1828,20 @@ main (int argc, char *argv[])
       if (params->param == ECM_PARAM_DEFAULT)
           params->param = param;
 
-      /* this is a hack to produce an error in ecm() when -bsaves is used
-         but we are not in batch mode */
-      if (savefile_s != NULL)
+      /* this is a hack to produce an error in ecm() when -bsaves or -bloads
+         is used but we are not in batch mode */
+      if (savefile_s != NULL || loadfile_s != NULL)
         mpz_set_ui (params->batch_s, 2);
 
-      /* load batch product s from a file */
+      /* load batch product s from a file, and put it in the cache of the
+         library, where all threads will find it */
       if (loadfile_s != NULL)
         {
           int st = cputime ();
-          params->batch_last_B1_used = B1;
-          if (read_s_from_file (params->batch_s, loadfile_s, B1))
+          mpz_t s;
+
+          mpz_init (s);
+          if (read_s_from_file (s, loadfile_s, B1))
             {
               fprintf (stderr, "Error while reading s from file\n");
               exit (EXIT_FAILURE);
@@ -1365,8 +1849,10 @@ main (int argc, char *argv[])
           else if (verbose >= OUTPUT_VERBOSE)
               fprintf (stdout, "Reading batch product (of %"PRIu64" bits) of "
                                "primes up to B1=%1.0f from %s took %ldms\n", 
-                               mpz_sizeinbase (params->batch_s, 2), B1,
+                               mpz_sizeinbase (s, 2), B1,
                                loadfile_s, cputime () - st);
+          ecm_batch_s_set (params, B1, s);
+          mpz_clear (s);
         }
 
       /* set parameters that may change from one curve to another */
@@ -1428,6 +1914,20 @@ main (int argc, char *argv[])
       mpz_set (params->sigma, (params->sigma_is_A) ? A : sigma);
       mpz_set (params->go, go.Candi.n); /* may change if contains N */
       mpz_set (params->B2min, B2min); /* may change with -c */
+      mpz_set (params->B2, B2);
+      if (unit.j > 0) /* a residue saved by -split runs its part of stage 2 */
+        {
+          mpz_set (params->B2min, unit.B2min);
+          mpz_set (params->B2, unit.B2);
+        }
+      /* a P-1 or P+1 residue from a checkpoint written during stage 2 */
+      params->fs2_done = unit.fs2_done;
+      memcpy (params->fs2_param, unit.fs2_param, sizeof (unit.fs2_param));
+      mpz_set (params->fs2_m_1, unit.fs2_m_1);
+      /* an ECM residue from a checkpoint written during batch stage 1 */
+      params->batch_ladder_bits = ladder.bits;
+      mpz_set (params->batch_ladder_x2, ladder.x2);
+      params->batch_ladder_B1 = ladder.B1;
       /* Default, for P-1/P+1 with old stage 2 and ECM, use NTT only 
          for small input */
       if (use_ntt == 1 && (method == ECM_ECM || S != ECM_DEFAULT_S)) 
@@ -1478,10 +1978,59 @@ main (int argc, char *argv[])
       mpmod_selftest (n.n);
 #endif
 
+      /* with -split, save the stage 2 units of the residue instead of
+         running it */
+      if (split_units > 0)
+        {
+          if (method != ECM_ECM || unit.j > 0)
+            {
+              fprintf (stderr, "Error, -split needs ECM residues not already "
+                       "split\n");
+              exit (EXIT_FAILURE);
+            }
+          if (ecm_stage2_split (split_bounds, split_units, n.n, B1, params)
+              == ECM_ERROR)
+            {
+              fprintf (stderr, "Please report internal errors at <%s>.\n",
+                       PACKAGE_BUGREPORT);
+              exit (EXIT_FAILURE);
+            }
+          unit.K = split_units;
+          for (unit.j = 1; unit.j <= split_units; unit.j++)
+            {
+              mpz_set (unit.B2min, split_bounds[unit.j - 1]);
+              mpz_set (unit.B2, split_bounds[unit.j]);
+              write_resumefile (savefilename, method, n.n, params, &n,
+                                orig_x0, orig_y0, comment, &unit);
+            }
+          unit.j = 0;
+          if (verbose >= OUTPUT_NORMAL)
+            {
+              printf ("Saved %u stage 2 units for B2=", split_units);
+              mpz_out_str (stdout, 10, split_bounds[0]);
+              printf ("-");
+              mpz_out_str (stdout, 10, split_bounds[split_units]);
+              printf ("\n");
+            }
+          continue;
+        }
+
       /* now call the ecm library */
+      threaded = 0;
       if (result == ECM_NO_FACTOR_FOUND)
+        {
+#ifdef HAVE_PTHREAD
+          if (nthreads > 1)
+            {
+              result = run_curves_threaded (f, n.n, B1, params, &pool,
+                                            workers, nthreads, &cnt);
+              threaded = 1;
+            }
+          else
+#endif
 	  /* if torsion was used, some factor may have been found... */
 	  result = ecm_factor (f, n.n, B1, params);
+        }
 
       if (result == ECM_ERROR)
         {
@@ -1490,20 +2039,36 @@ main (int argc, char *argv[])
           exit (EXIT_FAILURE);
         }
       
-      if (!params->gpu)
+      if (threaded)
+          ; /* run_curves_threaded() already updated cnt */
+      else if (!multi_curves)
           cnt --; /* one more curve performed */
       else
         {
-          if (cnt <= params->gpu_number_of_curves)
+          unsigned int nb_curves = params->gpu ? params->gpu_number_of_curves
+                                               : params->cpubatch;
+          if (cnt <= nb_curves)
               cnt = 0;
           else
-              cnt -= params->gpu_number_of_curves; 
+              cnt -= nb_curves; 
         }
 
-      /* When GPU is used we need to have the value of N before it is 
-        divided by potential factor in f */
+      /* When GPU or -cpubatch is used we need to have the value of N before
+        it is divided by potential factor in f */
       mpz_init_set (tmp_n, n.n);
 
+      /* A stage 2 unit of -split which found a factor is done as well: its
+         line, with the N of the other units and the factor, tells so to
+         -checkunits */
+      if (savefilename != NULL && unit.j > 0 &&
+          result != ECM_NO_FACTOR_FOUND)
+        {
+          mpz_set (unit.factor, f);
+          write_resumefile (savefilename, method, tmp_n, params, &n,
+                            orig_x0, orig_y0, comment, &unit);
+          mpz_set_ui (unit.factor, 0);
+        }
+
       if (result != ECM_NO_FACTOR_FOUND)
         {
           mpz_t tmp_factor;
@@ -1511,15 +2076,15 @@ main (int argc, char *argv[])
           mpz_init (tmp_factor);
           do 
             {
-              if (params->gpu)
+              if (multi_curves)
                   mpz_fdiv_qr (f, tmp_factor, f, tmp_n);
               else
                   mpz_set (tmp_factor, f);
 
               returncode = process_newfactor (tmp_factor, result, &n, method,
-                                 returncode, params->gpu, &cnt, &resume_wasPrp,
+                                 returncode, multi_curves, &cnt, &resume_wasPrp,
                                  resume_lastfac, resumefile, verbose, deep);
-            } while (params->gpu && mpz_cmp_ui (f, 0) != 0 
+            } while (multi_curves && mpz_cmp_ui (f, 0) != 0 
                                  && returncode != ECM_INPUT_NUMBER_FOUND);
           mpz_clear (tmp_factor);
         }
@@ -1537,11 +2102,14 @@ main (int argc, char *argv[])
 
       /* Write composite cofactors to savefile if requested */
       /* If no factor was found, we consider cofactor composite and write it */
-      if (savefilename != NULL && !n.isPrp)
+      /* With -t, the worker threads wrote the curves without factor */
+      if (savefilename != NULL && !n.isPrp &&
+          (!threaded || result != ECM_NO_FACTOR_FOUND) &&
+          (unit.j == 0 || result == ECM_NO_FACTOR_FOUND))
         {
         /* TODO Deal with return code */
 	    write_resumefile (savefilename, method, tmp_n, params, &n, 
-			      orig_x0, orig_y0, comment);
+			      orig_x0, orig_y0, comment, &unit);
         }
 
       mpz_clear (tmp_n);
@@ -1549,7 +2117,8 @@ main (int argc, char *argv[])
       /* Save the batch exponent s if requested */
       if (savefile_s != NULL)
         {
-          int ret = write_s_in_file (savefile_s, params->batch_s);
+          int ret = write_s_in_file (savefile_s,
+                                     (mpz_ptr) ecm_batch_s_get (params, B1));
           if (verbose >= OUTPUT_VERBOSE && ret > 0)
               printf ("Saved batch product (of %u bytes) in %s\n", ret, 
                       savefile_s);
@@ -1578,6 +2147,22 @@ main (int argc, char *argv[])
       mpz_clear (resume_lastfac);
     }
 
+#ifdef HAVE_PTHREAD
+  if (workers != NULL)
+    {
+      unsigned int i;
+
+      for (i = 0; i < nthreads; i++)
+        {
+          mpz_clear (workers[i].f);
+          fclose (workers[i].out);
+          ecm_clear (workers[i].params);
+        }
+      free (workers);
+      pthread_mutex_destroy (&pool.lock);
+    }
+#endif
+
   mpz_clear (orig_y0);
   mpz_clear (orig_x0);
   mpz_clear (y);
@@ -1591,6 +2176,19 @@ main (int argc, char *argv[])
   mpq_clear (rat_y0);
   mpq_clear (rat_x0);
   mpq_clear (rat_A);
+  if (split_bounds != NULL)
+    {
+      unsigned int j;
+
+      for (j = 0; j <= split_units; j++)
+        mpz_clear (split_bounds[j]);
+      free (split_bounds);
+    }
+  mpz_clear (unit.B2);
+  mpz_clear (unit.B2min);
+  mpz_clear (unit.factor);
+  mpz_clear (unit.fs2_m_1);
+  mpz_clear (ladder.x2);
   mpz_clear (startingB2min);
   mpz_clear (B2min);
   mpz_clear (B2);
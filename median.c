@@ -36,7 +36,6 @@ Proc. of ISSAC'03, Philadelphia, 2003.
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-extern unsigned int Fermat;
 
 static void list_add_wrapper (listz_t, listz_t, listz_t, unsigned int,
                               unsigned int);
@@ -730,7 +729,8 @@ TToomCookMul_space (unsigned int n, unsigned int m, unsigned int l)
 */
 int
 TMulGen (listz_t b, unsigned int n, listz_t a, unsigned int m,
-         listz_t c, unsigned int l, listz_t tmp, mpz_t modulus)
+         listz_t c, unsigned int l, listz_t tmp, mpz_t modulus,
+         unsigned int Fermat)
 {
   ASSERT (n <= l);
     
@@ -756,7 +756,8 @@ TMulGen (listz_t b, unsigned int n, listz_t a, unsigned int m,
 
 
 unsigned int
-TMulGen_space (unsigned int n, unsigned int m, unsigned int l)
+TMulGen_space (unsigned int n, unsigned int m, unsigned int l,
+               unsigned int Fermat)
 {
     if (Fermat)
       return 2 * (l + 1);
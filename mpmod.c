@@ -30,7 +30,7 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
   #include "mulredc.h"
 #endif
 
-FILE *ECM_STDOUT, *ECM_STDERR; /* define them here since needed in tune.c */
+ECM_TLS FILE *ECM_STDOUT, *ECM_STDERR; /* define them here since needed in tune.c */
 
 /* define WANT_ASSERT to check normalization of residues */
 /* #define WANT_ASSERT 1 */
@@ -564,8 +564,14 @@ mulredc_1 (mp_ptr z, const mp_limb_t x, mp_srcptr y, mp_srcptr m,
 #endif /* ifdef HAVE_NATIVE_MULREDC1_N */
 #endif
 
-static int tune_mulredc_table[] = TUNE_MULREDC_TABLE;
-static int tune_sqrredc_table[] = TUNE_SQRREDC_TABLE;
+#ifdef TUNE
+/* set by tune.c */
+int tune_mulredc_table[MULREDC_ASSEMBLY_MAX + 1];
+int tune_sqrredc_table[MULREDC_ASSEMBLY_MAX + 1];
+#else
+#define tune_mulredc_table __ecm_tune_params.mulredc_table
+#define tune_sqrredc_table __ecm_tune_params.sqrredc_table
+#endif
 
 static void 
 ecm_mulredc_basecase_n (mp_ptr rp, mp_srcptr s1p, mp_srcptr s2p, 
@@ -825,6 +831,7 @@ mpmod_init_MPZ (mpmod_t modulus, const mpz_t N)
 
   mpz_init2 (modulus->temp1, 2UL * modulus->bits + GMP_NUMB_BITS);
   mpz_init2 (modulus->temp2, modulus->bits);
+  mpz_init2 (modulus->temp3, modulus->bits + GMP_NUMB_BITS);
   mpz_init2 (modulus->aux_modulus, modulus->bits);
   mpz_set_ui (modulus->aux_modulus, 1UL);
   /* we precompute B^(n + ceil(n/2)) mod N, where B=2^GMP_NUMB_BITS */
@@ -852,6 +859,7 @@ mpmod_init_BASE2 (mpmod_t modulus, const int base2, const mpz_t N)
 
   mpz_init2 (modulus->temp1, 2UL * Nbits + GMP_NUMB_BITS);
   mpz_init2 (modulus->temp2, Nbits);
+  mpz_init2 (modulus->temp3, Nbits + GMP_NUMB_BITS);
   
   mpz_set_ui (modulus->temp1, 1UL);
   mpz_mul_2exp (modulus->temp1, modulus->temp1, abs (base2));
@@ -863,6 +871,7 @@ mpmod_init_BASE2 (mpmod_t modulus, const int base2, const mpz_t N)
     {
        outputf (OUTPUT_ERROR, "mpmod_init_BASE2: n does not divide 2^%d%c1\n",
                 abs (base2), base2 < 0 ? '-' : '+');
+       mpz_clear (modulus->temp3);
        mpz_clear (modulus->temp2);
        mpz_clear (modulus->temp1);
        mpz_clear (modulus->orig_modulus);
@@ -886,7 +895,7 @@ mpmod_init_BASE2 (mpmod_t modulus, const int base2, const mpz_t N)
 /* initialize the following fields:
    orig_modulus - the original modulus
    bits         - # of bits of N, rounded up to a multiple of GMP_NUMB_BITS
-   temp1, temp2 - auxiliary variables
+   temp1, temp2, temp3 - auxiliary variables
    Nprim        - -1/N mod B^n where B=2^GMP_NUMB_BITS and n = #limbs(N)
    R2           - (2^bits)^2 (mod N)
    R3           - (2^bits)^3 (mod N)
@@ -906,6 +915,7 @@ mpmod_init_MODMULN (mpmod_t modulus, const mpz_t N)
 
   mpz_init2 (modulus->temp1, 2UL * Nbits + GMP_NUMB_BITS);
   mpz_init2 (modulus->temp2, Nbits + 1);
+  mpz_init2 (modulus->temp3, Nbits + GMP_NUMB_BITS);
   modulus->Nprim = (mp_limb_t*) malloc (mpz_size (N) * sizeof (mp_limb_t));
 
   mpz_init2 (modulus->R2, Nbits);
@@ -955,6 +965,7 @@ mpmod_init_REDC (mpmod_t modulus, const mpz_t N)
   
   mpz_init2 (modulus->temp1, 2 * Nbits + GMP_NUMB_BITS);
   mpz_init2 (modulus->temp2, Nbits);
+  mpz_init2 (modulus->temp3, Nbits + GMP_NUMB_BITS);
   mpz_init2 (modulus->aux_modulus, Nbits);
 
   mpz_set_ui (modulus->temp1, 1UL);
@@ -1000,6 +1011,7 @@ mpmod_clear (mpmod_t modulus)
   mpz_clear (modulus->orig_modulus);
   mpz_clear (modulus->temp1);
   mpz_clear (modulus->temp2);
+  mpz_clear (modulus->temp3);
   if (modulus->repr == ECM_MOD_REDC || modulus->repr == ECM_MOD_MPZ)
     mpz_clear (modulus->aux_modulus);
   if (modulus->repr == ECM_MOD_MODMULN || modulus->repr == ECM_MOD_REDC)
@@ -1027,6 +1039,7 @@ mpmod_init_set (mpmod_t r, const mpmod_t modulus)
   mpz_init_set (r->orig_modulus, modulus->orig_modulus);
   mpz_init2 (r->temp1, 2 * Nbits + GMP_NUMB_BITS);
   mpz_init2 (r->temp2, Nbits + GMP_NUMB_BITS);
+  mpz_init2 (r->temp3, Nbits + GMP_NUMB_BITS);
   if (modulus->repr == ECM_MOD_MODMULN || modulus->repr == ECM_MOD_REDC)
     {
       mpz_init2 (r->multiple, Nbits);
@@ -2472,3 +2485,244 @@ mpresn_addsub (mpres_t R, mpres_t T,
       SIZ(T) = SIZ(S1);
     }
 }
+
+/* The mpresf_* functions work on residues of exactly n = mpz_size(N) limbs
+   in [0, N), whose limbs are allocated once by mpresf_init. Compared to
+   mpres_t, they save the size tests and reallocations of the mpz layer,
+   which matter for the small moduli where ECM and P+1 stage 1 spend their
+   time. For MODMULN and REDC, the representation is the same as mpres_t
+   (R = B^n in both cases), and products call ecm_mulredc_basecase_n
+   directly: with inputs < N, the output is < 2N, and one subtraction
+   brings it back into [0, N). For MPZ and BASE2, products go through
+   mpres_mul or mpres_sqr on a read-only mpz_t view of the limbs.
+   Additions, subtractions and multiplications by integers are the same for
+   all representations. Keeping the residues fully reduced costs one
+   comparison per operation, but a single correction step is then enough
+   whatever the ratio B^n/N. */
+
+/* Make t a read-only view of the n limbs of S, to be given as a const
+   argument to mpz and mpres functions. */
+static void
+mpresf_view (mpz_ptr t, const mpresf_t S, mp_size_t n)
+{
+  PTR(t) = S;
+  ALLOC(t) = n;
+  MPN_NORMALIZE (S, n);
+  SIZ(t) = n;
+}
+
+/* Allocate k residues R[0], ..., R[k-1] in a single block, all set to 0 */
+void
+mpresf_init (mpresf_t *R, unsigned int k, const mpmod_t modulus)
+{
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+  unsigned int i;
+
+  ASSERT (k > 0);
+  R[0] = (mp_limb_t *) malloc (k * n * sizeof (mp_limb_t));
+  ASSERT_ALWAYS (R[0] != NULL);
+  MPN_ZERO (R[0], k * n);
+  for (i = 1; i < k; i++)
+    R[i] = R[i - 1] + n;
+}
+
+/* Free the block allocated by mpresf_init (R, k, modulus) */
+void
+mpresf_clear (mpresf_t *R, ATTRIBUTE_UNUSED const mpmod_t modulus)
+{
+  free (R[0]);
+  R[0] = NULL;
+}
+
+void
+mpresf_set_mpres (mpresf_t R, const mpres_t S, mpmod_t modulus)
+{
+  mp_size_t n = ABSIZ(modulus->orig_modulus), s = SIZ(S);
+  mp_srcptr sp = PTR(S);
+
+  /* MPZ and BASE2 residues may be negative, BASE2 residues may have
+     more than n limbs, and all representations may give values >= N */
+  if (s < 0 || s > n || (s == n && mpn_cmp (sp, PTR(modulus->orig_modulus),
+                                            n) >= 0))
+    {
+      mpz_mod (modulus->temp1, S, modulus->orig_modulus);
+      s = SIZ(modulus->temp1);
+      sp = PTR(modulus->temp1);
+    }
+  MPN_COPY (R, sp, s);
+  MPN_ZERO (R + s, n - s);
+}
+
+void
+mpres_set_mpresf (mpres_t R, const mpresf_t S, const mpmod_t modulus)
+{
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+
+  MPZ_REALLOC (R, n);
+  MPN_COPY (PTR(R), S, n);
+  MPN_NORMALIZE (PTR(R), n);
+  SIZ(R) = n;
+}
+
+/* R <- S1 * S2 mod modulus. R may be equal to S1 or S2. */
+void
+mpresf_mul (mpresf_t R, const mpresf_t S1, const mpresf_t S2,
+            mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+
+  if (modulus->repr == ECM_MOD_MODMULN || modulus->repr == ECM_MOD_REDC)
+    {
+      ecm_mulredc_basecase_n (R, S1, S2, np, n,
+                              (modulus->repr == ECM_MOD_MODMULN) ?
+                              modulus->Nprim : PTR(modulus->aux_modulus),
+                              PTR(modulus->temp1));
+      if (mpn_cmp (R, np, n) >= 0)
+        mpn_sub_n (R, R, np, n);
+    }
+  else
+    {
+      mpz_t s1, s2;
+
+      mpresf_view (s1, S1, n);
+      mpresf_view (s2, S2, n);
+      mpres_mul (modulus->temp3, s1, s2, modulus);
+      mpresf_set_mpres (R, modulus->temp3, modulus);
+    }
+}
+
+/* R <- S^2 mod modulus. R may be equal to S. */
+void
+mpresf_sqr (mpresf_t R, const mpresf_t S, mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+
+  if (modulus->repr == ECM_MOD_MODMULN || modulus->repr == ECM_MOD_REDC)
+    {
+      ecm_sqrredc_basecase_n (R, S, np, n,
+                              (modulus->repr == ECM_MOD_MODMULN) ?
+                              modulus->Nprim : PTR(modulus->aux_modulus),
+                              PTR(modulus->temp1));
+      if (mpn_cmp (R, np, n) >= 0)
+        mpn_sub_n (R, R, np, n);
+    }
+  else
+    {
+      mpz_t s;
+
+      mpresf_view (s, S, n);
+      mpres_sqr (modulus->temp3, s, modulus);
+      mpresf_set_mpres (R, modulus->temp3, modulus);
+    }
+}
+
+/* R <- S1 + S2 mod modulus */
+void
+mpresf_add (mpresf_t R, const mpresf_t S1, const mpresf_t S2,
+            const mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+
+  if (mpn_add_n (R, S1, S2, n) != 0 || mpn_cmp (R, np, n) >= 0)
+    mpn_sub_n (R, R, np, n);
+}
+
+/* R <- S1 - S2 mod modulus */
+void
+mpresf_sub (mpresf_t R, const mpresf_t S1, const mpresf_t S2,
+            const mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+
+  if (mpn_sub_n (R, S1, S2, n) != 0)
+    mpn_add_n (R, R, np, n);
+}
+
+/* (R, T) <- (S1 + S2, S1 - S2) mod modulus. Any of R, T may be equal to
+   S1 or S2. */
+void
+mpresf_addsub (mpresf_t R, mpresf_t T, const mpresf_t S1, const mpresf_t S2,
+               mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+  mp_ptr r = (R == S1 || R == S2) ? PTR(modulus->temp1) : R;
+
+  if (mpn_add_n (r, S1, S2, n) != 0 || mpn_cmp (r, np, n) >= 0)
+    mpn_sub_n (r, r, np, n);
+  if (mpn_sub_n (T, S1, S2, n) != 0)
+    mpn_add_n (T, T, np, n);
+  if (r != R)
+    MPN_COPY (R, r, n);
+}
+
+/* R <- S * m mod modulus, where m must fit in a limb */
+void
+mpresf_mul_ui (mpresf_t R, const mpresf_t S, const unsigned long m,
+               const mpmod_t modulus)
+{
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+  mp_ptr t = PTR(modulus->temp1);
+  mp_limb_t q[2];
+
+  t[n] = mpn_mul_1 (t, S, n, (mp_limb_t) m);
+  mpn_tdiv_qr (q, R, 0, t, n + 1, PTR(modulus->orig_modulus), n);
+}
+
+/* R <- S / 2^k mod modulus. Does not need to be fast. */
+void
+mpresf_div_2exp (mpresf_t R, const mpresf_t S, const unsigned int k,
+                 const mpmod_t modulus)
+{
+  mp_srcptr np = PTR(modulus->orig_modulus);
+  mp_size_t n = ABSIZ(modulus->orig_modulus);
+  mp_limb_t cy;
+  unsigned int i;
+
+  ASSERT (mpz_odd_p (modulus->orig_modulus));
+  if (R != S)
+    MPN_COPY (R, S, n);
+  for (i = 0; i < k; i++)
+    {
+      /* R + N < 2N, thus (R + N) / 2 < N */
+      cy = (R[0] & 1) ? mpn_add_n (R, R, np, n) : 0;
+      mpn_rshift (R, R, n, 1);
+      R[n - 1] |= cy << (GMP_NUMB_BITS - 1);
+    }
+}
+
+/* Returns non-zero if inversion succeeded, and zero if not */
+int
+mpresf_invert (mpresf_t R, const mpresf_t S, mpmod_t modulus)
+{
+  mpz_t s;
+
+  mpresf_view (s, S, ABSIZ(modulus->orig_modulus));
+  if (mpres_invert (modulus->temp3, s, modulus) == 0)
+    return 0;
+  mpresf_set_mpres (R, modulus->temp3, modulus);
+  return 1;
+}
+
+void
+mpresf_gcd (mpz_t R, const mpresf_t S, const mpmod_t modulus)
+{
+  mpz_t s;
+
+  mpresf_view (s, S, ABSIZ(modulus->orig_modulus));
+  mpres_gcd (R, s, modulus);
+}
+
+/* Returns 1 if S == 0 (mod modulus), 0 otherwise */
+int
+mpresf_is_zero (const mpresf_t S, const mpmod_t modulus)
+{
+  mpz_t s;
+
+  mpresf_view (s, S, ABSIZ(modulus->orig_modulus));
+  return mpz_divisible_p (s, modulus->orig_modulus) ? 1 : 0;
+}
@@ -26,6 +26,9 @@ MA 02110-1301, USA. */
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 /* Tables for the maximum possible modulus (in bit size) for different 
    transform lengths l.
@@ -177,6 +180,57 @@ mpzspm_product_tree_init (mpzspm_t mpzspm)
   mpzspm->d = d;
 }
 
+/* Compute crt1[i] = (P / p_i) mod modulus and crt3[i] = (P / p_i)^{-1} mod
+   p_i with the product tree T, where P = T[d][0] is the product of all
+   primes. Each P / p_i is the product of the primes of the siblings of the
+   nodes on the path from the leaf p_i to the root, thus crt1 is obtained
+   from the root to the leaves by multiplying by the sibling of each node
+   modulo the modulus. For crt3, the remainder tree of P modulo the squares
+   of the nodes gives P mod p_i^2 = (P / p_i mod p_i) * p_i.
+   With n the size of the modulus, this takes O(n M(n) log n) instead of
+   O(n^3) for the direct computation. */
+static void
+mpzspm_crt_tree_init (mpzspm_t mpzspm)
+{
+  const unsigned int sp_num = mpzspm->sp_num;
+  unsigned int i, j, k, ni;
+  mpzv_t *T = mpzspm->T, crt1 = mpzspm->crt1;
+  mpz_t *U = mpzspm->buf[0];
+  mpz_t sq;
+  sp_t p;
+
+  mpz_init (sq);
+  mpz_set_ui (crt1[0], 1);
+  mpz_set (U[0], T[mpzspm->d][0]);
+  for (i = mpzspm->d; i-- > 0;)
+    { /* goes down from depth i+1 to i */
+      ni = 1 << i;
+      for (j = k = 0; j + ni < sp_num; j += 2*ni, k += 2)
+        {
+          mpz_mul (crt1[j+ni], crt1[j], T[i][k]);
+          mpz_mod (crt1[j+ni], crt1[j+ni], mpzspm->modulus);
+          mpz_mul (crt1[j], crt1[j], T[i][k+1]);
+          mpz_mod (crt1[j], crt1[j], mpzspm->modulus);
+
+          mpz_mul (sq, T[i][k+1], T[i][k+1]);
+          mpz_mod (U[j+ni], U[j], sq);
+          mpz_mul (sq, T[i][k], T[i][k]);
+          mpz_mod (U[j], U[j], sq);
+        }
+      /* for the last entry j if j + ni >= sp_num, there is nothing to do */
+    }
+
+  for (j = 0; j < sp_num; j++)
+    {
+      p = mpzspm->spm[j]->sp;
+      /* now U[j] = P mod p^2 */
+      mpz_set_sp (sq, p);
+      mpz_divexact (U[j], U[j], sq);
+      mpzspm->crt3[j] = sp_inv (mpz_get_sp (U[j]), p, mpzspm->spm[j]->mul_c);
+    }
+  mpz_clear (sq);
+}
+
 /* This function initializes a mpzspm_t structure which contains the number
    of small primes, the small primes with associated primitive roots and 
    precomputed data for the CRT to allow convolution products of length up 
@@ -186,7 +240,7 @@ mpzspm_product_tree_init (mpzspm_t mpzspm)
 mpzspm_t
 mpzspm_init (spv_size_t max_len, mpz_t modulus)
 {
-  unsigned int ub, i, j;
+  unsigned int ub, i;
   mpz_t P, S, T, mp, mt; /* mp is p as mpz_t, mt is a temp mpz_t */
   sp_t p, a;
   mpzspm_t mpzspm;
@@ -197,6 +251,7 @@ mpzspm_init (spv_size_t max_len, mpz_t modulus)
   mpzspm = (mpzspm_t) malloc (sizeof (__mpzspm_struct));
   if (mpzspm == NULL)
     return NULL;
+  mpzspm->pool = NULL;
   
   /* Upper bound for the number of primes we need.
    * Let minp, maxp denote the min, max permissible prime,
@@ -301,32 +356,38 @@ mpzspm_init (spv_size_t max_len, mpz_t modulus)
     }
   
   for (i = 0; i < mpzspm->sp_num; i++)
-    {
-      p = mpzspm->spm[i]->sp;
-      mpz_set_sp (mp, p);
-      
-      /* crt3[i] = (P / p)^{-1} mod p */
-      mpz_fdiv_q (T, P, mp);
-      mpz_fdiv_r (mt, T, mp);
-      a = mpz_get_sp (mt);
-      mpzspm->crt3[i] = sp_inv (a, p, mpzspm->spm[i]->mul_c);
-     
-      /* crt1[i] = (P / p) mod modulus */
-      mpz_init (mpzspm->crt1[i]);
-      mpz_mod (mpzspm->crt1[i], T, modulus);
+    mpz_init (mpzspm->crt1[i]);
 
-      /* crt4[i][j] = ((P / p[i]) mod modulus) mod p[j] */
-      for (j = 0; j < mpzspm->sp_num; j++)
-        {
-          mpz_set_sp (mp, mpzspm->spm[j]->sp);
-          mpz_fdiv_r (mt, mpzspm->crt1[i], mp);
-          mpzspm->crt4[j][i] = mpz_get_sp (mt);
-        }
-      
-      /* crt5[i] = (-P mod modulus) mod p */
-      mpz_mod (T, P, modulus);
-      mpz_sub (T, modulus, T);
-      mpz_set_sp (mp, p);
+  mpzspm_product_tree_init (mpzspm);
+
+  if (mpzspm->T == NULL) /* few primes, use the direct computation */
+    for (i = 0; i < mpzspm->sp_num; i++)
+      {
+        p = mpzspm->spm[i]->sp;
+        mpz_set_sp (mp, p);
+
+        /* crt3[i] = (P / p)^{-1} mod p */
+        mpz_fdiv_q (T, P, mp);
+        mpz_fdiv_r (mt, T, mp);
+        a = mpz_get_sp (mt);
+        mpzspm->crt3[i] = sp_inv (a, p, mpzspm->spm[i]->mul_c);
+
+        /* crt1[i] = (P / p) mod modulus */
+        mpz_mod (mpzspm->crt1[i], T, modulus);
+      }
+  else
+    mpzspm_crt_tree_init (mpzspm);
+
+  /* crt4[i][j] = ((P / p[i]) mod modulus) mod p[j], this is the conversion
+     of crt1 to CRT representation, with the remainder tree if available */
+  mpzspv_from_mpzv (mpzspm->crt4, 0, mpzspm->crt1, mpzspm->sp_num, mpzspm);
+
+  /* crt5[i] = (-P mod modulus) mod p */
+  mpz_mod (T, P, modulus);
+  mpz_sub (T, modulus, T);
+  for (i = 0; i < mpzspm->sp_num; i++)
+    {
+      mpz_set_sp (mp, mpzspm->spm[i]->sp);
       mpz_fdiv_r (mt, T, mp);
       mpzspm->crt5[i] = mpz_get_sp (mt);
     }
@@ -347,8 +408,6 @@ mpzspm_init (spv_size_t max_len, mpz_t modulus)
   mpz_clear (S);
   mpz_clear (T);
 
-  mpzspm_product_tree_init (mpzspm);
-
   if (test_verbose (OUTPUT_DEVVERBOSE))
     outputf (OUTPUT_DEVVERBOSE, "mpzspm_init took %lums\n", cputime() - st);
 
@@ -397,7 +456,7 @@ mpzspm_product_tree_clear (mpzspm_t mpzspm)
   free (T);
   for (int i = 0; i < omp_get_num_threads(); i++)
     {
-      for (j = 0; j < n; j++)
+      for (j = 0; j < mpzspm->sp_num; j++)
         mpz_clear (buf[i][j]);
       free (buf[i]);
     }
@@ -408,6 +467,7 @@ void mpzspm_clear (mpzspm_t mpzspm)
 {
   unsigned int i;
 
+  mpzspm_set_threads (mpzspm, 1);
   mpzspm_product_tree_clear (mpzspm);
 
   for (i = 0; i < mpzspm->sp_num; i++)
@@ -431,3 +491,265 @@ void mpzspm_clear (mpzspm_t mpzspm)
   free (mpzspm);
 }
 
+/* The functions of mpzspv.c do the same work for each small prime, on
+   data of that prime only. With mpzspm_set_threads (mpzspm, n), n > 1,
+   mpzspm_run() shares this work among the calling thread and n - 1 worker
+   threads which live as long as mpzspm, so that a stage 2 does not create
+   threads for each of its transforms. The primes are dealt out in ranges
+   of consecutive indices, the prime i always to the same thread at first:
+   as the pages of a vector are placed on the NUMA node of the thread which
+   touches them first, and stay in its cache if they fit, the vectors of a
+   prime stay local to the thread which mostly works on them. A thread which
+   has done its range steals the upper half of the range of another one, so
+   that slow primes (or cores) do not keep the others waiting. */
+
+#ifdef HAVE_PTHREAD
+typedef struct
+{
+  pthread_mutex_t lock;     /* protects lo and hi */
+  unsigned int lo, hi;      /* the indices of the primes still to do */
+} mpzspm_range_t;
+
+typedef struct
+{
+  struct __mpzspm_pool_struct *pool;
+  unsigned int id;          /* 1 to nthreads - 1, 0 is mpzspm_run() */
+  pthread_t tid;
+} mpzspm_worker_t;
+
+typedef struct __mpzspm_pool_struct
+{
+  unsigned int nthreads;
+  mpzspm_range_t *range;    /* the range of each thread */
+  mpzspm_worker_t *worker;  /* the nthreads - 1 workers */
+  pthread_mutex_t lock;     /* protects everything below */
+  pthread_cond_t start, done;
+  unsigned long generation; /* number of mpzspm_run() calls so far */
+  unsigned int busy;        /* workers still running the current task */
+  int quit;
+  mpzspm_task_t task;
+  void *arg;
+  FILE *os, *es;            /* ECM_STDOUT and ECM_STDERR of the creator */
+  int verbose;              /* its verbose setting, see set_verbose() */
+} mpzspm_pool_t;
+
+/* the next prime of thread id: from the low end of its own range, else
+   from the upper half of the range of the first thread after it which
+   has primes left, or (unsigned int) -1 if none is left */
+static unsigned int
+mpzspm_pool_next (mpzspm_pool_t *pool, unsigned int id)
+{
+  mpzspm_range_t *own = pool->range + id;
+  unsigned int j, i = (unsigned int) -1;
+
+  pthread_mutex_lock (&own->lock);
+  if (own->lo < own->hi)
+    i = own->lo++;
+  pthread_mutex_unlock (&own->lock);
+  if (i != (unsigned int) -1)
+    return i;
+
+  for (j = 1; j < pool->nthreads; j++)
+    {
+      mpzspm_range_t *victim = pool->range + (id + j) % pool->nthreads;
+      unsigned int lo = 0, hi = 0;
+
+      pthread_mutex_lock (&victim->lock);
+      if (victim->lo < victim->hi)
+        {
+          hi = victim->hi;
+          lo = victim->hi -= (hi - victim->lo + 1) / 2;
+        }
+      pthread_mutex_unlock (&victim->lock);
+      if (lo < hi)
+        {
+          pthread_mutex_lock (&own->lock);
+          own->lo = lo + 1;
+          own->hi = hi;
+          pthread_mutex_unlock (&own->lock);
+          return lo;
+        }
+    }
+  return (unsigned int) -1;
+}
+
+static void
+mpzspm_pool_work (mpzspm_pool_t *pool, unsigned int id)
+{
+  unsigned int i;
+
+  while ((i = mpzspm_pool_next (pool, id)) != (unsigned int) -1)
+    pool->task (pool->arg, i);
+}
+
+static void *
+mpzspm_pool_thread (void *arg)
+{
+  mpzspm_worker_t *w = (mpzspm_worker_t *) arg;
+  mpzspm_pool_t *pool = w->pool;
+  unsigned long generation = 0;
+
+  /* the output settings are thread-local, see outputf() */
+  set_verbose (pool->verbose);
+  ECM_STDOUT = pool->os;
+  ECM_STDERR = pool->es;
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;)
+    {
+      while (!pool->quit && pool->generation == generation)
+        pthread_cond_wait (&pool->start, &pool->lock);
+      if (pool->quit)
+        break;
+      generation = pool->generation;
+      pthread_mutex_unlock (&pool->lock);
+
+      mpzspm_pool_work (pool, w->id);
+
+      pthread_mutex_lock (&pool->lock);
+      if (--pool->busy == 0)
+        pthread_cond_signal (&pool->done);
+    }
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+static void
+mpzspm_pool_clear (mpzspm_pool_t *pool, unsigned int started)
+{
+  unsigned int i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->quit = 1;
+  pthread_cond_broadcast (&pool->start);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < started; i++)
+    pthread_join (pool->worker[i].tid, NULL);
+
+  for (i = 0; i < pool->nthreads; i++)
+    pthread_mutex_destroy (&pool->range[i].lock);
+  pthread_cond_destroy (&pool->start);
+  pthread_cond_destroy (&pool->done);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->range);
+  free (pool->worker);
+  free (pool);
+}
+#endif
+
+/* Let mpzspm_run() use nthreads threads, the calling one included, or
+   no other thread if nthreads <= 1. The number of threads is at most the
+   number of primes, and 1 without POSIX threads or if no thread could be
+   created. Returns the number of threads mpzspm_run() will use. Must not
+   be called while mpzspm_run() is running. */
+unsigned int
+mpzspm_set_threads (mpzspm_t mpzspm, unsigned int nthreads)
+{
+#ifdef HAVE_PTHREAD
+  mpzspm_pool_t *pool;
+  unsigned int i;
+
+  if (mpzspm->pool != NULL)
+    {
+      mpzspm_pool_clear (mpzspm->pool, mpzspm->pool->nthreads - 1);
+      mpzspm->pool = NULL;
+    }
+
+  if (nthreads > mpzspm->sp_num)
+    nthreads = mpzspm->sp_num;
+  if (nthreads <= 1)
+    return 1;
+
+  pool = (mpzspm_pool_t *) malloc (sizeof (mpzspm_pool_t));
+  if (pool == NULL)
+    return 1;
+  pool->range = (mpzspm_range_t *) malloc (nthreads *
+                                           sizeof (mpzspm_range_t));
+  pool->worker = (mpzspm_worker_t *) malloc ((nthreads - 1) *
+                                             sizeof (mpzspm_worker_t));
+  if (pool->range == NULL || pool->worker == NULL)
+    {
+      free (pool->range);
+      free (pool->worker);
+      free (pool);
+      return 1;
+    }
+  pool->nthreads = nthreads;
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_mutex_init (&pool->range[i].lock, NULL);
+      pool->range[i].lo = pool->range[i].hi = 0;
+    }
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->start, NULL);
+  pthread_cond_init (&pool->done, NULL);
+  pool->generation = 0;
+  pool->busy = 0;
+  pool->quit = 0;
+  pool->os = ECM_STDOUT;
+  pool->es = ECM_STDERR;
+  pool->verbose = get_verbose ();
+
+  for (i = 0; i < nthreads - 1; i++)
+    {
+      pool->worker[i].pool = pool;
+      pool->worker[i].id = i + 1;
+      if (pthread_create (&pool->worker[i].tid, NULL, mpzspm_pool_thread,
+                          (void *) (pool->worker + i)) != 0)
+        break;
+    }
+  if (i < nthreads - 1)
+    {
+      /* keep no pool rather than a smaller one */
+      mpzspm_pool_clear (pool, i);
+      return 1;
+    }
+
+  mpzspm->pool = pool;
+  return nthreads;
+#else
+  (void) mpzspm;
+  (void) nthreads;
+  return 1;
+#endif
+}
+
+/* Call task (arg, i) for 0 <= i < sp_num, with the threads of
+   mpzspm_set_threads() if any. Returns when all calls have returned. The
+   calls for different i must not write to the same data. */
+void
+mpzspm_run (mpzspm_t mpzspm, mpzspm_task_t task, void *arg)
+{
+  unsigned int i;
+#ifdef HAVE_PTHREAD
+  mpzspm_pool_t *pool = mpzspm->pool;
+
+  if (pool != NULL)
+    {
+      for (i = 0; i < pool->nthreads; i++)
+        {
+          pool->range[i].lo = mpzspm->sp_num * i / pool->nthreads;
+          pool->range[i].hi = mpzspm->sp_num * (i + 1) / pool->nthreads;
+        }
+
+      pthread_mutex_lock (&pool->lock);
+      pool->task = task;
+      pool->arg = arg;
+      pool->busy = pool->nthreads - 1;
+      pool->generation++;
+      pthread_cond_broadcast (&pool->start);
+      pthread_mutex_unlock (&pool->lock);
+
+      mpzspm_pool_work (pool, 0);
+
+      pthread_mutex_lock (&pool->lock);
+      while (pool->busy != 0)
+        pthread_cond_wait (&pool->done, &pool->lock);
+      pthread_mutex_unlock (&pool->lock);
+      return;
+    }
+#endif
+
+  for (i = 0; i < mpzspm->sp_num; i++)
+    task (arg, i);
+}
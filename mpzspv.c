@@ -372,6 +372,47 @@ mpzspv_from_mpzv (mpzspv_t x, const spv_size_t offset, const mpzv_t mpzv,
 #endif
 }
 
+/* Convert x[][offset] from CRT representation to mpz_t format, fast
+   version for the theorem below, assumes mpzspm->T has been precomputed (see
+   mpzspm.c). The sum of t_i P/p_i is computed from the leaves of the product
+   tree to the root: the sum for a node is the sum for its left child times
+   the product of the primes of its right child, plus the converse. With n
+   the size of the modulus, this takes O(M(n) log n) instead of O(n^2).
+   As mpzspv_from_mpzv_fast, this function must be thread-safe. */
+static void
+mpzspv_to_mpzv_fast (mpzspv_t x, spv_size_t offset, mpz_t r, mpzspm_t mpzspm)
+{
+  const unsigned int sp_num = mpzspm->sp_num;
+  unsigned int i, j, k, ni;
+  mpzv_t *T = mpzspm->T;
+  mpz_t *U = mpzspm->buf[omp_get_thread_num()];
+  spm_t *spm = mpzspm->spm;
+  float f = 0.5;
+  sp_t t;
+
+  for (j = 0; j < sp_num; j++)
+    {
+      /* crt3[j] = p_j/P mod p_j */
+      t = sp_mul (x[j][offset], mpzspm->crt3[j], spm[j]->sp, spm[j]->mul_c);
+      mpz_set_sp (U[j], t);
+      /* same error analysis as in mpzspv_to_mpzv */
+      f += (float) t * (1.0f / (float) spm[j]->sp);
+    }
+  for (i = 0; i < mpzspm->d; i++)
+    { /* goes up from depth i to i+1 */
+      ni = 1 << i;
+      for (j = k = 0; j + ni < sp_num; j += 2*ni, k += 2)
+        {
+          mpz_mul (U[j], U[j], T[i][k+1]);
+          mpz_addmul (U[j], U[j+ni], T[i][k]);
+        }
+      /* for the last entry U[j] if j + ni >= sp_num, there is nothing to do */
+    }
+  /* U[0] = sum(t_i P/p_i), subtract P round(alpha) */
+  mpz_submul_ui (U[0], T[mpzspm->d][0], (unsigned long) f);
+  mpz_mod (r, U[0], mpzspm->modulus);
+}
+
 /* Convert the len residues x[][offset..offset+len-1] from "spv" (RNS) format
  * to mpz_t format.
  * See: Daniel J. Bernstein and Jonathan P. Sorenson,
@@ -384,7 +425,8 @@ mpzspv_from_mpzv (mpzspv_t x, const spv_size_t offset, const mpzv_t mpzv,
  * t_i = u_i q_i mod p_i. Then u = P \alpha - P round(\alpha) where
  * \alpha = \sum_i t_i/p_i
  *
- * time: O(len * sp_num^2) where sp_num is proportional to the modulus size
+ * time: O(len * sp_num^2) where sp_num is proportional to the modulus size,
+ *       O(len * M(sp_num) log(sp_num)) with the product tree mpzspm->T
  * memory: MPZSPV_NORMALISE_STRIDE floats */
 void
 mpzspv_to_mpzv (mpzspv_t x, spv_size_t offset, mpzv_t mpzv,
@@ -392,12 +434,27 @@ mpzspv_to_mpzv (mpzspv_t x, spv_size_t offset, mpzv_t mpzv,
 {
   unsigned int i;
   spv_size_t k, l;
-  float *f = (float *) malloc (MPZSPV_NORMALISE_STRIDE * sizeof (float));
+  float *f;
   float prime_recip;
   sp_t t;
   spm_t *spm = mpzspm->spm;
   mpz_t mt;
 
+  if (mpzspm->T != NULL && mpzspm->sp_num >= MPZSPV_TO_MPZV_TREE_THRESHOLD)
+    {
+      ASSERT (mpzspv_verify (x, offset, len, mpzspm));
+#ifdef TIMING_CRT
+      mpzspv_to_mpzv_time -= cputime ();
+#endif
+      for (k = 0; k < len; k++)
+        mpzspv_to_mpzv_fast (x, offset + k, mpzv[k], mpzspm);
+#ifdef TIMING_CRT
+      mpzspv_to_mpzv_time += cputime ();
+#endif
+      return;
+    }
+
+  f = (float *) malloc (MPZSPV_NORMALISE_STRIDE * sizeof (float));
   if (f == NULL)
     {
       fprintf (stderr, "Cannot allocate memory in mpzspv_to_mpzv\n");
@@ -607,69 +664,107 @@ mpzspv_normalise (mpzspv_t x, spv_size_t offset, spv_size_t len,
 #endif
 }
 
+/* The arguments of mpzspv_to_ntt(), mpzspv_from_ntt() and
+   mpzspv_mul_ntt() for their tasks, one per small prime, run by
+   mpzspm_run() */
+typedef struct
+{
+  mpzspv_t r, x, y;
+  spv_size_t offsetr, offsetx, lenx, offsety, leny, ntt_size, monic_pos;
+  int monic, steps;
+  mpzspm_t mpzspm;
+} mpzspv_ntt_arg_t;
+
+/* Reduce the len coefficients of spv modulo x^ntt_size - 1, add x^len if
+   monic, and transform */
+static void
+spv_to_ntt (spv_t spv, spv_size_t len, spv_size_t ntt_size, int monic,
+            spm_t spm)
+{
+  spv_size_t j;
+
+  if (ntt_size < len)
+    {
+      for (j = ntt_size; j < len; j += ntt_size)
+        spv_add (spv, spv, spv + j, ntt_size, spm->sp);
+    }
+  if (ntt_size > len)
+    spv_set_zero (spv + len, ntt_size - len);
+
+  if (monic)
+    spv[len % ntt_size] = sp_add (spv[len % ntt_size], 1, spm->sp);
+
+  spv_ntt_gfp_dif_len (spv, ntt_size, spm);
+}
+
+/* Transform back, divide by ntt_size and subtract x^monic_pos if
+   monic_pos is not 0 */
+static void
+spv_from_ntt (spv_t spv, spv_size_t ntt_size, spv_size_t monic_pos,
+              spm_t spm)
+{
+  spv_ntt_gfp_dit_len (spv, ntt_size, spm);
+
+  /* spm->sp - (spm->sp - 1) / ntt_size is the inverse of ntt_size */
+  spv_mul_sp_simd (spv, spv, spm->sp - (spm->sp - 1) / ntt_size,
+      ntt_size, spm);
+
+  if (monic_pos)
+    spv[monic_pos % ntt_size] = sp_sub (spv[monic_pos % ntt_size],
+        1, spm->sp);
+}
+
+static void
+mpzspv_to_ntt_task (void *arg, unsigned int i)
+{
+  const mpzspv_ntt_arg_t *a = (const mpzspv_ntt_arg_t *) arg;
+
+  spv_to_ntt (a->x[i] + a->offsetx, a->lenx, a->ntt_size, a->monic,
+              a->mpzspm->spm[i]);
+}
+
 void
 mpzspv_to_ntt (mpzspv_t x, spv_size_t offset, spv_size_t len,
     spv_size_t ntt_size, int monic, mpzspm_t mpzspm)
 {
-  unsigned int i;
-  spv_size_t j, log2_ntt_size;
-  spm_t spm;
-  spv_t spv;
+  mpzspv_ntt_arg_t a;
   
   ASSERT (mpzspv_verify (x, offset, len, mpzspm));
   ASSERT (mpzspv_verify (x, offset + ntt_size, 0, mpzspm));
   
-  log2_ntt_size = ceil_log_2 (ntt_size);
+  a.x = x;
+  a.offsetx = offset;
+  a.lenx = len;
+  a.ntt_size = ntt_size;
+  a.monic = monic;
+  a.mpzspm = mpzspm;
+  mpzspm_run (mpzspm, mpzspv_to_ntt_task, &a);
+}
 
-  for (i = 0; i < mpzspm->sp_num; i++)
-    {
-      spm = mpzspm->spm[i];
-      spv = x[i] + offset;
-      
-      if (ntt_size < len)
-        {
-	  for (j = ntt_size; j < len; j += ntt_size)
-	    spv_add (spv, spv, spv + j, ntt_size, spm->sp);
-	}
-      if (ntt_size > len)
-	spv_set_zero (spv + len, ntt_size - len);
+#if 0
+static void
+mpzspv_from_ntt_task (void *arg, unsigned int i)
+{
+  const mpzspv_ntt_arg_t *a = (const mpzspv_ntt_arg_t *) arg;
 
-      if (monic)
-	spv[len % ntt_size] = sp_add (spv[len % ntt_size], 1, spm->sp);
-      
-      spv_ntt_gfp_dif (spv, log2_ntt_size, spm);
-    }
+  spv_from_ntt (a->x[i] + a->offsetx, a->ntt_size, a->monic_pos,
+                a->mpzspm->spm[i]);
 }
 
-#if 0
 void
 mpzspv_from_ntt (mpzspv_t x, spv_size_t offset, spv_size_t ntt_size,
                  spv_size_t monic_pos, mpzspm_t mpzspm)
 {
-  unsigned int i;
-  spv_size_t log2_ntt_size;
-  spm_t spm;
-  spv_t spv;
+  mpzspv_ntt_arg_t a;
   
   ASSERT (mpzspv_verify (x, offset, ntt_size, mpzspm));
   
-  log2_ntt_size = ceil_log_2 (ntt_size);
-
-  for (i = 0; i < mpzspm->sp_num; i++)
-    {
-      spm = mpzspm->spm[i];
-      spv = x[i] + offset;
-      
-      spv_ntt_gfp_dit (spv, log2_ntt_size, spm);
-
-      /* spm->sp - (spm->sp - 1) / ntt_size is the inverse of ntt_size */
-      spv_mul_sp (spv, spv, spm->sp - (spm->sp - 1) / ntt_size,
-	  ntt_size, spm->sp, spm->mul_c);
-      
-      if (monic_pos)
-	spv[monic_pos % ntt_size] = sp_sub (spv[monic_pos % ntt_size],
-	    1, spm->sp);
-    }
+  a.x = x;
+  a.offsetx = offset;
+  a.ntt_size = ntt_size;
+  a.monic_pos = monic_pos;
+  a.mpzspm = mpzspm;
+  mpzspm_run (mpzspm, mpzspv_from_ntt_task, &a);
 }
 #endif
 
@@ -691,7 +786,33 @@ mpzspv_random (mpzspv_t x, spv_size_t offset, spv_size_t len, mpzspm_t mpzspm)
    Contrary to calling these three operations separately, this function does 
    all three steps on a small-prime vector at a time, resulting in slightly 
    better cache efficiency (also in preparation to storing NTT vectors on disk 
-   and reading them in for the multiplication). */
+   and reading them in for the multiplication). The small primes are shared
+   among the threads of mpzspm_set_threads(), if any. */
+
+static void
+mpzspv_mul_ntt_task (void *arg, unsigned int i)
+{
+  const mpzspv_ntt_arg_t *a = (const mpzspv_ntt_arg_t *) arg;
+  spm_t spm = a->mpzspm->spm[i];
+  spv_t spvr = a->r[i] + a->offsetr;
+  spv_t spvx = a->x[i] + a->offsetx;
+  spv_t spvy = a->y[i] + a->offsety;
+
+  if ((a->steps & NTT_MUL_STEP_FFT1) != 0)
+    spv_to_ntt (spvx, a->lenx, a->ntt_size, a->monic, spm);
+
+  if ((a->steps & NTT_MUL_STEP_FFT2) != 0)
+    spv_to_ntt (spvy, a->leny, a->ntt_size, a->monic, spm);
+
+  if ((a->steps & NTT_MUL_STEP_MUL) != 0)
+    spv_pwmul_simd (spvr, spvx, spvy, a->ntt_size, spm);
+
+  if ((a->steps & NTT_MUL_STEP_IFFT) != 0)
+    {
+      ASSERT (sizeof (mp_limb_t) >= sizeof (sp_t));
+      spv_from_ntt (spvr, a->ntt_size, a->monic_pos, spm);
+    }
+}
 
 void
 mpzspv_mul_ntt (mpzspv_t r, const spv_size_t offsetr, 
@@ -700,176 +821,234 @@ mpzspv_mul_ntt (mpzspv_t r, const spv_size_t offsetr,
     const spv_size_t ntt_size, const int monic, const spv_size_t monic_pos, 
     mpzspm_t mpzspm, const int steps)
 {
-  spv_size_t log2_ntt_size;
-  int i;
-  
+  mpzspv_ntt_arg_t a;
+
   ASSERT (mpzspv_verify (x, offsetx, lenx, mpzspm));
   ASSERT (mpzspv_verify (y, offsety, leny, mpzspm));
   ASSERT (mpzspv_verify (x, offsetx + ntt_size, 0, mpzspm));
   ASSERT (mpzspv_verify (y, offsety + ntt_size, 0, mpzspm));
   ASSERT (mpzspv_verify (r, offsetr + ntt_size, 0, mpzspm));
   
-  log2_ntt_size = ceil_log_2 (ntt_size);
+  a.r = r;
+  a.offsetr = offsetr;
+  a.x = x;
+  a.offsetx = offsetx;
+  a.lenx = lenx;
+  a.y = y;
+  a.offsety = offsety;
+  a.leny = leny;
+  a.ntt_size = ntt_size;
+  a.monic = monic;
+  a.monic_pos = monic_pos;
+  a.mpzspm = mpzspm;
+  a.steps = steps;
+  mpzspm_run (mpzspm, mpzspv_mul_ntt_task, &a);
+}
+
+/* Multiply x[offset + j] by w^j for 0 <= j < len, where w is a primitive
+   (2len)-th root of unity modulo each prime, thus w^len = -1: the cyclic
+   convolution of length len of two twisted vectors, as computed by
+   mpzspv_mul_ntt, is the twisted negacyclic convolution (the product
+   modulo x^len + 1) of the original vectors. Needs 2len | max_ntt_size. */
+void
+mpzspv_negacyclic_twist (mpzspv_t x, spv_size_t offset, spv_size_t len,
+                         mpzspm_t mpzspm)
+{
+  unsigned int i;
+  spv_size_t j;
 
-  /* Need parallelization at higher level (e.g., handling a branch of the 
-     product tree in one thread) to make this worthwhile for ECM */
-#define MPZSPV_MUL_NTT_OPENMP 0
+  ASSERT (mpzspv_verify (x, offset, len, mpzspm));
+  ASSERT (mpzspm->max_ntt_size % (2 * len) == 0);
 
-#if defined(_OPENMP) && MPZSPV_MUL_NTT_OPENMP
-#pragma omp parallel if (ntt_size > 16384)
-  {
-#pragma omp for
-#endif
-  for (i = 0; i < (int) mpzspm->sp_num; i++)
+  for (i = 0; i < mpzspm->sp_num; i++)
     {
-      spv_size_t j;
       spm_t spm = mpzspm->spm[i];
-      spv_t spvr = r[i] + offsetr;
-      spv_t spvx = x[i] + offsetx;
-      spv_t spvy = y[i] + offsety;
+      spv_t spv = x[i] + offset;
+      sp_t w, v;
 
-      if ((steps & NTT_MUL_STEP_FFT1) != 0) {
-        if (ntt_size < lenx)
-          {
-            for (j = ntt_size; j < lenx; j += ntt_size)
-              spv_add (spvx, spvx, spvx + j, ntt_size, spm->sp);
-          }
-        if (ntt_size > lenx)
-          spv_set_zero (spvx + lenx, ntt_size - lenx);
-
-        if (monic)
-          spvx[lenx % ntt_size] = sp_add (spvx[lenx % ntt_size], 1, spm->sp);
-
-        spv_ntt_gfp_dif (spvx, log2_ntt_size, spm);
-      }
-
-      if ((steps & NTT_MUL_STEP_FFT2) != 0) {
-        if (ntt_size < leny)
-          {
-            for (j = ntt_size; j < leny; j += ntt_size)
-              spv_add (spvy, spvy, spvy + j, ntt_size, spm->sp);
-          }
-        if (ntt_size > leny)
-          spv_set_zero (spvy + leny, ntt_size - leny);
-
-        if (monic)
-          spvy[leny % ntt_size] = sp_add (spvy[leny % ntt_size], 1, spm->sp);
+      w = sp_pow (spm->prim_root, mpzspm->max_ntt_size / (2 * len), spm->sp,
+                  spm->mul_c);
+      for (j = 1, v = w; j < len; j++, v = sp_mul (v, w, spm->sp, spm->mul_c))
+        spv[j] = sp_mul (spv[j], v, spm->sp, spm->mul_c);
+    }
+}
 
-        spv_ntt_gfp_dif (spvy, log2_ntt_size, spm);
-      }
+/* Inverse of mpzspv_negacyclic_twist. The coefficients of a negacyclic
+   product are negative as often as not: this is fine as long as their
+   absolute value is less than P/2, where P is the product of the primes,
+   since mpzspv_normalise and mpzspv_to_mpzv use the explicit CRT, which
+   returns the residue modulo N of the representative in (-P/2, P/2). */
+void
+mpzspv_negacyclic_untwist (mpzspv_t x, spv_size_t offset, spv_size_t len,
+                           mpzspm_t mpzspm)
+{
+  unsigned int i;
+  spv_size_t j;
 
-      if ((steps & NTT_MUL_STEP_MUL) != 0) {
-        spv_pwmul (spvr, spvx, spvy, ntt_size, spm->sp, spm->mul_c);
-      }
+  ASSERT (mpzspv_verify (x, offset, len, mpzspm));
+  ASSERT (mpzspm->max_ntt_size % (2 * len) == 0);
 
-      if ((steps & NTT_MUL_STEP_IFFT) != 0) {
-        ASSERT (sizeof (mp_limb_t) >= sizeof (sp_t));
+  for (i = 0; i < mpzspm->sp_num; i++)
+    {
+      spm_t spm = mpzspm->spm[i];
+      spv_t spv = x[i] + offset;
+      sp_t w, v;
 
-        spv_ntt_gfp_dit (spvr, log2_ntt_size, spm);
+      w = sp_pow (spm->inv_prim_root, mpzspm->max_ntt_size / (2 * len),
+                  spm->sp, spm->mul_c);
+      for (j = 1, v = w; j < len; j++, v = sp_mul (v, w, spm->sp, spm->mul_c))
+        spv[j] = sp_mul (spv[j], v, spm->sp, spm->mul_c);
+    }
+}
 
-        /* spm->sp - (spm->sp - 1) / ntt_size is the inverse of ntt_size */
-        spv_mul_sp (spvr, spvr, spm->sp - (spm->sp - 1) / ntt_size,
-            ntt_size, spm->sp, spm->mul_c);
+/* bitrev (q + 1) from rev = bitrev (q), where bitrev reverses the k bits
+   of q and m = 2^k: the order of the rows of spv_ntt_gfp_dif_len() */
+static inline spv_size_t
+bitrev_next (spv_size_t rev, const spv_size_t m)
+{
+  spv_size_t bit = m >> 1;
 
-        if (monic_pos)
-          spvr[monic_pos % ntt_size] = sp_sub (spvr[monic_pos % ntt_size],
-              1, spm->sp);
-      }
+  while (rev & bit)
+    {
+      rev ^= bit;
+      bit >>= 1;
     }
-#if defined(_OPENMP) && MPZSPV_MUL_NTT_OPENMP
-  }
-#endif
+  return rev | bit;
 }
 
-/* Computes a DCT-I of the length dctlen. Input is the spvlen coefficients
-   in spv. tmp is temp space and must have space for 2*dctlen-2 sp_t's */
+typedef struct
+{
+  mpzspv_t dct;
+  mpzspv_t spv;
+  spv_size_t spvlen, dctlen;
+  mpzspv_t tmp;
+  mpzspm_t mpzspm;
+} mpzspv_to_dct1_arg_t;
 
-void
-mpzspv_to_dct1 (mpzspv_t dct, const mpzspv_t spv, const spv_size_t spvlen, 
-                const spv_size_t dctlen, mpzspv_t tmp, 
-		const mpzspm_t mpzspm)
+static void
+mpzspv_to_dct1_task (void *arg, unsigned int j)
 {
-  const spv_size_t l = 2 * (dctlen - 1); /* Length for the DFT */
-  const spv_size_t log2_l = ceil_log_2 (l);
-  int j;
+  const mpzspv_to_dct1_arg_t *a = (const mpzspv_to_dct1_arg_t *) arg;
+  const mpzspv_t dct = a->dct, spv = a->spv, tmp = a->tmp;
+  const spv_size_t spvlen = a->spvlen;
+  const spv_size_t l = 2 * (a->dctlen - 1); /* Length for the DFT */
+  const spm_t spm = a->mpzspm->spm[j];
+  spv_size_t i;
+  
+  /* Make a symmetric copy of spv in tmp. I.e. with spv = [3, 2, 1], 
+     spvlen = 3, dctlen = 5 (hence l = 8), we want 
+     tmp = [3, 2, 1, 0, 0, 0, 1, 2] */
+  spv_set (tmp[j], spv[j], spvlen);
+  spv_rev (tmp[j] + l - spvlen + 1, spv[j] + 1, spvlen - 1);
+  /* Now we have [3, 2, 1, ?, ?, ?, 1, 2]. Fill the ?'s with zeros. */
+  spv_set_sp (tmp[j] + spvlen, (sp_t) 0, l - 2 * spvlen + 1);
 
-#ifdef _OPENMP
-#pragma omp parallel private(j)
-  {
-#pragma omp for
+#if 0
+  printf ("mpzspv_to_dct1: tmp[%d] = [", j);
+  for (i = 0; i < l; i++)
+      printf ("%lu, ", tmp[j][i]);
+  printf ("]\n");
 #endif
-  for (j = 0; j < (int) mpzspm->sp_num; j++)
-    {
-      const spm_t spm = mpzspm->spm[j];
-      spv_size_t i;
-      
-      /* Make a symmetric copy of spv in tmp. I.e. with spv = [3, 2, 1], 
-         spvlen = 3, dctlen = 5 (hence l = 8), we want 
-         tmp = [3, 2, 1, 0, 0, 0, 1, 2] */
-      spv_set (tmp[j], spv[j], spvlen);
-      spv_rev (tmp[j] + l - spvlen + 1, spv[j] + 1, spvlen - 1);
-      /* Now we have [3, 2, 1, ?, ?, ?, 1, 2]. Fill the ?'s with zeros. */
-      spv_set_sp (tmp[j] + spvlen, (sp_t) 0, l - 2 * spvlen + 1);
+  
+  spv_ntt_gfp_dif_len (tmp[j], l, spm);
 
 #if 0
-      printf ("mpzspv_to_dct1: tmp[%d] = [", j);
-      for (i = 0; i < l; i++)
-          printf ("%lu, ", tmp[j][i]);
-      printf ("]\n");
+  printf ("mpzspv_to_dct1: tmp[%d] = [", j);
+  for (i = 0; i < l; i++)
+      printf ("%lu, ", tmp[j][i]);
+  printf ("]\n");
 #endif
-      
-      spv_ntt_gfp_dif (tmp[j], log2_l, spm);
 
-#if 0
-      printf ("mpzspv_to_dct1: tmp[%d] = [", j);
-      for (i = 0; i < l; i++)
-          printf ("%lu, ", tmp[j][i]);
-      printf ("]\n");
+  if (l % 3 == 0)
+    {
+      /* X[3 * bitrev (q) + r] is at r * l/3 + q. Copy X[0 ... l/2] */
+      const spv_size_t third = l / 3;
+      spv_size_t r, q, f, rev;
+
+      for (r = 0; r < 3; r++)
+        for (q = 0, rev = 0; q < third;
+             q++, rev = bitrev_next (rev, third))
+          {
+            f = 3 * rev + r;
+            if (f <= l / 2)
+              dct[j][f] = tmp[j][r * third + q];
+          }
+
+#ifdef WANT_ASSERT
+      /* Test that the coefficients are symmetric */
+      for (r = 0; r < 3; r++)
+        for (q = 0, rev = 0; q < third;
+             q++, rev = bitrev_next (rev, third))
+          {
+            f = 3 * rev + r;
+            ASSERT (tmp[j][r * third + q] == dct[j][MIN (f, l - f)]);
+          }
 #endif
+      return;
+    }
 
-      /* The forward transform is scrambled. We want elements [0 ... l/2]
-         of the unscrabled data, that is all the coefficients with the most 
-         significant bit in the index (in log2(l) word size) unset, plus the 
-         element at index l/2. By scrambling, these map to the elements with 
-         even index, plus the element at index 1. 
-         The elements with scrambled index 2*i are stored in h[i], the
-         element with scrambled index 1 is stored in h[params->l] */
+  /* The forward transform is scrambled. We want elements [0 ... l/2]
+     of the unscrabled data, that is all the coefficients with the most 
+     significant bit in the index (in log2(l) word size) unset, plus the 
+     element at index l/2. By scrambling, these map to the elements with 
+     even index, plus the element at index 1. 
+     The elements with scrambled index 2*i are stored in h[i], the
+     element with scrambled index 1 is stored in h[params->l] */
   
 #ifdef WANT_ASSERT
-      /* Test that the coefficients are symmetric (if they were unscrambled)
-         and that our algorithm for finding identical coefficients in the 
-         scrambled data works */
+  /* Test that the coefficients are symmetric (if they were unscrambled)
+     and that our algorithm for finding identical coefficients in the 
+     scrambled data works */
+  {
+    spv_size_t m = 5;
+    for (i = 2; i < l; i += 2L)
       {
-        spv_size_t m = 5;
-        for (i = 2; i < l; i += 2L)
-          {
-            /* This works, but why? */
-            if (i + i / 2L > m)
-                m = 2L * m + 1L;
+        /* This works, but why? */
+        if (i + i / 2L > m)
+            m = 2L * m + 1L;
 
-            ASSERT (tmp[j][i] == tmp[j][m - i]);
+        ASSERT (tmp[j][i] == tmp[j][m - i]);
 #if 0
-            printf ("mpzspv_to_dct1: DFT[%lu] == DFT[%lu]\n", i, m - i);
+        printf ("mpzspv_to_dct1: DFT[%lu] == DFT[%lu]\n", i, m - i);
 #endif
-          }
       }
-#endif
-
-      /* Copy coefficients to dct buffer */
-      for (i = 0; i < l / 2; i++)
-        dct[j][i] = tmp[j][i * 2];
-      dct[j][l / 2] = tmp[j][1];
-    }
-#ifdef _OPENMP
   }
 #endif
+
+  /* Copy coefficients to dct buffer */
+  for (i = 0; i < l / 2; i++)
+    dct[j][i] = tmp[j][i * 2];
+  dct[j][l / 2] = tmp[j][1];
+}
+
+/* Computes a DCT-I of the length dctlen. Input is the spvlen coefficients
+   in spv. tmp is temp space and must have space for 2*dctlen-2 sp_t's.
+   The DFT length 2*dctlen-2 is 2^k or 3*2^k. In the former case, the
+   DCT-I coefficients are stored in the scrambled order described in
+   mpzspv_to_dct1_task(), in the latter in the natural order. The small
+   primes are shared among the threads of mpzspm_set_threads(), if any. */
+void
+mpzspv_to_dct1 (mpzspv_t dct, const mpzspv_t spv, const spv_size_t spvlen, 
+                const spv_size_t dctlen, mpzspv_t tmp, 
+		const mpzspm_t mpzspm)
+{
+  mpzspv_to_dct1_arg_t a;
+
+  a.dct = dct;
+  a.spv = spv;
+  a.spvlen = spvlen;
+  a.dctlen = dctlen;
+  a.tmp = tmp;
+  a.mpzspm = mpzspm;
+  mpzspm_run (mpzspm, mpzspv_to_dct1_task, &a);
 }
 
 
 /* Multiply the polynomial in "dft" by the RLP in "dct", where "dft" 
    contains the polynomial coefficients (not FFT'd yet) and "dct" 
    contains the DCT-I coefficients of the RLP. The latter are 
-   assumed to be in the layout produced by mpzspv_to_dct1().
+   assumed to be in the layout produced by mpzspv_to_dct1(), and len is
+   2^k or 3*2^k.
    Output are the coefficients of the product polynomial, stored in dft. 
    The "steps" parameter controls which steps are computed:
    NTT_MUL_STEP_FFT1: do forward transform
@@ -877,242 +1056,280 @@ mpzspv_to_dct1 (mpzspv_t dct, const mpzspv_t spv, const spv_size_t spvlen,
    NTT_MUL_STEP_IFFT: do inverse transform 
 */
 
-void
-mpzspv_mul_by_dct (mpzspv_t dft, const mpzspv_t dct, const spv_size_t len, 
-		   const mpzspm_t mpzspm, const int steps)
+typedef struct
 {
-  int j;
-  spv_size_t log2_len = ceil_log_2 (len);
-  
-#ifdef _OPENMP
-#pragma omp parallel private(j)
-  {
-#pragma omp for
-#endif
-    for (j = 0; j < (int) (mpzspm->sp_num); j++)
-      {
-	const spm_t spm = mpzspm->spm[j];
-	const spv_t spv = dft[j];
-	unsigned long i, m;
+  mpzspv_t dft;
+  mpzspv_t dct;
+  spv_size_t len;
+  mpzspm_t mpzspm;
+  int steps;
+} mpzspv_mul_by_dct_arg_t;
+
+static void
+mpzspv_mul_by_dct_task (void *arg, unsigned int j)
+{
+  const mpzspv_mul_by_dct_arg_t *a = (const mpzspv_mul_by_dct_arg_t *) arg;
+  const mpzspv_t dct = a->dct;
+  const spv_size_t len = a->len;
+  const int steps = a->steps;
+  const spm_t spm = a->mpzspm->spm[j];
+  const spv_t spv = a->dft[j];
+  unsigned long i, m;
 	
-	/* Forward DFT of dft[j] */
-	if ((steps & NTT_MUL_STEP_FFT1) != 0)
-	  spv_ntt_gfp_dif (spv, log2_len, spm);
+  /* Forward DFT of dft[j] */
+  if ((steps & NTT_MUL_STEP_FFT1) != 0)
+    spv_ntt_gfp_dif_len (spv, len, spm);
 	
-	/* Point-wise product */
-	if ((steps & NTT_MUL_STEP_MUL) != 0)
+  /* Point-wise product */
+  if ((steps & NTT_MUL_STEP_MUL) != 0 && len % 3 == 0)
+    {
+      /* The natural order of the DCT-I, see mpzspv_to_dct1() */
+      const spv_size_t third = len / 3;
+      spv_size_t r, q, f, rev;
+
+      for (r = 0; r < 3; r++)
+	for (q = 0, rev = 0; q < third;
+	     q++, rev = bitrev_next (rev, third))
 	  {
-	    m = 5UL;
+	    f = 3 * rev + r;
+	    spv[r * third + q] = sp_mul (spv[r * third + q],
+					 dct[j][MIN (f, len - f)],
+					 spm->sp, spm->mul_c);
+	  }
+    }
+  else if ((steps & NTT_MUL_STEP_MUL) != 0)
+    {
+      m = 5UL;
 	    
-	    spv[0] = sp_mul (spv[0], dct[j][0], spm->sp, spm->mul_c);
-	    spv[1] = sp_mul (spv[1], dct[j][len / 2UL], spm->sp, spm->mul_c);
+      spv[0] = sp_mul (spv[0], dct[j][0], spm->sp, spm->mul_c);
+      spv[1] = sp_mul (spv[1], dct[j][len / 2UL], spm->sp, spm->mul_c);
 	    
-	    for (i = 2UL; i < len; i += 2UL)
-	      {
-		/* This works, but why? */
-		if (i + i / 2UL > m)
-		  m = 2UL * m + 1;
+      for (i = 2UL; i < len; i += 2UL)
+	{
+	  /* This works, but why? */
+	  if (i + i / 2UL > m)
+	    m = 2UL * m + 1;
 		
-		spv[i] = sp_mul (spv[i], dct[j][i / 2UL], spm->sp, spm->mul_c);
-		spv[m - i] = sp_mul (spv[m - i], dct[j][i / 2UL], spm->sp, 
-				     spm->mul_c);
-	      }
-	  }
+	  spv[i] = sp_mul (spv[i], dct[j][i / 2UL], spm->sp, spm->mul_c);
+	  spv[m - i] = sp_mul (spv[m - i], dct[j][i / 2UL], spm->sp, 
+			       spm->mul_c);
+	}
+    }
 	
-	/* Inverse transform of dft[j] */
-	if ((steps & NTT_MUL_STEP_IFFT) != 0)
-	  {
-	    spv_ntt_gfp_dit (spv, log2_len, spm);
+  /* Inverse transform of dft[j] */
+  if ((steps & NTT_MUL_STEP_IFFT) != 0)
+    {
+      spv_ntt_gfp_dit_len (spv, len, spm);
 	    
-	    /* Divide by transform length. FIXME: scale the DCT of h instead */
-	    spv_mul_sp (spv, spv, spm->sp - (spm->sp - 1) / len, len, 
-			spm->sp, spm->mul_c);
-	  }
-      }
-#ifdef _OPENMP
-  }
-#endif
+      /* Divide by transform length. FIXME: scale the DCT of h instead */
+      spv_mul_sp_simd (spv, spv, spm->sp - (spm->sp - 1) / len, len, 
+		       spm);
+    }
 }
 
+void
+mpzspv_mul_by_dct (mpzspv_t dft, const mpzspv_t dct, const spv_size_t len, 
+		   const mpzspm_t mpzspm, const int steps)
+{
+  mpzspv_mul_by_dct_arg_t a;
+
+  a.dft = dft;
+  a.dct = dct;
+  a.len = len;
+  a.mpzspm = mpzspm;
+  a.steps = steps;
+  mpzspm_run (mpzspm, mpzspv_mul_by_dct_task, &a);
+}
 
-void 
-mpzspv_sqr_reciprocal (mpzspv_t dft, const spv_size_t n, 
-                       const mpzspm_t mpzspm)
+
+typedef struct
+{
+  mpzspv_t dft;
+  spv_size_t n;
+  mpzspm_t mpzspm;
+} mpzspv_sqr_reciprocal_arg_t;
+
+static void
+mpzspv_sqr_reciprocal_task (void *arg, unsigned int j)
 {
+  const mpzspv_sqr_reciprocal_arg_t *a =
+    (const mpzspv_sqr_reciprocal_arg_t *) arg;
+  const mpzspm_t mpzspm = a->mpzspm;
+  const spv_size_t n = a->n;
   const spv_size_t log2_n = ceil_log_2 (n);
   const spv_size_t len = ((spv_size_t) 2) << log2_n;
   const spv_size_t log2_len = 1 + log2_n;
-  int j;
-
-  ASSERT(mpzspm->max_ntt_size % 3UL == 0UL);
-  ASSERT(len % 3UL != 0UL);
-  ASSERT(mpzspm->max_ntt_size % len == 0UL);
-
-#ifdef _OPENMP
-#pragma omp parallel
-  {
-#pragma omp for
-#endif
-    for (j = 0; j < (int) (mpzspm->sp_num); j++)
-      {
-        const spm_t spm = mpzspm->spm[j];
-        const spv_t spv = dft[j];
-        sp_t w1, w2, invlen;
-        const sp_t sp = spm->sp, mul_c = spm->mul_c;
-        spv_size_t i;
+  const spm_t spm = mpzspm->spm[j];
+  const spv_t spv = a->dft[j];
+  sp_t w1, w2, invlen;
+  const sp_t sp = spm->sp, mul_c = spm->mul_c;
+  spv_size_t i;
 
-        /* Zero out NTT elements [n .. len-n] */
-        spv_set_sp (spv + n, (sp_t) 0, len - 2*n + 1);
+  /* Zero out NTT elements [n .. len-n] */
+  spv_set_sp (spv + n, (sp_t) 0, len - 2*n + 1);
 
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          {
-            printf ("ntt_sqr_reciprocal: NTT vector mod %lu\n", sp);
-            ntt_print_vec ("ntt_sqr_reciprocal: before weighting:", spv, len);
-          }
+  if (j == 0)
+    {
+      printf ("ntt_sqr_reciprocal: NTT vector mod %lu\n", sp);
+      ntt_print_vec ("ntt_sqr_reciprocal: before weighting:", spv, len);
+    }
 #endif
 
-        /* Compute the root for the weight signal, a 3rd primitive root 
-           of unity */
-        w1 = sp_pow (spm->prim_root, mpzspm->max_ntt_size / 3UL, sp, 
-                     mul_c);
-        /* Compute iw= 1/w */
-        w2 = sp_pow (spm->inv_prim_root, mpzspm->max_ntt_size / 3UL, sp, 
-                     mul_c);
+  /* Compute the root for the weight signal, a 3rd primitive root 
+     of unity */
+  w1 = sp_pow (spm->prim_root, mpzspm->max_ntt_size / 3UL, sp, 
+	       mul_c);
+  /* Compute iw= 1/w */
+  w2 = sp_pow (spm->inv_prim_root, mpzspm->max_ntt_size / 3UL, sp, 
+	       mul_c);
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          printf ("w1 = %lu ,w2 = %lu\n", w1, w2);
+  if (j == 0)
+    printf ("w1 = %lu ,w2 = %lu\n", w1, w2);
 #endif
-        ASSERT(sp_mul(w1, w2, sp, mul_c) == (sp_t) 1);
-        ASSERT(w1 != (sp_t) 1);
-        ASSERT(sp_pow (w1, 3UL, sp, mul_c) == (sp_t) 1);
-        ASSERT(w2 != (sp_t) 1);
-        ASSERT(sp_pow (w2, 3UL, sp, mul_c) == (sp_t) 1);
-
-        /* Fill NTT elements spv[len-n+1 .. len-1] with coefficients and
-           apply weight signal to spv[i] and spv[l-i] for 0 <= i < n
-           Use the fact that w^i + w^{-i} = -1 if i != 0 (mod 3). */
-        for (i = 0; i + 2 < n; i += 3)
-          {
-            sp_t t, u;
+  ASSERT(sp_mul(w1, w2, sp, mul_c) == (sp_t) 1);
+  ASSERT(w1 != (sp_t) 1);
+  ASSERT(sp_pow (w1, 3UL, sp, mul_c) == (sp_t) 1);
+  ASSERT(w2 != (sp_t) 1);
+  ASSERT(sp_pow (w2, 3UL, sp, mul_c) == (sp_t) 1);
+
+  /* Fill NTT elements spv[len-n+1 .. len-1] with coefficients and
+     apply weight signal to spv[i] and spv[l-i] for 0 <= i < n
+     Use the fact that w^i + w^{-i} = -1 if i != 0 (mod 3). */
+  for (i = 0; i + 2 < n; i += 3)
+    {
+      sp_t t, u;
             
-	    if (i > 0)
-	      spv[len - i] = spv[i];
+      if (i > 0)
+	spv[len - i] = spv[i];
             
-            t = spv[i + 1];
-            u = sp_mul (t, w1, sp, mul_c);
-            spv[i + 1] = u;
-            spv[len - i - 1] = sp_neg (sp_add (t, u, sp), sp);
-
-            t = spv[i + 2];
-            u = sp_mul (t, w2, sp, mul_c);
-            spv[i + 2] = u;
-            spv[len - i - 2] = sp_neg (sp_add (t, u, sp), sp);
-          }
-        if (i < n && i > 0)
-          {
-            spv[len - i] = spv[i];
-          }
-        if (i + 1 < n)
-          {
-            sp_t t, u;
-            t = spv[i + 1];
-            u = sp_mul (t, w1, sp, mul_c);
-            spv[i + 1] = u;
-            spv[len - i - 1] = sp_neg (sp_add (t, u, sp), sp);
-          }
+      t = spv[i + 1];
+      u = sp_mul (t, w1, sp, mul_c);
+      spv[i + 1] = u;
+      spv[len - i - 1] = sp_neg (sp_add (t, u, sp), sp);
+
+      t = spv[i + 2];
+      u = sp_mul (t, w2, sp, mul_c);
+      spv[i + 2] = u;
+      spv[len - i - 2] = sp_neg (sp_add (t, u, sp), sp);
+    }
+  if (i < n && i > 0)
+    {
+      spv[len - i] = spv[i];
+    }
+  if (i + 1 < n)
+    {
+      sp_t t, u;
+      t = spv[i + 1];
+      u = sp_mul (t, w1, sp, mul_c);
+      spv[i + 1] = u;
+      spv[len - i - 1] = sp_neg (sp_add (t, u, sp), sp);
+    }
 
 #ifdef TRACE_ntt_sqr_reciprocal
-      if (j == 0)
-        ntt_print_vec ("ntt_sqr_reciprocal: after weighting:", spv, len);
+  if (j == 0)
+  ntt_print_vec ("ntt_sqr_reciprocal: after weighting:", spv, len);
 #endif
 
-        /* Forward DFT of dft[j] */
-        spv_ntt_gfp_dif (spv, log2_len, spm);
+  /* Forward DFT of dft[j] */
+  spv_ntt_gfp_dif (spv, log2_len, spm);
 
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          ntt_print_vec ("ntt_sqr_reciprocal: after forward transform:", 
-			 spv, len);
+  if (j == 0)
+    ntt_print_vec ("ntt_sqr_reciprocal: after forward transform:", 
+		   spv, len);
 #endif
 
-        /* Square the transformed vector point-wise */
-        spv_pwmul (spv, spv, spv, len, sp, mul_c);
+  /* Square the transformed vector point-wise */
+  spv_pwmul_simd (spv, spv, spv, len, spm);
       
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          ntt_print_vec ("ntt_sqr_reciprocal: after point-wise squaring:", 
-			 spv, len);
+  if (j == 0)
+    ntt_print_vec ("ntt_sqr_reciprocal: after point-wise squaring:", 
+		   spv, len);
 #endif
 
-        /* Inverse transform of dft[j] */
-        spv_ntt_gfp_dit (spv, log2_len, spm);
+  /* Inverse transform of dft[j] */
+  spv_ntt_gfp_dit (spv, log2_len, spm);
       
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          ntt_print_vec ("ntt_sqr_reciprocal: after inverse transform:", 
-			 spv, len);
+  if (j == 0)
+    ntt_print_vec ("ntt_sqr_reciprocal: after inverse transform:", 
+		   spv, len);
 #endif
 
-        /* Un-weight and divide by transform length */
-        invlen = sp - (sp - (sp_t) 1) / len; /* invlen = 1/len (mod sp) */
-        w1 = sp_mul (invlen, w1, sp, mul_c);
-        w2 = sp_mul (invlen, w2, sp, mul_c);
-        for (i = 0; i < 2 * n - 3; i += 3)
-          {
-            spv[i] = sp_mul (spv[i], invlen, sp, mul_c);
-            spv[i + 1] = sp_mul (spv[i + 1], w2, sp, mul_c);
-            spv[i + 2] = sp_mul (spv[i + 2], w1, sp, mul_c);
-          }
-        if (i < 2 * n - 1)
-          spv[i] = sp_mul (spv[i], invlen, sp, mul_c);
-        if (i < 2 * n - 2)
-          spv[i + 1] = sp_mul (spv[i + 1], w2, sp, mul_c);
+  /* Un-weight and divide by transform length */
+  invlen = sp - (sp - (sp_t) 1) / len; /* invlen = 1/len (mod sp) */
+  w1 = sp_mul (invlen, w1, sp, mul_c);
+  w2 = sp_mul (invlen, w2, sp, mul_c);
+  for (i = 0; i < 2 * n - 3; i += 3)
+    {
+      spv[i] = sp_mul (spv[i], invlen, sp, mul_c);
+      spv[i + 1] = sp_mul (spv[i + 1], w2, sp, mul_c);
+      spv[i + 2] = sp_mul (spv[i + 2], w1, sp, mul_c);
+    }
+  if (i < 2 * n - 1)
+    spv[i] = sp_mul (spv[i], invlen, sp, mul_c);
+  if (i < 2 * n - 2)
+    spv[i + 1] = sp_mul (spv[i + 1], w2, sp, mul_c);
         
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          ntt_print_vec ("ntt_sqr_reciprocal: after un-weighting:", spv, len);
+  if (j == 0)
+    ntt_print_vec ("ntt_sqr_reciprocal: after un-weighting:", spv, len);
 #endif
 
-        /* Separate the coefficients of R in the wrapped-around product. */
+  /* Separate the coefficients of R in the wrapped-around product. */
 
-        /* Set w1 = cuberoot(1)^l where cuberoot(1) is the same primitive
-           3rd root of unity we used for the weight signal */
-        w1 = sp_pow (spm->prim_root, mpzspm->max_ntt_size / 3UL, sp, 
-                     mul_c);
-        w1 = sp_pow (w1, len % 3UL, sp, mul_c);
+  /* Set w1 = cuberoot(1)^l where cuberoot(1) is the same primitive
+     3rd root of unity we used for the weight signal */
+  w1 = sp_pow (spm->prim_root, mpzspm->max_ntt_size / 3UL, sp, 
+	       mul_c);
+  w1 = sp_pow (w1, len % 3UL, sp, mul_c);
         
-        /* Set w2 = 1/(w1 - 1/w1). Incidentally, w2 = 1/sqrt(-3) */
-        w2 = sp_inv (w1, sp, mul_c);
-        w2 = sp_sub (w1, w2, sp);
-        w2 = sp_inv (w2, sp, mul_c);
+  /* Set w2 = 1/(w1 - 1/w1). Incidentally, w2 = 1/sqrt(-3) */
+  w2 = sp_inv (w1, sp, mul_c);
+  w2 = sp_sub (w1, w2, sp);
+  w2 = sp_inv (w2, sp, mul_c);
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          printf ("For separating: w1 = %lu, w2 = %lu\n", w1, w2);
+  if (j == 0)
+    printf ("For separating: w1 = %lu, w2 = %lu\n", w1, w2);
 #endif
         
-        for (i = len - (2*n - 2); i <= len / 2; i++)
-          {
-            sp_t t, u;
-            /* spv[i] = s_i + w^{-l} s_{l-i}. 
-               spv[l-i] = s_{l-i} + w^{-l} s_i */
-            t = sp_mul (spv[i], w1, sp, mul_c); /* t = w^l s_i + s_{l-i} */
-            t = sp_sub (t, spv[len - i], sp);   /* t = w^l s_i + w^{-l} s_i */
-            t = sp_mul (t, w2, sp, mul_c);      /* t = s_1 */
-
-            u = sp_sub (spv[i], t, sp);         /* u = w^{-l} s_{l-i} */
-            u = sp_mul (u, w1, sp, mul_c);      /* u = s_{l-i} */
-            spv[i] = t;
-            spv[len - i] = u;
-            ASSERT(i < len / 2 || t == u);
-          }
+  for (i = len - (2*n - 2); i <= len / 2; i++)
+    {
+      sp_t t, u;
+      /* spv[i] = s_i + w^{-l} s_{l-i}. 
+	 spv[l-i] = s_{l-i} + w^{-l} s_i */
+      t = sp_mul (spv[i], w1, sp, mul_c); /* t = w^l s_i + s_{l-i} */
+      t = sp_sub (t, spv[len - i], sp);   /* t = w^l s_i + w^{-l} s_i */
+      t = sp_mul (t, w2, sp, mul_c);      /* t = s_1 */
+
+      u = sp_sub (spv[i], t, sp);         /* u = w^{-l} s_{l-i} */
+      u = sp_mul (u, w1, sp, mul_c);      /* u = s_{l-i} */
+      spv[i] = t;
+      spv[len - i] = u;
+      ASSERT(i < len / 2 || t == u);
+    }
 
 #ifdef TRACE_ntt_sqr_reciprocal
-        if (j == 0)
-          ntt_print_vec ("ntt_sqr_reciprocal: after un-wrapping:", spv, len);
-#endif
-      }
-#ifdef _OPENMP
-    }
+  if (j == 0)
+    ntt_print_vec ("ntt_sqr_reciprocal: after un-wrapping:", spv, len);
 #endif
 }
+
+void 
+mpzspv_sqr_reciprocal (mpzspv_t dft, const spv_size_t n, 
+                       const mpzspm_t mpzspm)
+{
+  const spv_size_t len = ((spv_size_t) 2) << ceil_log_2 (n);
+  mpzspv_sqr_reciprocal_arg_t a;
+
+  ASSERT(mpzspm->max_ntt_size % 3UL == 0UL);
+  ASSERT(len % 3UL != 0UL);
+  ASSERT(mpzspm->max_ntt_size % len == 0UL);
+
+  a.dft = dft;
+  a.n = n;
+  a.mpzspm = mpzspm;
+  mpzspm_run (mpzspm, mpzspv_sqr_reciprocal_task, &a);
+}
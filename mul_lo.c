@@ -39,10 +39,11 @@ ecm_mul_lo_basecase (mp_ptr rp, mp_srcptr np, mp_srcptr mp, mp_size_t n)
     mpn_addmul_1 (++rp, np, n, (++mp)[0]);
 }
 
-#ifdef MPN_MUL_LO_THRESHOLD_TABLE
-size_t mpn_mul_lo_threshold[MPN_MUL_LO_THRESHOLD] = MPN_MUL_LO_THRESHOLD_TABLE;
-#else
+#ifdef TUNE
+/* set by tune.c */
 size_t mpn_mul_lo_threshold[MPN_MUL_LO_THRESHOLD];
+#else
+#define mpn_mul_lo_threshold __ecm_tune_params.mul_lo_table
 #endif
 
 
@@ -669,7 +669,7 @@ compute_s_4_add_sub(mpz_t s, ecm_uint B1, int disc)
 
     mpz_init(t);
     tp = cputime();
-    compute_s(t, B1, forbiddenres);
+    compute_s(t, B1, forbiddenres, 1);
     free(forbiddenres);
     printf("# computing prod(p^e <= %lu): %ldms\n", B1, elltime(tp,cputime()));
 #if USE_ADD_SUB_CHAINS == 0 /* keeping it simple for the time being */
@@ -931,7 +931,7 @@ one_curve_at_a_time(mpz_t f, char *ok, ell_curve_t *tE, ell_point_t *tP, int nE,
 	}
 	if(saveit){
 	    write_resumefile(savefilename, ECM_ECM, N, params, &candi, 
-			     tP[i]->x, tP[i]->y, comment);
+			     tP[i]->x, tP[i]->y, comment, NULL);
 	}
 
     }
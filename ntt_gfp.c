@@ -1,4 +1,4 @@
-/* ntt_gfp.c - low-level radix-2 dif/dit ntt routines over GF(p)
+/* ntt_gfp.c - low-level radix-2 and radix-3 dif/dit ntt routines over GF(p)
    
 Copyright 2005, 2006, 2007, 2008, 2009 Dave Newman, Jason Papadopoulos,
 Brian Gladman, Alexander Kruppa, Paul Zimmermann.
@@ -21,6 +21,56 @@ MA 02110-1301, USA. */
 #include "sp.h"
 #include "ecm-impl.h"
 
+/* With small primes of at most W_TYPE_SIZE - 2 bits, the scalar transforms
+   which use the twiddle tables follow D. Harvey, "Faster arithmetic for
+   number-theoretic transforms", J. Symbolic Comput. 60 (2014): a product by
+   a twiddle w uses its Shoup quotient floor(w * 2^W_TYPE_SIZE / p) and gives
+   a result in [0, 2p), and the values between two stages are kept in
+   [0, 2p) (dif) or [0, 4p) (dit) instead of [0, p). This saves a reduction
+   per butterfly, and the multiplication is cheaper than sp_mul(). The last
+   stage reduces to [0, p), so the results do not change. */
+#if SP_TYPE_BITS == W_TYPE_SIZE && SP_NUMB_BITS <= W_TYPE_SIZE - 2
+#define NTT_LAZY
+
+/* x*w mod p, in [0, 2p), for any x, with wq the Shoup quotient of w */
+static inline sp_t
+sp_mul_shoup (sp_t x, sp_t w, sp_t wq, sp_t p)
+{
+  sp_t q;
+  ATTRIBUTE_UNUSED sp_t t;
+
+  umul_ppmm (q, t, x, wq);
+  return x * w - q * p;
+}
+#endif
+
+/* Above NTT_GFP_BLOCK_BREAKOVER, a transform of length n = n1 * n2, with
+   n1 = 2^k, n2 <= 2^NTT_GFP_BLOCK_BREAKOVER, does the k outer radix-2
+   stages in a single pass over x, which is seen as n1 rows of n2 entries,
+   and the other stages on each row (D. H. Bailey, "FFTs in external or
+   hierarchical memory", J. Supercomputing 4 (1990)). The pass copies a
+   few columns of all rows at a time into a buffer of NTT_BLOCK_ENTRIES,
+   where the k stages stay in the L2 cache with their twiddles. The rows
+   fit in the cache too if NTT_GFP_BLOCK_BREAKOVER is small enough, so
+   that x goes through the memory twice, where the radix-2 code goes
+   through it once per stage until a sub-transform fits in the cache. The
+   results do not change. */
+#define NTT_BLOCK_ENTRIES 16384
+#define NTT_BLOCK_MAX_LOG2_ROWS 8	/* at least 64 columns at a time */
+
+static void ntt_gfp_columns (spv_t, spv_size_t, spv_size_t, spv_t, spv_t,
+                             int, spm_t);
+
+/* the number k of stages of the column pass for a transform of length
+   2^log2_len, 0 for the radix-2 code */
+static spv_size_t
+ntt_gfp_block_log2_rows (spv_size_t log2_len)
+{
+  if (log2_len <= NTT_GFP_BLOCK_BREAKOVER)
+    return 0;
+  return MIN (log2_len - NTT_GFP_BLOCK_BREAKOVER, NTT_BLOCK_MAX_LOG2_ROWS);
+}
+
 /*--------------------------- FORWARD NTT --------------------------------*/
 static void bfly_dif(spv_t x0, spv_t x1, spv_t w,
 			spv_size_t len, sp_t p, sp_t d)
@@ -213,9 +263,11 @@ static void bfly_dif(spv_t x0, spv_t x1, spv_t w,
 }
 
 static void
-spv_ntt_dif_core (spv_t x, spv_t w, 
-		  spv_size_t log2_len, sp_t p, sp_t d)
+spv_ntt_dif_core (spv_t x, spv_t w, spv_t wq,
+		  spv_size_t log2_len, spm_t spm)
 {
+  sp_t p = spm->sp;
+  sp_t d = spm->mul_c;
   spv_size_t len;
   spv_t x0, x1;
 	
@@ -299,22 +351,92 @@ spv_ntt_dif_core (spv_t x, spv_t w,
   len = 1 << (log2_len - 1);
   x0 = x;
   x1 = x + len;
-  bfly_dif (x0, x1, w, len, p, d);
-  spv_ntt_dif_core (x0, w + len, log2_len - 1, p, d);
-  spv_ntt_dif_core (x1, w + len, log2_len - 1, p, d);
+#ifdef SP_SIMD
+  if (spm->simd != SP_SIMD_NONE)
+    spv_bfly_dif_simd (x0, x1, w, wq, len, spm);
+  else
+#endif
+    bfly_dif (x0, x1, w, len, p, d);
+  spv_ntt_dif_core (x0, w + len, wq + len, log2_len - 1, spm);
+  spv_ntt_dif_core (x1, w + len, wq + len, log2_len - 1, spm);
 }
 
+#ifdef NTT_LAZY
+/* x0 + x1, (x0 - x1) * w for x0, x1 in [0, 2p), with results in [0, 2p) */
+static void
+bfly_dif_lazy (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+               spv_size_t len, sp_t p)
+{
+  const sp_t p2 = 2 * p;
+  spv_size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      sp_t t0 = x0[i];
+      sp_t t1 = x1[i];
+      sp_t t2 = t0 + t1;
+      x0[i] = (t2 >= p2) ? t2 - p2 : t2;
+      x1[i] = sp_mul_shoup (t0 - t1 + p2, w[i], wq[i], p);
+    }
+}
+
+/* spv_ntt_dif_core() for x in [0, 2p), the output is in [0, p) */
+static void
+spv_ntt_dif_lazy (spv_t x, spv_t w, spv_t wq,
+		  spv_size_t log2_len, spm_t spm)
+{
+  spv_size_t i, len;
+
+  /* the small transforms want their input in [0, p) */
+  if (log2_len <= 3)
+    {
+      for (i = 0; i < ((spv_size_t) 1 << log2_len); i++)
+        if (x[i] >= spm->sp)
+          x[i] -= spm->sp;
+      spv_ntt_dif_core (x, w, wq, log2_len, spm);
+      return;
+    }
+
+  len = 1 << (log2_len - 1);
+  bfly_dif_lazy (x, x + len, w, wq, len, spm->sp);
+  spv_ntt_dif_lazy (x, w + len, wq + len, log2_len - 1, spm);
+  spv_ntt_dif_lazy (x + len, w + len, wq + len, log2_len - 1, spm);
+}
+#endif
+
 void
 spv_ntt_gfp_dif (spv_t x, spv_size_t log2_len, spm_t data)
 {
   sp_t p = data->sp;
   sp_t d = data->mul_c;
+  spv_size_t k;
+  spv_t buf;
 
   if (log2_len <= NTT_GFP_TWIDDLE_DIF_BREAKOVER)
     { 
       spv_t w = data->nttdata->twiddle + 
 	        data->nttdata->twiddle_size - (1 << log2_len);
-      spv_ntt_dif_core (x, w, log2_len, p, d);
+      spv_t wq = data->nttdata->twiddle_shoup + 
+	         data->nttdata->twiddle_size - (1 << log2_len);
+#ifdef NTT_LAZY
+      if (data->simd == SP_SIMD_NONE)
+        spv_ntt_dif_lazy (x, w, wq, log2_len, data);
+      else
+#endif
+        spv_ntt_dif_core (x, w, wq, log2_len, data);
+    }
+  else if ((k = ntt_gfp_block_log2_rows (log2_len)) != 0 &&
+           (buf = (spv_t) sp_aligned_malloc (2 * NTT_BLOCK_ENTRIES
+                                             * sizeof (sp_t))) != NULL)
+    {
+      /* the k outer stages, then the rows */
+      spv_size_t i, log2_n2 = log2_len - k;
+
+      ntt_gfp_columns (x, log2_len, k, data->nttdata->ntt_roots, buf, 0,
+                       data);
+      sp_aligned_free (buf);
+      for (i = 0; i < ((spv_size_t) 1 << k); i++)
+        spv_ntt_gfp_dif (x + (i << log2_n2), log2_n2, data);
     }
   else
     {
@@ -340,9 +462,14 @@ spv_ntt_gfp_dif (spv_t x, spv_size_t log2_len, spm_t data)
 	  for (i = 0; i < len; i += block_size)
 	    {
 	      if (i)
-	        spv_mul_sp (w, w, root, block_size, p, d);
+	        spv_mul_sp_simd (w, w, root, block_size, data);
 
-	      bfly_dif (x0 + i, x1 + i, w, block_size, p, d);
+#ifdef SP_SIMD
+	      if (data->simd != SP_SIMD_NONE)
+	        spv_bfly_dif_simd (x0 + i, x1 + i, w, NULL, block_size, data);
+	      else
+#endif
+	        bfly_dif (x0 + i, x1 + i, w, block_size, p, d);
 	    }
 	}
 	
@@ -540,9 +667,11 @@ static inline void bfly_dit(spv_t x0, spv_t x1, spv_t w,
 }
 
 static void
-spv_ntt_dit_core (spv_t x, spv_t w, 
-		  spv_size_t log2_len, sp_t p, sp_t d)
+spv_ntt_dit_core (spv_t x, spv_t w, spv_t wq,
+		  spv_size_t log2_len, spm_t spm)
 {
+  sp_t p = spm->sp;
+  sp_t d = spm->mul_c;
   spv_size_t len;
   spv_t x0, x1;
 	
@@ -626,22 +755,103 @@ spv_ntt_dit_core (spv_t x, spv_t w,
   len = 1 << (log2_len - 1);
   x0 = x;
   x1 = x + len;
-  spv_ntt_dit_core (x0, w + len, log2_len - 1, p, d);
-  spv_ntt_dit_core (x1, w + len, log2_len - 1, p, d);
-  bfly_dit (x0, x1, w, len, p, d);
+  spv_ntt_dit_core (x0, w + len, wq + len, log2_len - 1, spm);
+  spv_ntt_dit_core (x1, w + len, wq + len, log2_len - 1, spm);
+#ifdef SP_SIMD
+  if (spm->simd != SP_SIMD_NONE)
+    spv_bfly_dit_simd (x0, x1, w, wq, len, spm);
+  else
+#endif
+    bfly_dit (x0, x1, w, len, p, d);
+}
+
+#ifdef NTT_LAZY
+/* x0 + x1 * w, x0 - x1 * w for x0, x1 in [0, 4p), with results in [0, 4p),
+   or in [0, p) if last is non-zero */
+static void
+bfly_dit_lazy (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+               spv_size_t len, sp_t p, int last)
+{
+  const sp_t p2 = 2 * p;
+  spv_size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      sp_t t0 = x0[i];
+      sp_t t1 = sp_mul_shoup (x1[i], w[i], wq[i], p);
+      if (t0 >= p2)
+        t0 -= p2;
+      if (last)
+        {
+          if (t0 >= p)
+            t0 -= p;
+          if (t1 >= p)
+            t1 -= p;
+          x0[i] = sp_add (t0, t1, p);
+          x1[i] = sp_sub (t0, t1, p);
+        }
+      else
+        {
+          x0[i] = t0 + t1;
+          x1[i] = t0 - t1 + p2;
+        }
+    }
+}
+
+/* spv_ntt_dit_core() with an output in [0, 4p), or in [0, p) if last is
+   non-zero */
+static void
+spv_ntt_dit_lazy (spv_t x, spv_t w, spv_t wq,
+		  spv_size_t log2_len, spm_t spm, int last)
+{
+  spv_size_t len;
+
+  if (log2_len <= 3)
+    {
+      spv_ntt_dit_core (x, w, wq, log2_len, spm);
+      return;
+    }
+
+  len = 1 << (log2_len - 1);
+  spv_ntt_dit_lazy (x, w + len, wq + len, log2_len - 1, spm, 0);
+  spv_ntt_dit_lazy (x + len, w + len, wq + len, log2_len - 1, spm, 0);
+  bfly_dit_lazy (x, x + len, w, wq, len, spm->sp, last);
 }
+#endif
 
 void
 spv_ntt_gfp_dit (spv_t x, spv_size_t log2_len, spm_t data)
 {
   sp_t p = data->sp;
   sp_t d = data->mul_c;
+  spv_size_t k;
+  spv_t buf;
 
   if (log2_len <= NTT_GFP_TWIDDLE_DIT_BREAKOVER)
     {
       spv_t w = data->inttdata->twiddle + 
 	        data->inttdata->twiddle_size - (1 << log2_len);
-      spv_ntt_dit_core (x, w, log2_len, p, d);
+      spv_t wq = data->inttdata->twiddle_shoup + 
+	         data->inttdata->twiddle_size - (1 << log2_len);
+#ifdef NTT_LAZY
+      if (data->simd == SP_SIMD_NONE)
+        spv_ntt_dit_lazy (x, w, wq, log2_len, data, 1);
+      else
+#endif
+        spv_ntt_dit_core (x, w, wq, log2_len, data);
+    }
+  else if ((k = ntt_gfp_block_log2_rows (log2_len)) != 0 &&
+           (buf = (spv_t) sp_aligned_malloc (2 * NTT_BLOCK_ENTRIES
+                                             * sizeof (sp_t))) != NULL)
+    {
+      /* the rows, then the k outer stages */
+      spv_size_t i, log2_n2 = log2_len - k;
+
+      for (i = 0; i < ((spv_size_t) 1 << k); i++)
+        spv_ntt_gfp_dit (x + (i << log2_n2), log2_n2, data);
+      ntt_gfp_columns (x, log2_len, k, data->inttdata->ntt_roots, buf, 1,
+                       data);
+      sp_aligned_free (buf);
     }
   else
     {
@@ -668,10 +878,236 @@ spv_ntt_gfp_dit (spv_t x, spv_size_t log2_len, spm_t data)
 	  for (i = 0; i < len; i += block_size)
 	    {
 	      if (i)
-	        spv_mul_sp (w, w, root, block_size, p, d);
+	        spv_mul_sp_simd (w, w, root, block_size, data);
 
-	      bfly_dit (x0 + i, x1 + i, w, block_size, p, d);
+#ifdef SP_SIMD
+	      if (data->simd != SP_SIMD_NONE)
+	        spv_bfly_dit_simd (x0 + i, x1 + i, w, NULL, block_size, data);
+	      else
+#endif
+	        bfly_dit (x0 + i, x1 + i, w, block_size, p, d);
 	    }
 	}
     }
 }
+
+/*--------------------------- RADIX 3 ------------------------------------*/
+/* The transforms of length len = 3 * 2^k, for a prime initialised for a
+   multiple of len (mpzspm_init() with such a max_len), do a radix-3 stage
+   between x[q], x[q + m] and x[q + 2m], m = 2^k, and the radix-2
+   transforms of the three rows of m entries. The forward transform leaves
+   X[3 * bitrev (q) + r] at r * m + q, where bitrev reverses the k bits of
+   q, as the radix-2 code leaves X[bitrev (q)] at q; the inverse transform
+   takes this order and gives back len times the input, as spv_ntt_gfp_dit()
+   does. For len = 2^k, these are spv_ntt_gfp_dif() and spv_ntt_gfp_dit(). */
+
+/* the radix-3 stage of the forward (inverse = 0) or inverse transform of
+   length 3m with the root r of order 3m: a, b, c become a + b + c,
+   (a - c + u) * r^q, (a - b - u) * r^(2q) with u = r^m * (b - c) for the
+   forward transform, and a, b * r^q, c * r^(2q) go through the same
+   butterfly before the twiddles for the inverse one. The twiddles are
+   computed MAX_NTT_BLOCK_SIZE at a time. */
+static void
+ntt_gfp_radix3 (spv_t x, spv_size_t m, sp_t r, int inverse, spm_t data)
+{
+  sp_t p = data->sp;
+  sp_t d = data->mul_c;
+  spv_size_t B = MIN (m, MAX_NTT_BLOCK_SIZE);
+  spv_size_t i, j;
+  spv_t x0 = x, x1 = x + m, x2 = x + 2 * m;
+  sp_t w1[MAX_NTT_BLOCK_SIZE], w2[MAX_NTT_BLOCK_SIZE], t[MAX_NTT_BLOCK_SIZE];
+  sp_t r3 = sp_pow (r, m, p, d);
+  sp_t step1 = sp_pow (r, B, p, d), step2 = sp_sqr (step1, p, d);
+
+  w1[0] = w2[0] = 1;
+  for (j = 1; j < B; j++)
+    {
+      w1[j] = sp_mul (w1[j - 1], r, p, d);
+      w2[j] = sp_sqr (w1[j], p, d);
+    }
+
+  for (i = 0; i < m; i += B)
+    {
+      if (i != 0)
+        {
+          spv_mul_sp_simd (w1, w1, step1, B, data);
+          spv_mul_sp_simd (w2, w2, step2, B, data);
+        }
+
+      if (inverse)
+        {
+          spv_pwmul_simd (x1 + i, x1 + i, w1, B, data);
+          spv_pwmul_simd (x2 + i, x2 + i, w2, B, data);
+        }
+
+      for (j = 0; j < B; j++)
+        t[j] = sp_sub (x1[i + j], x2[i + j], p);
+      spv_mul_sp_simd (t, t, r3, B, data);
+
+      for (j = 0; j < B; j++)
+        {
+          sp_t a = x0[i + j], b = x1[i + j], c = x2[i + j];
+
+          x0[i + j] = sp_add (a, sp_add (b, c, p), p);
+          x1[i + j] = sp_add (sp_sub (a, c, p), t[j], p);
+          x2[i + j] = sp_sub (sp_sub (a, b, p), t[j], p);
+        }
+
+      if (!inverse)
+        {
+          spv_pwmul_simd (x1 + i, x1 + i, w1, B, data);
+          spv_pwmul_simd (x2 + i, x2 + i, w2, B, data);
+        }
+    }
+}
+
+void
+spv_ntt_gfp_dif_len (spv_t x, spv_size_t len, spm_t data)
+{
+  spv_size_t m, log2_m;
+
+  if ((len & (len - 1)) == 0)
+    {
+      spv_ntt_gfp_dif (x, ceil_log_2 (len), data);
+      return;
+    }
+
+  m = len / 3;
+  log2_m = ceil_log_2 (m);
+  ASSERT (len == 3 * m && m == (spv_size_t) 1 << log2_m);
+  ASSERT (data->nttdata->ntt_roots3 != NULL);
+
+  ntt_gfp_radix3 (x, m, data->nttdata->ntt_roots3[log2_m], 0, data);
+  spv_ntt_gfp_dif (x, log2_m, data);
+  spv_ntt_gfp_dif (x + m, log2_m, data);
+  spv_ntt_gfp_dif (x + 2 * m, log2_m, data);
+}
+
+void
+spv_ntt_gfp_dit_len (spv_t x, spv_size_t len, spm_t data)
+{
+  spv_size_t m, log2_m;
+
+  if ((len & (len - 1)) == 0)
+    {
+      spv_ntt_gfp_dit (x, ceil_log_2 (len), data);
+      return;
+    }
+
+  m = len / 3;
+  log2_m = ceil_log_2 (m);
+  ASSERT (len == 3 * m && m == (spv_size_t) 1 << log2_m);
+  ASSERT (data->inttdata->ntt_roots3 != NULL);
+
+  spv_ntt_gfp_dit (x, log2_m, data);
+  spv_ntt_gfp_dit (x + m, log2_m, data);
+  spv_ntt_gfp_dit (x + 2 * m, log2_m, data);
+  ntt_gfp_radix3 (x, m, data->inttdata->ntt_roots3[log2_m], 1, data);
+}
+
+/*--------------------------- COLUMN PASS --------------------------------*/
+/* one stage of the column pass on the buffer of n1 rows of B entries: the
+   butterflies between rows g + i and g + i + h, for g a multiple of 2h and
+   0 <= i < h, with the twiddle w[i * B + b] for column b */
+static void
+ntt_gfp_column_stage (spv_t buf, spv_t w, spv_size_t n1, spv_size_t h,
+                      spv_size_t B, int inverse, spm_t data)
+{
+  sp_t p = data->sp;
+  sp_t d = data->mul_c;
+  spv_size_t g;
+
+  for (g = 0; g < n1; g += 2 * h)
+    {
+      spv_t x0 = buf + g * B;
+      spv_t x1 = x0 + h * B;
+
+#ifdef SP_SIMD
+      if (data->simd != SP_SIMD_NONE)
+        {
+          if (inverse)
+            spv_bfly_dit_simd (x0, x1, w, NULL, h * B, data);
+          else
+            spv_bfly_dif_simd (x0, x1, w, NULL, h * B, data);
+        }
+      else
+#endif
+      if (inverse)
+        bfly_dit (x0, x1, w, h * B, p, d);
+      else
+        bfly_dif (x0, x1, w, h * B, p, d);
+    }
+}
+
+/* The k outer stages of the forward (inverse = 0) or inverse transform of
+   length 2^log2_len with the given roots, i.e., the stages of the radix-2
+   code before (after) the sub-transforms of length n2 = 2^(log2_len - k).
+   Entry j = i * n2 + c is in row i and column c: stage l, for l = 0 the
+   outermost one, combines rows g + i and g + i + h, h = n1 / 2^(l+1), with
+   the twiddle r_l^(i * n2 + c), r_l = roots[log2_len - l]. The twiddles
+   of stage l for the B columns in the buffer are kept in the h rows of W_l,
+   and multiplied by r_l^B for the next B columns. buf has room for
+   2 * NTT_BLOCK_ENTRIES entries. */
+static void
+ntt_gfp_columns (spv_t x, spv_size_t log2_len, spv_size_t k, spv_t roots,
+                 spv_t buf, int inverse, spm_t data)
+{
+  sp_t p = data->sp;
+  sp_t d = data->mul_c;
+  spv_size_t n1 = (spv_size_t) 1 << k;
+  spv_size_t n2 = (spv_size_t) 1 << (log2_len - k);
+  spv_size_t B = MIN ((spv_size_t) NTT_BLOCK_ENTRIES >> k, n2);
+  spv_size_t c, i, l, h;
+  spv_t W = buf + NTT_BLOCK_ENTRIES, w;
+  sp_t step[NTT_BLOCK_MAX_LOG2_ROWS];
+
+  ASSERT (k >= 1 && k <= NTT_BLOCK_MAX_LOG2_ROWS && k <= log2_len);
+
+  /* the twiddles for the columns 0 to B - 1 */
+  for (l = 0, w = W; l < k; l++)
+    {
+      sp_t r = roots[log2_len - l];
+      sp_t r_n2 = sp_pow (r, n2, p, d);
+
+      h = n1 >> (l + 1);
+      w[0] = 1;
+      for (c = 1; c < B; c++)
+        w[c] = sp_mul (w[c - 1], r, p, d);
+      for (i = 1; i < h; i++)
+        spv_mul_sp_simd (w + i * B, w + (i - 1) * B, r_n2, B, data);
+      step[l] = sp_pow (r, B, p, d);
+      w += h * B;
+    }
+
+  for (c = 0; c < n2; c += B)
+    {
+      if (c != 0)
+        for (l = 0, w = W; l < k; l++)
+          {
+            h = n1 >> (l + 1);
+            spv_mul_sp_simd (w, w, step[l], h * B, data);
+            w += h * B;
+          }
+
+      for (i = 0; i < n1; i++)
+        spv_set (buf + i * B, x + i * n2 + c, B);
+
+      if (inverse)
+        {
+          /* W_l is at W + (n1 - 2^(k-l)) * B */
+          for (l = k; l-- > 0; )
+            ntt_gfp_column_stage (buf, W + (n1 - (n1 >> l)) * B, n1,
+                                  n1 >> (l + 1), B, 1, data);
+        }
+      else
+        for (l = 0, w = W; l < k; l++)
+          {
+            h = n1 >> (l + 1);
+            ntt_gfp_column_stage (buf, w, n1, h, B, 0, data);
+            w += h * B;
+          }
+
+      for (i = 0; i < n1; i++)
+        spv_set (x + i * n2 + c, buf + i * B, B);
+    }
+}
@@ -0,0 +1,459 @@
+/* ntt_simd.c - AVX2 and AVX-512 kernels for the ntt over GF(p)
+
+Copyright 2026 the GMP-ECM authors.
+
+The SP Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The SP Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the SP Library; see the file COPYING.LIB.  If not, write to
+the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+MA 02110-1301, USA. */
+
+/* The butterflies of ntt_gfp.c and the pointwise products of mpzspv.c, on
+   4 (AVX2) or 8 (AVX-512) residues at once. The kernels are compiled with
+   target attributes, so that the rest of the library needs no -mavx2, and
+   spm_init() chooses them only if the cpu has the instructions.
+
+   The product by a twiddle w from the tables of spm_init() uses its Shoup
+   quotient w' = floor(w * 2^64 / p): with q = floor(x * w' / 2^64), x*w - q*p
+   is in [0, 2p), so that only the low 64 bits of x*w and of q*p are needed.
+   The other products (the twiddles computed on the fly above the breakover,
+   the pointwise products) are reduced with the preinverse mul_c as in
+   sp_udiv_rem(). Neither AVX2 nor AVX-512 has the high half of a 64x64 bit
+   product, which is made of 32x32 bit ones.
+
+   The intermediate values are in [0, 2p), but every output is reduced to
+   [0, p): the results are those of the scalar code, and the kernels can be
+   used for any part of a transform. */
+
+#include "sp.h"
+
+#ifdef SP_SIMD
+
+#include <immintrin.h>
+
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#define TARGET_AVX512 __attribute__ ((target ("avx512f,avx512dq")))
+
+/* the shifts of sp_udiv_rem() */
+#define SHL_Q1 (2 * (W_TYPE_SIZE - SP_NUMB_BITS))
+#define SHR_Q1 (2 * SP_NUMB_BITS - W_TYPE_SIZE)
+
+/*--------------------------------- AVX2 ---------------------------------*/
+
+#define LOAD_AVX2(x) _mm256_loadu_si256 ((const __m256i *) (x))
+#define STORE_AVX2(x, v) _mm256_storeu_si256 ((__m256i *) (x), v)
+
+/* high and low 64 bits of x*y */
+static inline TARGET_AVX2 void
+mul_avx2 (__m256i *hi, __m256i *lo, __m256i x, __m256i y)
+{
+  const __m256i m32 = _mm256_set1_epi64x (0xffffffff);
+  __m256i xh = _mm256_srli_epi64 (x, 32);
+  __m256i yh = _mm256_srli_epi64 (y, 32);
+  __m256i ll = _mm256_mul_epu32 (x, y);
+  __m256i lh = _mm256_mul_epu32 (x, yh);
+  __m256i hl = _mm256_mul_epu32 (xh, y);
+  __m256i hh = _mm256_mul_epu32 (xh, yh);
+  __m256i t;
+
+  /* bits 32 to 63, and the carries into the high half */
+  t = _mm256_add_epi64 (_mm256_srli_epi64 (ll, 32),
+                        _mm256_and_si256 (lh, m32));
+  t = _mm256_add_epi64 (t, _mm256_and_si256 (hl, m32));
+  *lo = _mm256_or_si256 (_mm256_slli_epi64 (t, 32),
+                         _mm256_and_si256 (ll, m32));
+  hh = _mm256_add_epi64 (hh, _mm256_srli_epi64 (lh, 32));
+  hh = _mm256_add_epi64 (hh, _mm256_srli_epi64 (hl, 32));
+  *hi = _mm256_add_epi64 (hh, _mm256_srli_epi64 (t, 32));
+}
+
+/* low 64 bits of x*y */
+static inline TARGET_AVX2 __m256i
+mullo_avx2 (__m256i x, __m256i y)
+{
+  __m256i m = _mm256_add_epi64 (
+                _mm256_mul_epu32 (x, _mm256_srli_epi64 (y, 32)),
+                _mm256_mul_epu32 (_mm256_srli_epi64 (x, 32), y));
+
+  return _mm256_add_epi64 (_mm256_mul_epu32 (x, y), _mm256_slli_epi64 (m, 32));
+}
+
+/* x mod p for 0 <= x < 2p, where 2p < 2^63 makes the signed compare work */
+static inline TARGET_AVX2 __m256i
+red_avx2 (__m256i x, __m256i p)
+{
+  return _mm256_sub_epi64 (x,
+                           _mm256_andnot_si256 (_mm256_cmpgt_epi64 (p, x), p));
+}
+
+/* x*w mod p for 0 <= x < 2^64, with wq = floor(w * 2^64 / p) */
+static inline TARGET_AVX2 __m256i
+mul_shoup_avx2 (__m256i x, __m256i w, __m256i wq, __m256i p)
+{
+  __m256i q, r;
+
+  mul_avx2 (&q, &r, x, wq);
+  r = _mm256_sub_epi64 (mullo_avx2 (x, w), mullo_avx2 (q, p));
+  return red_avx2 (r, p);
+}
+
+/* x*y mod p for 0 <= x, y < p, like sp_mul() */
+static inline TARGET_AVX2 __m256i
+mul_preinv_avx2 (__m256i x, __m256i y, __m256i p, __m256i d)
+{
+  __m256i h, l, q, t;
+
+  mul_avx2 (&h, &l, x, y);
+  q = _mm256_or_si256 (_mm256_slli_epi64 (h, SHL_Q1),
+                       _mm256_srli_epi64 (l, SHR_Q1));
+  mul_avx2 (&q, &t, q, d);
+  q = _mm256_srli_epi64 (q, 1);
+  return red_avx2 (_mm256_sub_epi64 (l, mullo_avx2 (q, p)), p);
+}
+
+/* The kernels return how many entries they did, the caller does the rest */
+
+static TARGET_AVX2 spv_size_t
+bfly_dif_avx2 (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+               spv_size_t len, sp_t sp, sp_t mul_c)
+{
+  const __m256i p = _mm256_set1_epi64x (sp);
+  const __m256i d = _mm256_set1_epi64x (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 4 <= len; i += 4)
+    {
+      __m256i a = LOAD_AVX2 (x0 + i);
+      __m256i b = LOAD_AVX2 (x1 + i);
+      __m256i t = _mm256_add_epi64 (_mm256_sub_epi64 (a, b), p);
+
+      STORE_AVX2 (x0 + i, red_avx2 (_mm256_add_epi64 (a, b), p));
+      if (wq != NULL)
+        t = mul_shoup_avx2 (t, LOAD_AVX2 (w + i), LOAD_AVX2 (wq + i), p);
+      else
+        t = mul_preinv_avx2 (red_avx2 (t, p), LOAD_AVX2 (w + i), p, d);
+      STORE_AVX2 (x1 + i, t);
+    }
+  return i;
+}
+
+static TARGET_AVX2 spv_size_t
+bfly_dit_avx2 (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+               spv_size_t len, sp_t sp, sp_t mul_c)
+{
+  const __m256i p = _mm256_set1_epi64x (sp);
+  const __m256i d = _mm256_set1_epi64x (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 4 <= len; i += 4)
+    {
+      __m256i a = LOAD_AVX2 (x0 + i);
+      __m256i t = LOAD_AVX2 (x1 + i);
+
+      if (wq != NULL)
+        t = mul_shoup_avx2 (t, LOAD_AVX2 (w + i), LOAD_AVX2 (wq + i), p);
+      else
+        t = mul_preinv_avx2 (t, LOAD_AVX2 (w + i), p, d);
+      STORE_AVX2 (x0 + i, red_avx2 (_mm256_add_epi64 (a, t), p));
+      STORE_AVX2 (x1 + i, red_avx2 (_mm256_add_epi64 (_mm256_sub_epi64 (a, t),
+                                                      p), p));
+    }
+  return i;
+}
+
+static TARGET_AVX2 spv_size_t
+pwmul_avx2 (spv_t r, const sp_t *x, const sp_t *y, spv_size_t len,
+            sp_t sp, sp_t mul_c)
+{
+  const __m256i p = _mm256_set1_epi64x (sp);
+  const __m256i d = _mm256_set1_epi64x (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 4 <= len; i += 4)
+    STORE_AVX2 (r + i, mul_preinv_avx2 (LOAD_AVX2 (x + i), LOAD_AVX2 (y + i),
+                                        p, d));
+  return i;
+}
+
+static TARGET_AVX2 spv_size_t
+mul_sp_avx2 (spv_t r, const sp_t *x, sp_t c, sp_t cq, spv_size_t len,
+             sp_t sp)
+{
+  const __m256i p = _mm256_set1_epi64x (sp);
+  const __m256i w = _mm256_set1_epi64x (c);
+  const __m256i wq = _mm256_set1_epi64x (cq);
+  spv_size_t i;
+
+  for (i = 0; i + 4 <= len; i += 4)
+    STORE_AVX2 (r + i, mul_shoup_avx2 (LOAD_AVX2 (x + i), w, wq, p));
+  return i;
+}
+
+/*-------------------------------- AVX-512 -------------------------------*/
+
+#define LOAD_AVX512(x) _mm512_loadu_si512 ((const void *) (x))
+#define STORE_AVX512(x, v) _mm512_storeu_si512 ((void *) (x), v)
+
+/* high and low 64 bits of x*y */
+static inline TARGET_AVX512 void
+mul_avx512 (__m512i *hi, __m512i *lo, __m512i x, __m512i y)
+{
+  const __m512i m32 = _mm512_set1_epi64 (0xffffffff);
+  __m512i xh = _mm512_srli_epi64 (x, 32);
+  __m512i yh = _mm512_srli_epi64 (y, 32);
+  __m512i ll = _mm512_mul_epu32 (x, y);
+  __m512i lh = _mm512_mul_epu32 (x, yh);
+  __m512i hl = _mm512_mul_epu32 (xh, y);
+  __m512i hh = _mm512_mul_epu32 (xh, yh);
+  __m512i t;
+
+  /* bits 32 to 63, and the carries into the high half */
+  t = _mm512_add_epi64 (_mm512_srli_epi64 (ll, 32),
+                        _mm512_and_si512 (lh, m32));
+  t = _mm512_add_epi64 (t, _mm512_and_si512 (hl, m32));
+  *lo = _mm512_or_si512 (_mm512_slli_epi64 (t, 32),
+                         _mm512_and_si512 (ll, m32));
+  hh = _mm512_add_epi64 (hh, _mm512_srli_epi64 (lh, 32));
+  hh = _mm512_add_epi64 (hh, _mm512_srli_epi64 (hl, 32));
+  *hi = _mm512_add_epi64 (hh, _mm512_srli_epi64 (t, 32));
+}
+
+/* x mod p for 0 <= x < 2p */
+static inline TARGET_AVX512 __m512i
+red_avx512 (__m512i x, __m512i p)
+{
+  return _mm512_min_epu64 (x, _mm512_sub_epi64 (x, p));
+}
+
+/* x*w mod p for 0 <= x < 2^64, with wq = floor(w * 2^64 / p) */
+static inline TARGET_AVX512 __m512i
+mul_shoup_avx512 (__m512i x, __m512i w, __m512i wq, __m512i p)
+{
+  __m512i q, r;
+
+  mul_avx512 (&q, &r, x, wq);
+  r = _mm512_sub_epi64 (_mm512_mullo_epi64 (x, w), _mm512_mullo_epi64 (q, p));
+  return red_avx512 (r, p);
+}
+
+/* x*y mod p for 0 <= x, y < p, like sp_mul() */
+static inline TARGET_AVX512 __m512i
+mul_preinv_avx512 (__m512i x, __m512i y, __m512i p, __m512i d)
+{
+  __m512i h, l, q, t;
+
+  mul_avx512 (&h, &l, x, y);
+  q = _mm512_or_si512 (_mm512_slli_epi64 (h, SHL_Q1),
+                       _mm512_srli_epi64 (l, SHR_Q1));
+  mul_avx512 (&q, &t, q, d);
+  q = _mm512_srli_epi64 (q, 1);
+  return red_avx512 (_mm512_sub_epi64 (l, _mm512_mullo_epi64 (q, p)), p);
+}
+
+static TARGET_AVX512 spv_size_t
+bfly_dif_avx512 (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+                 spv_size_t len, sp_t sp, sp_t mul_c)
+{
+  const __m512i p = _mm512_set1_epi64 (sp);
+  const __m512i d = _mm512_set1_epi64 (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      __m512i a = LOAD_AVX512 (x0 + i);
+      __m512i b = LOAD_AVX512 (x1 + i);
+      __m512i t = _mm512_add_epi64 (_mm512_sub_epi64 (a, b), p);
+
+      STORE_AVX512 (x0 + i, red_avx512 (_mm512_add_epi64 (a, b), p));
+      if (wq != NULL)
+        t = mul_shoup_avx512 (t, LOAD_AVX512 (w + i), LOAD_AVX512 (wq + i),
+                              p);
+      else
+        t = mul_preinv_avx512 (red_avx512 (t, p), LOAD_AVX512 (w + i), p, d);
+      STORE_AVX512 (x1 + i, t);
+    }
+  return i;
+}
+
+static TARGET_AVX512 spv_size_t
+bfly_dit_avx512 (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+                 spv_size_t len, sp_t sp, sp_t mul_c)
+{
+  const __m512i p = _mm512_set1_epi64 (sp);
+  const __m512i d = _mm512_set1_epi64 (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      __m512i a = LOAD_AVX512 (x0 + i);
+      __m512i t = LOAD_AVX512 (x1 + i);
+
+      if (wq != NULL)
+        t = mul_shoup_avx512 (t, LOAD_AVX512 (w + i), LOAD_AVX512 (wq + i),
+                              p);
+      else
+        t = mul_preinv_avx512 (t, LOAD_AVX512 (w + i), p, d);
+      STORE_AVX512 (x0 + i, red_avx512 (_mm512_add_epi64 (a, t), p));
+      STORE_AVX512 (x1 + i, red_avx512 (_mm512_add_epi64 (
+                                          _mm512_sub_epi64 (a, t), p), p));
+    }
+  return i;
+}
+
+static TARGET_AVX512 spv_size_t
+pwmul_avx512 (spv_t r, const sp_t *x, const sp_t *y, spv_size_t len,
+              sp_t sp, sp_t mul_c)
+{
+  const __m512i p = _mm512_set1_epi64 (sp);
+  const __m512i d = _mm512_set1_epi64 (mul_c);
+  spv_size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    STORE_AVX512 (r + i, mul_preinv_avx512 (LOAD_AVX512 (x + i),
+                                            LOAD_AVX512 (y + i), p, d));
+  return i;
+}
+
+static TARGET_AVX512 spv_size_t
+mul_sp_avx512 (spv_t r, const sp_t *x, sp_t c, sp_t cq, spv_size_t len,
+               sp_t sp)
+{
+  const __m512i p = _mm512_set1_epi64 (sp);
+  const __m512i w = _mm512_set1_epi64 (c);
+  const __m512i wq = _mm512_set1_epi64 (cq);
+  spv_size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    STORE_AVX512 (r + i, mul_shoup_avx512 (LOAD_AVX512 (x + i), w, wq, p));
+  return i;
+}
+
+/*------------------------------ DISPATCH --------------------------------*/
+
+/* The dif butterflies x0 + x1, (x0 - x1) * w of ntt_gfp.c, for len entries.
+   If wq is not NULL, it holds the Shoup quotients of the twiddles w. */
+void
+spv_bfly_dif_simd (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+                   spv_size_t len, spm_t spm)
+{
+  sp_t p = spm->sp;
+  sp_t d = spm->mul_c;
+  spv_size_t i;
+
+  switch (spm->simd)
+    {
+    case SP_SIMD_AVX512:
+      i = bfly_dif_avx512 (x0, x1, w, wq, len, p, d);
+      break;
+    case SP_SIMD_AVX2:
+      i = bfly_dif_avx2 (x0, x1, w, wq, len, p, d);
+      break;
+    default:
+      i = 0;
+    }
+
+  for (; i < len; i++)
+    {
+      sp_t t0 = x0[i];
+      sp_t t1 = x1[i];
+      x0[i] = sp_add (t0, t1, p);
+      x1[i] = sp_mul (sp_sub (t0, t1, p), w[i], p, d);
+    }
+}
+
+/* The dit butterflies x0 + x1 * w, x0 - x1 * w of ntt_gfp.c */
+void
+spv_bfly_dit_simd (spv_t x0, spv_t x1, const sp_t *w, const sp_t *wq,
+                   spv_size_t len, spm_t spm)
+{
+  sp_t p = spm->sp;
+  sp_t d = spm->mul_c;
+  spv_size_t i;
+
+  switch (spm->simd)
+    {
+    case SP_SIMD_AVX512:
+      i = bfly_dit_avx512 (x0, x1, w, wq, len, p, d);
+      break;
+    case SP_SIMD_AVX2:
+      i = bfly_dit_avx2 (x0, x1, w, wq, len, p, d);
+      break;
+    default:
+      i = 0;
+    }
+
+  for (; i < len; i++)
+    {
+      sp_t t0 = x0[i];
+      sp_t t1 = sp_mul (x1[i], w[i], p, d);
+      x0[i] = sp_add (t0, t1, p);
+      x1[i] = sp_sub (t0, t1, p);
+    }
+}
+
+#endif /* SP_SIMD */
+
+/* The best kernels this cpu can run, SP_SIMD_NONE if there are none */
+int
+sp_simd_level (void)
+{
+#ifdef SP_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512dq"))
+    return SP_SIMD_AVX512;
+  if (__builtin_cpu_supports ("avx2"))
+    return SP_SIMD_AVX2;
+#endif
+  return SP_SIMD_NONE;
+}
+
+/* spv_pwmul() with the kernels of spm */
+void
+spv_pwmul_simd (spv_t r, spv_t x, spv_t y, spv_size_t len, spm_t spm)
+{
+  spv_size_t i = 0;
+
+  ASSERT (r >= x + len || x >= r);
+  ASSERT (r >= y + len || y >= r);
+
+#ifdef SP_SIMD
+  if (spm->simd == SP_SIMD_AVX512)
+    i = pwmul_avx512 (r, x, y, len, spm->sp, spm->mul_c);
+  else if (spm->simd == SP_SIMD_AVX2)
+    i = pwmul_avx2 (r, x, y, len, spm->sp, spm->mul_c);
+#endif
+
+  spv_pwmul (r + i, x + i, y + i, len - i, spm->sp, spm->mul_c);
+}
+
+/* spv_mul_sp() with the kernels of spm */
+void
+spv_mul_sp_simd (spv_t r, spv_t x, sp_t c, spv_size_t len, spm_t spm)
+{
+  spv_size_t i = 0;
+
+  ASSERT (r >= x + len || x >= r);
+
+#ifdef SP_SIMD
+  if (spm->simd != SP_SIMD_NONE && len >= 8)
+    {
+      sp_t cq = sp_shoup_quotient (c, spm->sp);
+
+      if (spm->simd == SP_SIMD_AVX512)
+        i = mul_sp_avx512 (r, x, c, cq, len, spm->sp);
+      else
+        i = mul_sp_avx2 (r, x, c, cq, len, spm->sp);
+    }
+#endif
+
+  spv_mul_sp (r + i, x + i, c, len - i, spm->sp, spm->mul_c);
+}
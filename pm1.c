@@ -357,6 +357,9 @@ print_prob (double B1, const mpz_t B2, unsigned long dF, unsigned long k,
 	    already been computed
           k is the number of blocks for stage 2
           verbose is the verbosity level
+          fs2_done, fs2_param and fs2_m_1 are the state of the stage 2 read
+            from a checkpoint (see fs2_resume), fs2_done is 0 if none
+          stage2_threads is the number of threads for the NTT of stage 2
    Output: f is the factor found, p is the residue at end of stage 1
    Return value: non-zero iff a factor is found (1 for stage 1, 2 for stage 2)
 */
@@ -365,7 +368,9 @@ pm1 (mpz_t f, mpz_t p, mpz_t N, mpz_t go, double *B1done, double B1,
      mpz_t B2min_parm, mpz_t B2_parm, unsigned long k, 
      int verbose, int repr, int use_ntt, FILE *os, FILE *es, 
      char *chkfilename, char *TreeFilename, double maxmem, 
-     gmp_randstate_t rng, int (*stop_asap)(void))
+     gmp_randstate_t rng, int (*stop_asap)(void), unsigned long fs2_done,
+     const unsigned long *fs2_param, mpz_t fs2_m_1,
+     unsigned int stage2_threads)
 {
   int youpi = ECM_NO_FACTOR_FOUND;
   long st;
@@ -420,6 +425,10 @@ pm1 (mpz_t f, mpz_t p, mpz_t N, mpz_t go, double *B1done, double B1,
 
       mpz_init (params.m_1);
       params.l = 0;
+      params.done = 0;
+      params.chkfilename = chkfilename;
+      params.stop_asap = stop_asap;
+      params.threads = stage2_threads;
       mpz_init (params_ntt.m_1);
       params_ntt.l = 0;
       mpz_init (params_nontt.m_1);
@@ -567,6 +576,9 @@ pm1 (mpz_t f, mpz_t p, mpz_t N, mpz_t go, double *B1done, double B1,
 
   if (B1 > *B1done || mpz_cmp_ui (go, 1) > 0)
     youpi = pm1_stage1 (f, x, modulus, B1, B1done, go, stop_asap, chkfilename);
+  else if (mpz_cmp (B2, B2min) >= 0) /* x is the residue of the checkpoint */
+    fs2_resume (&params, fs2_done, fs2_param, fs2_m_1);
+  params.B1done = *B1done;
 
   st = elltime (st, cputime ());
 
@@ -583,7 +595,8 @@ pm1 (mpz_t f, mpz_t p, mpz_t N, mpz_t go, double *B1done, double B1,
   if (stop_asap != NULL && (*stop_asap) ())
     goto clear_and_exit;
 
-  if (youpi == ECM_NO_FACTOR_FOUND && mpz_cmp (B2, B2min) >= 0)
+  if (youpi == ECM_NO_FACTOR_FOUND && mpz_cmp (B2, B2min) >= 0 &&
+      params.done < params.s_2)
     {
       if (use_ntt)
         youpi = pm1fs2_ntt (f, x, modulus, &params);
@@ -591,12 +604,6 @@ pm1 (mpz_t f, mpz_t p, mpz_t N, mpz_t go, double *B1done, double B1,
         youpi = pm1fs2 (f, x, modulus, &params);
     }
 
-  if (test_verbose (OUTPUT_VERBOSE))
-    {
-      if (mpz_sgn (B2min_parm) < 0)
-        rhoinit (1, 0); /* Free memory of rhotable */
-    }
-
 clear_and_exit:
   mpres_get_z (p, x, modulus);
   mpres_clear (x, modulus);
@@ -205,6 +205,22 @@ print_CRT_primes (const int verbosity, const char *prefix,
     }
 }
 
+/* Share the small primes of ntt_context among params->threads threads,
+   or among as many as OpenMP would use if params->threads is 1 */
+static void
+set_ntt_threads (mpzspm_t ntt_context, const faststage2_param_t *params)
+{
+  unsigned int nthreads = params->threads;
+
+#ifdef _OPENMP
+  if (nthreads <= 1)
+    nthreads = omp_get_max_threads ();
+#endif
+  nthreads = mpzspm_set_threads (ntt_context, nthreads);
+  outputf (OUTPUT_DEVVERBOSE, "NTT over the small primes uses %u thread%s\n",
+           nthreads, (nthreads > 1) ? "s" : "");
+}
+
 /* Approximate amount of memory in bytes each coefficient in an NTT takes 
    so that NTT can do transforms up to length lmax with modulus, or
    with 2*modulus if twice != 0 */
@@ -281,7 +297,7 @@ pm1fs2_maxlen (const size_t memory, const mpz_t modulus, const int use_ntt)
       size_t n, lmax = 1;
   
       n = ntt_coeff_mem (lmax, modulus, 0);
-      lmax = 1UL << ceil_log2 (memory / n / 3);
+      lmax = ntt_floor_len (memory / n / 3);
       return lmax;
     }
   else
@@ -356,7 +372,7 @@ pp1fs2_maxlen (const size_t memory, const mpz_t modulus, const int use_ntt,
 	n = memory / (2 * n + m / 2);
       else
 	n = memory / (3 * n);
-      return 1UL << (ceil_log2 (n / 2)); /* Rounded down to power of 2 */
+      return ntt_floor_len (n); /* Rounded down to 2^k or 3*2^k */
     }
   else
     {
@@ -602,13 +618,13 @@ choose_P (const mpz_t B2min, const mpz_t B2, const unsigned long lmax,
   if (mpz_cmp (B2, B2min) < 0)
     return 0L;
 
-  /* If we use the NTT, we allow only power-of-two transform lengths.
-     In that case, the code below assumes that lmax is a power of two.
+  /* If we use the NTT, we allow only transform lengths 2^k and 3*2^k.
+     In that case, the code below assumes that lmax is one of them.
      If that is not the case, print error and return. */
-  if (use_ntt && (lmax & (lmax - 1UL)) != 0)
+  if (use_ntt && ntt_floor_len (lmax) != lmax)
     {
       outputf (OUTPUT_ERROR, 
-               "choose_P: Error, lmax = %lu is not a power of two\n", lmax);
+               "choose_P: Error, lmax = %lu is not 2^k or 3*2^k\n", lmax);
       return ECM_ERROR;
     }
   
@@ -662,12 +678,13 @@ choose_P (const mpz_t B2min, const mpz_t B2, const unsigned long lmax,
       /* Try all possible transform lengths and store parameters in 
 	 P, s_1, s_2, l if they are better than the previously best ones */
        
-      /* Keep reducing tryl to find best parameters. For NTT, we only have 
-	 power of 2 lengths so far, so we can simply divide by 2. 
+      /* Keep reducing tryl to find best parameters. For NTT, we have 
+	 lengths 2^k and 3*2^k, so we go to the next smaller one: from 2^k
+	 to 3*2^(k-2), from 3*2^k to 2^(k+1). 
 	 For non-NTT, we have arbitrary transform lengths so we can decrease 
 	 in smaller steps... let's say by, umm, 25% each time? */
       for (tryl = lmax; mpz_cmp_ui (lmin, tryl) <= 0;
-	   tryl = (use_ntt) ? tryl / 2 : 3 * tryl / 4)
+	   tryl = (use_ntt) ? ntt_floor_len (tryl - 1) : 3 * tryl / 4)
 	{
 	  trys_1 = choose_s_1 (tryphiP, min_s2, tryl / 2, use_ntt);
 	  if (trys_1 == 0)
@@ -747,6 +764,33 @@ choose_P (const mpz_t B2min, const mpz_t B2, const unsigned long lmax,
 }
 
 
+/* Continue the stage 2 with parameters params from a checkpoint written
+   after done of its multi-point evaluations, with P, s_1, s_2 and l in
+   chk[0..3] and m_1. If these are not the parameters chosen now, the
+   stage 2 starts from the beginning. */
+void
+fs2_resume (faststage2_param_t *params, const unsigned long done,
+            const unsigned long *chk, mpz_t m_1)
+{
+  params->done = 0;
+  if (done == 0)
+    return;
+
+  if (chk[0] != params->P || chk[1] != params->s_1 ||
+      chk[2] != params->s_2 || chk[3] != params->l ||
+      mpz_cmp (m_1, params->m_1) != 0 || done > params->s_2)
+    {
+      outputf (OUTPUT_ERROR, "Warning: the checkpoint is for other stage 2 "
+               "parameters, starting stage 2 from the beginning\n");
+      return;
+    }
+
+  params->done = done;
+  outputf (OUTPUT_NORMAL, "Resuming stage 2 after multi-point evaluation "
+           "%lu of %lu\n", done, params->s_2);
+}
+
+
 
 static void
 list_output_poly (listz_t l, unsigned long len, int monic, int symmetric,
@@ -859,7 +903,7 @@ list_sqr_reciprocal (listz_t R, listz_t S, const unsigned long l,
     }
   mpz_tdiv_q_2exp (S[0], S[0], 1UL);
   
-  list_mul (r1, S, l, S, l, 0, t);
+  list_mul (r1, S, l, S, l, 0, t, 0);
   /* r1 = f0*g0/4 + (f0*g1 + f1*g0)/2 * x + f1*g1 * x^2 */
 #if 0
   for (i = 0; i < 2UL * l - 1UL; i++)
@@ -870,7 +914,7 @@ list_sqr_reciprocal (listz_t R, listz_t S, const unsigned long l,
   ASSERT_ALWAYS (Srev != NULL);
   for (i = 0UL; i < l; i++)
       (*Srev)[i] = (*S)[l - 1UL - i];
-  list_mul (r2, S, l, Srev, l, 0, t);
+  list_mul (r2, S, l, Srev, l, 0, t, 0);
   /* r2 is symmetric, r2[i] = r2[2*l - 2 - i]. Check this */
 #if 0
   for (i = 0; 0 && i < 2UL * l - 1UL; i++)
@@ -1023,7 +1067,7 @@ list_mul_reciprocal (listz_t R, listz_t S1, unsigned long l1,
   
   for (i = 0UL; i < l2; i++)
     mpz_set (rev[i], S2[l2 - 1UL - i]);
-  list_mul (r1, S1, lmax, rev, lmax, 0, t);
+  list_mul (r1, S1, lmax, rev, lmax, 0, t, 0);
   /* r1 = \tilde{f}(x) \rev(\tilde{g}(x)) and has degree l1 + l2 - 2,
      i.e. l1 + l2 - 1 entries. */
 #if 0
@@ -1033,7 +1077,7 @@ list_mul_reciprocal (listz_t R, listz_t S1, unsigned long l1,
   
   for (i = 0UL; i < l2; i++)
     mpz_set(rev[i], S2[i]);
-  list_mul (r2, S1, lmax, rev, lmax, 0, t);
+  list_mul (r2, S1, lmax, rev, lmax, 0, t, 0);
   /* \tilde{f}(x) \tilde{g}(x) */
   
 #if 0
@@ -1945,6 +1989,7 @@ build_F_ntt (listz_t F, const mpres_t P_1, sets_long_t *S_1,
   
   print_CRT_primes (OUTPUT_DEVVERBOSE, "CRT modulus for building F = ",
 		    F_ntt_context);
+  set_ntt_threads (F_ntt_context, params);
   
   outputf (OUTPUT_VERBOSE, "Computing F from factored S_1");
   
@@ -2625,6 +2670,29 @@ ntt_gcd (mpz_t f, mpz_t *product, mpzspv_t ntt, const unsigned long ntt_offset,
 }
 
 
+/* Called when the multi-point evaluation l found no factor. Each one takes
+   its own gcd, so that the stage 2 can be resumed from the next one with X
+   alone. Write a checkpoint if -chkpnt was given and CHKPNT_PERIOD has
+   elapsed since the last one, or if this was the last evaluation, or if we
+   have to stop. Return non-zero if the stage 2 must stop now. */
+static int
+fs2_checkpoint (const faststage2_param_t *params, const int method,
+                const unsigned long l, mpmod_t modulus, const mpres_t X,
+                long *last_chkpnt)
+{
+  const int stop = params->stop_asap != NULL && (*params->stop_asap) ();
+
+  if (params->chkfilename != NULL && (stop || l + 1 == params->s_2 ||
+      elltime (*last_chkpnt, cputime ()) > CHKPNT_PERIOD))
+    {
+      writechkfile_fs2 (params, method, l + 1, modulus, X);
+      *last_chkpnt = cputime ();
+    }
+
+  return stop;
+}
+
+
 int 
 pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus, 
 	const faststage2_param_t *params)
@@ -2644,7 +2712,7 @@ pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
   mpz_t mt;   /* All-purpose temp mpz_t */
   mpres_t mr; /* All-purpose temp mpres_t */
   int youpi = ECM_NO_FACTOR_FOUND;
-  long timetotalstart, realtotalstart, timestart;
+  long timetotalstart, realtotalstart, timestart, last_chkpnt;
 
   timetotalstart = cputime ();
   realtotalstart = realtime ();
@@ -2677,9 +2745,9 @@ pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
   R = init_list2 (lenR, (unsigned int) abs (modulus->bits));    
   tmplen = 3UL * params->l + list_mul_mem (params->l / 2);
   outputf (OUTPUT_DEVVERBOSE, "tmplen = %lu\n", tmplen);
-  if (TMulGen_space (params->l - 1, params->s_1, lenR) + 12 > tmplen)
+  if (TMulGen_space (params->l - 1, params->s_1, lenR, 0) + 12 > tmplen)
     {
-      tmplen = TMulGen_space (params->l - 1, params->s_1 - 1, lenR) + 12;
+      tmplen = TMulGen_space (params->l - 1, params->s_1 - 1, lenR, 0) + 12;
       /* FIXME: It appears TMulGen_space() returns a too small value! */
       outputf (OUTPUT_DEVVERBOSE, "With TMulGen_space, tmplen = %lu\n", 
 	       tmplen);
@@ -2743,7 +2811,8 @@ pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
       outputf (OUTPUT_VERBOSE, " /* PARI */\n");
     }
 
-  for (l = 0; l < params->s_2; l++)
+  last_chkpnt = cputime ();
+  for (l = params->done; l < params->s_2; l++)
     {
       const unsigned long M = params->l - 1L - params->s_1 / 2L;
       outputf (OUTPUT_VERBOSE, "Multi-point evaluation %lu of %lu:\n", 
@@ -2758,12 +2827,12 @@ pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
 
       outputf (OUTPUT_VERBOSE, "TMulGen of g and h");
       timestart = cputime ();
-      ASSERT(tmplen >= TMulGen_space (nr - 1, params->l - 1, params->s_1));
+      ASSERT(tmplen >= TMulGen_space (nr - 1, params->l - 1, params->s_1, 0));
 
       /* Computes rev(h)*g, stores coefficients of x^(s_1) to 
 	 x^(s_1+nr-1) = x^(len-1) */
       if (TMulGen (R, nr - 1, h, params->s_1, g, params->l - 1, tmp, 
-		   modulus->orig_modulus) < 0)
+		   modulus->orig_modulus, 0) < 0)
 	{
 	  outputf (OUTPUT_ERROR, "TMulGen returned error code (probably out "
 		   "of memory)\n");
@@ -2845,6 +2914,9 @@ pm1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
 	  youpi = ECM_FACTOR_FOUND_STEP2;
 	  break;
 	}
+
+      if (fs2_checkpoint (params, ECM_PM1, l, modulus, X, &last_chkpnt))
+        break;
     }
 
 #ifdef SHOW_TMP_USAGE
@@ -2898,7 +2970,7 @@ pm1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
   mpz_t *product_ptr = NULL;
   mpres_t tmpres; /* All-purpose temp mpres_t */
   int youpi = ECM_NO_FACTOR_FOUND;
-  long timetotalstart, realtotalstart, timestart, realstart;
+  long timetotalstart, realtotalstart, timestart, realstart, last_chkpnt;
 
   timetotalstart = cputime ();
   realtotalstart = realtime ();
@@ -2922,6 +2994,7 @@ pm1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
 
   print_CRT_primes (OUTPUT_DEVVERBOSE, "CRT modulus for evaluation = ", 
 		    ntt_context);
+  set_ntt_threads (ntt_context, params);
 
   if (make_S_1_S_2 (&S_1, &S_2, params) == ECM_ERROR)
       return ECM_ERROR;
@@ -3019,7 +3092,8 @@ pm1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
       product_ptr = &product;
     }
 
-  for (l = 0; l < params->s_2; l++)
+  last_chkpnt = cputime ();
+  for (l = params->done; l < params->s_2; l++)
     {
       const unsigned long M = params->l - 1L - params->s_1 / 2L;
 
@@ -3053,6 +3127,9 @@ pm1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
 	  youpi = ECM_FACTOR_FOUND_STEP2;
 	  break;
 	}
+
+      if (fs2_checkpoint (params, ECM_PM1, l, modulus, X, &last_chkpnt))
+        break;
     }
 
   if (test_verbose (OUTPUT_RESVERBOSE))
@@ -4027,7 +4104,7 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
   mpres_t b1_x, b1_y, Delta, tmpres[2];
   mpz_t mt;   /* All-purpose temp mpz_t */
   int youpi = ECM_NO_FACTOR_FOUND;
-  long timetotalstart, realtotalstart, timestart;
+  long timetotalstart, realtotalstart, timestart, last_chkpnt;
 
   timetotalstart = cputime ();
   realtotalstart = realtime ();
@@ -4069,9 +4146,9 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
   R_y = init_list2 (lenR, (unsigned int) abs (modulus->bits));
   tmplen = 3UL * params->l + list_mul_mem (params->l / 2) + 20;
   outputf (OUTPUT_DEVVERBOSE, "tmplen = %lu\n", tmplen);
-  if (TMulGen_space (params->l - 1, params->s_1, lenR) + 12 > tmplen)
+  if (TMulGen_space (params->l - 1, params->s_1, lenR, 0) + 12 > tmplen)
     {
-      tmplen = TMulGen_space (params->l - 1, params->s_1 - 1, lenR) + 12;
+      tmplen = TMulGen_space (params->l - 1, params->s_1 - 1, lenR, 0) + 12;
       /* FIXME: It appears TMulGen_space() returns a too small value! */
       outputf (OUTPUT_DEVVERBOSE, "With TMulGen_space, tmplen = %lu\n", 
 	       tmplen);
@@ -4148,7 +4225,8 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
 		 i, h_x[i], h_y[i]);
     }
   
-  for (l = 0; l < params->s_2; l++)
+  last_chkpnt = cputime ();
+  for (l = params->done; l < params->s_2; l++)
     {
       const long M = params->l - 1 - params->s_1 / 2;
       outputf (OUTPUT_VERBOSE, "Multi-point evaluation %lu of %lu:\n", 
@@ -4161,7 +4239,7 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
       outputf (OUTPUT_VERBOSE, "TMulGen of g_x and h_x");
       timestart = cputime ();
       if (TMulGen (R_x, nr - 1, h_x, params->s_1, g_x, params->l - 1, tmp,
-		   modulus->orig_modulus) < 0)
+		   modulus->orig_modulus, 0) < 0)
 	{
 	  outputf (OUTPUT_ERROR, "TMulGen returned error code (probably out "
 		   "of memory)\n");
@@ -4172,7 +4250,7 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
       outputf (OUTPUT_VERBOSE, "TMulGen of g_y and h_y");
       timestart = cputime ();
       if (TMulGen (R_y, nr - 1, h_y, params->s_1, g_y, params->l - 1, tmp,
-		   modulus->orig_modulus) < 0)
+		   modulus->orig_modulus, 0) < 0)
 	{
 	  outputf (OUTPUT_ERROR, "TMulGen returned error code (probably out "
 		   "of memory)\n");
@@ -4211,6 +4289,9 @@ pp1fs2 (mpz_t f, const mpres_t X, mpmod_t modulus,
 	  youpi = ECM_FACTOR_FOUND_STEP2;
 	  break;
 	}
+
+      if (fs2_checkpoint (params, ECM_PP1, l, modulus, X, &last_chkpnt))
+        break;
     }
 
   mpz_clear (mt);
@@ -4268,7 +4349,7 @@ pp1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
   mpz_t product;
   mpz_t *product_ptr = NULL;
   int youpi = ECM_NO_FACTOR_FOUND;
-  long timetotalstart, realtotalstart, timestart, realstart;
+  long timetotalstart, realtotalstart, timestart, realstart, last_chkpnt;
 
   timetotalstart = cputime ();
   realtotalstart = realtime ();
@@ -4307,6 +4388,7 @@ pp1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
 
   print_CRT_primes (OUTPUT_DEVVERBOSE, "CRT modulus for evaluation = ", 
 		    ntt_context);
+  set_ntt_threads (ntt_context, params);
 
   /* Allocate memory for F with correct amount of space for each mpz_t */
   lenF = params->s_1 / 2 + 1 + 1; /* Another +1 because poly_from_sets_V stores
@@ -4404,7 +4486,8 @@ pp1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
       product_ptr = &product;
     }
 
-  for (l = 0; l < params->s_2; l++)
+  last_chkpnt = cputime ();
+  for (l = params->done; l < params->s_2; l++)
     {
       const long M = params->l - 1 - params->s_1 / 2;
 
@@ -4503,6 +4586,9 @@ pp1fs2_ntt (mpz_t f, const mpres_t X, mpmod_t modulus,
 	  youpi = ECM_FACTOR_FOUND_STEP2;
 	  break;
 	}
+
+      if (fs2_checkpoint (params, ECM_PP1, l, modulus, X, &last_chkpnt))
+        break;
     }
 
   if (test_verbose (OUTPUT_RESVERBOSE))
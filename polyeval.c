@@ -21,13 +21,8 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
 
 #include <stdlib.h>
-#include <string.h> /* for strlen */
 #include "ecm-impl.h"
 
-#ifdef HAVE_UNISTD_H
-# include <unistd.h> /* for unlink */
-#endif
-
 
 #ifndef MAX
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
@@ -35,7 +30,6 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 /* #define DEBUG_TREEDATA */
 
-extern unsigned int Fermat;
 
 #if defined(DEBUG) || defined(DEBUG_TREEDATA)
 void
@@ -63,7 +57,7 @@ print_vect (listz_t t, unsigned int l)
 
 void
 TUpTree (listz_t b, listz_t *Tree, unsigned int k, listz_t tmp, int dolvl,
-         unsigned int sh, mpz_t n, FILE *TreeFile)
+         unsigned int sh, mpz_t n, unsigned int Fermat)
 {
     unsigned int m, l;
 
@@ -85,32 +79,16 @@ TUpTree (listz_t b, listz_t *Tree, unsigned int k, listz_t tmp, int dolvl,
 
     if (dolvl == 0 || dolvl == -1)
       {
-        if (TreeFile != NULL)
-          {
-            list_inp_raw (tmp + k, TreeFile, l);
-#ifdef DEBUG_TREEDATA
-            printf ("Read from file: ");
-            print_vect (tmp + k, l);
-#endif
-            TMulGen (tmp + l, m - 1, tmp + k, l - 1, b, k - 1, tmp + k + l, n);
-            list_inp_raw (tmp + k, TreeFile, m);
-#ifdef DEBUG_TREEDATA
-            print_vect (tmp + k, m);
-            printf ("\n");
-#endif
-            TMulGen (tmp, l - 1, tmp + k, m - 1, b, k - 1, tmp + k + m, n);
-          }
-        else
-          {
 #ifdef DEBUG_TREEDATA
-            printf ("Got from Tree: ");
-            print_vect (Tree[0] + sh, l);
-            print_vect (Tree[0] + sh + l, m);
-            printf ("\n");
+        printf ("Got from Tree: ");
+        print_vect (Tree[0] + sh, l);
+        print_vect (Tree[0] + sh + l, m);
+        printf ("\n");
 #endif
-            TMulGen (tmp + l, m - 1, Tree[0] + sh, l - 1, b, k - 1, tmp + k, n);
-            TMulGen (tmp, l - 1, Tree[0] + sh + l, m - 1, b, k - 1, tmp + k, n);
-          }
+        TMulGen (tmp + l, m - 1, Tree[0] + sh, l - 1, b, k - 1, tmp + k, n,
+                 Fermat);
+        TMulGen (tmp, l - 1, Tree[0] + sh + l, m - 1, b, k - 1, tmp + k, n,
+                 Fermat);
 
 #if defined(DEBUG) || defined (DEBUG_TREEDATA)
         fprintf (ECM_STDOUT, "And the result at that level (before correction) is:");
@@ -138,13 +116,13 @@ TUpTree (listz_t b, listz_t *Tree, unsigned int k, listz_t tmp, int dolvl,
       {
         if (dolvl > 0)
           dolvl--;
-        TUpTree (b, Tree + 1, l, tmp, dolvl, sh, n, TreeFile);
-        TUpTree (b + l, Tree + 1, m, tmp, dolvl, sh + l, n, TreeFile);
+        TUpTree (b, Tree + 1, l, tmp, dolvl, sh, n, Fermat);
+        TUpTree (b + l, Tree + 1, m, tmp, dolvl, sh + l, n, Fermat);
       }
 }
 
 static unsigned int
-TUpTree_space (unsigned int k)
+TUpTree_space (unsigned int k, unsigned int Fermat)
 {
 
     unsigned int m, l;
@@ -156,19 +134,19 @@ TUpTree_space (unsigned int k)
     if (k == 1)
       return 0;
    
-    r1 = TMulGen_space (l - 1, m - 1, k - 1) + l;
+    r1 = TMulGen_space (l - 1, m - 1, k - 1, Fermat) + l;
     if (m != l)
       {
-        r2 = TMulGen_space (m - 1, l - 1, k - 1) + k;
+        r2 = TMulGen_space (m - 1, l - 1, k - 1, Fermat) + k;
         r1 = MAX (r1, r2);
       }
 
-    r2 = TUpTree_space (l);
+    r2 = TUpTree_space (l, Fermat);
     r1 = MAX (r1, r2);
     
     if (m != l)
       {
-        r2 = TUpTree_space (m);
+        r2 = TUpTree_space (m, Fermat);
         r1 = MAX (r1, r2);
       }
 
@@ -198,7 +176,7 @@ Since list_mul_mem(k) >= 2*k, the maximum is the 1st.
 int
 polyeval_tellegen (listz_t b, unsigned int k, listz_t *Tree, listz_t tmp,
                    unsigned int sizeT, listz_t invF, mpz_t n, 
-                   char *TreeFilename)
+                   treefile_t TreeFile, unsigned int Fermat)
 {
     unsigned int tupspace;
     unsigned int tkspace;
@@ -206,15 +184,12 @@ polyeval_tellegen (listz_t b, unsigned int k, listz_t *Tree, listz_t tmp,
         r = 0; /* return value, 0 = no error */
     listz_t T;
 
-    ASSERT(Tree != NULL || TreeFilename != NULL);
+    ASSERT(Tree != NULL || TreeFile != NULL);
     
-    tupspace = TUpTree_space (k) + k;
+    tupspace = TUpTree_space (k, Fermat) + k;
     tkspace = 2 * k - 1 + list_mul_mem (k);
 
     tupspace = MAX (tupspace, tkspace);
-    
-    if (TreeFilename != NULL)
-      tupspace += (k + 1) / 2;
 
     if (sizeT >= tupspace)
         T = tmp;
@@ -231,7 +206,7 @@ polyeval_tellegen (listz_t b, unsigned int k, listz_t *Tree, listz_t tmp,
 #ifdef TELLEGEN_DEBUG
     fprintf (ECM_STDOUT, "In polyeval_tellegen, k = %d.\n", k);
     fprintf (ECM_STDOUT, "Required memory: %d.\n", 
-	     TMulGen_space (k - 1, k - 1, k - 1));
+	     TMulGen_space (k - 1, k - 1, k - 1, Fermat));
 #endif
 
     if (Fermat)
@@ -247,35 +222,24 @@ polyeval_tellegen (listz_t b, unsigned int k, listz_t *Tree, listz_t tmp,
         list_mod (T, T + k - 1, k, n);
       }
     list_revert (T, k);
-    if (TreeFilename != NULL)
+    if (TreeFile != NULL)
       {
         unsigned int lgk, i;
-        FILE *TreeFile;
-	char *fullname = (char *) malloc (strlen (TreeFilename) + 1 + 2 + 1);
-        ASSERT_ALWAYS(fullname != NULL);
 
 	lgk = ceil_log2 (k);
         for (i = 0; i < lgk; i++)
           {
-            sprintf (fullname, "%s.%d", TreeFilename, i);
-            
-	    TreeFile = fopen (fullname, "rb");
-            if (TreeFile == NULL)
+            Tree = treefile_level (TreeFile, i);
+            if (Tree == NULL)
               {
-                outputf (OUTPUT_ERROR, 
-                         "Error opening file %s for product tree of F\n",
-                         fullname);
                 r = ECM_ERROR;
                 goto clear_T;
               }
-            TUpTree (T, NULL, k, T + k, i, 0, n, TreeFile);
-            fclose (TreeFile);
-            unlink (fullname);
+            TUpTree (T, Tree, k, T + k, i, 0, n, Fermat);
           }
-        free (fullname);
       }
     else
-      TUpTree (T, Tree, k, T + k, -1, 0, n, NULL);
+      TUpTree (T, Tree, k, T + k, -1, 0, n, Fermat);
     list_swap (b, T, k); /* more efficient than list_set, since T is not
                             needed anymore */
 
@@ -125,7 +125,7 @@ pp1_stage1 (mpz_t f, mpres_t P0, mpmod_t n, double B1, double *B1done,
   double B0, p, q, r, last_chkpnt_p;
   mpz_t g;
   mpres_t P, Q;
-  mpres_t R, S, T;
+  mpresf_t t[7]; /* A, t, B, C, T, T2 and 2 for pp1_mul_prac */
   int youpi = ECM_NO_FACTOR_FOUND;
   unsigned int max_size, size_n;
   long last_chkpnt_time;
@@ -134,9 +134,7 @@ pp1_stage1 (mpz_t f, mpres_t P0, mpmod_t n, double B1, double *B1done,
   mpz_init (g);
   mpres_init (P, n);
   mpres_init (Q, n);
-  mpres_init (R, n);
-  mpres_init (S, n);
-  mpres_init (T, n);
+  mpresf_init (t, 7, n);
 
   B0 = ceil (sqrt (B1));
 
@@ -199,20 +197,29 @@ pp1_stage1 (mpz_t f, mpres_t P0, mpmod_t n, double B1, double *B1done,
     p = (double) getprime_mt (prime_info);
 
   /* then all primes > sqrt(B1) and taken with exponent 1 */
+  mpresf_set_mpres (t[0], P0, n);
+  mpres_set_ui (P, 2, n);
+  mpresf_set_mpres (t[6], P, n);
   for (; p <= B1; p = (double) getprime_mt (prime_info))
     {
-      pp1_mul_prac (P0, (ecm_uint) p, n, P, Q, R, S, T);
+      pp1_mul_prac (t[0], (ecm_uint) p, n, t[1], t[2], t[3], t[4], t[5],
+                    t[6]);
   
       if (stop_asap != NULL && (*stop_asap) ())
-        goto interrupt;
+        {
+          mpres_set_mpresf (P0, t[0], n);
+          goto interrupt;
+        }
       if (chkfilename != NULL && p > last_chkpnt_p + 10000. &&
           elltime (last_chkpnt_time, cputime ()) > CHKPNT_PERIOD)
         {
+          mpres_set_mpresf (P0, t[0], n);
 	  writechkfile (chkfilename, ECM_PP1, p, n, NULL, P0, NULL, NULL);
           last_chkpnt_p = p;
           last_chkpnt_time = cputime ();
         }
     }
+  mpres_set_mpresf (P0, t[0], n);
 
   /* If stage 1 finished normally, p is the smallest prime >B1 here.
      In that case, set to B1 */
@@ -231,9 +238,7 @@ clear_and_exit:
     writechkfile (chkfilename, ECM_PP1, p, n, NULL, P0, NULL, NULL);
   prime_info_clear (prime_info); /* free the prime table */
   mpres_clear (Q, n);
-  mpres_clear (R, n);
-  mpres_clear (S, n);
-  mpres_clear (T, n);
+  mpresf_clear (t, n);
   mpz_clear (g);
   mpres_clear (P, n);
   
@@ -268,6 +273,9 @@ pp1_check_factor (mpz_t a, mpz_t p)
 	  B2 is the stage 2 bound
           k is the number of blocks for stage 2
           verbose is the verbosity level
+          fs2_done, fs2_param and fs2_m_1 are the state of the stage 2 read
+            from a checkpoint (see fs2_resume), fs2_done is 0 if none
+          stage2_threads is the number of threads for the NTT of stage 2
    Output: f is the factor found, p is the residue at end of stage 1
    Return value: non-zero iff a factor is found (1 for stage 1, 2 for stage 2)
 */
@@ -276,7 +284,9 @@ pp1 (mpz_t f, mpz_t p, mpz_t n, mpz_t go, double *B1done, double B1,
      mpz_t B2min_parm, mpz_t B2_parm, unsigned long k,
      int verbose, int repr, int use_ntt, FILE *os, FILE *es,
      char *chkfilename, char *TreeFilename, double maxmem,
-     gmp_randstate_t rng, int (*stop_asap)(void))
+     gmp_randstate_t rng, int (*stop_asap)(void), unsigned long fs2_done,
+     const unsigned long *fs2_param, mpz_t fs2_m_1,
+     unsigned int stage2_threads)
 {
   int youpi = ECM_NO_FACTOR_FOUND;
   long st;
@@ -319,6 +329,10 @@ pp1 (mpz_t f, mpz_t p, mpz_t n, mpz_t go, double *B1done, double B1,
       mpz_init (faststage2_params.m_1);
       faststage2_params.l = 0;
       faststage2_params.file_stem = TreeFilename;
+      faststage2_params.done = 0;
+      faststage2_params.chkfilename = chkfilename;
+      faststage2_params.stop_asap = stop_asap;
+      faststage2_params.threads = stage2_threads;
       
       /* Find out what the longest transform length is we can do at all.
 	 If no maxmem is given, the non-NTT can theoretically do any length. */
@@ -424,6 +438,9 @@ pp1 (mpz_t f, mpz_t p, mpz_t n, mpz_t go, double *B1done, double B1,
   if (B1 > *B1done || mpz_cmp_ui (go, 1) > 0)
     youpi = pp1_stage1 (f, a, modulus, B1, B1done, go, stop_asap, 
                         chkfilename);
+  else if (mpz_cmp (B2, B2min) >= 0) /* a is the residue of the checkpoint */
+    fs2_resume (&faststage2_params, fs2_done, fs2_param, fs2_m_1);
+  faststage2_params.B1done = *B1done;
 
   outputf (OUTPUT_NORMAL, "Step 1 took %ldms\n", elltime (st, cputime ()));
   if (test_verbose (OUTPUT_RESVERBOSE))
@@ -444,7 +461,8 @@ pp1 (mpz_t f, mpz_t p, mpz_t n, mpz_t go, double *B1done, double B1,
   if (stop_asap != NULL && (*stop_asap) ())
     goto clear_and_exit;
       
-  if (youpi == ECM_NO_FACTOR_FOUND && mpz_cmp (B2, B2min) >= 0)
+  if (youpi == ECM_NO_FACTOR_FOUND && mpz_cmp (B2, B2min) >= 0 &&
+      faststage2_params.done < faststage2_params.s_2)
     {
       if (use_ntt)
         youpi = pp1fs2_ntt (f, a, modulus, &faststage2_params, twopass);
@@ -115,6 +115,8 @@ freadstrn (FILE *fd, char *s, char delim, unsigned int len)
 
 /* Reads an assignment from a save file. Return 1 if an assignment was
    successfully read, 0 if there are no more lines to read (at EOF) 
+   If the line is a part of a split stage 2, unit gets its range, otherwise
+   unit->j is set to 0.
 */
 
 int 
@@ -122,14 +124,16 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
 		      mpz_t sigma, mpz_t A,
 		      mpz_t x0, mpz_t y0, int *Etype, int *param, 
 		      double *b1, char *program, char *who, char *rtime, 
-		      char *comment, FILE *fd)
+		      char *comment, stage2_unit_t *unit, stage1_ladder_t *ladder,
+                      FILE *fd)
 {
   int a, have_method, have_x, have_y, have_z, have_n, have_sigma, have_a, 
-      have_b1, have_checksum, have_qx;
+      have_b1, have_b2, have_checksum, have_qx;
   unsigned int saved_checksum;
   char tag[16];
-  mpz_t z;
+  mpz_t z, z2;
   
+  mpz_init (z2);
   while (!feof (fd))
     {
       /* Ignore empty lines */
@@ -148,7 +152,7 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
         break;
       
       have_method = have_x = have_y = have_z = have_n = have_sigma = have_a = 
-                    have_b1 = have_qx = have_checksum = 0;
+                    have_b1 = have_b2 = have_qx = have_checksum = 0;
 
       /* For compatibility reason, param = ECM_PARAM_SUYAMA by default */
       *param = ECM_PARAM_SUYAMA;
@@ -167,6 +171,10 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
         rtime[0] = 0;
       if (comment != NULL)
         comment[0] = 0;
+      unit->j = 0;
+      mpz_set_ui (unit->factor, 0);
+      unit->fs2_done = 0;
+      ladder->bits = 0;
 
       while (!facceptnl (fd) && !feof (fd))
         {
@@ -268,6 +276,46 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
                 goto error;
               have_b1 = 1;
             }
+          else if (strcmp (tag, "B2") == 0)
+            {
+              mpz_inp_str (unit->B2min, fd, 10);
+              if (!facceptstr (fd, "-"))
+                goto error;
+              mpz_inp_str (unit->B2, fd, 10);
+              have_b2 = 1;
+            }
+          else if (strcmp (tag, "UNIT") == 0)
+            {
+              if (fscanf (fd, "%u/%u", &(unit->j), &(unit->K)) != 2)
+                goto error;
+            }
+          else if (strcmp (tag, "FACTOR") == 0)
+            {
+              if (mpz_inp_str (unit->factor, fd, 10) == 0)
+                goto error;
+            }
+          else if (strcmp (tag, "LADDER") == 0)
+            {
+              /* B1,bits,x2,z2 of a checkpoint of the batch stage 1 */
+              if (ladder->bits > 0 ||
+                  fscanf (fd, "%lf,%lu", &(ladder->B1), &(ladder->bits)) != 2
+                  || !facceptstr (fd, ",")
+                  || mpz_inp_str (ladder->x2, fd, 0) == 0
+                  || !facceptstr (fd, ","))
+                goto error;
+              if (mpz_inp_str (z2, fd, 0) == 0)
+                goto error;
+            }
+          else if (strcmp (tag, "FS2") == 0)
+            {
+              /* done/s_2,P,s_1,l,m_1 of a P-1 or P+1 stage 2 checkpoint */
+              if (fscanf (fd, "%lu/%lu,%lu,%lu,%lu", &(unit->fs2_done),
+                          &(unit->fs2_param[2]), &(unit->fs2_param[0]),
+                          &(unit->fs2_param[1]), &(unit->fs2_param[3])) != 5
+                  || !facceptstr (fd, ",")
+                  || mpz_inp_str (unit->fs2_m_1, fd, 10) == 0)
+                goto error;
+            }
           else if (strcmp (tag, "PROGRAM") == 0)
             {
               freadstrn (fd, program, ';', 255);
@@ -309,6 +357,7 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
               /* *b1 = 1.0; */
               strcpy (program, "Prime95");
               mpz_mod (x, x, n->n);
+              mpz_clear (z2);
               return 1;
             }
           goto error;
@@ -352,6 +401,28 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
           continue;
         }
 
+      if (have_b2 != (unit->j > 0) || unit->j > unit->K ||
+          (unit->j == 0 && mpz_sgn (unit->factor) != 0))
+        {
+          fprintf (stderr, "Save file line has an invalid stage 2 unit\n");
+          continue;
+        }
+
+      if (unit->fs2_done > 0 && (*method == ECM_ECM || unit->j > 0 ||
+                                 unit->fs2_done > unit->fs2_param[2]))
+        {
+          fprintf (stderr, "Save file line has an invalid stage 2 "
+                   "checkpoint\n");
+          continue;
+        }
+
+      if (ladder->bits > 0 && (*method != ECM_ECM || unit->j > 0 || have_y))
+        {
+          fprintf (stderr, "Save file line has an invalid stage 1 "
+                   "checkpoint\n");
+          continue;
+        }
+
       if (have_checksum)
         {
           mpz_t checksum;
@@ -392,6 +463,15 @@ read_resumefile_line (int *method, mpz_t x, mpz_t y, mpcandi_t *n,
           mpz_mod (x, z, n->n);
           mpz_clear (z);
         }
+      if (ladder->bits > 0) /* Must normalize as well */
+        {
+          if (!mpz_invert (z2, z2, n->n))
+            printf ("Oops, factor found while reading from save file.\n");
+          mpz_mul (z2, z2, ladder->x2);
+          mpz_mod (ladder->x2, z2, n->n);
+        }
+
+      mpz_clear (z2);
 
       return 1;
       
@@ -405,6 +485,7 @@ error:
     }
     
     /* We hit EOF without reading a proper save line */
+    mpz_clear (z2);
     return 0;
 }
 
@@ -413,7 +494,8 @@ error:
 static void  
 write_resumefile_line (FILE *file, int method, double B1, mpz_t sigma, 
                        int sigma_is_A, int Etype, int param, mpz_t x, mpz_t y,
-		       mpcandi_t *n, mpz_t x0, mpz_t y0, const char *comment)
+		       mpcandi_t *n, mpz_t x0, mpz_t y0, const char *comment,
+		       const stage2_unit_t *unit)
 {
   mpz_t checksum;
   time_t t;
@@ -446,7 +528,22 @@ write_resumefile_line (FILE *file, int method, double B1, mpz_t sigma,
             mpz_mul_ui (checksum, checksum, (param+1)%CHKSUMMOD);
     }
   
-  fprintf (file, "; B1=%.0f; N=", B1);
+  fprintf (file, "; B1=%.0f; ", B1);
+  if (unit != NULL && unit->j > 0)
+    {
+      fprintf (file, "B2=");
+      mpz_out_str (file, 10, unit->B2min);
+      fprintf (file, "-");
+      mpz_out_str (file, 10, unit->B2);
+      fprintf (file, "; UNIT=%u/%u; ", unit->j, unit->K);
+      if (mpz_sgn (unit->factor) != 0)
+        {
+          fprintf (file, "FACTOR=");
+          mpz_out_str (file, 10, unit->factor);
+          fprintf (file, "; ");
+        }
+    }
+  fprintf (file, "N=");
   if (n->cpExpr)
     fprintf(file, "%s", n->cpExpr);
   else
@@ -541,10 +638,12 @@ write_resumefile_line (FILE *file, int method, double B1, mpz_t sigma,
 int  
 write_resumefile (char *fn, int method, mpz_t N, ecm_params params,
 		  mpcandi_t *n, mpz_t orig_x0, mpz_t orig_y0, 
-		  const char *comment)
+		  const char *comment, const stage2_unit_t *unit)
 {
   FILE *file;
-  unsigned int i = 0;
+  unsigned int i = 0, nb_curves;
+  mpz_ptr sigma = params->sigma;
+  int param = params->param;
 #if defined(HAVE_FCNTL) && defined(HAVE_FILENO)
   struct flock lock;
   int r, fd;
@@ -594,7 +693,7 @@ write_resumefile (char *fn, int method, mpz_t N, ecm_params params,
   
 
   /* Now can call write_resumefile_line to write in the file */
-  if (params->gpu == 0)
+  if (params->gpu == 0 && params->cpubatch == 0)
     {
       /* Reduce stage 1 residue wrt new cofactor, in case a factor was 
          found */
@@ -602,29 +701,43 @@ write_resumefile (char *fn, int method, mpz_t N, ecm_params params,
 
       /* We write the B1done value to the save file. This requires that
          a correct B1done is returned by the factoring functions. */
+      /* For the torsion curves in Weierstrass form, sigma is the parameter
+         of the family and the curve coefficient is in E->a4: save them as
+         any other curve given by A, which read_resumefile_line() expects
+         without PARAM */
+      if (params->param == ECM_PARAM_TORSION && params->sigma_is_A == -1
+          && params->E->type == ECM_EC_TYPE_WEIERSTRASS)
+        {
+          sigma = params->E->a4;
+          param = ECM_PARAM_DEFAULT;
+        }
+
       /* FIXME: clang says that params->y == NULL is always false. */
       if (params->y == NULL)
 	{
-	  write_resumefile_line (file, method, params->B1done, params->sigma,
+	  write_resumefile_line (file, method, params->B1done, sigma,
 				 params->sigma_is_A, params->E->type, 
-				 params->param, 
+				 param, 
 				 tmp_x, NULL, n, orig_x0, orig_y0,
-				 comment);
+				 comment, unit);
 	}
       else
 	{
 	  mpz_mod (tmp_y, params->y, n->n);
-	  write_resumefile_line (file, method, params->B1done, params->sigma,
+	  write_resumefile_line (file, method, params->B1done, sigma,
 				 params->sigma_is_A, params->E->type,
-				 params->param, 
+				 param, 
 				 tmp_x, tmp_y, n, orig_x0, orig_y0,
-				 comment);
+				 comment, unit);
 	}
     }
   else
     {
-      mpz_add_ui (params->sigma, params->sigma, params->gpu_number_of_curves);
-      for (i = 0; i < params->gpu_number_of_curves; i++)
+      /* params->x holds the residues of all curves, see cpu_ecm */
+      nb_curves = params->gpu ? params->gpu_number_of_curves
+                              : params->cpubatch;
+      mpz_add_ui (params->sigma, params->sigma, nb_curves);
+      for (i = 0; i < nb_curves; i++)
         {
           mpz_sub_ui (params->sigma, params->sigma, 1);
           mpz_fdiv_qr (params->x, tmp_x, params->x, N); 
@@ -633,7 +746,7 @@ write_resumefile (char *fn, int method, mpz_t N, ecm_params params,
 				 params->sigma_is_A, params->E->type,
 				 params->param, 
 				 tmp_x, NULL, n, orig_x0, orig_y0, 
-				 comment);
+				 comment, unit);
         }
     }
 
@@ -653,15 +766,191 @@ write_resumefile (char *fn, int method, mpz_t N, ecm_params params,
   return 0;
 }
 
+/* A residue seen by check_stage2_units() */
+typedef struct
+{
+  mpz_t N, sigma;       /* sigma, or A if sigma_is_A */
+  int sigma_is_A, param;
+  double B1;
+  unsigned int K;
+  mpz_t *B2min, *B2;    /* the range of part j is B2min[j-1]-B2[j-1] */
+  mpz_t *factor;        /* the factor found by part j, or 0 */
+  char *done;           /* done[j-1] != 0 if part j was seen */
+} unit_residue_t;
+
+/* Read the save file lines of fd written by the runs of the stage 2 units
+   of -split, and check for each residue that all its units are present
+   and that their ranges have no gap. A unit which found a factor is done
+   as well, its line has the factor. Other lines are ignored.
+   Print a line for each residue, return 1 if all are complete, 0 if
+   some unit is missing or if there is none. */
+int
+check_stage2_units (FILE *fd)
+{
+  unit_residue_t *R = NULL, *r;
+  unsigned int nr = 0, i, j, missing;
+  int method, Etype, param, complete = 1;
+  double B1;
+  char program[256], who[256], rtime[256], comment[256];
+  mpz_t x, y, sigma, A, x0, y0;
+  mpcandi_t n;
+  stage2_unit_t unit;
+  stage1_ladder_t ladder;
+
+  mpz_init (x);
+  mpz_init (y);
+  mpz_init (sigma);
+  mpz_init (A);
+  mpz_init (x0);
+  mpz_init (y0);
+  mpz_init (unit.B2min);
+  mpz_init (unit.B2);
+  mpz_init (unit.factor);
+  mpz_init (unit.fs2_m_1);
+  mpz_init (ladder.x2);
+  mpcandi_t_init (&n);
+
+  while (read_resumefile_line (&method, x, y, &n, sigma, A, x0, y0, &Etype,
+                               &param, &B1, program, who, rtime, comment,
+                               &unit, &ladder, fd))
+    {
+      int sigma_is_A = mpz_sgn (sigma) == 0;
+
+      if (method != ECM_ECM || unit.j == 0)
+        continue;
+
+      /* the residues are identified by N, the curve and B1 */
+      for (i = 0, r = R; i < nr; i++, r++)
+        if (mpz_cmp (r->N, n.n) == 0 && r->sigma_is_A == sigma_is_A &&
+            mpz_cmp (r->sigma, sigma_is_A ? A : sigma) == 0 &&
+            r->param == param && r->B1 == B1 && r->K == unit.K)
+          break;
+      if (i == nr)
+        {
+          R = (unit_residue_t *) realloc (R, ++nr * sizeof (unit_residue_t));
+          r = R + i;
+          if (R == NULL ||
+              (r->B2min = (mpz_t *) malloc (unit.K * sizeof (mpz_t))) == NULL ||
+              (r->B2 = (mpz_t *) malloc (unit.K * sizeof (mpz_t))) == NULL ||
+              (r->factor = (mpz_t *) malloc (unit.K * sizeof (mpz_t)))
+              == NULL ||
+              (r->done = (char *) calloc (unit.K, 1)) == NULL)
+            {
+              fprintf (stderr, "Cannot allocate memory in "
+                       "check_stage2_units\n");
+              exit (EXIT_FAILURE);
+            }
+          mpz_init_set (r->N, n.n);
+          mpz_init_set (r->sigma, sigma_is_A ? A : sigma);
+          r->sigma_is_A = sigma_is_A;
+          r->param = param;
+          r->B1 = B1;
+          r->K = unit.K;
+          for (j = 0; j < unit.K; j++)
+            {
+              mpz_init (r->B2min[j]);
+              mpz_init (r->B2[j]);
+              mpz_init (r->factor[j]);
+            }
+        }
+      mpz_set (r->B2min[unit.j - 1], unit.B2min);
+      mpz_set (r->B2[unit.j - 1], unit.B2);
+      mpz_set (r->factor[unit.j - 1], unit.factor);
+      r->done[unit.j - 1] = 1;
+    }
+
+  if (nr == 0)
+    {
+      printf ("No stage 2 units found\n");
+      complete = 0;
+    }
+
+  for (i = 0, r = R; i < nr; i++, r++)
+    {
+      printf ("%s=", r->sigma_is_A ? "A" : "SIGMA");
+      mpz_out_str (stdout, 10, r->sigma);
+      printf (", B1=%.0f, N with %u digits: ", r->B1, nb_digits (r->N));
+      for (j = missing = 0; j < r->K; j++)
+        if (!r->done[j])
+          printf ("%s%u", (missing++ == 0) ? "missing units " : ", ", j + 1);
+      if (missing == 0)
+        {
+          /* -split makes each unit start where the previous one ends */
+          for (j = 1; j < r->K; j++)
+            {
+              mpz_add_ui (x, r->B2[j - 1], 1);
+              if (mpz_cmp (r->B2min[j], x) > 0)
+                printf ("%sunits %u and %u", (missing++ == 0) ? "gap between "
+                        : ", ", j, j + 1);
+            }
+        }
+      if (missing == 0)
+        {
+          printf ("all %u units done, B2=", r->K);
+          mpz_out_str (stdout, 10, r->B2min[0]);
+          printf ("-");
+          mpz_out_str (stdout, 10, r->B2[r->K - 1]);
+        }
+      else
+        printf (" of %u", r->K);
+      for (j = 0; j < r->K; j++)
+        if (mpz_sgn (r->factor[j]) != 0)
+          {
+            printf (", unit %u found the factor ", j + 1);
+            mpz_out_str (stdout, 10, r->factor[j]);
+          }
+      printf ("\n");
+      complete = complete && missing == 0;
+
+      mpz_clear (r->N);
+      mpz_clear (r->sigma);
+      for (j = 0; j < r->K; j++)
+        {
+          mpz_clear (r->B2min[j]);
+          mpz_clear (r->B2[j]);
+          mpz_clear (r->factor[j]);
+        }
+      free (r->B2min);
+      free (r->B2);
+      free (r->factor);
+      free (r->done);
+    }
+  free (R);
+
+  mpcandi_t_free (&n);
+  mpz_clear (unit.B2);
+  mpz_clear (unit.B2min);
+  mpz_clear (unit.factor);
+  mpz_clear (unit.fs2_m_1);
+  mpz_clear (ladder.x2);
+  mpz_clear (y0);
+  mpz_clear (x0);
+  mpz_clear (A);
+  mpz_clear (sigma);
+  mpz_clear (y);
+  mpz_clear (x);
+
+  return complete;
+}
+
+
+/* size of the buffer of write_s_in_file */
+#define WRITE_S_BUFSIZE 65536
 
 /* For the batch mode */
-/* Write the batch exponent s in a file */
+/* Write the batch exponent s in a file, in the format of mpz_out_raw:
+   the number of bytes of s on 4 bytes, then the bytes of s, both most
+   significant byte first. Since s may have gigabytes, the bytes are
+   written from its limbs through a small buffer, instead of converting all
+   of s at once as mpz_out_raw does. */
 /* Return the number of bytes written */
 int
 write_s_in_file (char *fn, mpz_t s)
 {
   FILE *file;
-  int ret = 0;
+  unsigned char buf[WRITE_S_BUFSIZE];
+  size_t bytes, i, k, b;
+  mp_limb_t l;
 
 #ifdef DEBUG
   if (fn == NULL)
@@ -670,18 +959,54 @@ write_s_in_file (char *fn, mpz_t s)
       exit (EXIT_FAILURE);
     }
 #endif
-  
+
+  bytes = (mpz_sizeinbase (s, 2) + 7) / 8;
+  if (mpz_sgn (s) <= 0 || bytes > 0x7fffffff - 4)
+    {
+      fprintf (stderr, "Batch product too large to be saved in %s\n", fn);
+      return 0;
+    }
+
   file = fopen (fn, "wb");
   if (file == NULL)
     {
       fprintf (stderr, "Could not open file %s for writing\n", fn);
       return 0;
     }
-  
-  ret = mpz_out_raw (file, s);
-  
+
+  for (k = 0; k < 4; k++)
+    buf[k] = (unsigned char) (bytes >> (8 * (3 - k)));
+  /* the most significant limb has only the first bytes % sizeof (mp_limb_t)
+     bytes, if non zero */
+  b = bytes - (mpz_size (s) - 1) * sizeof (mp_limb_t);
+  for (i = mpz_size (s); i-- > 0; b = sizeof (mp_limb_t))
+    {
+      l = mpz_getlimbn (s, i);
+      while (b-- > 0)
+        {
+          buf[k++] = (unsigned char) (l >> (8 * b));
+          if (k == WRITE_S_BUFSIZE)
+            {
+              if (fwrite (buf, 1, k, file) != k)
+                goto error;
+              k = 0;
+            }
+        }
+    }
+  if (fwrite (buf, 1, k, file) != k)
+    goto error;
+
+  if (fclose (file) != 0)
+    {
+      fprintf (stderr, "Error while writing file %s\n", fn);
+      return 0;
+    }
+  return (int) (4 + bytes);
+
+error:
+  fprintf (stderr, "Error while writing file %s\n", fn);
   fclose (file);
-  return ret;
+  return 0;
 }
 
 /* For the batch mode */
@@ -72,10 +72,22 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 void rhoinit (int, int); /* used in stage2.c */
 
+/* The table of Dickman's rho function is shared by all threads. Once built
+   by rhoinit() it is only read, and since the library always asks for the
+   same size, it is built once and kept until the end of the process. */
 static double *rhotable = NULL;
 static int invh = 0;
 static double h = 0.;
 static int tablemax = 0;
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+static pthread_mutex_t rhotable_lock = PTHREAD_MUTEX_INITIALIZER;
+#define RHOTABLE_LOCK() pthread_mutex_lock (&rhotable_lock)
+#define RHOTABLE_UNLOCK() pthread_mutex_unlock (&rhotable_lock)
+#else
+#define RHOTABLE_LOCK()
+#define RHOTABLE_UNLOCK()
+#endif
 #if defined(TESTDRIVE)
 #define PRIME_PI_MAX 10000
 #define PRIME_PI_MAP(x) (((x)+1)/2)
@@ -344,13 +356,21 @@ Buchstab_omega (const double x)
 
 #endif
 
+/* Build the table of rho(i/parm_invh) for 0 <= i < parm_invh*parm_tablemax,
+   unless it already exists. With parm_tablemax == 0, free the table; this
+   and changing the size of the table are only allowed while no other thread
+   uses it. */
 void 
 rhoinit (int parm_invh, int parm_tablemax)
 {
   int i;
 
+  RHOTABLE_LOCK();
   if (parm_invh == invh && parm_tablemax == tablemax)
-    return;
+    {
+      RHOTABLE_UNLOCK();
+      return;
+    }
 
   if (rhotable != NULL)
     {
@@ -363,7 +383,10 @@ rhoinit (int parm_invh, int parm_tablemax)
   
   /* The integration below expects 3 * invh > 4 */
   if (parm_tablemax == 0 || parm_invh < 2)
-    return;
+    {
+      RHOTABLE_UNLOCK();
+      return;
+    }
     
   invh = parm_invh;
   h = 1. / (double) invh;
@@ -397,6 +420,7 @@ rhoinit (int parm_invh, int parm_tablemax)
 #endif
         }
     }
+  RHOTABLE_UNLOCK();
 }
 
 /* assumes alpha < tablemax */
@@ -38,9 +38,9 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #define CHECKSUM 1
 */
 
-static mpz_t gt;
-static int gt_inited = 0;
-unsigned int Fermat;
+/* All functions below take as last argument a temporary gt of at least 2n
+   bits, allocated by F_mul() and F_mul_trans() for the duration of the
+   call, so that they do not need any state outside their arguments. */
 
 #define CACHESIZE 512U
 
@@ -49,7 +49,7 @@ unsigned int Fermat;
 #define ADDSUB_MOD(a, b) \
   mpz_sub (gt, a, b); \
   mpz_add (a, a, b);  \
-  F_mod_gt (b, n);    \
+  F_mod_gt (b, n, gt);    \
   F_mod_1 (a, n);
 
 __GMP_DECLSPEC mp_limb_t __gmpn_mod_34lsub1 (mp_limb_t*, mp_size_t);
@@ -102,7 +102,7 @@ F_mod_1 (mpz_t RS, unsigned int n)
 /* R = gt (mod 2^n+1) */
 
 static inline void 
-F_mod_gt (mpz_t R, unsigned int n)
+F_mod_gt (mpz_t R, unsigned int n, mpz_t gt)
 {
   mp_size_t size;
   mp_limb_t v;
@@ -137,7 +137,7 @@ F_mod_gt (mpz_t R, unsigned int n)
    S1 == S2, S1 == R, S2 == R ok, but none may == gt.
    Assume n >= GMP_NUMB_BITS, and GMP_NUMB_BITS is a power of two. */
 static void 
-F_mulmod (mpz_t R, mpz_t S1, mpz_t S2, unsigned int n)
+F_mulmod (mpz_t R, mpz_t S1, mpz_t S2, unsigned int n, mpz_t gt)
 {
   int n2 = n / GMP_NUMB_BITS; /* type of _mp_size is int */
 
@@ -159,11 +159,11 @@ F_mulmod (mpz_t R, mpz_t S1, mpz_t S2, unsigned int n)
       mpn_mul_fft (PTR(gt), n2, PTR(S1), ABSIZ(S1), PTR(S2), ABSIZ(S2), k);
       MPN_NORMALIZE(PTR(gt), n2);
       SIZ(gt) = ((SIZ(S1) ^ SIZ(S2)) >= 0) ? n2 : -n2;
-      F_mod_gt (R, n);
+      F_mod_gt (R, n, gt);
       return;
     }
   mpz_mul (gt, S1, S2);
-  F_mod_gt (R, n);
+  F_mod_gt (R, n, gt);
   return;
 }
 
@@ -330,7 +330,7 @@ F_divby5_1 (mpz_t RS, unsigned int n)
 /* Assumes 0 < e < 4*n, and e <> 2*n */
 
 static void 
-F_mul_sqrt2exp (mpz_t R, mpz_t S, int e, unsigned int n) 
+F_mul_sqrt2exp (mpz_t R, mpz_t S, int e, unsigned int n, mpz_t gt) 
 {
   int chgsgn = 0, odd;
 
@@ -388,7 +388,7 @@ F_mul_sqrt2exp (mpz_t R, mpz_t S, int e, unsigned int n)
    Currently this routine is always called with e=n, with n a power of 2,
    thus we assume e is even. Moreover we assume 0 < e < 2n. */
 static void 
-F_mul_sqrt2exp_2 (mpz_t R, mpz_t S, int e, unsigned int n)
+F_mul_sqrt2exp_2 (mpz_t R, mpz_t S, int e, unsigned int n, mpz_t gt)
 {
   ASSERT (S != R);
   ASSERT (R != gt);
@@ -417,7 +417,7 @@ F_mul_sqrt2exp_2 (mpz_t R, mpz_t S, int e, unsigned int n)
    Performs forward transform.
    Assumes l > 1. */
 static void 
-F_fft_dif (mpz_t *A, int l, int stride2, int n) 
+F_fft_dif (mpz_t *A, int l, int stride2, int n, mpz_t gt) 
 {
   int i, omega = (4 * n) / l, iomega;
 
@@ -435,7 +435,7 @@ F_fft_dif (mpz_t *A, int l, int stride2, int n)
 
   mpz_sub (gt, A1s, A3s);            /* gt = a1 - a3 */
   mpz_add (A1s, A1s, A3s);           /* A1 = a1 + a3 */
-  F_mul_sqrt2exp_2 (A3s, gt, n, n);  /* A3 = i * (a1 - a3) */
+  F_mul_sqrt2exp_2 (A3s, gt, n, n, gt);  /* A3 = i * (a1 - a3) */
       
   mpz_sub (gt, A[0], A2s);           /* gt = a0 - a2 */
   mpz_add (A[0], A[0], A2s);         /* A0 = a0 + a2 */
@@ -449,7 +449,7 @@ F_fft_dif (mpz_t *A, int l, int stride2, int n)
     {
       mpz_sub (gt, A1is, A3is);
       mpz_add (A1is, A1is, A3is);
-      F_mul_sqrt2exp_2 (A3is, gt, n, n);
+      F_mul_sqrt2exp_2 (A3is, gt, n, n, gt);
           
       mpz_sub (gt, A0is, A2is);
       mpz_add (A0is, A0is, A2is);
@@ -460,21 +460,21 @@ F_fft_dif (mpz_t *A, int l, int stride2, int n)
       mpz_sub (A3is, gt, A3is);
       /* iomega goes from 4n/l to n-4n/l (with original l) thus cannot
          equal 0 nor 2n */
-      F_mul_sqrt2exp (A1is, A1is, iomega, n);
+      F_mul_sqrt2exp (A1is, A1is, iomega, n, gt);
       /* 2*iomega goes from 8n/l to 2n-8n/l (with original l) thus cannot
          equal 0 nor 2n */
-      F_mul_sqrt2exp (A2is, A2is, 2 * iomega, n);
+      F_mul_sqrt2exp (A2is, A2is, 2 * iomega, n, gt);
       /* 3*iomega goes from 12n/l to 3n-12n/l (with original l) thus cannot
          equal 0 nor 2n (because n is a power of 2) */
-      F_mul_sqrt2exp (A3is, A3is, 3 * iomega, n);
+      F_mul_sqrt2exp (A3is, A3is, 3 * iomega, n, gt);
     }
 
   if (l > 1)
     {
-      F_fft_dif (A, l, stride2, n);
-      F_fft_dif (A + (l << stride2), l, stride2, n);
-      F_fft_dif (A + (2 * l << stride2), l, stride2, n);
-      F_fft_dif (A + (3 * l << stride2), l, stride2, n);
+      F_fft_dif (A, l, stride2, n, gt);
+      F_fft_dif (A + (l << stride2), l, stride2, n, gt);
+      F_fft_dif (A + (2 * l << stride2), l, stride2, n, gt);
+      F_fft_dif (A + (3 * l << stride2), l, stride2, n, gt);
     }
 }
 
@@ -482,7 +482,7 @@ F_fft_dif (mpz_t *A, int l, int stride2, int n)
    Does not perform divide-by-length. l, and n as in F_fft_dif().
    Assume l > 1. */
 static void 
-F_fft_dit (mpz_t *A, int l, int stride2, int n) 
+F_fft_dit (mpz_t *A, int l, int stride2, int n, mpz_t gt) 
 {
   int i, omega = (4 * n) / l, iomega;
 
@@ -500,15 +500,15 @@ F_fft_dit (mpz_t *A, int l, int stride2, int n)
       
   if (l > 1)
     {
-      F_fft_dit (A, l, stride2, n);
-      F_fft_dit (A + (l << stride2), l, stride2, n);
-      F_fft_dit (A + (2 * l << stride2), l, stride2, n);
-      F_fft_dit (A + (3 * l << stride2), l, stride2, n);
+      F_fft_dit (A, l, stride2, n, gt);
+      F_fft_dit (A + (l << stride2), l, stride2, n, gt);
+      F_fft_dit (A + (2 * l << stride2), l, stride2, n, gt);
+      F_fft_dit (A + (3 * l << stride2), l, stride2, n, gt);
     }
 
   mpz_sub (gt, A3s, A1s);            /* gt = -(a1 - a3) */
   mpz_add (A1s, A1s, A3s);           /* A1 = a1 + a3 */
-  F_mul_sqrt2exp_2 (A3s, gt, n, n);  /* A3 = i * -(a1 - a3) */
+  F_mul_sqrt2exp_2 (A3s, gt, n, n, gt);  /* A3 = i * -(a1 - a3) */
       
   mpz_sub (gt, A[0], A2s);           /* gt = a0 - a2 */
   mpz_add (A[0], A[0], A2s);         /* A0 = a0 + a2 */
@@ -524,16 +524,16 @@ F_fft_dit (mpz_t *A, int l, int stride2, int n)
          this is like multiplying by omega^(4*n-i) */
       /* iomega goes from 4n/l to n-4n/l (with original l) thus
          3n < 4*n-iomega < 4n */
-      F_mul_sqrt2exp (A1is, A1is, 4 * n - iomega, n);
+      F_mul_sqrt2exp (A1is, A1is, 4 * n - iomega, n, gt);
       /* 2n < 4*n-2*iomega < 4n */
-      F_mul_sqrt2exp (A2is, A2is, 4 * n - 2 * iomega, n);
+      F_mul_sqrt2exp (A2is, A2is, 4 * n - 2 * iomega, n, gt);
       /* n < 4*n-3*iomega < 4n, and 4*n-3*iomega cannot equal 2n since
          n is a power of 2 and 3*iomega is divisible by 3 */
-      F_mul_sqrt2exp (A3is, A3is, 4 * n - 3 * iomega, n);
+      F_mul_sqrt2exp (A3is, A3is, 4 * n - 3 * iomega, n, gt);
 
       mpz_sub (gt, A3is, A1is);
       mpz_add (A1is, A1is, A3is);
-      F_mul_sqrt2exp_2 (A3is, gt, n, n);
+      F_mul_sqrt2exp_2 (A3is, gt, n, n, gt);
 
       mpz_sub (gt, A0is, A2is);
       mpz_add (A0is, A0is, A2is);
@@ -574,11 +574,14 @@ F_fft_dit (mpz_t *A, int l, int stride2, int n)
 #define t5 t[5*l+i]
 
 
+static unsigned int F_mul_gt (mpz_t *, mpz_t *, mpz_t *, unsigned int, int,
+                              unsigned int, mpz_t *, mpz_t);
+
 /* Assume A <> B. There was some code for squaring (A=B) in revision <= 2788.
  */
 static unsigned int
 F_toomcook4 (mpz_t *C, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n, 
-             mpz_t *t)
+             mpz_t *t, mpz_t gt)
 {
   unsigned int l, i, r;
 
@@ -658,19 +661,19 @@ F_toomcook4 (mpz_t *C, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n,
   /* A0 B0  A(1) B(1) A(-1) B(-1) A3 B3 */
   /* C0 C1   C2   C3   C4    C5   C6 C7 */
 
-  r = F_mul (t, t, t + l, l, DEFAULT, n, t + 6 * l);
+  r = F_mul_gt (t, t, t + l, l, DEFAULT, n, t + 6 * l, gt);
   /* t0 = 8*A(1/2) * 8*B(1/2) = 64*C(1/2) */
-  r += F_mul (t + 2 * l, t + 2 * l, t + 3 * l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (t + 2 * l, t + 2 * l, t + 3 * l, l, DEFAULT, n, t + 6 * l, gt);
   /* t2 = A(2) * B(2) = C(2) */
-  r += F_mul (t + 4 * l, t + 4 * l, t + 5 * l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (t + 4 * l, t + 4 * l, t + 5 * l, l, DEFAULT, n, t + 6 * l, gt);
   /* t4 = A(-2) * B(-2) = C(-2) */
-  r += F_mul (C, A, C + l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (C, A, C + l, l, DEFAULT, n, t + 6 * l, gt);
   /* C0 = A(0)*B(0) = C(0) */
-  r += F_mul (C + 2 * l, C + 2 * l, C + 3 * l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (C + 2 * l, C + 2 * l, C + 3 * l, l, DEFAULT, n, t + 6 * l, gt);
   /* C2 = A(1)*B(1) = C(1) */
-  r += F_mul (C + 4 * l, C + 4 * l, C + 5 * l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (C + 4 * l, C + 4 * l, C + 5 * l, l, DEFAULT, n, t + 6 * l, gt);
   /* C4 = A(-1)*B(-1) = C(-1) */
-  r += F_mul (C + 6 * l, C + 6 * l, B + 3 * l, l, DEFAULT, n, t + 6 * l);
+  r += F_mul_gt (C + 6 * l, C + 6 * l, B + 3 * l, l, DEFAULT, n, t + 6 * l, gt);
   /* C6 = A(inf)*B(inf) = C(inf) */
   
 /* C(0)   C(1)   C(-1)  C(inf)  64*C(1/2)  C(2)   C(-2) */
@@ -772,7 +775,7 @@ F_toomcook4 (mpz_t *C, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n,
    Assume A <> B (there was code for squaring in revision <= 2788. */
 static unsigned int
 F_karatsuba (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n, 
-             mpz_t *t)
+             mpz_t *t, mpz_t gt)
 {
   unsigned int i, r;
 
@@ -786,21 +789,23 @@ F_karatsuba (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n,
       mpz_add (t[i + len], B[i], B[i + len]); /* t1 = B0 + B1 */
     }
   
-  r = F_mul (t, t, t + len, len, DEFAULT, n, t + 2 * len);
+  r = F_mul_gt (t, t, t + len, len, DEFAULT, n, t + 2 * len, gt);
   /* t[0...2*len-1] = (A0+A1) * (B0+B1) = A0*B0 + A0*B1 + A1*B0 + A1*B1 */
   
   if (R != A)
     {
-      r += F_mul (R, A, B, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R, A, B, len, DEFAULT, n, t + 2 * len, gt);
       /* R[0...2*len-1] = A0 * B0 */
-      r += F_mul (R + 2 * len, A + len, B + len, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R + 2 * len, A + len, B + len, len, DEFAULT, n,
+                     t + 2 * len, gt);
       /* R[2*len...4*len-1] = A1 * B1, may overwrite B */
     }
   else if (R + 2 * len != B)
     {
-      r += F_mul (R + 2 * len, A + len, B + len, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R + 2 * len, A + len, B + len, len, DEFAULT, n,
+                     t + 2 * len, gt);
       /* R[2*len...4*len-1] = A1 * B1 */
-      r += F_mul (R, A, B, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R, A, B, len, DEFAULT, n, t + 2 * len, gt);
       /* R[0...2*len-1] = A0 * B0, overwrites A */
     }
   else /* R == A && R + 2*len == B */
@@ -812,9 +817,10 @@ F_karatsuba (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n,
           mpz_set (A[len + i], B[i]);
           mpz_set (B[i], gt);
         }
-      r += F_mul (R, R, R + len, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R, R, R + len, len, DEFAULT, n, t + 2 * len, gt);
       /* R[0...2*len-1] = A0 * B0, overwrites A */
-      r += F_mul (R + 2 * len, R + 2 * len, R + 3 * len, len, DEFAULT, n, t + 2 * len);
+      r += F_mul_gt (R + 2 * len, R + 2 * len, R + 3 * len, len, DEFAULT, n,
+                     t + 2 * len, gt);
       /* R[2*len...4*len-1] = A1 * B1, overwrites B */
     }
 
@@ -849,9 +855,9 @@ F_karatsuba (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, unsigned int n,
    n=2^m
    Return value: number of multiplies performed, or UINT_MAX in case of error.
 */
-unsigned int 
-F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter, 
-       unsigned int n, mpz_t *t)
+static unsigned int 
+F_mul_gt (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter, 
+          unsigned int n, mpz_t *t, mpz_t gt)
 {
   unsigned int i, r=0;
   unsigned int transformlen = (parameter == NOPAD) ? len : 2 * len;
@@ -863,26 +869,20 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
   if (len == 0)
     return 0;
   
-  if (!gt_inited)
-    {
-      mpz_init2 (gt, 2 * n);
-      gt_inited = 1;
-    }
-  
   if (len == 1)
     {
       if (parameter == MONIC) 
         {
           /* (x + a0)(x + b0) = x^2 + (a0 + b0)x + a0*b0 */
           mpz_add (gt, A[0], B[0]);
-          F_mod_gt (t[0], n);
-          F_mulmod (R[0], A[0], B[0], n); /* May overwrite A[0] */
+          F_mod_gt (t[0], n, gt);
+          F_mulmod (R[0], A[0], B[0], n, gt); /* May overwrite A[0] */
           mpz_set (R[1], t[0]); /* May overwrite B[0] */
           /* We don't store the leading 1 monomial in the result poly */
         }
       else
         {
-          F_mulmod (R[0], A[0], B[0], n); /* May overwrite A[0] */
+          F_mulmod (R[0], A[0], B[0], n, gt); /* May overwrite A[0] */
           mpz_set_ui (R[1], 0); /* May overwrite B[0] */
         }
       
@@ -924,18 +924,18 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
     }
   
   mpz_mul (gt, gt, chksum1);
-  F_mod_gt (chksum1, n);
+  F_mod_gt (chksum1, n, gt);
 
   mpz_mul (gt, chksum0, chksum_1);
-  F_mod_gt (chksum_1, n);
+  F_mod_gt (chksum_1, n, gt);
 
   /* Compute A(0) * B(0) */
   mpz_mul (gt, A[0], B[0]);
-  F_mod_gt (chksum0, n);
+  F_mod_gt (chksum0, n, gt);
 
   /* Compute A(inf) * B(inf) */
   mpz_mul (gt, A[len - 1], B[len - 1]);
-  F_mod_gt (chksuminf, n);
+  F_mod_gt (chksuminf, n, gt);
   if (parameter == MONIC)
     {
       mpz_add (chksuminf, chksuminf, A[len - 2]);
@@ -975,7 +975,7 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
           for (; i < transformlen; i++)
             mpz_set_ui (t[i], 0);
 
-          F_fft_dif (t, transformlen, 0, n);
+          F_fft_dif (t, transformlen, 0, n, gt);
         } else
           t = R; /* Do squaring */
 
@@ -987,23 +987,23 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
       for (; i < transformlen; i++)
         mpz_set_ui (R[i], 0); /* May overwrite B[i - len] */
 
-      F_fft_dif (R, transformlen, 0, n);
+      F_fft_dif (R, transformlen, 0, n, gt);
 
       for (i = 0; i < transformlen; i++) 
         {
-          F_mulmod (R[i], R[i], t[i], n);
+          F_mulmod (R[i], R[i], t[i], n, gt);
           /* Do the div-by-length. Transform length was transformlen, 
              len2 = log_2 (transformlen), so divide by 
              2^(len2) = sqrt(2)^(2*len2) */
 
           /* since transformlen = 2^len2 <= 4*n then for n >= 8 we have
              2*len2 <= 2*log2(4*n) < 2n */
-          F_mul_sqrt2exp (R[i], R[i], 4 * n - 2 * len2, n);
+          F_mul_sqrt2exp (R[i], R[i], 4 * n - 2 * len2, n, gt);
         }
 
       r += transformlen;
 
-      F_fft_dit (R, transformlen, 0, n);
+      F_fft_dit (R, transformlen, 0, n, gt);
 
       if (parameter == MONIC)
         mpz_sub_ui (R[0], R[0], 1);
@@ -1018,9 +1018,9 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
         }
       
       if (len / n == 4 || len == 2)
-        r += F_karatsuba (R, A, B, len, n, t);
+        r += F_karatsuba (R, A, B, len, n, t, gt);
       else
-        r += F_toomcook4 (R, A, B, len, n, t);
+        r += F_toomcook4 (R, A, B, len, n, t, gt);
 
       if (parameter == MONIC) /* Handle the leading monomial the hard way */
         {
@@ -1122,9 +1122,9 @@ F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter,
    R[0 ... lenB / 2 - 1] 
    Return value: number of multiplies performed, UINT_MAX in error case. */
 
-unsigned int 
-F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA, 
-             unsigned int lenB, unsigned int n, mpz_t *t)
+static unsigned int 
+F_mul_trans_gt (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA, 
+                unsigned int lenB, unsigned int n, mpz_t *t, mpz_t gt)
 {
   unsigned int i, r = 0, len2;
 
@@ -1134,15 +1134,9 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
   
   ASSERT(lenA == lenB / 2 || lenA == lenB / 2 + 1);
 
-  if (!gt_inited)
-    {
-      mpz_init2 (gt, 2 * n);
-      gt_inited = 1;
-    }
-  
   if (lenB == 2)
     {
-      F_mulmod (R[0], A[0], B[0], n);
+      F_mulmod (R[0], A[0], B[0], n, gt);
       return 1;
     }
 
@@ -1162,7 +1156,7 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
       for (i = 0; i < lenB; i++)
         mpz_set (t[i], B[i]);
 
-      F_fft_dif (t, lenB, 0, n);
+      F_fft_dif (t, lenB, 0, n, gt);
 
       /* Put transform of reversed A into t + lenB */
       for (i = 0; i < lenA; i++) 
@@ -1170,21 +1164,21 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
       for (i = lenA; i < lenB; i++)
         mpz_set_ui (t[i + lenB], 0);
 
-      F_fft_dif (t + lenB, lenB, 0, n);
+      F_fft_dif (t + lenB, lenB, 0, n, gt);
 
       for (i = 0; i < lenB; i++) 
         {
-          F_mulmod (t[i], t[i], t[i + lenB], n);
+          F_mulmod (t[i], t[i], t[i + lenB], n, gt);
           /* Do the div-by-length. Transform length was len, so divide by
              2^len2 = sqrt(2)^(2*len2) */
           /* since len2 = log2(lenB) and lenB <= 4*n, for n >= 8 we have
              2*len2 < 2*n */
-          F_mul_sqrt2exp (t[i], t[i], 4 * n - 2 * len2, n);
+          F_mul_sqrt2exp (t[i], t[i], 4 * n - 2 * len2, n, gt);
         }
 
       r += lenB;
 
-      F_fft_dit (t, lenB, 0, n);
+      F_fft_dit (t, lenB, 0, n, gt);
       
       for (i = 0; i < lenB / 2; i++)
         mpz_set (R[i], t[i + lenA - 1]);
@@ -1217,13 +1211,13 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
         mpz_add (t[i], A[i], A[i + h]);
       if (lenA1 == h + 1)
 	mpz_set (t[h], A[2*h]);
-      r = F_mul_trans (t, t, B + h, lenA1, 2 * h, n, t + lenA1);
+      r = F_mul_trans_gt (t, t, B + h, lenA1, 2 * h, n, t + lenA1, gt);
       /* Uses t[h ... 5h-1] as temp */
 
       /* U */
       for (i = 0; i < 2 * h; i++)
         mpz_sub (t[i + h], B[i], B[h + i]);
-      r += F_mul_trans (t + h, A, t + h, lenA0, 2 * h, n, t + 3 * h);
+      r += F_mul_trans_gt (t + h, A, t + h, lenA0, 2 * h, n, t + 3 * h, gt);
       /* Uses t[3h ... 7h-1] as temp */
       
       for (i = 0; i < h; i++)
@@ -1232,7 +1226,7 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
       /* V */
       for (i = 0; i < 2 * h; i++)
         mpz_sub (t[i + h], B[i + 2 * h], B[i + h]);
-      r += F_mul_trans (t + h, A + h, t + h, lenA1, 2 * h, n, t + 3 * h);
+      r += F_mul_trans_gt (t + h, A + h, t + h, lenA1, 2 * h, n, t + 3 * h, gt);
       /* Uses t[3h ... 7h - 1] as temp */
       
       for (i = 0; i < h; i++)
@@ -1242,9 +1236,30 @@ F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA,
   return r;
 }
 
-void F_clear ()
+unsigned int 
+F_mul (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int len, int parameter, 
+       unsigned int n, mpz_t *t)
+{
+  mpz_t gt;
+  unsigned int r;
+
+  mpz_init2 (gt, 2 * n);
+  r = F_mul_gt (R, A, B, len, parameter, n, t, gt);
+  mpz_clear (gt);
+
+  return r;
+}
+
+unsigned int 
+F_mul_trans (mpz_t *R, mpz_t *A, mpz_t *B, unsigned int lenA, 
+             unsigned int lenB, unsigned int n, mpz_t *t)
 {
-  if (gt_inited)
-    mpz_clear (gt);
-  gt_inited = 0;
+  mpz_t gt;
+  unsigned int r;
+
+  mpz_init2 (gt, 2 * n);
+  r = F_mul_trans_gt (R, A, B, lenA, lenB, n, t, gt);
+  mpz_clear (gt);
+
+  return r;
 }
@@ -30,7 +30,7 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #endif
 #ifdef TESTDRIVE
 #include <stdio.h>
-FILE *ECM_STDOUT, *ECM_STDERR;
+ECM_TLS FILE *ECM_STDOUT, *ECM_STDERR;
 #endif
 
 /*****************************************************************
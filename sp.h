@@ -36,11 +36,11 @@ MA 02110-1301, USA.
 #include <sys/types.h> /* needed for size_t */
 #endif
 
-#ifndef TUNE
-#include "ecm-params.h"
-#else
+#include "ecm-tune.h"
+#ifdef TUNE
 extern size_t NTT_GFP_TWIDDLE_DIF_BREAKOVER;
 extern size_t NTT_GFP_TWIDDLE_DIT_BREAKOVER;
+extern size_t NTT_GFP_BLOCK_BREAKOVER;
 extern size_t MUL_NTT_THRESHOLD;
 extern size_t PREREVERTDIVISION_NTT_THRESHOLD;
 extern size_t POLYINVERT_NTT_THRESHOLD;
@@ -95,6 +95,10 @@ typedef mp_limb_t UDItype;
    and the naive method for fewer moduli. We must have I0_THRESHOLD >= 1. */
 #define I0_THRESHOLD 7
 
+/* mpzspv_to_mpzv uses the product tree for MPZSPV_TO_MPZV_TREE_THRESHOLD
+   moduli or more, below the direct method is faster */
+#define MPZSPV_TO_MPZV_TREE_THRESHOLD 500
+
 /*********
  * TYPES *
  *********/
@@ -134,6 +138,19 @@ typedef uint64_t sp_t;
 #define SP_MIN ((sp_t)1 << (SP_NUMB_BITS - 1))
 #define SP_MAX ((sp_t)(-1) >> (W_TYPE_SIZE - SP_NUMB_BITS))
 
+/* The AVX2 and AVX-512 kernels of ntt_simd.c need a 64-bit sp_t and small
+ * primes of at most W_TYPE_SIZE - 2 bits. Whether they are used is decided
+ * at run time for each small prime, see spm_init() */
+
+#if defined(HAVE_NTT_SIMD) && SP_TYPE_BITS == 64 && \
+    SP_NUMB_BITS <= W_TYPE_SIZE - 2
+#define SP_SIMD
+#endif
+
+#define SP_SIMD_NONE 0
+#define SP_SIMD_AVX2 1
+#define SP_SIMD_AVX512 2
+
 /* vector of residues modulo a common small prime */
 typedef sp_t * spv_t;
 
@@ -143,8 +160,11 @@ typedef unsigned long spv_size_t;
 typedef struct
 {
   spv_t ntt_roots;
+  spv_t ntt_roots3;	/* [i] of order 3 * 2^i, or NULL if 3 does not divide
+			   the length the prime was initialised for */
   spv_size_t twiddle_size;
   spv_t twiddle;
+  spv_t twiddle_shoup;	/* floor(twiddle[i] * 2^SP_TYPE_BITS / sp) */
 } __sp_nttdata;
 
 typedef __sp_nttdata sp_nttdata_t[1];
@@ -172,7 +192,8 @@ typedef struct
   sp_t inv_prim_root;
   sp_nttdata_t nttdata;
   sp_nttdata_t inttdata;
-  spv_t scratch;
+  spv_t scratch;	/* MAX_NTT_BLOCK_SIZE twiddles for the ntt */
+  int simd;		/* SP_SIMD_* kernels used for this prime */
 } __spm_struct;
 
 typedef __spm_struct * spm_t;
@@ -198,12 +219,19 @@ typedef struct
 
     /* product tree to speed up conversion from mpz to sp */
     mpzv_t *T;            /* product tree */
-    mpz_t **buf;          /* mpzspv_from_mpzv_fast buffer, one per thread */
+    mpz_t **buf;          /* buffer of the product tree, one per thread */
     unsigned int d;       /* ceil(log(sp_num)/log(2)) */
+
+    /* threads of mpzspm_run(), see mpzspm_set_threads(), or NULL */
+    struct __mpzspm_pool_struct *pool;
   } __mpzspm_struct;
 
 typedef __mpzspm_struct * mpzspm_t;
 
+/* a task of mpzspm_run(): the work of the given argument for the small
+   prime of the given index */
+typedef void (*mpzspm_task_t) (void *, unsigned int);
+
 /* MPZSPV */
 
 /* sp representation of a mpz polynomial */
@@ -455,6 +483,25 @@ sp_pow (sp_t x, sp_t a, sp_t m, sp_t d)
 /* x / 2 mod m */
 #define sp_div_2(x,m) (((x) & 1) ? (m) - (((m) - (x)) >> 1) : ((x) >> 1))
   
+/* floor(w * 2^SP_TYPE_BITS / m) for 0 <= w < m. With this quotient, w*x mod m
+   needs only the low half of the products by w and m, and one correction
+   (V. Shoup's trick), see ntt_simd.c */
+static inline sp_t
+sp_shoup_quotient (sp_t w, sp_t m)
+{
+#if SP_TYPE_BITS == W_TYPE_SIZE
+  sp_t q;
+  ATTRIBUTE_UNUSED sp_t r;
+
+  /* udiv_qrnnd may need a normalised divisor */
+  udiv_qrnnd (q, r, w << (W_TYPE_SIZE - SP_NUMB_BITS), 0,
+              m << (W_TYPE_SIZE - SP_NUMB_BITS));
+  return q;
+#else
+  return (sp_t) (((uint64_t) w << SP_TYPE_BITS) / m);
+#endif
+}
+
 int sp_prime (sp_t);
 
 /* spm */
@@ -489,12 +536,28 @@ void spv_random (spv_t, spv_size_t, sp_t);
 
 void spv_ntt_gfp_dif (spv_t, spv_size_t, spm_t);
 void spv_ntt_gfp_dit (spv_t, spv_size_t, spm_t);
+void spv_ntt_gfp_dif_len (spv_t, spv_size_t, spm_t);
+void spv_ntt_gfp_dit_len (spv_t, spv_size_t, spm_t);
+
+/* ntt_simd */
+
+int sp_simd_level (void);
+void spv_pwmul_simd (spv_t, spv_t, spv_t, spv_size_t, spm_t);
+void spv_mul_sp_simd (spv_t, spv_t, sp_t, spv_size_t, spm_t);
+#ifdef SP_SIMD
+void spv_bfly_dif_simd (spv_t, spv_t, const sp_t *, const sp_t *,
+    spv_size_t, spm_t);
+void spv_bfly_dit_simd (spv_t, spv_t, const sp_t *, const sp_t *,
+    spv_size_t, spm_t);
+#endif
 
 /* mpzspm */
 
 spv_size_t mpzspm_max_len (mpz_t);
 mpzspm_t mpzspm_init (spv_size_t, mpz_t);
 void mpzspm_clear (mpzspm_t);
+unsigned int mpzspm_set_threads (mpzspm_t, unsigned int);
+void mpzspm_run (mpzspm_t, mpzspm_task_t, void *);
 
 /* mpzspv */
 
@@ -524,6 +587,8 @@ void mpzspv_mul_ntt (mpzspv_t, spv_size_t, mpzspv_t, spv_size_t, spv_size_t,
     mpzspv_t, spv_size_t, spv_size_t, spv_size_t, int, spv_size_t, mpzspm_t, 
     int);
 void mpzspv_random (mpzspv_t, spv_size_t, spv_size_t, mpzspm_t);
+void mpzspv_negacyclic_twist (mpzspv_t, spv_size_t, spv_size_t, mpzspm_t);
+void mpzspv_negacyclic_untwist (mpzspv_t, spv_size_t, spv_size_t, mpzspm_t);
 void mpzspv_to_dct1 (mpzspv_t, mpzspv_t, spv_size_t, spv_size_t, mpzspv_t, 
     mpzspm_t);
 void mpzspv_mul_by_dct (mpzspv_t, const mpzspv_t, spv_size_t, const mpzspm_t, 
@@ -46,16 +46,34 @@ ordpow (const sp_t q, sp_t a, const sp_t sp, const sp_t mul_c)
    If unsuccessful, returns 0 (and frees allocated memory) */
 static int
 nttdata_init (const sp_t sp, const sp_t mul_c, 
-		const sp_t prim_root, const spv_size_t log2_len,
+		const sp_t prim_root, const sp_t root3,
+		const spv_size_t log2_len,
 		sp_nttdata_t data, spv_size_t breakover)
 {
   spv_t r, t;
   spv_size_t i, j, k;
 
+  /* the roots of order 3 * 2^i, for the radix-3 stage of
+     spv_ntt_gfp_dif_len() */
+  data->ntt_roots3 = NULL;
+  if (root3 != 0)
+    {
+      r = data->ntt_roots3 =
+	  (spv_t) sp_aligned_malloc ((log2_len + 1) * sizeof(sp_t));
+      if (r == NULL)
+	return 0;
+      r[log2_len] = root3;
+      for (i = log2_len; i > 0; i--)
+	r[i-1] = sp_sqr (r[i], sp, mul_c);
+    }
+
   r = data->ntt_roots = 
 	  (spv_t) sp_aligned_malloc ((log2_len + 1) * sizeof(sp_t));
   if (r == NULL)
-    return 0;
+    {
+      sp_aligned_free (data->ntt_roots3);
+      return 0;
+    }
 
   i = log2_len;
   r[i] = prim_root;
@@ -67,6 +85,7 @@ nttdata_init (const sp_t sp, const sp_t mul_c,
   if (t == NULL)
     {
       sp_aligned_free (r);
+      sp_aligned_free (data->ntt_roots3);
       return 0;
     }
   data->twiddle_size = 1 << k;
@@ -79,6 +98,19 @@ nttdata_init (const sp_t sp, const sp_t mul_c,
 
       t += j;
     }
+
+  /* the quotients for Shoup's multiplication by the twiddles */
+  t = data->twiddle_shoup = (spv_t) sp_aligned_malloc (sizeof(sp_t) << k);
+  if (t == NULL)
+    {
+      sp_aligned_free (data->twiddle);
+      sp_aligned_free (r);
+      sp_aligned_free (data->ntt_roots3);
+      return 0;
+    }
+  for (j = 0; j + 1 < ((spv_size_t) 1 << k); j++)
+    t[j] = sp_shoup_quotient (data->twiddle[j], sp);
+
   return 1;
 }
 
@@ -86,7 +118,9 @@ static void
 nttdata_clear(sp_nttdata_t data)
 {
   sp_aligned_free(data->ntt_roots);
+  sp_aligned_free(data->ntt_roots3);
   sp_aligned_free(data->twiddle);
+  sp_aligned_free(data->twiddle_shoup);
 }
 
 /* Compute some constants, including a primitive n'th root of unity. 
@@ -106,6 +140,7 @@ spm_init (spv_size_t n, sp_t sp, mp_size_t k)
 
   spm->sp = sp;
   sp_reciprocal (spm->mul_c, sp);
+  spm->simd = sp_simd_level ();
 
   /* compute spm->invm = -1/p mod B where B = 2^GMP_NUMB_BITS */
   a = sp_pow (2, GMP_NUMB_BITS, sp, spm->mul_c); /* a = B mod p */
@@ -215,16 +250,26 @@ spm_init (spv_size_t n, sp_t sp, mp_size_t k)
       ntt_power++;
     }
 
+  /* and the roots for the lengths 3 * 2^k, if 3 divides n */
+  q = n >> ntt_power;
+  if (q % 3 == 0)
+    {
+      a = sp_pow (spm->prim_root, q / 3, sp, spm->mul_c);
+      b = sp_pow (spm->inv_prim_root, q / 3, sp, spm->mul_c);
+    }
+  else
+    a = b = 0;
+
   if (nttdata_init (sp, spm->mul_c, 
                     sp_pow (spm->prim_root, 
                             n >> ntt_power, sp, spm->mul_c),
-                    ntt_power, spm->nttdata, 
+                    a, ntt_power, spm->nttdata, 
                     NTT_GFP_TWIDDLE_DIF_BREAKOVER))
     {
       if (nttdata_init (sp, spm->mul_c, 
                         sp_pow (spm->inv_prim_root, 
                                 n >> ntt_power, sp, spm->mul_c),
-                        ntt_power, spm->inttdata, 
+                        b, ntt_power, spm->inttdata, 
                         NTT_GFP_TWIDDLE_DIT_BREAKOVER))
         {
           spm->scratch = (spv_t) sp_aligned_malloc (MAX_NTT_BLOCK_SIZE *
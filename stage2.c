@@ -24,16 +24,14 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h> /* for floor */
-#include <string.h> /* for strlen */
-
-#ifdef HAVE_UNISTD_H
-#include <unistd.h> /* for unlink */
-#endif
 
 #include "ecm-impl.h"
 #include "sp.h"
 
-extern unsigned int Fermat;
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 
 /* r <- Dickson(n,a)(x) */
 static void 
@@ -221,6 +219,68 @@ init_progression_coeffs (mpz_t i0, const unsigned long d,
   return fd;
 }
 
+
+/* Init a table of differences in two variables for the evaluation of
+
+   Dickson_{E,a} (s + n * D + r * D2)
+
+   For 0 <= l, j < L, puts in coeffs[j * L + l] the finite difference
+   Delta_{D2}^l Delta_D^(E-j) Dickson_{E,a} (s), where
+   Delta_D f(x) = f(x + D) - f(x), or 0 if l > j.
+   The coeffs[j * L] are the L last entries of the table fin_diff_coeff()
+   gives for the progression in n with r = 0. For each j, Delta_D^(E-j)
+   Dickson_{E,a} (s + r * D2) is a polynomial of degree j in r, thus adding
+   coeffs[j * L + l + 1] to coeffs[j * L + l] for all 0 <= l < L - 1 turns
+   these entries for r into the ones for r + 1.
+   Requires 1 <= L <= E + 1.
+
+   Return NULL if an error occurred.
+*/
+
+listz_t
+init_progression_coeffs2 (mpz_t s, mpz_t D, mpz_t D2, const unsigned int E,
+                          const int dickson_a, const unsigned int L)
+{
+  unsigned int j, l, r, E1 = E + 1;
+  listz_t fd, t;
+
+  ASSERT (1 <= L && L <= E1);
+
+  fd = init_list (L * L);
+  t = init_list (L * E1 + 1);
+  if (fd == NULL || t == NULL)
+    {
+      if (fd != NULL)
+        clear_list (fd, L * L);
+      if (t != NULL)
+        clear_list (t, L * E1 + 1);
+      return NULL;
+    }
+
+  /* t[r * E1 + h] = Delta_D^h Dickson_{E,a} (s + r * D2) */
+  mpz_set (t[L * E1], s);
+  for (r = 0; r < L; r++)
+    {
+      fin_diff_coeff (t + r * E1, t[L * E1], D, E, dickson_a);
+      mpz_add (t[L * E1], t[L * E1], D2);
+    }
+
+  /* t[r * E1 + h] = Delta_{D2}^r Delta_D^h Dickson_{E,a} (s) for r <= E-h */
+  for (l = 1; l < L; l++)
+    for (r = L - 1; r >= l; r--)
+      for (j = l; j < L; j++)
+        mpz_sub (t[r * E1 + E - j], t[r * E1 + E - j],
+                 t[(r - 1) * E1 + E - j]);
+
+  for (j = 0; j < L; j++)
+    for (l = 0; l <= j; l++)
+      mpz_set (fd[j * L + l], t[l * E1 + E - j]);
+
+  clear_list (t, L * E1 + 1);
+  return fd;
+}
+
+
 void 
 init_roots_params (progression_params_t *params, const int S, 
 		   const unsigned long d1, const unsigned long d2, 
@@ -276,15 +336,29 @@ init_roots_params (progression_params_t *params, const int S,
   params->rsieve = 1;
 }
 
+/* Non-zero if the products G * H mod F of stage 2 use the Montgomery
+   reduction (see ntt_MontgomeryMulMod), which needs the NTT and dF a
+   power of two */
+static int
+stage2_montgomery (unsigned long dF, int use_ntt, unsigned int Fermat)
+{
+  if (!use_ntt || Fermat != 0 || dF < 2 || (dF & (dF - 1)) != 0)
+    return 0;
+  return dF >= MONTGOMERY_REDUCE_NTT_THRESHOLD;
+}
+
 double 
 memory_use (unsigned long dF, unsigned int sp_num, unsigned int Ftreelvl,
             mpmod_t modulus)
 {
   double mem;
+  int montgomery = stage2_montgomery (dF, sp_num != 0, 0);
   
   /* printf ("memory_use (%lu, %d, %d, )\n", dF, sp_num, Ftreelvl); */
 
   mem = 9.0; /* F:1, T:3*2, invF:1, G:1 */
+  if (montgomery)
+    mem += 1.0; /* -1/F mod (x^dF+1) */
   mem += (double) Ftreelvl;
   mem *= (double) dF;
   mem += 2. * list_mul_mem (dF); /* Also in T */
@@ -302,12 +376,364 @@ memory_use (unsigned long dF, unsigned int sp_num, unsigned int Ftreelvl,
 	 + (MPZSPV_NORMALISE_STRIDE * ((double) sp_num * 
 	 	sizeof (sp_t) + 6.0 * sizeof (sp_t) + sizeof (float)))
 
-	 /* sp_F, sp_invF */
-	 + ((1.0 + 2.0) * dF * sp_num * sizeof (sp_t));
+	 /* sp_F, sp_invF, and sp_ninvF for the Montgomery reduction */
+	 + ((1.0 + 2.0 + montgomery) * dF * sp_num * sizeof (sp_t));
 
   return mem;
 }
 
+/* What the blocks of stage 2 share, read-only */
+typedef struct
+{
+  unsigned long dF;
+  listz_t F;                /* F(x), monic of degree dF */
+  listz_t invF;             /* 1/F(x), see PrerevertDivision */
+  mpzspv_t sp_F, sp_invF;   /* their transforms, if use_ntt */
+  listz_t ninvF;            /* -1/F mod (x^dF+1), see
+                               ntt_MontgomeryMulMod, or NULL if not used */
+  mpzspv_t sp_ninvF;        /* its negacyclic transform, if use_ntt */
+  __mpz_struct *n;          /* the number to factor */
+  int use_ntt;
+  unsigned int ntt_threads; /* for the NTT of each thread of the blocks,
+                               see mpzspm_set_threads() */
+  unsigned int Fermat;
+  int (*stop_asap)(void);
+  FILE *os, *es;            /* ECM_STDOUT and ECM_STDERR of the caller */
+  int verbose;              /* its verbose setting, see set_verbose() */
+} stage2_shared_t;
+
+/* T[0..dF-1] <- G * T[0..dF-1] mod F, where G and T[0..dF-1] have degree
+   < dF. Needs 3dF+list_mul_mem(dF) cells in T.
+   With the Montgomery reduction, T[0..dF-1] <- G * T[0..dF-1] / (x^dF+1)
+   mod F instead: after the k blocks, each G(f_i) is multiplied by
+   (f_i^dF+1)^(1-k), and their product by a power of the resultant of F and
+   x^dF+1, which is invertible modulo n (see PolyInvertNegacyclic), thus
+   the gcd with n does not change.
+   Return ECM_ERROR if an error occurred, ECM_NO_FACTOR_FOUND otherwise. */
+static int
+stage2_mulmod (listz_t T, listz_t G, const stage2_shared_t *S,
+               mpzspm_t mpzspm)
+{
+  unsigned long dF = S->dF;
+  long st;
+
+  if (S->ninvF != NULL)
+    {
+      st = cputime ();
+      ntt_MontgomeryMulMod (T, T, G, S->sp_F, S->sp_ninvF, dF, mpzspm);
+      outputf (OUTPUT_VERBOSE, "Computing G * H / (x^%lu+1) mod F took "
+               "%ldms\n", dF, elltime (st, cputime ()));
+      return ECM_NO_FACTOR_FOUND;
+    }
+
+  /* ------------------------------------------------
+     |   F    |  invF  |    G    |         T        |
+     ------------------------------------------------
+     |  F(x)  | 1/F(x) |G(x)-F(x)|  H(x)  |         |
+     ------------------------------------------------ */
+
+  st = cputime ();
+  /* previous G mod F is in H, with degree < dF, i.e. dF coefficients:
+     requires 3dF-1+list_mul_mem(dF) cells in T */
+  if (S->use_ntt)
+    {
+      ntt_mul (T + dF, G, T, dF, T + 3 * dF, 0, mpzspm);
+      list_mod (T, T + dF, 2 * dF, S->n);
+    }
+  else
+    list_mulmod (T, T + dF, G, T, dF, T + 3 * dF, S->n, S->Fermat);
+
+  outputf (OUTPUT_VERBOSE, "Computing G * H took %ldms\n", 
+           elltime (st, cputime ()));
+
+  if (S->stop_asap != NULL && (*S->stop_asap)())
+    return ECM_NO_FACTOR_FOUND;
+
+  /* ------------------------------------------------
+     |   F    |  invF  |    G    |         T        |
+     ------------------------------------------------
+     |  F(x)  | 1/F(x) |G(x)-F(x)| G * H  |         |
+     ------------------------------------------------ */
+
+  st = cputime ();
+  if (S->use_ntt)
+    ntt_PrerevertDivision (T, S->F, S->invF + 1, S->sp_F, S->sp_invF, dF,
+                           T + 2 * dF, mpzspm);
+  else if (PrerevertDivision (T, S->F, S->invF + 1, dF, T + 2 * dF, S->n,
+                              S->Fermat))
+    return ECM_ERROR;
+          
+  outputf (OUTPUT_VERBOSE, "Reducing  G * H mod F took %ldms\n", 
+           elltime (st, cputime ()));
+
+  return ECM_NO_FACTOR_FOUND;
+}
+
+/* Compute the next dF roots of G from state, and G(x) from its roots in G.
+   If first is non-zero, put G(x) mod F in T[0..dF-1], otherwise multiply
+   T[0..dF-1] by G(x) mod F. Needs 3dF+list_mul_mem(dF) cells in T.
+   Return ECM_FACTOR_FOUND_STEP2 (with the factor in f) or ECM_ERROR,
+   otherwise ECM_NO_FACTOR_FOUND, also if stop_asap() asks to stop. */
+static int
+stage2_block (mpz_t f, listz_t T, listz_t G, int first,
+              const stage2_shared_t *S, ecm_roots_state_t *state,
+              mpmod_t modulus, mpzspm_t mpzspm)
+{
+  unsigned long dF = S->dF;
+  int youpi;
+  long st;
+
+  youpi = ecm_rootsG (f, G, dF, state, modulus);
+
+  if (test_verbose (OUTPUT_TRACE))
+    {
+      unsigned long j;
+      for (j = 0; j < dF; j++)
+        outputf (OUTPUT_TRACE, "g_%lu = %Zd\n", j, G[j]);
+    }
+
+  ASSERT(youpi != ECM_ERROR); /* xxx_rootsG cannot fail */
+  if (youpi) /* factor found */
+    return ECM_FACTOR_FOUND_STEP2;
+
+  if (S->stop_asap != NULL && (*S->stop_asap)())
+    return ECM_NO_FACTOR_FOUND;
+
+  /* -----------------------------------------------
+     |   F    |  invF  |   G    |         T        |
+     -----------------------------------------------
+     |  F(x)  | 1/F(x) | rootsG |      ???         |
+     ----------------------------------------------- */
+
+  st = cputime ();
+
+  if (S->use_ntt)
+    ntt_PolyFromRoots (G, G, dF, T + dF, mpzspm);
+  else
+    PolyFromRoots (G, G, dF, T + dF, S->n, S->Fermat);
+
+  if (test_verbose (OUTPUT_TRACE))
+    {
+      unsigned long j;
+      outputf (OUTPUT_TRACE, "G(x) = x^%lu ", dF);
+      for (j = 0; j < dF; j++)
+        outputf (OUTPUT_TRACE, "+ (%Zd * x^%lu)", G[j], j);
+      outputf (OUTPUT_TRACE, "\n");
+    }
+
+  /* needs 2*dF+list_mul_mem(dF/2) cells in T */
+  outputf (OUTPUT_VERBOSE, "Building G from its roots took %ldms\n", 
+           elltime (st, cputime ()));
+
+  if (S->stop_asap != NULL && (*S->stop_asap)())
+    return ECM_NO_FACTOR_FOUND;
+
+  if (first)
+    {
+      list_sub (T, G, S->F, dF); /* coefficients 1 of degree cancel,
+                                    thus T is of degree < dF */
+      list_mod (T, T, dF, S->n);
+      return ECM_NO_FACTOR_FOUND;
+    }
+
+  /* since F and G are monic of same degree, G mod F = G - F */
+  list_sub (G, G, S->F, dF);
+  list_mod (G, G, dF, S->n);
+
+  return stage2_mulmod (T, G, S, mpzspm);
+}
+
+#ifdef HAVE_PTHREAD
+/* A thread of stage 2: it handles the blocks first, ..., first+blocks-1
+   of roots of G, and leaves the product of their G(x) mod F in T[0..dF-1].
+   mpmod_t and the NTT tables hold scratch space, thus each thread uses its
+   own copies. */
+typedef struct
+{
+  pthread_t tid;
+  const stage2_shared_t *S;
+  curve *X;
+  __mpmod_struct *modulus;
+  root_params_t *root_params;
+  mpzspm_t mpzspm;          /* NULL: make our own, if use_ntt */
+  unsigned long first, blocks;
+  listz_t T;
+  volatile int *stop;       /* set when a thread finds a factor */
+  mpz_t f;
+  int youpi;
+} stage2_thread_t;
+
+static void *
+stage2_thread (void *arg)
+{
+  stage2_thread_t *w = (stage2_thread_t *) arg;
+  const stage2_shared_t *S = w->S;
+  unsigned long dF = S->dF, i, r, phid2;
+  mpmod_t modulus;
+  curve X;
+  root_params_t root_params;
+  mpzspm_t mpzspm = w->mpzspm;
+  ecm_roots_state_t *state;
+  listz_t G;
+
+  /* the output settings are thread-local, see outputf() */
+  set_verbose (S->verbose);
+  ECM_STDOUT = S->os;
+  ECM_STDERR = S->es;
+
+  mpmod_init_set (modulus, w->modulus);
+  mpres_init (X.x, modulus);
+  mpres_init (X.y, modulus);
+  mpres_init (X.A, modulus);
+  mpres_set (X.x, w->X->x, modulus);
+  mpres_set (X.y, w->X->y, modulus);
+  mpres_set (X.A, w->X->A, modulus);
+  X.disc = 0;
+
+  /* The roots of G are Dickson_{S,a}(d1 * i) for the i >= i0 coprime to
+     d2, in increasing order, whatever the number of progressions used by
+     ecm_rootsG_init(). We start at the root r = first*dF, i.e. with i0
+     increased by r/eulerphi(d2) times d2 and the r mod eulerphi(d2) first
+     progressions skipped. */
+  root_params = *(w->root_params);
+  phid2 = eulerphi (root_params.d2);
+  r = w->first * dF;
+  mpz_init (root_params.i0);
+  mpz_set_ui (root_params.i0, r / phid2);
+  mpz_mul_ui (root_params.i0, root_params.i0, root_params.d2);
+  mpz_add (root_params.i0, root_params.i0, w->root_params->i0);
+
+  if (S->use_ntt && mpzspm == NULL)
+    {
+      /* the same primes as the ones of sp_F and sp_invF */
+      mpzspm = mpzspm_init (2 * dF, modulus->orig_modulus);
+      ASSERT_ALWAYS(mpzspm != NULL);
+      mpzspm_set_threads (mpzspm, S->ntt_threads);
+    }
+
+  G = init_list2 (dF, mpz_sizeinbase (modulus->orig_modulus, 2) + 
+                      3 * GMP_NUMB_BITS);
+  ASSERT_ALWAYS(G != NULL);
+
+  state = ecm_rootsG_init (w->f, &X, &root_params, dF, w->blocks, modulus);
+  if (state == NULL)
+    {
+      /* ecm: f = -1 if an error occurred */
+      w->youpi = (mpz_cmp_si (w->f, -1)) ? ECM_FACTOR_FOUND_STEP2 : ECM_ERROR;
+      *(w->stop) = 1;
+    }
+  else
+    {
+      ASSERT(r % phid2 < state->params.nr);
+      state->params.next = r % phid2;
+      for (i = 0; i < w->blocks; i++)
+        {
+          w->youpi = stage2_block (w->f, w->T, G, i == 0, S, state, modulus,
+                                   mpzspm);
+          if (w->youpi != ECM_NO_FACTOR_FOUND)
+            *(w->stop) = 1;
+          if (*(w->stop) || (S->stop_asap != NULL && (*S->stop_asap)()))
+            break;
+        }
+      ecm_rootsG_clear (state, modulus);
+    }
+
+  clear_list (G, dF);
+  if (mpzspm != w->mpzspm)
+    mpzspm_clear (mpzspm);
+  mpz_clear (root_params.i0);
+  mpres_clear (X.x, modulus);
+  mpres_clear (X.y, modulus);
+  mpres_clear (X.A, modulus);
+  mpmod_clear (modulus);
+
+  return NULL;
+}
+
+/* Put in T[0..dF-1] the product of G(x) mod F over the k blocks of roots
+   of G, with nthreads threads that each handle consecutive blocks. The
+   calling thread is one of them, and T (of sizeT cells) is its buffer.
+   Return as stage2(). */
+static int
+stage2_threaded (mpz_t f, listz_t T, unsigned long sizeT, unsigned long k,
+                 unsigned int nthreads, const stage2_shared_t *S, curve *X,
+                 root_params_t *root_params, mpmod_t modulus,
+                 mpzspm_t mpzspm)
+{
+  stage2_thread_t *W;
+  int *started;
+  volatile int stop = 0;
+  unsigned int i;
+  int youpi = ECM_NO_FACTOR_FOUND;
+  long st;
+
+  W = (stage2_thread_t *) malloc (nthreads * sizeof (stage2_thread_t));
+  ASSERT_ALWAYS(W != NULL);
+  started = (int *) malloc (nthreads * sizeof (int));
+  ASSERT_ALWAYS(started != NULL);
+  for (i = 0; i < nthreads; i++)
+    {
+      W[i].S = S;
+      W[i].X = X;
+      W[i].modulus = modulus;
+      W[i].root_params = root_params;
+      W[i].mpzspm = (i == 0) ? mpzspm : NULL;
+      W[i].first = k * i / nthreads;
+      W[i].blocks = k * (i + 1) / nthreads - W[i].first;
+      if (i == 0)
+        W[i].T = T;
+      else
+        {
+          W[i].T = init_list2 (sizeT, 2 * mpz_sizeinbase (modulus->orig_modulus,
+                               2) + 3 * GMP_NUMB_BITS);
+          ASSERT_ALWAYS(W[i].T != NULL);
+        }
+      W[i].stop = &stop;
+      mpz_init (W[i].f);
+      W[i].youpi = ECM_NO_FACTOR_FOUND;
+    }
+
+  for (i = 1; i < nthreads; i++)
+    started[i] = pthread_create (&W[i].tid, NULL, stage2_thread,
+                                 (void *) (W + i)) == 0;
+  stage2_thread ((void *) W);
+  /* if a thread could not be created, do its blocks here */
+  for (i = 1; i < nthreads; i++)
+    if (started[i])
+      pthread_join (W[i].tid, NULL);
+    else
+      stage2_thread ((void *) (W + i));
+
+  for (i = 0; i < nthreads && youpi == ECM_NO_FACTOR_FOUND; i++)
+    if (W[i].youpi != ECM_NO_FACTOR_FOUND)
+      {
+        youpi = W[i].youpi;
+        mpz_set (f, W[i].f);
+      }
+
+  if (youpi == ECM_NO_FACTOR_FOUND
+      && (S->stop_asap == NULL || !(*S->stop_asap)()))
+    {
+      st = cputime ();
+      for (i = 1; i < nthreads && youpi == ECM_NO_FACTOR_FOUND; i++)
+        youpi = stage2_mulmod (T, W[i].T, S, mpzspm);
+      outputf (OUTPUT_VERBOSE, "Combining the products of %u threads took "
+               "%ldms\n", nthreads, elltime (st, cputime ()));
+    }
+
+  for (i = 0; i < nthreads; i++)
+    {
+      if (i > 0)
+        clear_list (W[i].T, sizeT);
+      mpz_clear (W[i].f);
+    }
+  free (started);
+  free (W);
+
+  return youpi;
+}
+#endif
+
 /* Input:  X is the point at end of stage 1
            n is the number to factor
            B2min-B2 is the stage 2 range (we consider B2min is done)
@@ -319,6 +745,10 @@ memory_use (unsigned long dF, unsigned int sp_num, unsigned int Ftreelvl,
                page 257: using x^(i^e)+1/x^(i^e) instead of x^(i^(2e))
                reduces the cost of Brent-Suyama's extension from 2*e
                to e+3 multiplications per value of i.
+           nthreads is the number of threads among which the k blocks
+           are shared (1 without POSIX threads). If there are fewer
+           blocks than threads, the threads of each block share the
+           small primes of its NTT.
    Output: f is the factor found
    Return value: 2 (step number) iff a factor was found,
                  or ECM_ERROR if an error occurred.
@@ -326,27 +756,30 @@ memory_use (unsigned long dF, unsigned int sp_num, unsigned int Ftreelvl,
 int
 stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k, 
         root_params_t *root_params, int use_ntt, char *TreeFilename, 
-        int (*stop_asap)(void))
+        unsigned int nthreads, int (*stop_asap)(void))
 {
   unsigned long i, sizeT;
   mpz_t n;
-  listz_t F, G, H, T;
+  listz_t F, G = NULL, T;
   int youpi = ECM_NO_FACTOR_FOUND;
   long st, st0;
   void *rootsG_state = NULL;
+  stage2_shared_t S;
   listz_t *Tree = NULL; /* stores the product tree for F */
+  treefile_t TreeFile;  /* or the file which does, with -treefile */
   unsigned int lgk; /* ceil(log(k)/log(2)) */
-  listz_t invF = NULL;
+  listz_t invF = NULL, ninvF = NULL;
   double mem;
   mpzspm_t mpzspm = NULL;
-  mpzspv_t sp_F = NULL, sp_invF = NULL;
+  unsigned int ntt_threads = 1; /* threads of the NTT of each block */
+  mpzspv_t sp_F = NULL, sp_invF = NULL, sp_ninvF = NULL;
+  unsigned int Fermat = 0; /* if non-zero, n divides 2^Fermat+1 */
   
   /* check alloc. size of f */
   mpres_realloc (f, modulus);
 
   st0 = cputime ();
 
-  Fermat = 0;
   if (modulus->repr == ECM_MOD_BASE2 && modulus->Fermat > 0)
     {
       Fermat = modulus->Fermat;
@@ -367,6 +800,20 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
   mem = memory_use (dF, use_ntt ? mpzspm->sp_num : 0,
       (TreeFilename == NULL) ? lgk : 0, modulus);
 
+#ifdef HAVE_PTHREAD
+  if (nthreads > k)
+    {
+      ntt_threads = nthreads / k;
+      nthreads = k;
+    }
+  /* each other thread has its own G, T and NTT tables */
+  if (nthreads > 1)
+    mem += (double) (nthreads - 1) * memory_use (dF, use_ntt ?
+        mpzspm->sp_num : 0, 0, modulus);
+#else
+  nthreads = 1;
+#endif
+
   /* we want at least two significant digits */
   if (mem < 1048576.0)
     outputf (OUTPUT_VERBOSE, "Estimated memory usage: %1.0fKB\n", mem / 1024.);
@@ -377,6 +824,10 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
     outputf (OUTPUT_VERBOSE, "Estimated memory usage: %1.2fGB\n", 
              mem / 1073741824.);
 
+  /* outside of the blocks, all the threads share the small primes */
+  if (use_ntt)
+    mpzspm_set_threads (mpzspm, nthreads * ntt_threads);
+
   F = init_list2 (dF + 1, mpz_sizeinbase (modulus->orig_modulus, 2) + 
                           3 * GMP_NUMB_BITS);
   ASSERT_ALWAYS(F != NULL);
@@ -387,7 +838,6 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
   T = init_list2 (sizeT, 2 * mpz_sizeinbase (modulus->orig_modulus, 2) + 
                          3 * GMP_NUMB_BITS);
   ASSERT_ALWAYS(T != NULL);
-  H = T;
 
   /* needs dF+1 cells in T */
   youpi = ecm_rootsF (f, F, root_params, dF, (curve*) X, modulus);
@@ -436,38 +886,26 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
   st = cputime ();
   if (TreeFilename != NULL)
     {
-      FILE *TreeFile;
-      char *fullname = (char *) malloc (strlen (TreeFilename) + 1 + 2 + 1);
-      int ret;
-      ASSERT_ALWAYS(fullname != NULL);
-      
+      if (treefile_init (TreeFile, TreeFilename, dF, lgk, n) == ECM_ERROR)
+        {
+          youpi = ECM_ERROR;
+          TreeFilename = NULL; /* nothing to clear */
+          goto free_Tree_i;
+        }
+
       for (i = lgk; i > 0; i--)
         {
           if (stop_asap != NULL && (*stop_asap)())
             goto free_Tree_i;
-          sprintf (fullname, "%s.%lu", TreeFilename, i - 1);
-          
-	  TreeFile = fopen (fullname, "wb");
-          if (TreeFile == NULL)
-            {
-              outputf (OUTPUT_ERROR, 
-                       "Error opening file for product tree of F\n");
-              youpi = ECM_ERROR;
-              goto free_Tree_i;
-            }
-	  
-          ret = (use_ntt) ? ntt_PolyFromRoots_Tree (F, F, dF, T, i - 1,
-                                                    mpzspm, NULL, TreeFile)
-            : PolyFromRoots_Tree (F, F, dF, T, i - 1, n, NULL, TreeFile, 0);
-	  if (ret == ECM_ERROR)
+          if ((use_ntt ? ntt_PolyFromRoots_Tree (F, F, dF, T, i - 1, mpzspm,
+                                                 NULL, TreeFile)
+               : PolyFromRoots_Tree (F, F, dF, T, i - 1, n, NULL, TreeFile,
+                                     i - 1, 0, Fermat)) == ECM_ERROR)
 	    {
-              fclose (TreeFile);
               youpi = ECM_ERROR;
               goto free_Tree_i;
             }
-          fclose (TreeFile);
         }
-      free (fullname);
     }
   else
     {
@@ -475,7 +913,7 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
       if (use_ntt)
         ntt_PolyFromRoots_Tree (F, F, dF, T, -1, mpzspm, Tree, NULL);
       else
-	PolyFromRoots_Tree (F, F, dF, T, -1, n, Tree, NULL, 0);
+	PolyFromRoots_Tree (F, F, dF, T, -1, n, Tree, NULL, 0, 0, Fermat);
     }
   
   
@@ -526,7 +964,7 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
 	  mpzspv_to_ntt (sp_invF, 0, dF, 2 * dF, 0, mpzspm);
 	}
       else
-        PolyInvert (invF, F + 1, dF, T, n);
+        PolyInvert (invF, F + 1, dF, T, n, Fermat);
       
       /* now invF[0..dF-1] = Quo(x^(2dF-1), F) */
       outputf (OUTPUT_VERBOSE, "Computing 1/F took %ldms\n",
@@ -542,156 +980,103 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
   if (stop_asap != NULL && (*stop_asap)())
     goto clear_invF;
 
-  /* start computing G with dF roots.
-
-     In the non CM case, roots are at i0*d, (i0+1)*d, (i0+2)*d, ... 
-     where i0*d <= B2min < (i0+1)*d .
-  */
-  G = init_list2 (dF, mpz_sizeinbase (modulus->orig_modulus, 2) + 
-                      3 * GMP_NUMB_BITS);
-  ASSERT_ALWAYS(G != NULL);
-
-  st = cputime ();
-  rootsG_state = ecm_rootsG_init (f, (curve *) X, root_params, dF, k, 
-                                  modulus);
-
-  /* rootsG_state=NULL if an error occurred or (ecm only) a factor was found */
-  if (rootsG_state == NULL)
-    {
-      /* ecm: f = -1 if an error occurred */
-      youpi = (mpz_cmp_si (f, -1)) ? ECM_FACTOR_FOUND_STEP2 : ECM_ERROR;
-      goto clear_G;
-    }
-
-  if (stop_asap != NULL && (*stop_asap)())
-    goto clear_fd;
-
-  for (i = 0; i < k; i++)
+  if (k > 1 && stage2_montgomery (dF, use_ntt, Fermat))
     {
-      /* needs dF+1 cells in T+dF */
-	youpi = ecm_rootsG (f, G, dF, (ecm_roots_state_t *) rootsG_state, 
-			      modulus);
-
-      if (test_verbose (OUTPUT_TRACE))
-	{
-	  unsigned long j;
-	  for (j = 0; j < dF; j++)
-	    outputf (OUTPUT_TRACE, "g_%lu = %Zd\n", j, G[j]);
-	}
-
-      ASSERT(youpi != ECM_ERROR); /* xxx_rootsG cannot fail */
-      if (youpi) /* factor found */
+      st = cputime ();
+      ninvF = init_list2 (dF, mpz_sizeinbase (modulus->orig_modulus, 2) + 
+                              2 * GMP_NUMB_BITS);
+      ASSERT_ALWAYS(ninvF != NULL);
+      if (PolyInvertNegacyclic (ninvF, F, dF, f, n))
         {
-          youpi = ECM_FACTOR_FOUND_STEP2;
-          goto clear_fd;
+          /* very unlikely: F has a root r with r^dF = -1 mod some factor */
+          clear_list (ninvF, dF);
+          ninvF = NULL;
+          if (mpz_cmp (f, n) < 0)
+            {
+              youpi = ECM_FACTOR_FOUND_STEP2;
+              goto clear_invF;
+            }
         }
-
-    if (stop_asap != NULL && (*stop_asap)())
-      goto clear_fd;
-
-  /* -----------------------------------------------
-     |   F    |  invF  |   G    |         T        |
-     -----------------------------------------------
-     |  F(x)  | 1/F(x) | rootsG |      ???         |
-     ----------------------------------------------- */
-
-      st = cputime ();
-
-      if (use_ntt)
-        ntt_PolyFromRoots (G, G, dF, T + dF, mpzspm);
       else
-        PolyFromRoots (G, G, dF, T + dF, n);
-
-      if (test_verbose (OUTPUT_TRACE))
-	{
-	  unsigned long j;
-	  outputf (OUTPUT_TRACE, "G(x) = x^%lu ", dF);
-	  for (j = 0; j < dF; j++)
-	    outputf (OUTPUT_TRACE, "+ (%Zd * x^%lu)", G[j], j);
-	  outputf (OUTPUT_TRACE, "\n");
-	}
+        {
+          sp_ninvF = mpzspv_init (dF, mpzspm);
+          mpzspv_from_mpzv (sp_ninvF, 0, ninvF, dF, mpzspm);
+          mpzspv_negacyclic_twist (sp_ninvF, 0, dF, mpzspm);
+          mpzspv_to_ntt (sp_ninvF, 0, dF, dF, 0, mpzspm);
+          outputf (OUTPUT_VERBOSE, "Computing -1/F mod (x^%lu+1) took "
+                   "%ldms\n", dF, elltime (st, cputime ()));
+        }
+    }
 
-      /* needs 2*dF+list_mul_mem(dF/2) cells in T */
-      outputf (OUTPUT_VERBOSE, "Building G from its roots took %ldms\n", 
-               elltime (st, cputime ()));
+  S.dF = dF;
+  S.F = F;
+  S.invF = invF;
+  S.sp_F = sp_F;
+  S.sp_invF = sp_invF;
+  S.ninvF = ninvF;
+  S.sp_ninvF = sp_ninvF;
+  S.n = n;
+  S.use_ntt = use_ntt;
+  S.ntt_threads = ntt_threads;
+  S.Fermat = Fermat;
+  S.stop_asap = stop_asap;
+  S.os = ECM_STDOUT;
+  S.es = ECM_STDERR;
+  S.verbose = get_verbose ();
+
+#ifdef HAVE_PTHREAD
+  if (nthreads > 1)
+    {
+      outputf (OUTPUT_VERBOSE, "Using %u threads for the %lu blocks of "
+               "stage 2\n", nthreads, k);
+      if (use_ntt)
+        mpzspm_set_threads (mpzspm, ntt_threads);
+      youpi = stage2_threaded (f, T, sizeT, k, nthreads, &S, (curve *) X,
+                               root_params, modulus, mpzspm);
+      if (use_ntt)
+        mpzspm_set_threads (mpzspm, nthreads * ntt_threads);
+      if (youpi != ECM_NO_FACTOR_FOUND)
+        goto clear_fd;
+      if (stop_asap != NULL && (*stop_asap)())
+        goto clear_fd;
+    }
+  else
+#endif
+    {
+      /* start computing G with dF roots.
 
-    if (stop_asap != NULL && (*stop_asap)())
-      goto clear_fd;
+         In the non CM case, roots are at i0*d, (i0+1)*d, (i0+2)*d, ... 
+         where i0*d <= B2min < (i0+1)*d .
+      */
+      G = init_list2 (dF, mpz_sizeinbase (modulus->orig_modulus, 2) + 
+                          3 * GMP_NUMB_BITS);
+      ASSERT_ALWAYS(G != NULL);
 
-  /* -----------------------------------------------
-     |   F    |  invF  |   G    |         T        |
-     -----------------------------------------------
-     |  F(x)  | 1/F(x) |  G(x)  |      ???         |
-     ----------------------------------------------- */
+      rootsG_state = ecm_rootsG_init (f, (curve *) X, root_params, dF, k, 
+                                      modulus);
 
-      if (i == 0)
+      /* rootsG_state=NULL if an error occurred or (ecm only) a factor was
+         found */
+      if (rootsG_state == NULL)
         {
-          list_sub (H, G, F, dF); /* coefficients 1 of degree cancel,
-                                     thus T is of degree < dF */
-          list_mod (H, H, dF, n);
-          /* ------------------------------------------------
-             |   F    |  invF  |    G    |         T        |
-             ------------------------------------------------
-             |  F(x)  | 1/F(x) |  ???    |G(x)-F(x)|  ???   |
-             ------------------------------------------------ */
+          /* ecm: f = -1 if an error occurred */
+          youpi = (mpz_cmp_si (f, -1)) ? ECM_FACTOR_FOUND_STEP2 : ECM_ERROR;
+          goto clear_G;
         }
-      else
-	{
-          /* since F and G are monic of same degree, G mod F = G - F */
-          list_sub (G, G, F, dF);
-          list_mod (G, G, dF, n);
-
-          /* ------------------------------------------------
-             |   F    |  invF  |    G    |         T        |
-             ------------------------------------------------
-             |  F(x)  | 1/F(x) |G(x)-F(x)|  H(x)  |         |
-             ------------------------------------------------ */
-
-	  st = cputime ();
-	  /* previous G mod F is in H, with degree < dF, i.e. dF coefficients:
-	     requires 3dF-1+list_mul_mem(dF) cells in T */
-          if (use_ntt)
-	    {
-	      ntt_mul (T + dF, G, H, dF, T + 3 * dF, 0, mpzspm);
-	      list_mod (H, T + dF, 2 * dF, n);
-	    }
-	  else
-	    list_mulmod (H, T + dF, G, H, dF, T + 3 * dF, n);
 
-          outputf (OUTPUT_VERBOSE, "Computing G * H took %ldms\n", 
-                   elltime (st, cputime ()));
+      if (stop_asap != NULL && (*stop_asap)())
+        goto clear_fd;
 
-          if (stop_asap != NULL && (*stop_asap)())
+      for (i = 0; i < k; i++)
+        {
+          youpi = stage2_block (f, T, G, i == 0, &S,
+                                (ecm_roots_state_t *) rootsG_state, modulus,
+                                mpzspm);
+          if (youpi != ECM_NO_FACTOR_FOUND)
             goto clear_fd;
-
-          /* ------------------------------------------------
-             |   F    |  invF  |    G    |         T        |
-             ------------------------------------------------
-             |  F(x)  | 1/F(x) |G(x)-F(x)| G * H  |         |
-             ------------------------------------------------ */
-
-	  st = cputime ();
-
-          if (use_ntt)
-	    {
-	      ntt_PrerevertDivision (H, F, invF + 1, sp_F, sp_invF, dF,
-		  T + 2 * dF, mpzspm);
-	    }
-	  else
-	    {
-	      if (PrerevertDivision (H, F, invF + 1, dF, T + 2 * dF, n))
-	        {
-	          youpi = ECM_ERROR;
-	          goto clear_fd;
-	        }
-	    }
-          
-	  outputf (OUTPUT_VERBOSE, "Reducing  G * H mod F took %ldms\n", 
-                   elltime (st, cputime ()));
-
           if (stop_asap != NULL && (*stop_asap)())
             goto clear_fd;
-	}
+        }
     }
   
   clear_list (F, dF + 1);
@@ -701,10 +1086,10 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
   st = cputime ();
   if (use_ntt)
     youpi = ntt_polyevalT (T, dF, Tree, T + dF + 1, sp_invF,
-	mpzspm, TreeFilename);
+	mpzspm, (TreeFilename != NULL) ? TreeFile : NULL);
   else
     youpi = polyeval_tellegen (T, dF, Tree, T + dF + 1, sizeT - dF - 1, invF,
-	n, TreeFilename);
+	n, (TreeFilename != NULL) ? TreeFile : NULL, Fermat);
 
   if (youpi)
     {
@@ -735,17 +1120,21 @@ stage2 (mpz_t f, void *X, mpmod_t modulus, unsigned long dF, unsigned long k,
     outputf (OUTPUT_RESVERBOSE, "Product of G(f_i) = %Zd\n", T[0]);
 
 clear_fd:
-  ecm_rootsG_clear ((ecm_roots_state_t *) rootsG_state, modulus);
+  if (rootsG_state != NULL)
+    ecm_rootsG_clear ((ecm_roots_state_t *) rootsG_state, modulus);
 
 clear_G:
   clear_list (G, dF);
 clear_invF:
   clear_list (invF, dF + 1);
+  clear_list (ninvF, dF);
 
   if (use_ntt)
     {
       mpzspv_clear (sp_F, mpzspm);
       mpzspv_clear (sp_invF, mpzspm);
+      if (sp_ninvF != NULL)
+        mpzspv_clear (sp_ninvF, mpzspm);
     }
 free_Tree_i:
   if (Tree != NULL)
@@ -754,7 +1143,8 @@ free_Tree_i:
         clear_list (Tree[i], dF);
       free (Tree);
     }
-  /* the trees are already cleared by ntt_polyevalT or polyeval_tellegen */
+  if (TreeFilename != NULL)
+    treefile_clear (TreeFile);
   mpz_clear (n);
 
 clear_T:
@@ -764,9 +1154,6 @@ clear_T:
   if (use_ntt)
     mpzspm_clear (mpzspm);
   
-  if (Fermat)
-    F_clear ();
-  
 
   if (stop_asap == NULL || !(*stop_asap)())
     {
@@ -0,0 +1,219 @@
+/* test_lanes.c - check the arithmetic on blocks of interleaved residues.
+
+Copyright 2026 the GMP-ECM authors.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Compares every function of lanes.c with the same computation done with
+   mpz_t, for random moduli of 1 to MAXN limbs, including residues close to
+   N. The results do not depend on the implementation (portable or AVX2),
+   thus the same reference is used for both. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ecm-gmp.h"
+#include "ecm-impl.h"
+
+#define MAXN 24
+#define ITER 50
+
+static unsigned long errors = 0;
+
+static void
+check (const char *what, mpz_t ref, const mp_limb_t *r, unsigned int c,
+       mpz_t N, mp_size_t n)
+{
+  mpz_t x;
+
+  mpz_init (x);
+  lane_to_mpz (x, r, c, n);
+  if (mpz_cmp (x, ref) != 0)
+    {
+      gmp_fprintf (stderr, "Error in %s, lane %u, N=%Zd\n"
+                   "expected %Zd\ngot      %Zd\n", what, c, N, ref, x);
+      errors ++;
+    }
+  mpz_clear (x);
+}
+
+static void
+random_residue (mpz_t x, mpz_t N, gmp_randstate_t rng, unsigned long k)
+{
+  /* mostly random values, with some extreme ones */
+  switch (k % 8)
+    {
+    case 0:
+      mpz_set_ui (x, 0);
+      break;
+    case 1:
+      mpz_sub_ui (x, N, 1);
+      break;
+    case 2:
+      mpz_urandomb (x, rng, 32);
+      mpz_sub (x, N, x);
+      if (mpz_sgn (x) < 0)
+        mpz_set_ui (x, 1);
+      break;
+    default:
+      mpz_urandomm (x, rng, N);
+    }
+}
+
+int
+main (void)
+{
+  const unsigned int L = ECM_BATCH_LANES;
+  mp_limb_t *a, *b, *r, *t, m[ECM_BATCH_LANES], invm;
+  mpz_t N, R, Rinv, B, Binv, x[ECM_BATCH_LANES], y[ECM_BATCH_LANES], ref;
+  gmp_randstate_t rng;
+  mp_size_t n;
+  unsigned long k;
+  unsigned int c;
+
+  gmp_randinit_default (rng);
+  gmp_randseed_ui (rng, 17);
+  mpz_init (N);
+  mpz_init (R);
+  mpz_init (Rinv);
+  mpz_init (B);
+  mpz_init (Binv);
+  mpz_init (ref);
+  for (c = 0; c < L; c++)
+    {
+      mpz_init (x[c]);
+      mpz_init (y[c]);
+    }
+  a = malloc (MAXN * L * sizeof (mp_limb_t));
+  b = malloc (MAXN * L * sizeof (mp_limb_t));
+  r = malloc (MAXN * L * sizeof (mp_limb_t));
+  t = malloc ((MAXN + 2) * L * sizeof (mp_limb_t));
+  if (a == NULL || b == NULL || r == NULL || t == NULL)
+    {
+      fprintf (stderr, "Error, cannot allocate memory\n");
+      exit (EXIT_FAILURE);
+    }
+  mpz_setbit (B, GMP_NUMB_BITS);
+
+  for (n = 1; n <= MAXN; n++)
+    for (k = 0; k < ITER; k++)
+      {
+        /* an odd N of exactly n limbs, sometimes with its top bit set */
+        mpz_urandomb (N, rng, n * GMP_NUMB_BITS);
+        mpz_setbit (N, n * GMP_NUMB_BITS - 1 - (k % 2));
+        mpz_setbit (N, 0);
+        mpz_set_ui (R, 0);
+        mpz_setbit (R, n * GMP_NUMB_BITS);
+        mpz_invert (Rinv, R, N);
+        mpz_invert (Binv, B, N);
+        mpz_invert (ref, N, B);
+        invm = -mpz_getlimbn (ref, 0);
+
+        for (c = 0; c < L; c++)
+          {
+            random_residue (x[c], N, rng, k + c);
+            random_residue (y[c], N, rng, k + 3 * c + 1);
+            mpz_to_lane (a, c, x[c], n);
+            mpz_to_lane (b, c, y[c], n);
+            m[c] = mpz_getlimbn (y[c], 0);
+          }
+
+        mulredc_lanes (r, a, b, PTR(N), n, invm, t);
+        for (c = 0; c < L; c++)
+          {
+            mpz_mul (ref, x[c], y[c]);
+            mpz_mul (ref, ref, Rinv);
+            mpz_mod (ref, ref, N);
+            check ("mulredc_lanes", ref, r, c, N, n);
+          }
+
+        sqrredc_lanes (r, a, PTR(N), n, invm, t);
+        for (c = 0; c < L; c++)
+          {
+            mpz_mul (ref, x[c], x[c]);
+            mpz_mul (ref, ref, Rinv);
+            mpz_mod (ref, ref, N);
+            check ("sqrredc_lanes", ref, r, c, N, n);
+          }
+
+        mulredc_1_lanes (r, a, m, PTR(N), n, invm, t);
+        for (c = 0; c < L; c++)
+          {
+            /* m[c] = y[c] mod B */
+            mpz_tdiv_r_2exp (ref, y[c], GMP_NUMB_BITS);
+            mpz_mul (ref, ref, x[c]);
+            mpz_mul (ref, ref, Binv);
+            mpz_mod (ref, ref, N);
+            check ("mulredc_1_lanes", ref, r, c, N, n);
+          }
+
+        addmod_lanes (r, a, b, PTR(N), n, t);
+        for (c = 0; c < L; c++)
+          {
+            mpz_add (ref, x[c], y[c]);
+            mpz_mod (ref, ref, N);
+            check ("addmod_lanes", ref, r, c, N, n);
+          }
+
+        submod_lanes (r, a, b, PTR(N), n);
+        for (c = 0; c < L; c++)
+          {
+            mpz_sub (ref, x[c], y[c]);
+            mpz_mod (ref, ref, N);
+            check ("submod_lanes", ref, r, c, N, n);
+          }
+
+        /* the output may overlap the inputs */
+        mulredc_lanes (a, a, a, PTR(N), n, invm, t);
+        sqrredc_lanes (b, b, PTR(N), n, invm, t);
+        for (c = 0; c < L; c++)
+          {
+            mpz_mul (ref, x[c], x[c]);
+            mpz_mul (ref, ref, Rinv);
+            mpz_mod (ref, ref, N);
+            check ("mulredc_lanes in place", ref, a, c, N, n);
+            mpz_mul (ref, y[c], y[c]);
+            mpz_mul (ref, ref, Rinv);
+            mpz_mod (ref, ref, N);
+            check ("sqrredc_lanes in place", ref, b, c, N, n);
+          }
+      }
+
+  free (a);
+  free (b);
+  free (r);
+  free (t);
+  for (c = 0; c < L; c++)
+    {
+      mpz_clear (x[c]);
+      mpz_clear (y[c]);
+    }
+  mpz_clear (N);
+  mpz_clear (R);
+  mpz_clear (Rinv);
+  mpz_clear (B);
+  mpz_clear (Binv);
+  mpz_clear (ref);
+  gmp_randclear (rng);
+
+  if (errors != 0)
+    {
+      printf ("%lu errors\n", errors);
+      return EXIT_FAILURE;
+    }
+  printf ("Arithmetic on blocks of %u residues is ok for 1 to %d limbs\n",
+          L, MAXN);
+  return 0;
+}
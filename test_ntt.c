@@ -0,0 +1,283 @@
+/* test_ntt.c - check the kernels of ntt_simd.c against the scalar code.
+
+Copyright 2026 the GMP-ECM authors.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* For the small primes of a 100-bit modulus, the kernels of every level the
+   cpu supports are compared with the scalar code (SP_SIMD_NONE) on the same
+   random input, with residues 0 and p-1 now and then: the forward and
+   inverse transforms of every length up to beyond the breakovers, thus
+   with the twiddles from the tables and those computed on the fly, and the
+   pointwise products. The scalar code itself must give back the input times
+   the length after a forward and an inverse transform. Without the kernels
+   (no AVX2, or not x86_64) only the latter is checked. Then the transforms
+   with the column pass of ntt_gfp.c, for several NTT_GFP_BLOCK_BREAKOVER,
+   are compared with those of the radix-2 scalar code. Last, the transforms
+   of length 3*2^k, for the primes of a 3*2^MAX_LOG2_LEN3 max_len, are
+   compared with a naive DFT in the order of spv_ntt_gfp_dif_len() for the
+   small lengths, and must give back the input times the length. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sp.h"
+
+/* beyond the breakovers of all parameter files */
+#define MAX_LOG2_LEN 20
+/* never any column pass */
+#define NO_BLOCK 64
+/* the transforms of length 3*2^k, up to k = MAX_LOG2_LEN3, are compared
+   with the naive DFT up to k = MAX_LOG2_DFT3 */
+#define MAX_LOG2_LEN3 14
+#define MAX_LOG2_DFT3 6
+
+static unsigned long errors = 0;
+static uint64_t seed = 1;
+
+static sp_t
+random_sp (sp_t p)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  switch (seed >> 60)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return p - 1;
+    default:
+      return (sp_t) ((seed >> 2) % p);
+    }
+}
+
+static void
+check (const char *what, int level, spv_size_t len, spv_t r, spv_t ref,
+       spm_t spm)
+{
+  if (memcmp (r, ref, len * sizeof (sp_t)) != 0)
+    {
+      fprintf (stderr, "Error, %s of length %lu modulo %" PRISP
+               " with kernels %d differs from the scalar code\n",
+               what, len, spm->sp, level);
+      errors++;
+    }
+}
+
+static void
+test_spm (spm_t spm, spv_t x, spv_t y, spv_t r, spv_t ref)
+{
+  int level, best = spm->simd;
+  spv_size_t i, len, log2_len;
+  sp_t p = spm->sp;
+
+  for (log2_len = 0; log2_len <= MAX_LOG2_LEN; log2_len++)
+    {
+      len = (spv_size_t) 1 << log2_len;
+      for (i = 0; i < len; i++)
+        {
+          x[i] = random_sp (p);
+          y[i] = random_sp (p);
+        }
+
+      /* the scalar code: dit (dif (x)) = len * x */
+      spm->simd = SP_SIMD_NONE;
+      spv_set (ref, x, len);
+      spv_ntt_gfp_dif (ref, log2_len, spm);
+      spv_ntt_gfp_dit (ref, log2_len, spm);
+      spv_mul_sp (r, x, (sp_t) (len % p), len, p, spm->mul_c);
+      check ("dit (dif (x))", SP_SIMD_NONE, len, ref, r, spm);
+
+      for (level = SP_SIMD_NONE + 1; level <= best; level++)
+        {
+          spm->simd = SP_SIMD_NONE;
+          spv_set (ref, x, len);
+          spv_ntt_gfp_dif (ref, log2_len, spm);
+          spm->simd = level;
+          spv_set (r, x, len);
+          spv_ntt_gfp_dif (r, log2_len, spm);
+          check ("dif", level, len, r, ref, spm);
+
+          spm->simd = SP_SIMD_NONE;
+          spv_set (ref, y, len);
+          spv_ntt_gfp_dit (ref, log2_len, spm);
+          spm->simd = level;
+          spv_set (r, y, len);
+          spv_ntt_gfp_dit (r, log2_len, spm);
+          check ("dit", level, len, r, ref, spm);
+
+          spv_pwmul (ref, x, y, len, p, spm->mul_c);
+          spv_pwmul_simd (r, x, y, len, spm);
+          check ("pwmul", level, len, r, ref, spm);
+
+          spv_mul_sp (ref, x, y[0], len, p, spm->mul_c);
+          spv_mul_sp_simd (r, x, y[0], len, spm);
+          check ("mul_sp", level, len, r, ref, spm);
+        }
+    }
+  spm->simd = best;
+}
+
+static void
+test_block (spm_t spm, spv_t x, spv_t y, spv_t r, spv_t ref)
+{
+  static const size_t breakover[] = {1, 4, 9, 15};
+  size_t old_breakover = NTT_GFP_BLOCK_BREAKOVER;
+  int level, best = spm->simd;
+  spv_size_t i, j, len, log2_len;
+  sp_t p = spm->sp;
+
+  for (log2_len = MAX_LOG2_LEN - 8; log2_len <= MAX_LOG2_LEN; log2_len += 4)
+    {
+      len = (spv_size_t) 1 << log2_len;
+      for (i = 0; i < len; i++)
+        x[i] = random_sp (p);
+
+      /* the references: y = dif (x), ref = dit (x) */
+      NTT_GFP_BLOCK_BREAKOVER = NO_BLOCK;
+      spm->simd = SP_SIMD_NONE;
+      spv_set (y, x, len);
+      spv_ntt_gfp_dif (y, log2_len, spm);
+      spv_set (ref, x, len);
+      spv_ntt_gfp_dit (ref, log2_len, spm);
+
+      for (j = 0; j < sizeof (breakover) / sizeof (breakover[0]); j++)
+        for (level = SP_SIMD_NONE; level <= best; level++)
+          {
+            NTT_GFP_BLOCK_BREAKOVER = breakover[j];
+            spm->simd = level;
+            spv_set (r, x, len);
+            spv_ntt_gfp_dif (r, log2_len, spm);
+            check ("dif with column pass", level, len, r, y, spm);
+            spv_set (r, x, len);
+            spv_ntt_gfp_dit (r, log2_len, spm);
+            check ("dit with column pass", level, len, r, ref, spm);
+          }
+    }
+  NTT_GFP_BLOCK_BREAKOVER = old_breakover;
+  spm->simd = best;
+}
+
+/* the k bits of q in reverse order */
+static spv_size_t
+bitrev (spv_size_t q, spv_size_t k)
+{
+  spv_size_t r = 0;
+
+  for ( ; k > 0; k--, q >>= 1)
+    r = 2 * r + (q & 1);
+  return r;
+}
+
+static void
+test_len3 (spm_t spm, spv_t x, spv_t y, spv_t r, spv_t ref)
+{
+  int level, best = spm->simd;
+  spv_size_t i, j, len, m, log2_m;
+  sp_t p = spm->sp, d = spm->mul_c;
+
+  for (log2_m = 1; log2_m <= MAX_LOG2_LEN3; log2_m++)
+    {
+      m = (spv_size_t) 1 << log2_m;
+      len = 3 * m;
+      for (i = 0; i < len; i++)
+        x[i] = random_sp (p);
+
+      /* the naive DFT: X[3 * bitrev (q) + r] at r * m + q */
+      if (log2_m <= MAX_LOG2_DFT3)
+        {
+          sp_t w = spm->nttdata->ntt_roots3[log2_m];
+
+          for (i = 0; i < len; i++)
+            {
+              spv_size_t f = 3 * bitrev (i % m, log2_m) + i / m;
+              sp_t wf = sp_pow (w, f, p, d), t = 1, s = 0;
+
+              for (j = 0; j < len; j++, t = sp_mul (t, wf, p, d))
+                s = sp_add (s, sp_mul (x[j], t, p, d), p);
+              y[i] = s;
+            }
+        }
+
+      for (level = SP_SIMD_NONE; level <= best; level++)
+        {
+          spm->simd = level;
+          spv_set (r, x, len);
+          spv_ntt_gfp_dif_len (r, len, spm);
+          if (log2_m <= MAX_LOG2_DFT3)
+            check ("dif_len against the DFT", level, len, r, y, spm);
+          spv_ntt_gfp_dit_len (r, len, spm);
+          spv_mul_sp (ref, x, (sp_t) (len % p), len, p, d);
+          check ("dit_len (dif_len (x))", level, len, r, ref, spm);
+        }
+    }
+  spm->simd = best;
+}
+
+int
+main (void)
+{
+  spv_size_t len = (spv_size_t) 1 << MAX_LOG2_LEN;
+  mpzspm_t mpzspm;
+  spv_t x, y, r, ref;
+  unsigned int i;
+  mpz_t n;
+
+  mpz_init (n);
+  mpz_ui_pow_ui (n, 2, 100);
+  mpz_add_ui (n, n, 277);
+  mpzspm = mpzspm_init (len, n);
+  x = (spv_t) malloc (len * sizeof (sp_t));
+  y = (spv_t) malloc (len * sizeof (sp_t));
+  r = (spv_t) malloc (len * sizeof (sp_t));
+  ref = (spv_t) malloc (len * sizeof (sp_t));
+  if (mpzspm == NULL || x == NULL || y == NULL || r == NULL || ref == NULL)
+    {
+      fprintf (stderr, "Error, could not allocate memory\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < mpzspm->sp_num; i++)
+    {
+      test_spm (mpzspm->spm[i], x, y, r, ref);
+      test_block (mpzspm->spm[i], x, y, r, ref);
+    }
+  mpzspm_clear (mpzspm);
+
+  mpzspm = mpzspm_init ((spv_size_t) 3 << MAX_LOG2_LEN3, n);
+  if (mpzspm == NULL)
+    {
+      fprintf (stderr, "Error, could not allocate memory\n");
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < mpzspm->sp_num; i++)
+    test_len3 (mpzspm->spm[i], x, y, r, ref);
+
+  if (errors != 0)
+    {
+      printf ("%lu errors\n", errors);
+      return EXIT_FAILURE;
+    }
+  printf ("%u small primes, kernels up to %d, column pass and lengths "
+          "3*2^k match the scalar code\n", mpzspm->sp_num, sp_simd_level ());
+
+  free (x);
+  free (y);
+  free (r);
+  free (ref);
+  mpzspm_clear (mpzspm);
+  mpz_clear (n);
+  return 0;
+}
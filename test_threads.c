@@ -0,0 +1,217 @@
+/* test_threads.c - check that libecm can be used by several threads at once.
+
+Copyright 2026 the GMP-ECM authors.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* Each test case is a call of ecm_factor() with fixed parameters (sigma,
+   starting point, bounds). The cases are first run in the main thread to get
+   the reference results, then NTHREADS threads run all of them again, in
+   different orders, and every result (return value, factor and residue
+   after stage 1) must match the reference. The cases cover the code with
+   state that used to be global: verbose output, the Schoenhage-Strassen
+   code for Fermat numbers, the rho table for the probabilities, and the
+   batch mode exponent. The last cases are run again with several threads
+   in stage 2 (as with -t2), which share the blocks of ECM and the small
+   primes of the NTT, against the references computed with one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <gmp.h>
+#include "ecm.h"
+
+#define NTHREADS 4
+#define ROUNDS 2
+
+typedef struct
+{
+  int method;
+  int param;        /* for ECM */
+  const char *n;
+  const char *sigma; /* for ECM */
+  const char *x0;    /* for P-1 and P+1 */
+  double B1;
+  const char *B2;
+  int verbose;
+  unsigned int stage2_threads; /* but 1 for the references */
+} test_case_t;
+
+static const test_case_t cases[] =
+{
+  /* factor 30210181 found in stage 2 */
+  {ECM_ECM, ECM_PARAM_SUYAMA, "2050449353925555290706354283", "7", NULL,
+   30, "1000000", 0, 1},
+  /* no factor, with verbose output and probabilities */
+  {ECM_ECM, ECM_PARAM_SUYAMA, "1000000000000000000000000000000000000000000000"
+   "00000000000000000000000000000000000000000000000000000000000000000000021",
+   "17", NULL, 2000, "-1", 2, 1},
+  /* batch mode, all threads share the exponent s */
+  {ECM_ECM, ECM_PARAM_BATCH_32BITS_D, "2050449353925555290706354283", "17",
+   NULL, 11000, "0", 0, 1},
+  /* Fermat number F8: stage 2 uses the Schoenhage-Strassen code */
+  {ECM_ECM, ECM_PARAM_SUYAMA, "11579208923731619542357098500868790785326998466"
+   "5640564039457584007913129639937", "7", NULL, 1000, "-1", 0, 1},
+  /* P-1 with the fast stage 2 */
+  {ECM_PM1, 0, "11579208923731619542357098500868790785326998466"
+   "5640564039457584007913129639937", NULL, "3", 10000, "100000000", 1, 1},
+  /* P+1 */
+  {ECM_PP1, 0, "2050449353925555290706354283", NULL, "7", 1000, "-1", 0, 1},
+  /* ECM with 2 threads for each of the 2 blocks of stage 2 */
+  {ECM_ECM, ECM_PARAM_SUYAMA, "2050449353925555290706354283", "7", NULL,
+   30, "1000000", 0, 4},
+  /* P-1 and P+1 with 3 threads for the NTT of stage 2 */
+  {ECM_PM1, 0, "11579208923731619542357098500868790785326998466"
+   "5640564039457584007913129639937", NULL, "3", 10000, "100000000", 0, 3},
+  {ECM_PP1, 0, "9268761976679399274699775426340986816310780428558896164753938"
+   "90924472263264685984244528031891485349", NULL, "7", 2000, "10000000", 0,
+   3}
+};
+
+#define NCASES (sizeof (cases) / sizeof (cases[0]))
+
+typedef struct
+{
+  int ret;
+  mpz_t f;
+  mpz_t x;
+} result_t;
+
+static result_t reference[NCASES];
+
+static int
+run_case (result_t *r, unsigned int i, FILE *out, unsigned int stage2_threads)
+{
+  const test_case_t *c = cases + i;
+  ecm_params q;
+  mpz_t n;
+
+  ecm_init (q);
+  mpz_init_set_str (n, c->n, 10);
+  q->method = c->method;
+  q->verbose = c->verbose;
+  q->os = out;
+  q->es = out;
+  q->stage2_threads = stage2_threads;
+  gmp_randseed_ui (q->rng, 17);
+  if (c->method == ECM_ECM)
+    {
+      q->param = c->param;
+      mpz_set_str (q->sigma, c->sigma, 10);
+    }
+  else
+    mpz_set_str (q->x, c->x0, 10);
+  mpz_set_str (q->B2, c->B2, 10);
+
+  r->ret = ecm_factor (r->f, n, c->B1, q);
+  mpz_set (r->x, q->x);
+
+  mpz_clear (n);
+  ecm_clear (q);
+  return r->ret;
+}
+
+static void *
+one_thread (void *arg)
+{
+  unsigned long id = (unsigned long) arg, errors = 0;
+  unsigned int k, i;
+  result_t r;
+  FILE *out;
+
+  /* verbose output goes to a file private to this thread */
+  out = tmpfile ();
+  if (out == NULL)
+    {
+      fprintf (stderr, "Error, could not create temporary file\n");
+      exit (EXIT_FAILURE);
+    }
+  mpz_init (r.f);
+  mpz_init (r.x);
+  for (k = 0; k < ROUNDS * NCASES; k++)
+    {
+      /* each thread starts at a different case */
+      i = (k + id) % NCASES;
+      run_case (&r, i, out, cases[i].stage2_threads);
+      if (r.ret != reference[i].ret || mpz_cmp (r.f, reference[i].f) != 0 ||
+          mpz_cmp (r.x, reference[i].x) != 0)
+        {
+          gmp_fprintf (stderr, "Error in thread %lu, case %u: got %d, f=%Zd, "
+                       "expected %d, f=%Zd\n", id, i, r.ret, r.f,
+                       reference[i].ret, reference[i].f);
+          errors ++;
+        }
+    }
+  mpz_clear (r.f);
+  mpz_clear (r.x);
+  fclose (out);
+
+  return (void *) errors;
+}
+
+int
+main (void)
+{
+  pthread_t tid[NTHREADS];
+  unsigned long i, errors = 0;
+  void *e;
+  FILE *out;
+
+  out = tmpfile ();
+  if (out == NULL)
+    {
+      fprintf (stderr, "Error, could not create temporary file\n");
+      exit (EXIT_FAILURE);
+    }
+  for (i = 0; i < NCASES; i++)
+    {
+      mpz_init (reference[i].f);
+      mpz_init (reference[i].x);
+      if (run_case (reference + i, i, out, 1) < 0)
+        {
+          fprintf (stderr, "Error in case %lu\n", i);
+          exit (EXIT_FAILURE);
+        }
+    }
+  fclose (out);
+
+  for (i = 0; i < NTHREADS; i++)
+    if (pthread_create (&tid[i], NULL, one_thread, (void *) i) != 0)
+      {
+        fprintf (stderr, "Error, could not create thread %lu\n", i);
+        exit (EXIT_FAILURE);
+      }
+  for (i = 0; i < NTHREADS; i++)
+    {
+      pthread_join (tid[i], &e);
+      errors += (unsigned long) e;
+    }
+
+  for (i = 0; i < NCASES; i++)
+    {
+      mpz_clear (reference[i].f);
+      mpz_clear (reference[i].x);
+    }
+
+  if (errors != 0)
+    {
+      printf ("%lu errors\n", errors);
+      return EXIT_FAILURE;
+    }
+  printf ("%u threads ran %u test cases, all results match\n", NTHREADS,
+          (unsigned int) (ROUNDS * NCASES));
+  return 0;
+}
@@ -0,0 +1,322 @@
+/* treefile.c - the product tree of F on disk, for -treefile.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* With -treefile, stage 2 does not keep the levels of the product tree of F
+   in memory: stage2() writes them to a file while it builds F, and
+   polyeval_tellegen() or ntt_polyevalT() read them back one at a time.
+
+   All levels go to a single file, each coefficient as the limbs of a
+   residue modulo N, padded with zeros to the size of N. Coefficient j of
+   level i thus has a fixed place, the same as Tree[i][j] when the tree is
+   in memory. The file is mapped into memory, and the coefficients of the
+   level in use are read-only mpz_t's pointing into the mapping: reading a
+   level neither converts the coefficients nor makes a system call for each
+   of them, and the kernel reads ahead what is not yet in memory.
+
+   The levels are stored from the last one to the first one, since they are
+   read from the first to the last: once a level has been used, it is cut
+   off the end of the file, and the disk space is given back level by level
+   like it was when each level had its own file.
+
+   Without mmap(), the level in use is read into a buffer with a single
+   fread(), and without mpz_roinit_n() (GMP before 6.0) its coefficients
+   are copied into ordinary mpz_t's. */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for unlink, ftruncate, write, sysconf */
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && defined(HAVE_FTRUNCATE)
+#define TREEFILE_MMAP
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#include "ecm-impl.h"
+#include "ecm-gmp.h"
+
+/* offset in limbs of coefficient j of level i */
+static uint64_t
+treefile_offset (treefile_t T, unsigned int i, unsigned long j)
+{
+  return ((uint64_t) (T->levels - 1 - i) * T->len + j) * T->width;
+}
+
+#ifdef TREEFILE_MMAP
+/* Give the file descriptor fd a size of size bytes, with the disk space
+   allocated: a write through the mapping into a hole of a sparse file
+   raises SIGBUS when the disk is full. Return 0 on success. */
+static int
+treefile_reserve (int fd, uint64_t size)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+  if (size == 0)
+    return 0;
+  return posix_fallocate (fd, 0, (off_t) size);
+#else
+  static const char zero[4096];
+  uint64_t done;
+  ssize_t w;
+
+  for (done = 0; done < size; done += (uint64_t) w)
+    {
+      size_t n = (size - done < sizeof (zero)) ? (size_t) (size - done)
+                                               : sizeof (zero);
+      w = write (fd, zero, n);
+      if (w <= 0)
+        return -1;
+    }
+  return 0;
+#endif
+}
+#endif
+
+/* Create the file for a tree with the given number of levels of len
+   coefficients, which are residues modulo n.
+   Return 0 on success, ECM_ERROR on error. */
+int
+treefile_init (treefile_t T, const char *filename, unsigned long len,
+               unsigned int levels, mpz_t n)
+{
+#ifdef TREEFILE_MMAP
+  uint64_t size;
+#endif
+
+  T->width = mpz_size (n);
+  T->len = len;
+  T->levels = levels;
+  T->fd = -1;
+  T->file = NULL;
+  T->data = NULL;
+  T->view = NULL;
+  T->tree = NULL;
+
+  T->filename = (char *) malloc (strlen (filename) + 1);
+  if (T->filename == NULL)
+    return ECM_ERROR;
+  strcpy (T->filename, filename);
+  mpz_init_set (T->modulus, n);
+  mpz_init (T->t);
+
+  T->tree = (listz_t *) calloc (levels + 1, sizeof (listz_t));
+#ifdef HAVE___GMPZ_ROINIT_N
+  T->view = (listz_t) malloc ((len + 1) * sizeof (mpz_t));
+#else
+  T->view = init_list2 (len, mpz_sizeinbase (n, 2));
+#endif
+  if (T->tree == NULL || T->view == NULL)
+    goto error;
+
+#ifdef TREEFILE_MMAP
+  size = treefile_offset (T, 0, len) * sizeof (mp_limb_t);
+  if (size != (uint64_t) (size_t) size || size != (uint64_t) (off_t) size)
+    {
+      outputf (OUTPUT_ERROR, "Product tree of F too large for file %s\n",
+               filename);
+      goto error;
+    }
+  T->fd = open (filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (T->fd < 0)
+    goto error_open;
+  if (treefile_reserve (T->fd, size) != 0)
+    goto error_open;
+  if (size > 0)
+    {
+      T->data = (mp_limb_t *) mmap (NULL, (size_t) size,
+                                    PROT_READ | PROT_WRITE, MAP_SHARED,
+                                    T->fd, 0);
+      if (T->data == (mp_limb_t *) MAP_FAILED)
+        {
+          T->data = NULL;
+          goto error_open;
+        }
+#ifdef HAVE_MADVISE
+      madvise (T->data, (size_t) size, MADV_SEQUENTIAL);
+#endif
+    }
+#else
+  T->file = fopen (filename, "wb+");
+  if (T->file == NULL)
+    goto error_open;
+  T->data = (mp_limb_t *) malloc ((len * T->width + 1) * sizeof (mp_limb_t));
+  if (T->data == NULL)
+    goto error;
+#endif
+
+  return 0;
+
+error_open:
+  outputf (OUTPUT_ERROR, "Error opening file %s for product tree of F\n",
+           filename);
+error:
+  treefile_clear (T);
+  return ECM_ERROR;
+}
+
+/* Put the residue a, reduced modulo N if needed, at r. */
+static void
+treefile_put (treefile_t T, mp_limb_t *r, mpz_t a)
+{
+  mpz_srcptr b = a;
+  size_t s;
+
+  if (mpz_sgn (a) < 0 || mpz_size (a) > T->width)
+    {
+      mpz_mod (T->t, a, T->modulus);
+      b = T->t;
+    }
+  s = mpz_size (b);
+  MPN_COPY (r, PTR(b), s);
+  MPN_ZERO (r + s, T->width - s);
+}
+
+/* Write a[0..n-1] as the coefficients pos..pos+n-1 of the given level.
+   Return 0 on success, ECM_ERROR on error. */
+int
+treefile_write (treefile_t T, unsigned int level, unsigned long pos,
+                listz_t a, unsigned long n)
+{
+  mp_limb_t *r;
+  unsigned long j;
+
+  ASSERT (level < T->levels && pos + n <= T->len);
+
+#ifdef TREEFILE_MMAP
+  r = T->data + treefile_offset (T, level, pos);
+#else
+  r = T->data;
+#endif
+  for (j = 0; j < n; j++)
+    treefile_put (T, r + j * T->width, a[j]);
+
+#ifndef TREEFILE_MMAP
+  if (aux_fseek64 (T->file, (int64_t) (treefile_offset (T, level, pos)
+                                       * sizeof (mp_limb_t)), SEEK_SET) != 0
+      || fwrite (r, sizeof (mp_limb_t), n * T->width, T->file)
+         != n * T->width)
+    {
+      outputf (OUTPUT_ERROR, "Error writing product tree of F\n");
+      return ECM_ERROR;
+    }
+#endif
+
+  return 0;
+}
+
+/* Make the given level the one in use: the levels before it, which must
+   have been used already, are dropped. Return an array Tree of levels
+   pointers, of which only Tree[level] is set, and which may be used like
+   the product tree in memory, or NULL on error. */
+listz_t *
+treefile_level (treefile_t T, unsigned int level)
+{
+  mp_limb_t *p;
+  size_t bytes = T->len * T->width * sizeof (mp_limb_t);
+  unsigned long j;
+
+  ASSERT (level < T->levels);
+
+  if (level > 0)
+    T->tree[level - 1] = NULL;
+
+#ifdef TREEFILE_MMAP
+  p = T->data + treefile_offset (T, level, 0);
+  if (level > 0 && ftruncate (T->fd, (off_t) (treefile_offset (T, level,
+                                 T->len) * sizeof (mp_limb_t))) != 0)
+    {
+      outputf (OUTPUT_ERROR, "Error truncating file %s\n", T->filename);
+      return NULL;
+    }
+#if defined(HAVE_MADVISE) && defined(_SC_PAGESIZE)
+  {
+    /* ask the kernel to start reading the whole level */
+    size_t skip = (size_t) treefile_offset (T, level, 0) * sizeof (mp_limb_t)
+                  % (size_t) sysconf (_SC_PAGESIZE);
+    madvise ((char *) p - skip, bytes + skip, MADV_WILLNEED);
+  }
+#endif
+#else
+  p = T->data;
+  if (aux_fseek64 (T->file, (int64_t) (treefile_offset (T, level, 0)
+                                       * sizeof (mp_limb_t)), SEEK_SET) != 0
+      || fread (p, 1, bytes, T->file) != bytes)
+    {
+      outputf (OUTPUT_ERROR, "Error reading product tree of F\n");
+      return NULL;
+    }
+#endif
+
+  for (j = 0; j < T->len; j++, p += T->width)
+    {
+#ifdef HAVE___GMPZ_ROINIT_N
+      mpz_roinit_n (T->view[j], p, T->width);
+#else
+      mp_size_t s = T->width;
+
+      MPZ_REALLOC (T->view[j], s);
+      MPN_COPY (PTR(T->view[j]), p, s);
+      MPN_NORMALIZE (p, s);
+      SIZ(T->view[j]) = s;
+#endif
+    }
+
+  T->tree[level] = T->view;
+  return T->tree;
+}
+
+/* Free the memory used by T, and delete its file. */
+void
+treefile_clear (treefile_t T)
+{
+#ifdef HAVE___GMPZ_ROINIT_N
+  free (T->view);
+#else
+  if (T->view != NULL)
+    clear_list (T->view, T->len);
+#endif
+  free (T->tree);
+#ifdef TREEFILE_MMAP
+  if (T->data != NULL)
+    munmap (T->data, (size_t) (treefile_offset (T, 0, T->len)
+                               * sizeof (mp_limb_t)));
+  if (T->fd >= 0)
+    {
+      close (T->fd);
+      unlink (T->filename);
+    }
+#else
+  free (T->data);
+  if (T->file != NULL)
+    {
+      fclose (T->file);
+      unlink (T->filename);
+    }
+#endif
+  mpz_clear (T->modulus);
+  mpz_clear (T->t);
+  free (T->filename);
+}
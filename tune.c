@@ -20,14 +20,22 @@ http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ecm-gmp.h"
 #include "ecm-impl.h"
 
 /* 250ms, we (probably) don't need any more precision */
 #define GRANULARITY 250
 #define MAX_LOG2_LEN 18 /* 2 * 131072 */
+/* with -quick */
+#define QUICK_GRANULARITY 20
+#define QUICK_MAX_LOG2_LEN 15
 #define MAX_LEN (1U << max_log2_len)
 #define MAX_LOG2_MPZSPV_NORMALISE_STRIDE (MIN (12, max_log2_len))
+/* the length of the transforms for NTT_GFP_BLOCK_BREAKOVER, which must not
+   fit in the L2 cache */
+#define BLOCK_LOG2_LEN 22
+#define QUICK_BLOCK_LOG2_LEN 20
 /* we currently optimize GMP-ECM for a 200-digit number */
 #define M_str "29799904256775982671863388319999573561548825027149399972531599612392671227006866151136667908641695103422986028076864929902803267437351318167549013218980573566942647077444419419003164546362008247462049"
 
@@ -44,7 +52,7 @@ double x (size_t n)                          \
       __st = cputime ();                     \
       for (__i = 0; __i < __k; __i++) { x; } \
       __k *= 2;                              \
-    } while (ELAPSED < GRANULARITY);         \
+    } while (ELAPSED < granularity);         \
     __k /= 2;                                \
     __st = ELAPSED;                          \
   } while (0)
@@ -75,14 +83,23 @@ spv_t spv;
 mpzspv_t mpzspv;
 int tune_verbose;
 int max_log2_len = MAX_LOG2_LEN;
+int block_log2_len = BLOCK_LOG2_LEN;
+spm_t block_spm;
+spv_t block_spv;
 int min_log2_len = 3;
+int granularity = GRANULARITY;
+/* with -quick and a profile with a section for this machine, the
+   parameters are only searched near their previous values */
+int incremental = 0;
 
 size_t MPZMOD_THRESHOLD;
 size_t REDC_THRESHOLD;
 size_t NTT_GFP_TWIDDLE_DIF_BREAKOVER = MAX_LOG2_LEN;
 size_t NTT_GFP_TWIDDLE_DIT_BREAKOVER = MAX_LOG2_LEN;
+size_t NTT_GFP_BLOCK_BREAKOVER = MAX_LOG2_LEN;
 size_t MUL_NTT_THRESHOLD;
 size_t PREREVERTDIVISION_NTT_THRESHOLD;
+size_t MONTGOMERY_REDUCE_NTT_THRESHOLD;
 size_t POLYINVERT_NTT_THRESHOLD;
 size_t POLYEVALT_NTT_THRESHOLD;
 size_t MPZSPV_NORMALISE_STRIDE = 256;
@@ -147,7 +164,6 @@ tune_mpres_mul (mp_size_t limbs, int repr)
   return (double) __k / (double) __st;
 }
 
-#if 0
 double
 tune_mpres_sqr (mp_size_t limbs, int repr)
 {
@@ -194,7 +210,6 @@ tune_mpres_sqr (mp_size_t limbs, int repr)
 
   return (double) __k / (double) __st;
 }
-#endif
 
 double
 tune_mpres_mul_mpz (size_t n)
@@ -226,6 +241,13 @@ TUNE_FUNC_START (tune_spv_ntt_gfp_dit)
 TUNE_FUNC_END (tune_spv_ntt_gfp_dit_recursive)
 
 
+TUNE_FUNC_START (tune_spv_ntt_gfp_block)
+  NTT_GFP_BLOCK_BREAKOVER = n;
+  TUNE_FUNC_LOOP (spv_ntt_gfp_dif (block_spv, block_log2_len, block_spm);
+                  spv_ntt_gfp_dit (block_spv, block_log2_len, block_spm));
+TUNE_FUNC_END (tune_spv_ntt_gfp_block)
+
+
 TUNE_FUNC_START (tune_ntt_mul)
   MUL_NTT_THRESHOLD = 0;
 
@@ -234,7 +256,7 @@ TUNE_FUNC_END (tune_ntt_mul)
 
 
 TUNE_FUNC_START (tune_list_mul)
-  TUNE_FUNC_LOOP (list_mul (z, x, 1 << n, y, 1 << n, 1, t));
+  TUNE_FUNC_LOOP (list_mul (z, x, 1 << n, y, 1 << n, 1, t, 0));
 TUNE_FUNC_END (tune_list_mul)
 
 
@@ -247,10 +269,24 @@ TUNE_FUNC_END (tune_ntt_PrerevertDivision)
 
 
 TUNE_FUNC_START (tune_PrerevertDivision)
-  TUNE_FUNC_LOOP (PrerevertDivision (z, x, y, 1 << n, t, mpzspm->modulus));
+  TUNE_FUNC_LOOP (PrerevertDivision (z, x, y, 1 << n, t, mpzspm->modulus, 0));
 TUNE_FUNC_END (tune_PrerevertDivision)
 
 
+/* the product and reduction G * H mod F of stage 2, with the NTT code */
+TUNE_FUNC_START (tune_ntt_mulmod)
+  TUNE_FUNC_LOOP (ntt_mul (z, x, y, 1 << n, NULL, 0, mpzspm);
+    list_mod (z, z, 2 << n, mpzspm->modulus);
+    ntt_PrerevertDivision (z, x, y, mpzspv, mpzspv, 1 << n, t, mpzspm));
+TUNE_FUNC_END (tune_ntt_mulmod)
+
+
+TUNE_FUNC_START (tune_ntt_MontgomeryMulMod)
+  TUNE_FUNC_LOOP (ntt_MontgomeryMulMod (z, x, y, mpzspv, mpzspv, 1 << n,
+    mpzspm));
+TUNE_FUNC_END (tune_ntt_MontgomeryMulMod)
+
+
 TUNE_FUNC_START (tune_ntt_PolyInvert)
   POLYINVERT_NTT_THRESHOLD = 1 << n;
   
@@ -260,7 +296,7 @@ TUNE_FUNC_END (tune_ntt_PolyInvert)
 
 TUNE_FUNC_START (tune_PolyInvert)
   
-  TUNE_FUNC_LOOP (PolyInvert (z, x, 1 << n, t, mpzspm->modulus));
+  TUNE_FUNC_LOOP (PolyInvert (z, x, 1 << n, t, mpzspm->modulus, 0));
 TUNE_FUNC_END (tune_PolyInvert)
   
 
@@ -289,7 +325,7 @@ TUNE_FUNC_START (tune_polyevalT)
     Tree[i] = x;
 
   TUNE_FUNC_LOOP (polyeval_tellegen (z, 1 << n, Tree, t, 3 * (1 << n),
-	  x, mpzspm->modulus, NULL));
+	  x, mpzspm->modulus, NULL, 0));
 
   free (Tree);
 TUNE_FUNC_END (tune_polyevalT)
@@ -394,6 +430,59 @@ maximise (double (*f)(size_t), size_t min_n, size_t max_n)
   return best_n;
 }
 
+/* Restrict the range [*lo, *hi) of the search for a parameter to
+ * [old - d, old + d] in an incremental tuning. */
+static void
+search_range (size_t *lo, size_t *hi, size_t old, size_t d)
+{
+  if (!incremental)
+    return;
+  if (old > *lo + d)
+    *lo = old - d;
+  if (old + d + 1 < *hi)
+    *hi = old + d + 1;
+  if (*lo > *hi)
+    *lo = *hi;
+}
+
+/* Like maximise, but in an incremental tuning f is only evaluated at
+ * min_n, min_n + 1 and the n within distance d of old: the smallest values
+ * usually select special cases, which may be the best anywhere. */
+size_t
+maximise_near (double (*f)(size_t), size_t min_n, size_t max_n, size_t old,
+               size_t d)
+{
+  size_t n, best_n = min_n;
+  double f_n, f_best_n = -1.0;
+
+  for (n = min_n; n < max_n; n++)
+    {
+      if (incremental && n > min_n + 1 && (n + d < old || n > old + d))
+        continue;
+      f_n = f (n);
+      if (f_n > f_best_n)
+        {
+	  f_best_n = f_n;
+	  best_n = n;
+	}
+    }
+
+  return best_n;
+}
+
+static size_t
+log2_size (size_t n)
+{
+  size_t k = 0;
+
+  while (n > 1)
+    {
+      n >>= 1;
+      k ++;
+    }
+  return k;
+}
+
 #if 0
 /* Debugging. Print the value of f0(n) and f1(n) and which is fastest. */
 void
@@ -413,6 +502,45 @@ print_timings (double (*f0)(size_t), double (*f1)(size_t),
 }
 #endif
 
+/* Choose for each size up to MULREDC_ASSEMBLY_MAX limbs the fastest way
+   to compute mpres_mul and mpres_sqr with MODMULN, as bench_mulredc does for
+   ecm-params.h: 0 for mulredc, 1 for mpn_mul_n and redc_1, 2 for mpn_mul_n
+   and redc_2. A method which is not available falls through to the next
+   one in mpmod.c, thus has the same timing. */
+static void
+tune_mulredc_tables (ecm_tune_params_t *P)
+{
+  mp_size_t n;
+  int c;
+  double f, f_mul, f_sqr;
+
+  for (n = 1; n <= MULREDC_ASSEMBLY_MAX; n++)
+    {
+      f_mul = f_sqr = -1.0;
+      for (c = 0; c <= 2; c++)
+        {
+          tune_mulredc_table[n] = tune_sqrredc_table[n] = c;
+          f = tune_mpres_mul (n, ECM_MOD_MODMULN);
+          if (f > f_mul)
+            {
+              f_mul = f;
+              P->mulredc_table[n] = c;
+            }
+          f = tune_mpres_sqr (n, ECM_MOD_MODMULN);
+          if (f > f_sqr)
+            {
+              f_sqr = f;
+              P->sqrredc_table[n] = c;
+            }
+        }
+      tune_mulredc_table[n] = P->mulredc_table[n];
+      tune_sqrredc_table[n] = P->sqrredc_table[n];
+      if (tune_verbose)
+        printf ("mulredc %2ld limbs: mul %d, sqr %d\n", (long) n,
+                P->mulredc_table[n], P->sqrredc_table[n]);
+    }
+}
+
 static void
 tune_list_mul_n ()
 {
@@ -467,7 +595,11 @@ tune_list_mul_n ()
     }
   printf ("#define LIST_MUL_TABLE {0");
   for (n = 1; n < TUNE_LIST_MUL_N_MAX_SIZE; n++)
-    printf (",%u", best[n]);
+    {
+      printf (",%u", best[n]);
+      /* used by list_mul in the next measurements */
+      list_mul_table[n] = best[n];
+    }
   printf ("}\n");
 }
 
@@ -475,6 +607,10 @@ int
 main (int argc, char **argv)
 {
   spv_size_t i;
+  char *profile = NULL;
+  int quick = 0, user_max_log2_len = 0;
+  ecm_tune_params_t P, old;
+  size_t lo, hi;
 
   while (argc > 1)
     {
@@ -489,15 +625,42 @@ main (int argc, char **argv)
           max_log2_len = atoi (argv[2]);
 	  if (max_log2_len < min_log2_len)
 	    max_log2_len = min_log2_len;
+          user_max_log2_len = 1;
+          argc -= 2;
+          argv += 2;
+        }
+      else if (argc > 2 && strcmp (argv[1], "-profile") == 0)
+        {
+          profile = argv[2];
           argc -= 2;
           argv += 2;
         }
+      else if (strcmp (argv[1], "-quick") == 0)
+        {
+          quick = 1;
+          argc --;
+          argv ++;
+        }
       else
         {
-          fprintf (stderr, "Usage: tune [-v] [-max_log2_len nnn]\n");
+          fprintf (stderr, "Usage: tune [-v] [-max_log2_len nnn] [-quick] "
+                   "[-profile file]\n");
           exit (1);
         }
     }
+
+  memset (&P, 0, sizeof (P));
+  memset (&old, 0, sizeof (old));
+  if (quick)
+    {
+      granularity = QUICK_GRANULARITY;
+      if (!user_max_log2_len)
+        max_log2_len = QUICK_MAX_LOG2_LEN;
+      block_log2_len = QUICK_BLOCK_LOG2_LEN;
+      /* start from the values found by a previous run on this machine */
+      if (profile != NULL && tune_profile_read (&old, profile, NULL) == 1)
+        incremental = 1;
+    }
   
   gmp_randinit_default (gmp_randstate);
   mpz_init_set_str (M, M_str, 10);
@@ -520,18 +683,29 @@ main (int argc, char **argv)
   for (i = 0; i < MAX_LEN; i++)
     mpz_quick_random (z[i], M);    
   
+  /* bench_mulredc gives them for ecm-params.h */
+  if (profile != NULL)
+    tune_mulredc_tables (&P);
+
   tune_list_mul_n ();
+  memcpy (P.list_mul_table, list_mul_table, sizeof (P.list_mul_table));
   
   spm = mpzspm->spm[0];
   spv = mpzspv[0];
   
+  lo = 1;
+  hi = 512;
+  search_range (&lo, &hi, old.mpzmod_threshold, old.mpzmod_threshold / 2 + 10);
   MPZMOD_THRESHOLD = crossover2 (tune_mpres_mul_modmuln, tune_mpres_mul_mpz,
-      1, 512, 10);
+      lo, hi, 10);
   
   printf ("#define MPZMOD_THRESHOLD %lu\n", (unsigned long) MPZMOD_THRESHOLD);
   
+  lo = MPZMOD_THRESHOLD;
+  hi = 512;
+  search_range (&lo, &hi, old.redc_threshold, old.redc_threshold / 2 + 10);
   REDC_THRESHOLD = crossover2 (tune_mpres_mul_mpz, tune_mpres_mul_redc,
-      MPZMOD_THRESHOLD, 512, 10);
+      lo, hi, 10);
   
   printf ("#define REDC_THRESHOLD %lu\n", (unsigned long) REDC_THRESHOLD);
 
@@ -542,54 +716,116 @@ main (int argc, char **argv)
 
   for (mp_size = 2; mp_size < MPN_MUL_LO_THRESHOLD; mp_size++)
     {
-      mpn_mul_lo_threshold[mp_size] = maximise (tune_ecm_mul_lo_n, 0, mp_size);
+      mpn_mul_lo_threshold[mp_size] = maximise_near (tune_ecm_mul_lo_n, 0,
+          mp_size, old.mul_lo_table[mp_size], 1);
       printf (", %lu", (unsigned long) mpn_mul_lo_threshold[mp_size]);
       fflush (stdout);
     }
 
   printf ("}\n");
 	  
-  NTT_GFP_TWIDDLE_DIF_BREAKOVER = maximise
-      (tune_spv_ntt_gfp_dif, min_log2_len, max_log2_len);
+  NTT_GFP_TWIDDLE_DIF_BREAKOVER = maximise_near (tune_spv_ntt_gfp_dif,
+      min_log2_len, max_log2_len, old.ntt_gfp_twiddle_dif_breakover, 2);
 
   printf ("#define NTT_GFP_TWIDDLE_DIF_BREAKOVER %lu\n",
       (unsigned long) NTT_GFP_TWIDDLE_DIF_BREAKOVER);
    
-  NTT_GFP_TWIDDLE_DIT_BREAKOVER = maximise
-      (tune_spv_ntt_gfp_dit, min_log2_len, max_log2_len);
+  NTT_GFP_TWIDDLE_DIT_BREAKOVER = maximise_near (tune_spv_ntt_gfp_dit,
+      min_log2_len, max_log2_len, old.ntt_gfp_twiddle_dit_breakover, 2);
 
   printf ("#define NTT_GFP_TWIDDLE_DIT_BREAKOVER %lu\n",
       (unsigned long) NTT_GFP_TWIDDLE_DIT_BREAKOVER);
+
+  /* a breakover of block_log2_len means no column pass at all */
+  {
+    mpzspm_t block_mpzspm = mpzspm_init ((spv_size_t) 1 << block_log2_len, M);
+
+    ASSERT_ALWAYS (block_mpzspm != NULL);
+    block_spm = block_mpzspm->spm[0];
+    block_spv = (spv_t) sp_aligned_malloc (sizeof (sp_t) << block_log2_len);
+    ASSERT_ALWAYS (block_spv != NULL);
+    spv_random (block_spv, (spv_size_t) 1 << block_log2_len, block_spm->sp);
+    NTT_GFP_BLOCK_BREAKOVER = maximise_near (tune_spv_ntt_gfp_block,
+        MAX (NTT_GFP_TWIDDLE_DIF_BREAKOVER, NTT_GFP_TWIDDLE_DIT_BREAKOVER),
+        block_log2_len + 1, old.ntt_gfp_block_breakover, 2);
+    sp_aligned_free (block_spv);
+    mpzspm_clear (block_mpzspm);
+  }
+
+  printf ("#define NTT_GFP_BLOCK_BREAKOVER %lu\n",
+      (unsigned long) NTT_GFP_BLOCK_BREAKOVER);
   
-  MUL_NTT_THRESHOLD = 1 << crossover2 (tune_list_mul, tune_ntt_mul, 1,
-      max_log2_len, 2);
+  lo = 1;
+  hi = max_log2_len;
+  search_range (&lo, &hi, log2_size (old.mul_ntt_threshold), 2);
+  MUL_NTT_THRESHOLD = 1 << crossover2 (tune_list_mul, tune_ntt_mul, lo,
+      hi, 2);
 
   printf ("#define MUL_NTT_THRESHOLD %lu\n", (unsigned long) MUL_NTT_THRESHOLD);
 
+  lo = 1;
+  hi = max_log2_len;
+  search_range (&lo, &hi, log2_size (old.prerevertdivision_ntt_threshold), 2);
   PREREVERTDIVISION_NTT_THRESHOLD = 1 << crossover2 (tune_PrerevertDivision,
-      tune_ntt_PrerevertDivision, 1, max_log2_len, 2);
+      tune_ntt_PrerevertDivision, lo, hi, 2);
 
   printf ("#define PREREVERTDIVISION_NTT_THRESHOLD %lu\n",
       (unsigned long) PREREVERTDIVISION_NTT_THRESHOLD);
 
+  /* the products G * H mod F with a power-of-two degree, where the
+     Montgomery reduction replaces the whole product */
+  lo = 1;
+  hi = max_log2_len;
+  search_range (&lo, &hi, log2_size (old.montgomery_reduce_ntt_threshold), 2);
+  MONTGOMERY_REDUCE_NTT_THRESHOLD = 1 << crossover2 (tune_ntt_mulmod,
+      tune_ntt_MontgomeryMulMod, lo, hi, 2);
+
+  printf ("#define MONTGOMERY_REDUCE_NTT_THRESHOLD %lu\n",
+      (unsigned long) MONTGOMERY_REDUCE_NTT_THRESHOLD);
+
+  lo = 5;
+  hi = max_log2_len;
+  search_range (&lo, &hi, log2_size (old.polyinvert_ntt_threshold), 2);
   POLYINVERT_NTT_THRESHOLD = 1 << crossover (tune_PolyInvert,
-      tune_ntt_PolyInvert, 5, max_log2_len);
+      tune_ntt_PolyInvert, lo, hi);
 
   printf ("#define POLYINVERT_NTT_THRESHOLD %lu\n", 
       (unsigned long) POLYINVERT_NTT_THRESHOLD);
   
+  lo = 5;
+  hi = max_log2_len;
+  search_range (&lo, &hi, log2_size (old.polyevalt_ntt_threshold), 2);
   POLYEVALT_NTT_THRESHOLD = 1 << crossover (tune_polyevalT,
-      tune_ntt_polyevalT, 5, max_log2_len);
+      tune_ntt_polyevalT, lo, hi);
 
   printf ("#define POLYEVALT_NTT_THRESHOLD %lu\n", 
       (unsigned long) POLYEVALT_NTT_THRESHOLD);
   
-  MPZSPV_NORMALISE_STRIDE = 1 << maximise (tune_mpzspv_normalise,
-      1, MAX_LOG2_MPZSPV_NORMALISE_STRIDE);
+  MPZSPV_NORMALISE_STRIDE = 1 << maximise_near (tune_mpzspv_normalise,
+      1, MAX_LOG2_MPZSPV_NORMALISE_STRIDE,
+      log2_size (old.mpzspv_normalise_stride), 1);
 	  
   printf ("#define MPZSPV_NORMALISE_STRIDE %lu\n", 
       (unsigned long) MPZSPV_NORMALISE_STRIDE);
 
+  if (profile != NULL)
+    {
+      memcpy (P.mul_lo_table, mpn_mul_lo_threshold, sizeof (P.mul_lo_table));
+      P.mpzmod_threshold = MPZMOD_THRESHOLD;
+      P.redc_threshold = REDC_THRESHOLD;
+      P.ntt_gfp_twiddle_dif_breakover = NTT_GFP_TWIDDLE_DIF_BREAKOVER;
+      P.ntt_gfp_twiddle_dit_breakover = NTT_GFP_TWIDDLE_DIT_BREAKOVER;
+      P.ntt_gfp_block_breakover = NTT_GFP_BLOCK_BREAKOVER;
+      P.mul_ntt_threshold = MUL_NTT_THRESHOLD;
+      P.prerevertdivision_ntt_threshold = PREREVERTDIVISION_NTT_THRESHOLD;
+      P.montgomery_reduce_ntt_threshold = MONTGOMERY_REDUCE_NTT_THRESHOLD;
+      P.polyinvert_ntt_threshold = POLYINVERT_NTT_THRESHOLD;
+      P.polyevalt_ntt_threshold = POLYEVALT_NTT_THRESHOLD;
+      P.mpzspv_normalise_stride = MPZSPV_NORMALISE_STRIDE;
+      if (tune_profile_write (&P, profile, stderr) != 0)
+        exit (1);
+    }
+
   mpzspv_clear (mpzspv, mpzspm);
   mpzspm_clear (mpzspm);
   
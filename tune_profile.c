@@ -0,0 +1,553 @@
+/* tune_profile.c - tuning parameters at run time and tuning profiles.
+
+Copyright 2026 the GMP-ECM authors.
+
+This file is part of the ECM Library.
+
+The ECM Library is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+The ECM Library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the ECM Library; see the file COPYING.LIB.  If not, see
+http://www.gnu.org/licenses/ or write to the Free Software Foundation, Inc.,
+51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+/* A tuning profile is a text file written by "tune -profile file". It
+   holds one section per machine, so that the nodes of a cluster can share
+   the same file:
+
+     ecm_tune_profile 1
+     cpu Intel(R) Core(TM) i5-4590 CPU @ 3.30GHz
+     limb_bits 64
+     gmp 6.2.1
+     TUNE_MULREDC_TABLE 0 0 0 0 0 0 0 0 0 1 1 1 1 1 1 1 1 1 1 1 1
+     ...
+     MPZSPV_NORMALISE_STRIDE 512
+
+   The first line gives the version of the format. A section starts with a
+   "cpu" line, with the processor name as tune_cpu_model() gives it, or "*"
+   for any processor, and is only used with the same number of bits per
+   limb. Each other line sets the parameter of the same name in a params.h
+   file; the parameters a section does not give keep their value. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <cpuid.h>
+#endif
+#define ECM_TUNE_NO_ALIASES
+#include "ecm-impl.h"
+#include "mpmod.h"
+
+#define TUNE_PROFILE_VERSION 1
+#define TUNE_PROFILE_LINE 1024
+
+typedef enum { TUNE_INT, TUNE_SIZE } tune_type_t;
+
+/* the parameters in the order in which they are written */
+static const struct
+{
+  const char *name;
+  tune_type_t type;
+  size_t offset;
+  unsigned int len; /* number of values, 1 for a threshold */
+} tune_fields[] =
+{
+  {"TUNE_MULREDC_TABLE", TUNE_INT,
+   offsetof (ecm_tune_params_t, mulredc_table), MULREDC_ASSEMBLY_MAX + 1},
+  {"TUNE_SQRREDC_TABLE", TUNE_INT,
+   offsetof (ecm_tune_params_t, sqrredc_table), MULREDC_ASSEMBLY_MAX + 1},
+  {"LIST_MUL_TABLE", TUNE_INT,
+   offsetof (ecm_tune_params_t, list_mul_table), TUNE_LIST_MUL_N_MAX_SIZE},
+  {"MPN_MUL_LO_THRESHOLD_TABLE", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, mul_lo_table), MPN_MUL_LO_THRESHOLD},
+  {"MPZMOD_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, mpzmod_threshold), 1},
+  {"REDC_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, redc_threshold), 1},
+  {"NTT_GFP_TWIDDLE_DIF_BREAKOVER", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, ntt_gfp_twiddle_dif_breakover), 1},
+  {"NTT_GFP_TWIDDLE_DIT_BREAKOVER", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, ntt_gfp_twiddle_dit_breakover), 1},
+  {"NTT_GFP_BLOCK_BREAKOVER", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, ntt_gfp_block_breakover), 1},
+  {"MUL_NTT_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, mul_ntt_threshold), 1},
+  {"PREREVERTDIVISION_NTT_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, prerevertdivision_ntt_threshold), 1},
+  {"MONTGOMERY_REDUCE_NTT_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, montgomery_reduce_ntt_threshold), 1},
+  {"POLYINVERT_NTT_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, polyinvert_ntt_threshold), 1},
+  {"POLYEVALT_NTT_THRESHOLD", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, polyevalt_ntt_threshold), 1},
+  {"MPZSPV_NORMALISE_STRIDE", TUNE_SIZE,
+   offsetof (ecm_tune_params_t, mpzspv_normalise_stride), 1},
+  {NULL, TUNE_INT, 0, 0}
+};
+
+/* Put in s (of len characters) the name of the processor we run on,
+   without leading or trailing blanks, or "unknown". */
+void
+tune_cpu_model (char *s, size_t len)
+{
+  char name[49] = "";
+  size_t i, j;
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+  unsigned int r[12];
+
+  if (__get_cpuid_max (0x80000000, NULL) >= 0x80000004)
+    {
+      for (i = 0; i < 3; i++)
+        __get_cpuid (0x80000002 + i, r + 4 * i, r + 4 * i + 1, r + 4 * i + 2,
+                     r + 4 * i + 3);
+      memcpy (name, r, 48);
+      name[48] = '\0';
+    }
+#else
+  FILE *fp;
+  char line[256], *p;
+
+  /* Linux on other processors */
+  if ((fp = fopen ("/proc/cpuinfo", "r")) != NULL)
+    {
+      while (fgets (line, sizeof (line), fp) != NULL)
+        if (strncmp (line, "model name", 10) == 0
+            && (p = strchr (line, ':')) != NULL)
+          {
+            strncpy (name, p + 1, sizeof (name) - 1);
+            break;
+          }
+      fclose (fp);
+    }
+#endif
+
+  for (i = 0; isspace ((unsigned char) name[i]); i++);
+  for (j = strlen (name); j > i && isspace ((unsigned char) name[j - 1]); j--);
+  if (j == i)
+    strncpy (s, "unknown", len);
+  else
+    {
+      if (j - i >= len)
+        j = i + len - 1;
+      memcpy (s, name + i, j - i);
+      s[j - i] = '\0';
+    }
+  s[len - 1] = '\0';
+}
+
+/* Remove the trailing newline and blanks of s, return s without its
+   leading blanks. */
+static char *
+tune_strip (char *s)
+{
+  size_t j;
+
+  while (isspace ((unsigned char) *s))
+    s++;
+  for (j = strlen (s); j > 0 && isspace ((unsigned char) s[j - 1]); j--);
+  s[j] = '\0';
+  return s;
+}
+
+/* Set the parameter whose values are in v according to tune_fields[i],
+   return 0 if they are not valid. */
+static int
+tune_set_field (ecm_tune_params_t *P, unsigned int i, char *v)
+{
+  unsigned long x[TUNE_LIST_MUL_N_MAX_SIZE];
+  unsigned int k, len = tune_fields[i].len;
+  char *end;
+  void *f = (char *) P + tune_fields[i].offset;
+
+  for (k = 0; k < len; k++)
+    {
+      x[k] = strtoul (v, &end, 10);
+      if (end == v)
+        return 0;
+      v = end;
+    }
+  if (*tune_strip (v) != '\0')
+    return 0; /* too many values */
+
+  if (tune_fields[i].type == TUNE_INT)
+    {
+      /* the tables of methods: 0 to MPMOD_MUL_REDC_C for the REDC tables
+         (see mpmod.h), 0 to 3 for LIST_MUL_TABLE (see list_mult_n) */
+      unsigned long max = (tune_fields[i].offset ==
+                           offsetof (ecm_tune_params_t, list_mul_table))
+                          ? 3 : MPMOD_MUL_REDC_C;
+
+      for (k = 0; k < len; k++)
+        if (x[k] > max)
+          return 0;
+      for (k = 0; k < len; k++)
+        ((int *) f)[k] = (int) x[k];
+    }
+  else
+    {
+      if (len > 1) /* ecm_mul_lo_n splits n limbs at x[n] < n */
+        {
+          for (k = 0; k < len; k++)
+            if (x[k] != 0 && x[k] >= k)
+              return 0;
+        }
+      else if (f == &(P->mpzspv_normalise_stride) && x[0] == 0)
+        return 0;
+      for (k = 0; k < len; k++)
+        ((size_t *) f)[k] = (size_t) x[k];
+    }
+  return 1;
+}
+
+/* Read the section of the tuning profile file for the processor we run on
+   into P, or the one for any processor if there is none. Return 1 if there
+   is such a section, 0 if not, and -1 (with a message on es if not NULL)
+   if the file cannot be read or is not a valid tuning profile. */
+int
+tune_profile_read (ecm_tune_params_t *P, const char *file, FILE *es)
+{
+  FILE *fp;
+  char line[TUNE_PROFILE_LINE], cpu[64], *key, *v;
+  ecm_tune_params_t S, wild;
+  unsigned int lineno = 0, i;
+  int in_section = 0, section_cpu = 0, section_limb = 1;
+  int found = 0, found_wild = 0, version = 0;
+
+  tune_cpu_model (cpu, sizeof (cpu));
+  if ((fp = fopen (file, "r")) == NULL)
+    {
+      if (es != NULL)
+        fprintf (es, "Error, cannot read tuning profile %s\n", file);
+      return -1;
+    }
+
+  /* S is the section being read, initialized with P */
+  while (!found && fgets (line, sizeof (line), fp) != NULL)
+    {
+      lineno ++;
+      if (strchr (line, '\n') == NULL && !feof (fp))
+        goto error; /* line too long */
+      key = tune_strip (line);
+      if (*key == '\0' || *key == '#')
+        continue;
+      for (v = key; *v != '\0' && !isspace ((unsigned char) *v); v++);
+      if (*v != '\0')
+        *v++ = '\0';
+      v = tune_strip (v);
+
+      if (version == 0)
+        {
+          if (strcmp (key, "ecm_tune_profile") != 0)
+            goto error;
+          version = atoi (v);
+          if (version != TUNE_PROFILE_VERSION)
+            {
+              if (es != NULL)
+                fprintf (es, "Error, tuning profile %s has version %d, "
+                         "expected %d\n", file, version,
+                         TUNE_PROFILE_VERSION);
+              fclose (fp);
+              return -1;
+            }
+          continue;
+        }
+
+      if (strcmp (key, "cpu") == 0)
+        {
+          /* end of the previous section */
+          if (in_section && section_limb)
+            {
+              if (section_cpu == 1)
+                found = 1;
+              else if (section_cpu == 2 && !found_wild)
+                {
+                  wild = S;
+                  found_wild = 1;
+                }
+            }
+          if (found)
+            break;
+          in_section = 1;
+          section_cpu = (strcmp (v, cpu) == 0) ? 1
+            : (strcmp (v, "*") == 0) ? 2 : 0;
+          section_limb = 1;
+          S = *P;
+          continue;
+        }
+
+      if (!in_section)
+        goto error;
+      if (strcmp (key, "limb_bits") == 0)
+        section_limb = (atoi (v) == GMP_NUMB_BITS);
+      else if (strcmp (key, "gmp") != 0)
+        {
+          for (i = 0; tune_fields[i].name != NULL; i++)
+            if (strcmp (key, tune_fields[i].name) == 0)
+              break;
+          if (tune_fields[i].name == NULL || !tune_set_field (&S, i, v))
+            goto error;
+        }
+    }
+
+  if (!found && in_section && section_limb)
+    {
+      if (section_cpu == 1)
+        found = 1;
+      else if (section_cpu == 2 && !found_wild)
+        {
+          wild = S;
+          found_wild = 1;
+        }
+    }
+  fclose (fp);
+  if (version == 0)
+    {
+      lineno = 0;
+      goto error_closed;
+    }
+
+  if (found)
+    *P = S;
+  else if (found_wild)
+    *P = wild;
+  return found || found_wild;
+
+ error:
+  fclose (fp);
+ error_closed:
+  if (es != NULL)
+    {
+      if (lineno == 0)
+        fprintf (es, "Error, %s is not a tuning profile\n", file);
+      else
+        fprintf (es, "Error in tuning profile %s, line %u\n", file, lineno);
+    }
+  return -1;
+}
+
+/* Write P as the section of the tuning profile file for the processor we
+   run on. The other sections of file, if it exists, are kept. Return 0 on
+   success, -1 (with a message on es if not NULL) on error. */
+int
+tune_profile_write (const ecm_tune_params_t *P, const char *file, FILE *es)
+{
+  FILE *fp, *out;
+  char line[TUNE_PROFILE_LINE], buf[TUNE_PROFILE_LINE], cpu[64];
+  char *tmp, *key, *v, *section = NULL, *t;
+  size_t section_len = 0, section_alloc = 0, l;
+  int keep = 0, version = 0;
+  unsigned int i, k;
+
+  tune_cpu_model (cpu, sizeof (cpu));
+  tmp = malloc (strlen (file) + 5);
+  if (tmp == NULL)
+    return -1;
+  sprintf (tmp, "%s.tmp", file);
+  if ((out = fopen (tmp, "w")) == NULL)
+    {
+      if (es != NULL)
+        fprintf (es, "Error, cannot write %s\n", tmp);
+      free (tmp);
+      return -1;
+    }
+  fprintf (out, "ecm_tune_profile %d\n", TUNE_PROFILE_VERSION);
+
+  /* Copy the sections of the old file, except ours. A section is kept in
+     memory until we know its number of bits per limb. */
+  if ((fp = fopen (file, "r")) != NULL)
+    {
+      while (fgets (line, sizeof (line), fp) != NULL)
+        {
+          strcpy (buf, line);
+          key = tune_strip (buf);
+          if (*key == '\0')
+            continue; /* we put one blank line between sections */
+          for (v = key; *v != '\0' && !isspace ((unsigned char) *v); v++);
+          if (*v != '\0')
+            *v++ = '\0';
+          v = tune_strip (v);
+          if (version == 0)
+            {
+              if (*key == '#')
+                continue;
+              if (strcmp (key, "ecm_tune_profile") != 0
+                  || atoi (v) != TUNE_PROFILE_VERSION)
+                {
+                  /* not a profile we understand, do not overwrite it */
+                  if (es != NULL)
+                    fprintf (es, "Error, %s is not a tuning profile of "
+                             "version %d\n", file, TUNE_PROFILE_VERSION);
+                  fclose (fp);
+                  goto error;
+                }
+              version = 1;
+              continue;
+            }
+          if (strcmp (key, "cpu") == 0)
+            {
+              if (keep && section_len > 0)
+                fprintf (out, "\n%.*s", (int) section_len, section);
+              section_len = 0;
+              keep = (strcmp (v, cpu) != 0);
+            }
+          else if (strcmp (key, "limb_bits") == 0 && atoi (v) != GMP_NUMB_BITS)
+            keep = 1;
+          l = strlen (line);
+          if (section_len + l + 2 > section_alloc)
+            {
+              section_alloc = 2 * (section_len + l + 2);
+              t = realloc (section, section_alloc);
+              if (t == NULL)
+                {
+                  fclose (fp);
+                  goto error;
+                }
+              section = t;
+            }
+          memcpy (section + section_len, line, l);
+          section_len += l;
+          if (line[l - 1] != '\n')
+            section[section_len++] = '\n';
+        }
+      fclose (fp);
+      if (keep && section_len > 0)
+        fprintf (out, "\n%.*s", (int) section_len, section);
+      free (section);
+      section = NULL;
+    }
+
+  fprintf (out, "\ncpu %s\n", cpu);
+  fprintf (out, "limb_bits %d\n", GMP_NUMB_BITS);
+  fprintf (out, "gmp %s\n", gmp_version);
+  for (i = 0; tune_fields[i].name != NULL; i++)
+    {
+      const void *f = (const char *) P + tune_fields[i].offset;
+
+      fprintf (out, "%s", tune_fields[i].name);
+      for (k = 0; k < tune_fields[i].len; k++)
+        if (tune_fields[i].type == TUNE_INT)
+          fprintf (out, " %d", ((const int *) f)[k]);
+        else
+          fprintf (out, " %lu", (unsigned long) ((const size_t *) f)[k]);
+      fprintf (out, "\n");
+    }
+
+  if (fclose (out) != 0 || rename (tmp, file) != 0)
+    {
+      if (es != NULL)
+        fprintf (es, "Error, cannot write %s\n", file);
+      remove (tmp);
+      free (tmp);
+      return -1;
+    }
+  free (tmp);
+  return 0;
+
+ error:
+  fclose (out);
+  remove (tmp);
+  free (tmp);
+  free (section);
+  return -1;
+}
+
+#ifndef TUNE
+
+#include "ecm-params.h"
+
+/* the parameters chosen at compile time, or by fat.c */
+static ecm_tune_params_t tune_params_default = ECM_TUNE_PARAMS (ECM_TUNE_CASE);
+ecm_tune_params_t __ecm_tune_params = ECM_TUNE_PARAMS (ECM_TUNE_CASE);
+
+/* the last profile given to tune_profile_load, and the result */
+static char *tune_profile_file = NULL;
+static char *tune_profile_name = NULL;
+static int tune_profile_status = 0;
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+static pthread_mutex_t tune_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+#define TUNE_PROFILE_LOCK() pthread_mutex_lock (&tune_profile_lock)
+#define TUNE_PROFILE_UNLOCK() pthread_mutex_unlock (&tune_profile_lock)
+#else
+#define TUNE_PROFILE_LOCK()
+#define TUNE_PROFILE_UNLOCK()
+#endif
+
+/* Use the parameters of the tuning profile file for the processor we run
+   on. If the profile has no section for it, the parameters chosen at
+   compile time are used. Return as tune_profile_read. The parameters are
+   shared by all threads and should not change while other threads
+   compute: the file is only read if it is not the last one given. */
+int
+tune_profile_load (const char *file, FILE *es)
+{
+  ecm_tune_params_t P = tune_params_default;
+  char *name = NULL;
+  int ret;
+
+  TUNE_PROFILE_LOCK();
+  if (tune_profile_file != NULL && strcmp (file, tune_profile_file) == 0)
+    {
+      ret = tune_profile_status;
+      TUNE_PROFILE_UNLOCK();
+      return ret;
+    }
+  ret = tune_profile_read (&P, file, es);
+  if (ret == 1)
+    {
+      name = malloc (strlen (file) + 9);
+      if (name == NULL)
+        ret = -1;
+      else
+        {
+          sprintf (name, "profile %s", file);
+          P.name = name;
+        }
+    }
+  if (ret >= 0)
+    {
+      __ecm_tune_params = P;
+      free (tune_profile_name);
+      tune_profile_name = name;
+    }
+  free (tune_profile_file);
+  tune_profile_file = malloc (strlen (file) + 1);
+  if (tune_profile_file != NULL)
+    strcpy (tune_profile_file, file);
+  tune_profile_status = ret;
+  TUNE_PROFILE_UNLOCK();
+  return ret;
+}
+
+/* Called when the library is loaded, with compilers that allow it. */
+#if defined (__GNUC__)
+static void tune_params_init (void) __attribute__ ((constructor));
+#endif
+
+static void
+tune_params_init (void)
+{
+  const char *file;
+
+#ifdef WANT_FAT_BINARY
+  tune_params_default = *fat_tune_params ();
+  __ecm_tune_params = tune_params_default;
+#endif
+  file = getenv ("ECM_TUNE_PROFILE");
+  if (file != NULL && *file != '\0')
+    tune_profile_load (file, stderr);
+}
+
+#endif /* TUNE */